@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MESH_LINK_H__
+#define MESH_LINK_H__
+
+/**
+ * @file
+ * @defgroup mesh_link Mesh link
+ * @{
+ * @brief Framing for the serial link between the gateway and its mesh radio.
+ *
+ * A frame carries a header and a batch of messages, followed by a CRC-16/CCITT
+ * of both. On the wire, frames are COBS encoded and terminated by a zero byte,
+ * so a receiver resynchronizes at the next frame after any corruption.
+ *
+ * The header holds a sequence number and an acknowledgment. The sequence number
+ * counts frames with messages. The acknowledgment is the sequence number the
+ * sender expects next from its peer. A peer may have a limited number of
+ * unacknowledged frames in flight, which provides flow control. Frames without
+ * messages only carry an acknowledgment, and do not use a sequence number.
+ *
+ * The framing does not depend on Zephyr, and builds for Linux hosts as well.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Length of the frame header. */
+#define MESH_LINK_HDR_LEN 2
+/** Length of the frame CRC. */
+#define MESH_LINK_CRC_LEN 2
+/** Length of the message header, type and body length. */
+#define MESH_LINK_MSG_HDR_LEN 2
+/** Largest frame before encoding, header and CRC included. */
+#define MESH_LINK_FRAME_MAX 128
+/** Largest encoded frame, delimiter included. */
+#define MESH_LINK_ENCODED_MAX (MESH_LINK_FRAME_MAX + MESH_LINK_FRAME_MAX / 254 + 2)
+/** Largest message body. */
+#define MESH_LINK_MSG_MAX \
+	(MESH_LINK_FRAME_MAX - MESH_LINK_HDR_LEN - MESH_LINK_CRC_LEN - MESH_LINK_MSG_HDR_LEN)
+
+/** Message types. Bodies are little endian. */
+enum mesh_link_msg_type {
+	/** Echo request, answered by a pong with the same body. */
+	MESH_LINK_MSG_PING = 0x01,
+	MESH_LINK_MSG_PONG = 0x02,
+	/** Command for the robots, from the gateway. See @ref MESH_LINK_CMD_LEN. */
+	MESH_LINK_MSG_CMD = 0x03,
+	/** Robot status report, from the mesh radio. See @ref MESH_LINK_STATUS_LEN. */
+	MESH_LINK_MSG_STATUS = 0x04,
+};
+
+/** Command types in the command body. */
+enum mesh_link_cmd_type {
+	/** Movement configuration: time in ms (4), angle in degrees (2). */
+	MESH_LINK_CMD_MOVE = 0x01,
+	/** Start movement: network start time in us (6), 0 to start immediately. */
+	MESH_LINK_CMD_START = 0x02,
+};
+
+/** Command body: dst (2), type (1), tid (1), seq (1), then the parameters of
+ *  the command type, zero padded to 6 bytes.
+ */
+#define MESH_LINK_CMD_LEN 11
+/** Status body: addr (2), state (1), hops (1), rssi (1), battery in mV (2). */
+#define MESH_LINK_STATUS_LEN 7
+
+/** Frame header. */
+struct mesh_link_hdr {
+	/** Sequence number of the frame. Only meaningful if the frame has messages. */
+	uint8_t seq;
+	/** Next sequence number expected from the peer. */
+	uint8_t ack;
+	/** Number of messages in the frame. */
+	uint8_t msg_count;
+};
+
+/** Frame being assembled. */
+struct mesh_link_frame {
+	uint8_t buf[MESH_LINK_FRAME_MAX];
+	size_t len;
+	uint8_t msg_count;
+};
+
+/** Receive state of the frame decoder. */
+struct mesh_link_decoder {
+	uint8_t buf[MESH_LINK_ENCODED_MAX];
+	size_t len;
+	/** Discarding bytes until the next delimiter. */
+	bool overflow;
+	/** Frames dropped because of encoding or CRC errors, or length. */
+	uint32_t errors;
+};
+
+/**
+ * @brief Callback for received frames.
+ *
+ * @param frame Decoded frame, header included and CRC excluded.
+ * @param len Length of the frame.
+ * @param user_data User data given to the decoder.
+ */
+typedef void (*mesh_link_frame_cb_t)(const uint8_t *frame, size_t len, void *user_data);
+
+/**
+ * @brief Callback for the messages of a frame.
+ *
+ * @param type Message type.
+ * @param body Message body.
+ * @param len Length of the message body.
+ * @param user_data User data given to the parser.
+ */
+typedef void (*mesh_link_msg_cb_t)(uint8_t type, const uint8_t *body, size_t len,
+				   void *user_data);
+
+/**
+ * @brief Compute the CRC-16/CCITT of a buffer.
+ *
+ * @param data Buffer.
+ * @param len Length of the buffer.
+ * @return CRC with the initial value 0xffff.
+ */
+uint16_t mesh_link_crc16(const uint8_t *data, size_t len);
+
+/**
+ * @brief COBS encode a buffer.
+ *
+ * @param in Buffer to encode.
+ * @param len Length of the buffer.
+ * @param out Encoded buffer, without delimiter. Must hold len + len / 254 + 1 bytes.
+ * @return Length of the encoded buffer.
+ */
+size_t mesh_link_cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+/**
+ * @brief Decode a COBS encoded buffer.
+ *
+ * Decoding may be done in place.
+ *
+ * @param in Encoded buffer, without delimiter.
+ * @param len Length of the encoded buffer.
+ * @param out Decoded buffer. Must hold len bytes.
+ * @return Length of the decoded buffer, or -EBADMSG if the encoding is invalid.
+ */
+int mesh_link_cobs_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+/**
+ * @brief Start assembling a frame.
+ *
+ * @param frame Frame.
+ */
+void mesh_link_frame_init(struct mesh_link_frame *frame);
+
+/**
+ * @brief Add a message to a frame.
+ *
+ * @param frame Frame.
+ * @param type Message type.
+ * @param body Message body.
+ * @param len Length of the message body.
+ * @return 0 on success, -EINVAL if the body is too long for any frame, or -ENOMEM if
+ *         it does not fit in this frame.
+ */
+int mesh_link_frame_add(struct mesh_link_frame *frame, uint8_t type, const void *body, size_t len);
+
+/**
+ * @brief Encode a frame for the wire.
+ *
+ * The frame is left as it is, and may be encoded again.
+ *
+ * @param frame Frame.
+ * @param seq Sequence number of the frame.
+ * @param ack Next sequence number expected from the peer.
+ * @param out Encoded frame, delimiter included. Must hold @ref MESH_LINK_ENCODED_MAX bytes.
+ * @return Length of the encoded frame.
+ */
+size_t mesh_link_frame_encode(struct mesh_link_frame *frame, uint8_t seq, uint8_t ack,
+			      uint8_t *out);
+
+/**
+ * @brief Parse a received frame.
+ *
+ * @param frame Frame, as passed to @ref mesh_link_frame_cb_t.
+ * @param len Length of the frame.
+ * @param hdr Header of the frame.
+ * @param cb Called for every message in the frame.
+ * @param user_data Passed to @p cb.
+ * @return 0 on success, or -EBADMSG if the frame is malformed. Messages before the
+ *         malformed part have been passed to @p cb.
+ */
+int mesh_link_frame_parse(const uint8_t *frame, size_t len, struct mesh_link_hdr *hdr,
+			  mesh_link_msg_cb_t cb, void *user_data);
+
+/**
+ * @brief Reset a frame decoder.
+ *
+ * @param dec Decoder.
+ */
+void mesh_link_decoder_init(struct mesh_link_decoder *dec);
+
+/**
+ * @brief Feed received bytes to a frame decoder.
+ *
+ * @param dec Decoder.
+ * @param data Received bytes.
+ * @param len Number of received bytes.
+ * @param cb Called for every complete frame with a valid CRC.
+ * @param user_data Passed to @p cb.
+ */
+void mesh_link_decoder_feed(struct mesh_link_decoder *dec, const uint8_t *data, size_t len,
+			    mesh_link_frame_cb_t cb, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* MESH_LINK_H__ */
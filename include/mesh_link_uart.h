@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MESH_LINK_UART_H__
+#define MESH_LINK_UART_H__
+
+/**
+ * @file
+ * @defgroup mesh_link_uart Mesh link UART transport
+ * @{
+ * @brief Mesh link over the UART chosen as ncs,mesh-link-uart, using the async API.
+ *
+ * Messages are batched into frames while a frame is in transmission, and
+ * optionally for a configurable delay. Pings are answered by the transport.
+ * Frames the peer does not acknowledge in time are resent, up to a number of
+ * retries.
+ */
+
+#include <zephyr/kernel.h>
+#include <mesh_link.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Link counters. */
+struct mesh_link_uart_stats {
+	uint32_t msgs_tx;
+	uint32_t msgs_rx;
+	uint32_t frames_tx;
+	uint32_t frames_rx;
+	/** Frames dropped because of encoding or CRC errors. */
+	uint32_t frames_dropped;
+	/** Frames from the peer dropped because an earlier frame was missing. */
+	uint32_t frames_lost;
+	/** Times the peer did not acknowledge in time, and frames were resent or given up on. */
+	uint32_t ack_timeouts;
+	/** Frames sent again. */
+	uint32_t frames_resent;
+	/** Frames given up on after the last retry. */
+	uint32_t frames_failed;
+	/** Received bytes that did not fit in the receive buffer. */
+	uint32_t rx_overruns;
+	/** Last ping round trip time in microseconds, 0 if no pong has been received. */
+	uint32_t rtt_us;
+	uint32_t rtt_min_us;
+	uint32_t rtt_max_us;
+};
+
+/**
+ * @brief Callback for frames given up on.
+ *
+ * @param frames Number of frames the peer did not acknowledge after the last retry.
+ *               Their messages may or may not have been received.
+ */
+typedef void (*mesh_link_uart_lost_cb_t)(uint8_t frames);
+
+/**
+ * @brief Initialize the transport and start receiving.
+ *
+ * @param cb Called from the system workqueue for every received message,
+ *           except pings and pongs.
+ * @param lost Called from the system workqueue when frames are given up on. May be NULL.
+ * @return 0 on success, negative errno code otherwise.
+ */
+int mesh_link_uart_init(mesh_link_msg_cb_t cb, mesh_link_uart_lost_cb_t lost);
+
+/**
+ * @brief Queue a message for transmission.
+ *
+ * @param type Message type.
+ * @param body Message body.
+ * @param len Length of the message body.
+ * @return 0 on success, -EBUSY if the link is congested and the message should be
+ *         retried later, or another negative errno code.
+ */
+int mesh_link_uart_send(uint8_t type, const void *body, size_t len);
+
+/**
+ * @brief Send a ping to measure the round trip time.
+ *
+ * The result is available in the link counters once the pong has been received.
+ *
+ * @return 0 on success, negative errno code otherwise.
+ */
+int mesh_link_uart_ping(void);
+
+/**
+ * @brief Get the link counters.
+ *
+ * @param stats Structure the counters are copied to.
+ */
+void mesh_link_uart_stats_get(struct mesh_link_uart_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* MESH_LINK_UART_H__ */
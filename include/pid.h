@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef PID_H__
+#define PID_H__
+
+/**
+ * @file
+ * @defgroup pid PID controller
+ * @{
+ * @brief PID controllers and low-pass filters in float, Q15 and Q31.
+ *
+ * The controllers take the derivative of the measurement rather than of the
+ * error, so setpoint steps do not kick the output, and low-pass filter it.
+ * The integrator is clamped to the output range, and stops integrating while
+ * the output is saturated in the direction of the error. A feed-forward term
+ * is added to the output before it is limited.
+ *
+ * Gains are given per update, with the update interval folded in: ki is the
+ * integral gain times the interval, kd the derivative gain over the interval.
+ *
+ * Fixed-point gains are fractions scaled by 2^shift, so gains above one are
+ * expressed with a shift. Inputs and outputs are in the same format as the
+ * gains, without the shift.
+ *
+ * The library does not depend on Zephyr, and builds for Linux hosts as well.
+ * It is not used by any sample yet: the mesh_bot motors run open loop.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Q15 fixed-point value, in [-1, 1). */
+typedef int16_t pid_q15_t;
+/** Q31 fixed-point value, in [-1, 1). */
+typedef int32_t pid_q31_t;
+
+/** Largest gain shift. */
+#define PID_SHIFT_MAX 15
+
+/** Configuration of a float PID controller. */
+struct pid_f32_config {
+	float kp;
+	/** Integral gain times the update interval. */
+	float ki;
+	/** Derivative gain over the update interval. */
+	float kd;
+	/** Feed-forward gain. */
+	float kff;
+	/** Derivative filter coefficient in (0, 1]. 1 disables the filter. */
+	float d_alpha;
+	float out_min;
+	float out_max;
+};
+
+/** Float PID controller. */
+struct pid_f32 {
+	struct pid_f32_config cfg;
+	float integ;
+	float prev_meas;
+	float d_filt;
+};
+
+/** Configuration of a Q15 PID controller. */
+struct pid_q15_config {
+	pid_q15_t kp;
+	pid_q15_t ki;
+	pid_q15_t kd;
+	pid_q15_t kff;
+	/** Gains are scaled by 2^shift, up to @ref PID_SHIFT_MAX. */
+	uint8_t shift;
+	/** Derivative filter coefficient. 0x7fff disables the filter. */
+	pid_q15_t d_alpha;
+	pid_q15_t out_min;
+	pid_q15_t out_max;
+};
+
+/** Q15 PID controller. */
+struct pid_q15 {
+	struct pid_q15_config cfg;
+	/** Integrator, with 16 extra fractional bits so small errors accumulate. */
+	int32_t integ;
+	pid_q15_t prev_meas;
+	pid_q15_t d_filt;
+};
+
+/** Configuration of a Q31 PID controller. */
+struct pid_q31_config {
+	pid_q31_t kp;
+	pid_q31_t ki;
+	pid_q31_t kd;
+	pid_q31_t kff;
+	/** Gains are scaled by 2^shift, up to @ref PID_SHIFT_MAX. */
+	uint8_t shift;
+	/** Derivative filter coefficient. 0x7fffffff disables the filter. */
+	pid_q31_t d_alpha;
+	pid_q31_t out_min;
+	pid_q31_t out_max;
+};
+
+/** Q31 PID controller. */
+struct pid_q31 {
+	struct pid_q31_config cfg;
+	/** Integrator, with 16 extra fractional bits so small errors accumulate. */
+	int64_t integ;
+	pid_q31_t prev_meas;
+	pid_q31_t d_filt;
+};
+
+/** First order low-pass filter, y += alpha * (x - y). */
+struct lpf_f32 {
+	float alpha;
+	float y;
+};
+
+/** Q15 first order low-pass filter. */
+struct lpf_q15 {
+	pid_q15_t alpha;
+	/** Output, with 16 extra fractional bits so small steps are not lost. */
+	int32_t y;
+};
+
+/** Q31 first order low-pass filter. */
+struct lpf_q31 {
+	pid_q31_t alpha;
+	/** Output, with 31 extra fractional bits so small steps are not lost. */
+	int64_t y;
+};
+
+/**
+ * @brief Initialize a float PID controller.
+ *
+ * @param pid Controller.
+ * @param cfg Configuration, copied to the controller.
+ */
+void pid_f32_init(struct pid_f32 *pid, const struct pid_f32_config *cfg);
+
+/**
+ * @brief Reset the integrator and derivative of a float PID controller.
+ *
+ * @param pid Controller.
+ * @param meas Current measurement, so the next derivative starts from zero.
+ */
+void pid_f32_reset(struct pid_f32 *pid, float meas);
+
+/**
+ * @brief Run one update of a float PID controller.
+ *
+ * @param pid Controller.
+ * @param sp Setpoint.
+ * @param meas Measurement.
+ * @param ff Feed-forward input, scaled by kff.
+ * @return Controller output, within the output limits.
+ */
+float pid_f32_update(struct pid_f32 *pid, float sp, float meas, float ff);
+
+/**
+ * @brief Update a set of float PID controllers.
+ *
+ * Runs faster than separate updates, as the controllers are updated in one
+ * loop without calls in between.
+ *
+ * @param pids Controllers.
+ * @param sp Setpoint of each controller.
+ * @param meas Measurement of each controller.
+ * @param ff Feed-forward input of each controller, or NULL for none.
+ * @param out Output of each controller.
+ * @param count Number of controllers.
+ */
+void pid_f32_update_batch(struct pid_f32 *pids, const float *sp, const float *meas,
+			  const float *ff, float *out, size_t count);
+
+/** @brief Initialize a Q15 PID controller. See @ref pid_f32_init. */
+void pid_q15_init(struct pid_q15 *pid, const struct pid_q15_config *cfg);
+
+/** @brief Reset a Q15 PID controller. See @ref pid_f32_reset. */
+void pid_q15_reset(struct pid_q15 *pid, pid_q15_t meas);
+
+/** @brief Run one update of a Q15 PID controller. See @ref pid_f32_update. */
+pid_q15_t pid_q15_update(struct pid_q15 *pid, pid_q15_t sp, pid_q15_t meas, pid_q15_t ff);
+
+/** @brief Update a set of Q15 PID controllers. See @ref pid_f32_update_batch. */
+void pid_q15_update_batch(struct pid_q15 *pids, const pid_q15_t *sp, const pid_q15_t *meas,
+			  const pid_q15_t *ff, pid_q15_t *out, size_t count);
+
+/** @brief Initialize a Q31 PID controller. See @ref pid_f32_init. */
+void pid_q31_init(struct pid_q31 *pid, const struct pid_q31_config *cfg);
+
+/** @brief Reset a Q31 PID controller. See @ref pid_f32_reset. */
+void pid_q31_reset(struct pid_q31 *pid, pid_q31_t meas);
+
+/** @brief Run one update of a Q31 PID controller. See @ref pid_f32_update. */
+pid_q31_t pid_q31_update(struct pid_q31 *pid, pid_q31_t sp, pid_q31_t meas, pid_q31_t ff);
+
+/** @brief Update a set of Q31 PID controllers. See @ref pid_f32_update_batch. */
+void pid_q31_update_batch(struct pid_q31 *pids, const pid_q31_t *sp, const pid_q31_t *meas,
+			  const pid_q31_t *ff, pid_q31_t *out, size_t count);
+
+/**
+ * @brief Filter a sample with a float low-pass filter.
+ *
+ * @param lpf Filter. Set alpha and the initial output before the first sample.
+ * @param x Sample.
+ * @return Filter output.
+ */
+static inline float lpf_f32_update(struct lpf_f32 *lpf, float x)
+{
+	lpf->y += lpf->alpha * (x - lpf->y);
+	return lpf->y;
+}
+
+/**
+ * @brief Set the output of a Q15 low-pass filter.
+ *
+ * @param lpf Filter.
+ * @param y Output.
+ */
+static inline void lpf_q15_set(struct lpf_q15 *lpf, pid_q15_t y)
+{
+	lpf->y = (int32_t)y << 16;
+}
+
+/** @brief Filter a sample with a Q15 low-pass filter. See @ref lpf_f32_update. */
+static inline pid_q15_t lpf_q15_update(struct lpf_q15 *lpf, pid_q15_t x)
+{
+	int64_t diff = ((int64_t)x << 16) - lpf->y;
+
+	lpf->y += (int32_t)((diff * lpf->alpha) >> 15);
+	return (pid_q15_t)(lpf->y >> 16);
+}
+
+/**
+ * @brief Set the output of a Q31 low-pass filter.
+ *
+ * @param lpf Filter.
+ * @param y Output.
+ */
+static inline void lpf_q31_set(struct lpf_q31 *lpf, pid_q31_t y)
+{
+	lpf->y = (int64_t)y << 31;
+}
+
+/** @brief Filter a sample with a Q31 low-pass filter. See @ref lpf_f32_update. */
+static inline pid_q31_t lpf_q31_update(struct lpf_q31 *lpf, pid_q31_t x)
+{
+	int64_t diff = (((int64_t)x << 31) - lpf->y) >> 31;
+
+	lpf->y += diff * lpf->alpha;
+	return (pid_q31_t)(lpf->y >> 31);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* PID_H__ */
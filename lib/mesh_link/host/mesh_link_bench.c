@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Mesh link benchmark for Linux hosts.
+ *
+ * Measures ping round trip latency and message throughput of the mesh link
+ * protocol. Without arguments, both ends run on this host over a pty pair.
+ * Given a serial device, the far end is the mesh radio, which answers pings
+ * and acknowledges frames.
+ *
+ * Build from the repository root:
+ *
+ *   gcc -O2 -Iinclude lib/mesh_link/mesh_link.c lib/mesh_link/host/mesh_link_bench.c \
+ *       -o mesh_link_bench -lpthread -lutil
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mesh_link.h>
+
+/* Must match CONFIG_MESH_LINK_UART_WINDOW of the peer. */
+#define WINDOW 4
+#define PINGS 1000
+#define THROUGHPUT_SEC 2
+
+struct endpoint {
+	int fd;
+	uint8_t tx_seq;
+	uint8_t peer_ack;
+	uint8_t rx_ack;
+	bool ack_due;
+	struct mesh_link_decoder dec;
+	/* Filled by the message callback. */
+	uint32_t msgs_rx;
+	uint32_t pong_token;
+	struct mesh_link_frame reply;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				continue;
+			}
+			perror("write");
+			exit(1);
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static void frame_send(struct endpoint *ep, struct mesh_link_frame *frame)
+{
+	uint8_t wire[MESH_LINK_ENCODED_MAX];
+	size_t len = mesh_link_frame_encode(frame, ep->tx_seq, ep->rx_ack, wire);
+
+	if (frame->msg_count) {
+		ep->tx_seq++;
+	}
+	ep->ack_due = false;
+	write_all(ep->fd, wire, len);
+}
+
+static bool can_send(struct endpoint *ep)
+{
+	return (uint8_t)(ep->tx_seq - ep->peer_ack) < WINDOW;
+}
+
+static void msg_received(uint8_t type, const uint8_t *body, size_t len, void *user_data)
+{
+	struct endpoint *ep = user_data;
+
+	ep->msgs_rx++;
+
+	if (type == MESH_LINK_MSG_PING) {
+		mesh_link_frame_add(&ep->reply, MESH_LINK_MSG_PONG, body, len);
+	} else if (type == MESH_LINK_MSG_PONG && len == 4) {
+		memcpy(&ep->pong_token, body, 4);
+	}
+}
+
+static void frame_received(const uint8_t *frame, size_t len, void *user_data)
+{
+	struct endpoint *ep = user_data;
+	struct mesh_link_hdr hdr;
+
+	if (mesh_link_frame_parse(frame, len, &hdr, msg_received, ep)) {
+		return;
+	}
+
+	if ((uint8_t)(hdr.ack - ep->peer_ack) <= (uint8_t)(ep->tx_seq - ep->peer_ack)) {
+		ep->peer_ack = hdr.ack;
+	}
+
+	if (hdr.msg_count) {
+		ep->rx_ack = hdr.seq + 1;
+		ep->ack_due = true;
+	}
+}
+
+static void receive(struct endpoint *ep, int timeout_ms)
+{
+	struct pollfd pfd = { .fd = ep->fd, .events = POLLIN };
+	uint8_t buf[512];
+	ssize_t n;
+
+	if (poll(&pfd, 1, timeout_ms) <= 0) {
+		return;
+	}
+
+	n = read(ep->fd, buf, sizeof(buf));
+	if (n > 0) {
+		mesh_link_frame_init(&ep->reply);
+		mesh_link_decoder_feed(&ep->dec, buf, n, frame_received, ep);
+	}
+}
+
+/* Far end on the pty: answers pings, acknowledges everything it reads. */
+static void *peer_thread(void *arg)
+{
+	struct endpoint *ep = arg;
+
+	while (true) {
+		receive(ep, -1);
+
+		if (ep->reply.msg_count || ep->ack_due) {
+			frame_send(ep, &ep->reply);
+		}
+	}
+
+	return NULL;
+}
+
+static void raw_mode(int fd, speed_t speed)
+{
+	struct termios tio;
+
+	tcgetattr(fd, &tio);
+	cfmakeraw(&tio);
+	if (speed) {
+		cfsetspeed(&tio, speed);
+		tio.c_cflag |= CRTSCTS;
+	}
+	tcsetattr(fd, TCSANOW, &tio);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void bench_rtt(struct endpoint *ep)
+{
+	static uint64_t rtt[PINGS];
+	struct mesh_link_frame frame;
+	uint64_t sum = 0;
+
+	for (uint32_t token = 1; token <= PINGS; token++) {
+		uint64_t start = now_ns();
+
+		mesh_link_frame_init(&frame);
+		mesh_link_frame_add(&frame, MESH_LINK_MSG_PING, &token, sizeof(token));
+		frame_send(ep, &frame);
+
+		while (ep->pong_token != token) {
+			receive(ep, 1000);
+			if (now_ns() - start > 1000000000ull) {
+				fprintf(stderr, "Ping %u timed out\n", token);
+				exit(1);
+			}
+		}
+
+		rtt[token - 1] = now_ns() - start;
+		sum += rtt[token - 1];
+
+		/* Flush the acknowledgment, as the transport would. */
+		if (ep->ack_due) {
+			mesh_link_frame_init(&frame);
+			frame_send(ep, &frame);
+		}
+	}
+
+	qsort(rtt, PINGS, sizeof(rtt[0]), cmp_u64);
+	printf("RTT over %d pings: min %.1f us, avg %.1f us, p99 %.1f us, max %.1f us\n",
+	       PINGS, rtt[0] / 1e3, sum / 1e3 / PINGS, rtt[PINGS * 99 / 100] / 1e3,
+	       rtt[PINGS - 1] / 1e3);
+}
+
+static void bench_throughput(struct endpoint *ep, int batch)
+{
+	uint8_t cmd[MESH_LINK_CMD_LEN] = { 0x00, 0x01, 0x01 };
+	uint8_t wire[MESH_LINK_ENCODED_MAX];
+	struct mesh_link_frame frame;
+	uint64_t start = now_ns();
+	uint64_t end = start + THROUGHPUT_SEC * 1000000000ull;
+	uint64_t msgs = 0;
+	size_t wire_len;
+
+	mesh_link_frame_init(&frame);
+	for (int i = 0; i < batch; i++) {
+		mesh_link_frame_add(&frame, MESH_LINK_MSG_CMD, cmd, sizeof(cmd));
+	}
+	wire_len = mesh_link_frame_encode(&frame, 0, 0, wire);
+
+	while (now_ns() < end) {
+		while (can_send(ep)) {
+			frame_send(ep, &frame);
+			msgs += batch;
+		}
+		receive(ep, 100);
+	}
+
+	/* Let the last frames be acknowledged. */
+	while (ep->peer_ack != ep->tx_seq && now_ns() < end + 1000000000ull) {
+		receive(ep, 100);
+	}
+
+	double sec = (now_ns() - start) / 1e9;
+
+	printf("Batch %2d: %9.0f msg/s, %.1f wire bytes per message, "
+	       "%6.0f msg/s wire limit at 1 Mbaud\n",
+	       batch, msgs / sec, (double)wire_len / batch,
+	       100000.0 * batch / wire_len);
+}
+
+static void frame_count(const uint8_t *frame, size_t len, void *user_data)
+{
+	(void)frame;
+	(void)len;
+	(*(uint32_t *)user_data)++;
+}
+
+static void bench_codec(void)
+{
+	uint8_t cmd[MESH_LINK_CMD_LEN] = { 0x00, 0x01, 0x01 };
+	uint8_t wire[MESH_LINK_ENCODED_MAX];
+	struct mesh_link_frame frame;
+	struct mesh_link_decoder dec;
+	uint32_t frames = 0;
+	const int rounds = 200000;
+	int msgs = 0;
+	size_t len;
+
+	mesh_link_frame_init(&frame);
+	while (mesh_link_frame_add(&frame, MESH_LINK_MSG_CMD, cmd, sizeof(cmd)) == 0) {
+		msgs++;
+	}
+
+	uint64_t start = now_ns();
+
+	for (int i = 0; i < rounds; i++) {
+		len = mesh_link_frame_encode(&frame, i, 0, wire);
+	}
+
+	uint64_t enc = now_ns() - start;
+
+	mesh_link_decoder_init(&dec);
+	start = now_ns();
+	for (int i = 0; i < rounds; i++) {
+		uint8_t copy[MESH_LINK_ENCODED_MAX];
+
+		memcpy(copy, wire, len);
+		mesh_link_decoder_feed(&dec, copy, len, frame_count, &frames);
+	}
+
+	uint64_t dec_ns = now_ns() - start;
+
+	printf("Codec, %d messages per frame: encode %.0f ns/frame, decode %.0f ns/frame, "
+	       "%u/%d frames valid\n", msgs, (double)enc / rounds, (double)dec_ns / rounds,
+	       frames, rounds);
+}
+
+int main(int argc, char **argv)
+{
+	static struct endpoint local, peer;
+	pthread_t thread;
+	int master, slave;
+
+	mesh_link_decoder_init(&local.dec);
+	mesh_link_decoder_init(&peer.dec);
+
+	if (argc > 1) {
+		local.fd = open(argv[1], O_RDWR | O_NOCTTY);
+		if (local.fd < 0) {
+			perror(argv[1]);
+			return 1;
+		}
+		raw_mode(local.fd, B1000000);
+	} else {
+		if (openpty(&master, &slave, NULL, NULL, NULL)) {
+			perror("openpty");
+			return 1;
+		}
+		raw_mode(master, 0);
+		raw_mode(slave, 0);
+		local.fd = master;
+		peer.fd = slave;
+		pthread_create(&thread, NULL, peer_thread, &peer);
+	}
+
+	bench_codec();
+	bench_rtt(&local);
+	bench_throughput(&local, 1);
+	bench_throughput(&local, 4);
+	bench_throughput(&local, 9);
+
+	printf("Frames dropped: %u local, %u peer\n", local.dec.errors, peer.dec.errors);
+	return 0;
+}
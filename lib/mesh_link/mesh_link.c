@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <mesh_link.h>
+
+/* CRC-16/CCITT-FALSE without a lookup table, one byte at a time. */
+uint16_t mesh_link_crc16(const uint8_t *data, size_t len)
+{
+	uint16_t crc = 0xffff;
+
+	for (size_t i = 0; i < len; i++) {
+		uint8_t x = (crc >> 8) ^ data[i];
+
+		x ^= x >> 4;
+		crc = (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+	}
+
+	return crc;
+}
+
+size_t mesh_link_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t code_idx = 0;
+	size_t out_idx = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (in[i] != 0) {
+			out[out_idx++] = in[i];
+			code++;
+		}
+
+		if (in[i] == 0 || code == 0xff) {
+			out[code_idx] = code;
+			code_idx = out_idx++;
+			code = 1;
+		}
+	}
+
+	out[code_idx] = code;
+	return out_idx;
+}
+
+int mesh_link_cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t in_idx = 0;
+	size_t out_idx = 0;
+
+	while (in_idx < len) {
+		uint8_t code = in[in_idx++];
+
+		if (code == 0 || in_idx + code - 1 > len) {
+			return -EBADMSG;
+		}
+
+		/* The output never overtakes the input, so this works in place. */
+		memmove(&out[out_idx], &in[in_idx], code - 1);
+		in_idx += code - 1;
+		out_idx += code - 1;
+
+		if (code != 0xff && in_idx < len) {
+			out[out_idx++] = 0;
+		}
+	}
+
+	return out_idx;
+}
+
+void mesh_link_frame_init(struct mesh_link_frame *frame)
+{
+	frame->len = MESH_LINK_HDR_LEN;
+	frame->msg_count = 0;
+}
+
+int mesh_link_frame_add(struct mesh_link_frame *frame, uint8_t type, const void *body, size_t len)
+{
+	if (len > MESH_LINK_MSG_MAX) {
+		return -EINVAL;
+	}
+
+	if (frame->len + MESH_LINK_MSG_HDR_LEN + len + MESH_LINK_CRC_LEN > sizeof(frame->buf)) {
+		return -ENOMEM;
+	}
+
+	frame->buf[frame->len++] = type;
+	frame->buf[frame->len++] = len;
+	memcpy(&frame->buf[frame->len], body, len);
+	frame->len += len;
+	frame->msg_count++;
+
+	return 0;
+}
+
+size_t mesh_link_frame_encode(struct mesh_link_frame *frame, uint8_t seq, uint8_t ack,
+			      uint8_t *out)
+{
+	uint16_t crc;
+	size_t len;
+
+	frame->buf[0] = seq;
+	frame->buf[1] = ack;
+
+	/* Room for the CRC is reserved when adding messages. */
+	crc = mesh_link_crc16(frame->buf, frame->len);
+	frame->buf[frame->len] = crc & 0xff;
+	frame->buf[frame->len + 1] = crc >> 8;
+
+	len = mesh_link_cobs_encode(frame->buf, frame->len + MESH_LINK_CRC_LEN, out);
+	out[len++] = 0;
+
+	return len;
+}
+
+int mesh_link_frame_parse(const uint8_t *frame, size_t len, struct mesh_link_hdr *hdr,
+			  mesh_link_msg_cb_t cb, void *user_data)
+{
+	size_t idx = MESH_LINK_HDR_LEN;
+
+	if (len < MESH_LINK_HDR_LEN) {
+		return -EBADMSG;
+	}
+
+	hdr->seq = frame[0];
+	hdr->ack = frame[1];
+	hdr->msg_count = 0;
+
+	while (idx < len) {
+		uint8_t type;
+		uint8_t body_len;
+
+		if (idx + MESH_LINK_MSG_HDR_LEN > len) {
+			return -EBADMSG;
+		}
+
+		type = frame[idx++];
+		body_len = frame[idx++];
+
+		if (idx + body_len > len) {
+			return -EBADMSG;
+		}
+
+		hdr->msg_count++;
+		cb(type, &frame[idx], body_len, user_data);
+		idx += body_len;
+	}
+
+	return 0;
+}
+
+void mesh_link_decoder_init(struct mesh_link_decoder *dec)
+{
+	dec->len = 0;
+	dec->overflow = false;
+	dec->errors = 0;
+}
+
+static void frame_complete(struct mesh_link_decoder *dec, mesh_link_frame_cb_t cb, void *user_data)
+{
+	int len = mesh_link_cobs_decode(dec->buf, dec->len, dec->buf);
+	uint16_t crc;
+
+	if (len < MESH_LINK_HDR_LEN + MESH_LINK_CRC_LEN) {
+		dec->errors++;
+		return;
+	}
+
+	len -= MESH_LINK_CRC_LEN;
+	crc = dec->buf[len] | (dec->buf[len + 1] << 8);
+
+	if (crc != mesh_link_crc16(dec->buf, len)) {
+		dec->errors++;
+		return;
+	}
+
+	cb(dec->buf, len, user_data);
+}
+
+void mesh_link_decoder_feed(struct mesh_link_decoder *dec, const uint8_t *data, size_t len,
+			    mesh_link_frame_cb_t cb, void *user_data)
+{
+	/* Copy everything up to the next delimiter at once. */
+	while (len) {
+		const uint8_t *end = memchr(data, 0, len);
+		size_t chunk = end ? (size_t)(end - data) : len;
+
+		if (!dec->overflow) {
+			if (dec->len + chunk > sizeof(dec->buf)) {
+				dec->overflow = true;
+				dec->errors++;
+			} else {
+				memcpy(&dec->buf[dec->len], data, chunk);
+				dec->len += chunk;
+			}
+		}
+
+		if (end == NULL) {
+			break;
+		}
+
+		if (!dec->overflow && dec->len) {
+			frame_complete(dec, cb, user_data);
+		}
+
+		dec->len = 0;
+		dec->overflow = false;
+		data = end + 1;
+		len -= chunk + 1;
+	}
+}
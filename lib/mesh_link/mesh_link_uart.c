@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <mesh_link_uart.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(mesh_link, CONFIG_MESH_LINK_LOG_LEVEL);
+
+#define WINDOW CONFIG_MESH_LINK_UART_WINDOW
+/* Room for a full window of frames from the peer. */
+#define RX_RING_SIZE (WINDOW * MESH_LINK_ENCODED_MAX)
+
+static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(ncs_mesh_link_uart));
+
+/* Receive path
+ *
+ * The UART DMA alternates between two small buffers. Received bytes are moved
+ * to a ring buffer in interrupt context, and decoded from the system workqueue.
+ */
+static uint8_t rx_bufs[2][CONFIG_MESH_LINK_UART_RX_BUF_SIZE];
+static uint8_t rx_buf_next;
+RING_BUF_DECLARE(rx_ring, RX_RING_SIZE);
+static struct mesh_link_decoder decoder;
+
+/* Transmit path
+ *
+ * Messages are added to the pending frame, which is encoded into the DMA
+ * buffer once the previous frame has been sent and the peer has room for it.
+ * Messages sent in the meantime are batched into the same frame.
+ */
+static uint8_t tx_buf[MESH_LINK_ENCODED_MAX];
+static atomic_t tx_busy;
+static struct mesh_link_frame pending;
+static K_MUTEX_DEFINE(pending_lock);
+
+/* Retransmission
+ *
+ * Sent frames are kept until the peer acknowledges them. When no acknowledgment
+ * comes in time, all unacknowledged frames are sent again, oldest first, with
+ * the current acknowledgment. The peer only accepts frames in sequence, so it
+ * drops the frames that follow a lost one until they are resent. After too many
+ * retries the frames are given up on, and reported as lost.
+ */
+static struct mesh_link_frame sent[WINDOW];
+/* Slot of the oldest unacknowledged frame. */
+static uint8_t sent_first;
+
+/* Sequence state, only accessed from the system workqueue. */
+static uint8_t tx_seq;
+static uint8_t resend_seq;
+static uint8_t peer_ack;
+static uint8_t ack_retries;
+static uint8_t rx_ack;
+static uint8_t rx_ack_sent;
+static bool rx_ack_requested;
+static bool rx_synced;
+
+static mesh_link_msg_cb_t msg_cb;
+static mesh_link_uart_lost_cb_t lost_cb;
+static struct mesh_link_uart_stats stats;
+static uint32_t ping_token;
+static uint32_t ping_sent;
+
+static void tx_work_fn(struct k_work *work);
+static void ack_timeout_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(tx_work, tx_work_fn);
+static K_WORK_DELAYABLE_DEFINE(ack_timeout_work, ack_timeout_work_fn);
+
+static bool window_open(void)
+{
+	return (uint8_t)(tx_seq - peer_ack) < WINDOW;
+}
+
+static struct mesh_link_frame *sent_frame(uint8_t seq)
+{
+	return &sent[(sent_first + (uint8_t)(seq - peer_ack)) % WINDOW];
+}
+
+static void peer_ack_set(uint8_t ack)
+{
+	/* Frames waiting to be resent may be acknowledged in the meantime. */
+	if ((uint8_t)(resend_seq - peer_ack) < (uint8_t)(ack - peer_ack)) {
+		resend_seq = ack;
+	}
+
+	sent_first = (sent_first + (uint8_t)(ack - peer_ack)) % WINDOW;
+	peer_ack = ack;
+}
+
+static void tx_work_fn(struct k_work *work)
+{
+	static struct mesh_link_frame ack_frame;
+	size_t len;
+	int err;
+
+	if (!atomic_cas(&tx_busy, 0, 1)) {
+		/* Picked up again when the ongoing transmission is done. */
+		return;
+	}
+
+	k_mutex_lock(&pending_lock, K_FOREVER);
+
+	if (resend_seq != tx_seq) {
+		stats.frames_resent++;
+		len = mesh_link_frame_encode(sent_frame(resend_seq), resend_seq, rx_ack, tx_buf);
+		resend_seq++;
+	} else if (pending.msg_count && window_open()) {
+		stats.frames_tx++;
+		stats.msgs_tx += pending.msg_count;
+		*sent_frame(tx_seq) = pending;
+		len = mesh_link_frame_encode(&pending, tx_seq++, rx_ack, tx_buf);
+		resend_seq = tx_seq;
+		mesh_link_frame_init(&pending);
+	} else if (rx_ack != rx_ack_sent || rx_ack_requested) {
+		mesh_link_frame_init(&ack_frame);
+		len = mesh_link_frame_encode(&ack_frame, tx_seq, rx_ack, tx_buf);
+	} else {
+		len = 0;
+	}
+
+	k_mutex_unlock(&pending_lock);
+
+	if (tx_seq != peer_ack) {
+		/* Timed from the first unacknowledged frame, as it is not rescheduled. */
+		k_work_schedule(&ack_timeout_work, K_MSEC(CONFIG_MESH_LINK_UART_ACK_TIMEOUT_MS));
+	}
+
+	if (len == 0) {
+		atomic_clear(&tx_busy);
+		return;
+	}
+
+	rx_ack_sent = rx_ack;
+	rx_ack_requested = false;
+
+	err = uart_tx(uart, tx_buf, len, SYS_FOREVER_US);
+	if (err) {
+		LOG_ERR("uart_tx, error: %d", err);
+		atomic_clear(&tx_busy);
+	}
+}
+
+static void ack_timeout_work_fn(struct k_work *work)
+{
+	uint8_t unacked = tx_seq - peer_ack;
+
+	if (unacked == 0) {
+		return;
+	}
+
+	stats.ack_timeouts++;
+
+	if (ack_retries < CONFIG_MESH_LINK_UART_ACK_RETRIES) {
+		LOG_DBG("No acknowledgment for %d frames, resending", unacked);
+		ack_retries++;
+		resend_seq = peer_ack;
+	} else {
+		LOG_WRN("No acknowledgment for %d frames after %d retries", unacked, ack_retries);
+		stats.frames_failed += unacked;
+		ack_retries = 0;
+		peer_ack_set(tx_seq);
+
+		if (lost_cb) {
+			lost_cb(unacked);
+		}
+	}
+
+	k_work_reschedule(&tx_work, K_NO_WAIT);
+}
+
+static void msg_received(uint8_t type, const uint8_t *body, size_t len, void *user_data)
+{
+	stats.msgs_rx++;
+
+	switch (type) {
+	case MESH_LINK_MSG_PING:
+		(void)mesh_link_uart_send(MESH_LINK_MSG_PONG, body, len);
+		break;
+	case MESH_LINK_MSG_PONG:
+		if (len == sizeof(ping_token) && sys_get_le32(body) == ping_token) {
+			stats.rtt_us = k_cyc_to_us_floor32(k_cycle_get_32() - ping_sent);
+			stats.rtt_min_us = stats.rtt_min_us ?
+					   MIN(stats.rtt_min_us, stats.rtt_us) : stats.rtt_us;
+			stats.rtt_max_us = MAX(stats.rtt_max_us, stats.rtt_us);
+		}
+		break;
+	default:
+		if (msg_cb) {
+			msg_cb(type, body, len, NULL);
+		}
+		break;
+	}
+}
+
+static void msg_skipped(uint8_t type, const uint8_t *body, size_t len, void *user_data)
+{
+}
+
+/* Only frames in sequence are accepted. Frames after a lost one are dropped
+ * until the peer resends from the lost one, and frames received before are
+ * acknowledged again, in case the acknowledgment was lost.
+ */
+static bool seq_accepted(uint8_t seq)
+{
+	uint8_t ahead = seq - rx_ack;
+	uint8_t behind = rx_ack - seq;
+
+	if (!rx_synced || ahead == 0) {
+		return true;
+	}
+
+	if (ahead < WINDOW) {
+		stats.frames_lost++;
+		rx_ack_requested = true;
+		return false;
+	}
+
+	if (behind <= WINDOW) {
+		rx_ack_requested = true;
+		return false;
+	}
+
+	/* Far outside the window, the peer restarted. */
+	return true;
+}
+
+static void frame_received(const uint8_t *frame, size_t len, void *user_data)
+{
+	struct mesh_link_hdr hdr;
+
+	if (mesh_link_frame_parse(frame, len, &hdr, msg_skipped, NULL)) {
+		stats.frames_dropped++;
+		return;
+	}
+
+	/* Ignore acknowledgments of frames that have not been sent, they are
+	 * left over from before the peer restarted.
+	 */
+	if (hdr.ack != peer_ack &&
+	    (uint8_t)(hdr.ack - peer_ack) <= (uint8_t)(tx_seq - peer_ack)) {
+		peer_ack_set(hdr.ack);
+		ack_retries = 0;
+		if (peer_ack == tx_seq) {
+			k_work_cancel_delayable(&ack_timeout_work);
+		} else {
+			k_work_reschedule(&ack_timeout_work,
+					  K_MSEC(CONFIG_MESH_LINK_UART_ACK_TIMEOUT_MS));
+		}
+		k_work_reschedule(&tx_work, K_NO_WAIT);
+	}
+
+	if (hdr.msg_count == 0) {
+		return;
+	}
+
+	if (!seq_accepted(hdr.seq)) {
+		k_work_reschedule(&tx_work, K_NO_WAIT);
+		return;
+	}
+
+	stats.frames_rx++;
+	rx_synced = true;
+	rx_ack = hdr.seq + 1;
+	(void)mesh_link_frame_parse(frame, len, &hdr, msg_received, NULL);
+
+	/* Acknowledge right away once half the peer's window is in use. Otherwise
+	 * give outgoing messages a chance to carry the acknowledgment.
+	 */
+	if ((uint8_t)(rx_ack - rx_ack_sent) >= WINDOW / 2) {
+		k_work_reschedule(&tx_work, K_NO_WAIT);
+	} else {
+		k_work_schedule(&tx_work, K_USEC(CONFIG_MESH_LINK_UART_ACK_DELAY_US));
+	}
+}
+
+static void rx_work_fn(struct k_work *work)
+{
+	uint8_t *data;
+	uint32_t len;
+
+	while ((len = ring_buf_get_claim(&rx_ring, &data, RX_RING_SIZE)) > 0) {
+		mesh_link_decoder_feed(&decoder, data, len, frame_received, NULL);
+		ring_buf_get_finish(&rx_ring, len);
+	}
+}
+
+static K_WORK_DEFINE(rx_work, rx_work_fn);
+
+static int rx_enable(void)
+{
+	rx_buf_next = 1;
+
+	return uart_rx_enable(uart, rx_bufs[0], sizeof(rx_bufs[0]),
+			      CONFIG_MESH_LINK_UART_RX_TIMEOUT_US);
+}
+
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	uint32_t written;
+	int err;
+
+	switch (evt->type) {
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		atomic_clear(&tx_busy);
+		k_work_reschedule(&tx_work, K_NO_WAIT);
+		break;
+	case UART_RX_RDY:
+		written = ring_buf_put(&rx_ring, &evt->data.rx.buf[evt->data.rx.offset],
+				       evt->data.rx.len);
+		stats.rx_overruns += evt->data.rx.len - written;
+		k_work_submit(&rx_work);
+		break;
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, rx_bufs[rx_buf_next], sizeof(rx_bufs[0]));
+		rx_buf_next ^= 1;
+		break;
+	case UART_RX_STOPPED:
+		LOG_WRN("Receiver stopped, reason %d", evt->data.rx_stop.reason);
+		break;
+	case UART_RX_DISABLED:
+		err = rx_enable();
+		if (err) {
+			LOG_ERR("uart_rx_enable, error: %d", err);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+int mesh_link_uart_init(mesh_link_msg_cb_t cb, mesh_link_uart_lost_cb_t lost)
+{
+	int err;
+
+	if (!device_is_ready(uart)) {
+		LOG_ERR("UART %s not ready", uart->name);
+		return -ENODEV;
+	}
+
+	msg_cb = cb;
+	lost_cb = lost;
+	mesh_link_decoder_init(&decoder);
+	mesh_link_frame_init(&pending);
+
+	err = uart_callback_set(uart, uart_cb, NULL);
+	if (err) {
+		LOG_ERR("uart_callback_set, error: %d", err);
+		return err;
+	}
+
+	return rx_enable();
+}
+
+int mesh_link_uart_send(uint8_t type, const void *body, size_t len)
+{
+	bool first;
+	int err;
+
+	k_mutex_lock(&pending_lock, K_FOREVER);
+	err = mesh_link_frame_add(&pending, type, body, len);
+	first = pending.msg_count == 1;
+	k_mutex_unlock(&pending_lock);
+
+	if (err == -ENOMEM) {
+		/* Flush the full frame as soon as possible. */
+		k_work_reschedule(&tx_work, K_NO_WAIT);
+		return -EBUSY;
+	}
+
+	if (err) {
+		return err;
+	}
+
+	if (first) {
+		k_work_schedule(&tx_work, K_USEC(CONFIG_MESH_LINK_UART_BATCH_US));
+	}
+
+	return 0;
+}
+
+int mesh_link_uart_ping(void)
+{
+	uint8_t body[sizeof(ping_token)];
+
+	sys_put_le32(++ping_token, body);
+	ping_sent = k_cycle_get_32();
+
+	return mesh_link_uart_send(MESH_LINK_MSG_PING, body, sizeof(body));
+}
+
+void mesh_link_uart_stats_get(struct mesh_link_uart_stats *out)
+{
+	*out = stats;
+	out->frames_dropped += decoder.errors;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <pid.h>
+
+#if defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+/* Fraction bits carried by the fixed-point integrators beyond the output format. */
+#define INTEG_EXTRA_BITS 16
+
+static inline int32_t sat_q15(int32_t x)
+{
+#if defined(__ARM_FEATURE_SAT)
+	return __ssat(x, 16);
+#else
+	return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x;
+#endif
+}
+
+static inline int32_t sat_q31(int64_t x)
+{
+	return x > INT32_MAX ? INT32_MAX : x < INT32_MIN ? INT32_MIN : (int32_t)x;
+}
+
+static inline int64_t clamp64(int64_t x, int64_t min, int64_t max)
+{
+	return x > max ? max : x < min ? min : x;
+}
+
+static inline float clampf(float x, float min, float max)
+{
+	return x > max ? max : x < min ? min : x;
+}
+
+/* Float */
+
+void pid_f32_init(struct pid_f32 *pid, const struct pid_f32_config *cfg)
+{
+	pid->cfg = *cfg;
+	pid_f32_reset(pid, 0.0f);
+}
+
+void pid_f32_reset(struct pid_f32 *pid, float meas)
+{
+	pid->integ = 0.0f;
+	pid->prev_meas = meas;
+	pid->d_filt = 0.0f;
+}
+
+static inline float f32_update(struct pid_f32 *pid, float sp, float meas, float ff)
+{
+	const struct pid_f32_config *cfg = &pid->cfg;
+	float err = sp - meas;
+	float d = cfg->kd * (pid->prev_meas - meas);
+	float integ = clampf(pid->integ + cfg->ki * err, cfg->out_min, cfg->out_max);
+	float out;
+
+	pid->prev_meas = meas;
+	pid->d_filt += cfg->d_alpha * (d - pid->d_filt);
+
+	out = cfg->kp * err + integ + pid->d_filt + cfg->kff * ff;
+
+	/* Keep the integrator from winding further into saturation. */
+	if (!(out > cfg->out_max && err > 0.0f) && !(out < cfg->out_min && err < 0.0f)) {
+		pid->integ = integ;
+	}
+
+	return clampf(out, cfg->out_min, cfg->out_max);
+}
+
+float pid_f32_update(struct pid_f32 *pid, float sp, float meas, float ff)
+{
+	return f32_update(pid, sp, meas, ff);
+}
+
+void pid_f32_update_batch(struct pid_f32 *pids, const float *sp, const float *meas,
+			  const float *ff, float *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		out[i] = f32_update(&pids[i], sp[i], meas[i], ff ? ff[i] : 0.0f);
+	}
+}
+
+/* Q15 */
+
+void pid_q15_init(struct pid_q15 *pid, const struct pid_q15_config *cfg)
+{
+	pid->cfg = *cfg;
+	if (pid->cfg.shift > PID_SHIFT_MAX) {
+		pid->cfg.shift = PID_SHIFT_MAX;
+	}
+	pid_q15_reset(pid, 0);
+}
+
+void pid_q15_reset(struct pid_q15 *pid, pid_q15_t meas)
+{
+	pid->integ = 0;
+	pid->prev_meas = meas;
+	pid->d_filt = 0;
+}
+
+static inline pid_q15_t q15_update(struct pid_q15 *pid, pid_q15_t sp, pid_q15_t meas,
+				   pid_q15_t ff)
+{
+	const struct pid_q15_config *cfg = &pid->cfg;
+	const int shift = 15 - cfg->shift;
+	int32_t err = sat_q15((int32_t)sp - meas);
+	/* 16 by 16 bit products fit 32 bits, and map to single multiplies on Cortex-M4. */
+	int32_t p = (cfg->kp * err) >> shift;
+	int32_t d = sat_q15((cfg->kd * sat_q15((int32_t)pid->prev_meas - meas)) >> shift);
+	int32_t f = (cfg->kff * ff) >> shift;
+	int64_t integ = clamp64(pid->integ + ((int64_t)(cfg->ki * err) << (cfg->shift + 1)),
+				(int64_t)cfg->out_min << INTEG_EXTRA_BITS,
+				(int64_t)cfg->out_max << INTEG_EXTRA_BITS);
+	int64_t out;
+
+	pid->prev_meas = meas;
+	pid->d_filt += (int32_t)(((int64_t)cfg->d_alpha * (d - pid->d_filt)) >> 15);
+
+	out = (int64_t)p + (integ >> INTEG_EXTRA_BITS) + pid->d_filt + f;
+
+	if (!(out > cfg->out_max && err > 0) && !(out < cfg->out_min && err < 0)) {
+		pid->integ = (int32_t)integ;
+	}
+
+	return (pid_q15_t)clamp64(out, cfg->out_min, cfg->out_max);
+}
+
+pid_q15_t pid_q15_update(struct pid_q15 *pid, pid_q15_t sp, pid_q15_t meas, pid_q15_t ff)
+{
+	return q15_update(pid, sp, meas, ff);
+}
+
+void pid_q15_update_batch(struct pid_q15 *pids, const pid_q15_t *sp, const pid_q15_t *meas,
+			  const pid_q15_t *ff, pid_q15_t *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		out[i] = q15_update(&pids[i], sp[i], meas[i], ff ? ff[i] : 0);
+	}
+}
+
+/* Q31 */
+
+void pid_q31_init(struct pid_q31 *pid, const struct pid_q31_config *cfg)
+{
+	pid->cfg = *cfg;
+	if (pid->cfg.shift > PID_SHIFT_MAX) {
+		pid->cfg.shift = PID_SHIFT_MAX;
+	}
+	pid_q31_reset(pid, 0);
+}
+
+void pid_q31_reset(struct pid_q31 *pid, pid_q31_t meas)
+{
+	pid->integ = 0;
+	pid->prev_meas = meas;
+	pid->d_filt = 0;
+}
+
+static inline pid_q31_t q31_update(struct pid_q31 *pid, pid_q31_t sp, pid_q31_t meas,
+				   pid_q31_t ff)
+{
+	const struct pid_q31_config *cfg = &pid->cfg;
+	const int shift = 31 - cfg->shift;
+	int32_t err = sat_q31((int64_t)sp - meas);
+	int64_t p = ((int64_t)cfg->kp * err) >> shift;
+	int32_t d = sat_q31(((int64_t)cfg->kd * sat_q31((int64_t)pid->prev_meas - meas)) >> shift);
+	int64_t f = ((int64_t)cfg->kff * ff) >> shift;
+	/* The step is at most 2^62 and the clamped integrator 2^47, so the sum fits. */
+	int64_t integ = clamp64(pid->integ + (((int64_t)cfg->ki * err) >>
+					      (15 - cfg->shift)),
+				(int64_t)cfg->out_min << INTEG_EXTRA_BITS,
+				(int64_t)cfg->out_max << INTEG_EXTRA_BITS);
+	int64_t out;
+
+	pid->prev_meas = meas;
+	pid->d_filt += (int32_t)(((int64_t)cfg->d_alpha * ((int64_t)d - pid->d_filt)) >> 31);
+
+	out = p + (integ >> INTEG_EXTRA_BITS) + pid->d_filt + f;
+
+	if (!(out > cfg->out_max && err > 0) && !(out < cfg->out_min && err < 0)) {
+		pid->integ = integ;
+	}
+
+	return (pid_q31_t)clamp64(out, cfg->out_min, cfg->out_max);
+}
+
+pid_q31_t pid_q31_update(struct pid_q31 *pid, pid_q31_t sp, pid_q31_t meas, pid_q31_t ff)
+{
+	return q31_update(pid, sp, meas, ff);
+}
+
+void pid_q31_update_batch(struct pid_q31 *pids, const pid_q31_t *sp, const pid_q31_t *meas,
+			  const pid_q31_t *ff, pid_q31_t *out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		out[i] = q31_update(&pids[i], sp[i], meas[i], ff ? ff[i] : 0);
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _CLOUD_MODULE_EVENT_H_
+#define _CLOUD_MODULE_EVENT_H_
+
+/**
+ * @brief Cloud Event
+ * @defgroup cloud_module_event Cloud Event
+ * @{
+ */
+
+#include <app_event_manager.h>
+#include <app_event_manager_profiler_tracer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum cloud_module_event_type {
+	CLOUD_EVT_CONNECTING,
+	CLOUD_EVT_CONNECTED,
+	CLOUD_EVT_DISCONNECTED,
+	/** Data received from the cloud. The receiver of the event frees the buffer. */
+	CLOUD_EVT_DATA_RECEIVED,
+	/** A batch has been published. Only the length is valid. */
+	CLOUD_EVT_DATA_SENT,
+	/** A batch could not be published. The receiver of the event frees the buffer. */
+	CLOUD_EVT_DATA_UNSENT,
+	/** A STORAGE_EVT_DATA_SEND buffer has been handled. The error is 0 once the broker
+	 *  has acknowledged it. Not sent for a buffer in flight when the connection is lost.
+	 */
+	CLOUD_EVT_BACKLOG_SENT,
+	/** The connection backoff has expired. Internal to the cloud module. */
+	CLOUD_EVT_CONNECTION_RETRY,
+	/** The batch interval has expired. Internal to the cloud module. */
+	CLOUD_EVT_BATCH_TIMEOUT,
+	/** No CONNACK within the connect timeout. Internal to the cloud module. */
+	CLOUD_EVT_CONNECT_TIMEOUT,
+	/** Shutdown stops waiting for PUBACKs. Internal to the cloud module. */
+	CLOUD_EVT_SHUTDOWN_DISCONNECT,
+	/** Unsent data has been handed to the storage module and the broker
+	 *  connection is closed.
+	 */
+	CLOUD_EVT_SHUTDOWN_READY,
+	CLOUD_EVT_ERROR,
+};
+
+struct cloud_module_data {
+	uint8_t *buf;
+	size_t len;
+};
+
+struct cloud_module_event {
+	struct app_event_header header;
+	enum cloud_module_event_type type;
+	union {
+		struct cloud_module_data data;
+		uint32_t id;
+		int err;
+	} data;
+};
+
+APP_EVENT_TYPE_DECLARE(cloud_module_event);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _CLOUD_MODULE_EVENT_H_ */
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <stdio.h>
+
+#include "data_module_event.h"
+
+
+static void profile_data_module_event(struct log_event_buf *buf,
+			      const struct app_event_header *aeh)
+{
+}
+
+APP_EVENT_INFO_DEFINE(data_module_event,
+		  ENCODE(),
+		  ENCODE(),
+		  profile_data_module_event);
+
+APP_EVENT_TYPE_DEFINE(data_module_event,
+		  NULL,
+		  &data_module_event_info,
+		  APP_EVENT_FLAGS_CREATE(APP_EVENT_TYPE_FLAGS_INIT_LOG_ENABLE));
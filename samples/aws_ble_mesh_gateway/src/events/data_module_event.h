@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _DATA_MODULE_EVENT_H_
+#define _DATA_MODULE_EVENT_H_
+
+/**
+ * @brief Data Event
+ * @defgroup data_module_event Data Event
+ * @{
+ */
+
+#include <app_event_manager.h>
+#include <app_event_manager_profiler_tracer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum data_module_event_type {
+	/** Telemetry ready to be sent to the cloud. The buffer is allocated with k_malloc
+	 *  and ownership passes to the receiver of the event, which frees it.
+	 *  Records must be self-delimiting, as several records are published as one batch.
+	 */
+	DATA_EVT_DATA_SEND,
+	/** The telemetry upload window has elapsed. Internal to the data module. */
+	DATA_EVT_UPLOAD_WINDOW,
+	/** The pending upload window has been sent to the cloud module. */
+	DATA_EVT_SHUTDOWN_READY,
+	DATA_EVT_ERROR,
+};
+
+struct data_module_data {
+	uint8_t *buf;
+	size_t len;
+};
+
+struct data_module_event {
+	struct app_event_header header;
+	enum data_module_event_type type;
+	union {
+		struct data_module_data buffer;
+		uint32_t id;
+		int err;
+	} data;
+};
+
+APP_EVENT_TYPE_DECLARE(data_module_event);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _DATA_MODULE_EVENT_H_ */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _MESH_BRIDGE_MODULE_EVENT_H_
+#define _MESH_BRIDGE_MODULE_EVENT_H_
+
+/**
+ * @brief Mesh bridge Event
+ * @defgroup mesh_bridge_module_event Mesh bridge Event
+ * @{
+ */
+
+#include <app_event_manager.h>
+#include <app_event_manager_profiler_tracer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum mesh_bridge_module_event_type {
+	/** A command is ready to be sent to the mesh. */
+	MESH_BRIDGE_EVT_SEND,
+	/** Status report received from a robot. */
+	MESH_BRIDGE_EVT_ROBOT_STATUS,
+	/** A command was not sent, as its destination has not been heard from recently. */
+	MESH_BRIDGE_EVT_UNREACHABLE,
+	/** Airtime may be available for queued commands. Internal to the mesh bridge module. */
+	MESH_BRIDGE_EVT_SCHEDULE,
+	/** Time to remove silent robots from the presence table. Internal to the mesh bridge module. */
+	MESH_BRIDGE_EVT_PRESENCE_EXPIRE,
+	/** Queued commands have been discarded, and the fleet has been stopped. */
+	MESH_BRIDGE_EVT_SHUTDOWN_READY,
+	MESH_BRIDGE_EVT_ERROR,
+};
+
+enum mesh_bridge_cmd_type {
+	/** Movement configuration, see the mesh_bot movement server model. */
+	MESH_BRIDGE_CMD_MOVE = 0x01,
+	/** Start movement, immediately or at a network time instant. */
+	MESH_BRIDGE_CMD_START = 0x02,
+};
+
+/** Command for a robot, or a group of robots, in the mesh. */
+struct mesh_bridge_cmd {
+	/** Destination address. */
+	uint16_t dst;
+	enum mesh_bridge_cmd_type type;
+	/** Transaction ID and sequence number used by the robots to drop duplicates. */
+	uint8_t tid;
+	uint8_t seq;
+	union {
+		struct {
+			uint32_t time;
+			int16_t angle;
+		} move;
+		struct {
+			/** Network time in microseconds, 0 to start immediately. */
+			uint64_t start_time;
+		} start;
+	};
+};
+
+/** Last known status of a robot. */
+struct mesh_bridge_robot_status {
+	uint16_t addr;
+	/** Motor module state of the robot. */
+	uint8_t state;
+	/** Number of relay hops the report travelled. */
+	uint8_t hops;
+	/** RSSI of the last hop in dBm. */
+	int8_t rssi;
+	uint16_t battery_mv;
+};
+
+struct mesh_bridge_module_event {
+	struct app_event_header header;
+	enum mesh_bridge_module_event_type type;
+	union {
+		struct mesh_bridge_cmd cmd;
+		struct mesh_bridge_robot_status status;
+		uint32_t id;
+		int err;
+	} data;
+};
+
+APP_EVENT_TYPE_DECLARE(mesh_bridge_module_event);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _MESH_BRIDGE_MODULE_EVENT_H_ */
@@ -15,6 +15,7 @@
 
 #include <app_event_manager.h>
 #include <app_event_manager_profiler_tracer.h>
+#include <modem/lte_lc.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,19 @@ enum modem_module_event_type {
 	MODEM_EVT_LTE_CONNECTING,
 	MODEM_EVT_LTE_CONNECTED,
 	MODEM_EVT_LTE_DISCONNECTED,
+	MODEM_EVT_LTE_CELL_UPDATE,
+	MODEM_EVT_LTE_PSM_UPDATE,
+	MODEM_EVT_LTE_EDRX_UPDATE,
+	/** No downlink traffic for a while. Internal to the modem module. */
+	MODEM_EVT_DOWNLINK_IDLE,
+	/** The connection attempt has timed out. Internal to the modem module. */
+	MODEM_EVT_CONNECT_TIMEOUT,
+	/** The connection backoff has expired. Internal to the modem module. */
+	MODEM_EVT_CONNECT_RETRY,
+	/** The modem reports that the supply voltage is critically low. */
+	MODEM_EVT_BATTERY_LOW,
+	/** The modem has been powered off. */
+	MODEM_EVT_SHUTDOWN_READY,
 	MODEM_EVT_ERROR,
 };
 
@@ -33,6 +47,10 @@ struct modem_module_event {
 	struct app_event_header header;
 	enum modem_module_event_type type;
 	union {
+		struct lte_lc_cell cell;
+		struct lte_lc_psm_cfg psm;
+		struct lte_lc_edrx_cfg edrx;
+		uint32_t id;
 		int err;
 	} data;
 };
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _STORAGE_MODULE_EVENT_H_
+#define _STORAGE_MODULE_EVENT_H_
+
+/**
+ * @brief Storage Event
+ * @defgroup storage_module_event Storage Event
+ * @{
+ */
+
+#include <app_event_manager.h>
+#include <app_event_manager_profiler_tracer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum storage_module_event_type {
+	/** Stored telemetry ready to be published. The buffer is owned by the
+	 *  storage module and stays valid until CLOUD_EVT_BACKLOG_SENT is received.
+	 *  It may point directly into flash.
+	 */
+	STORAGE_EVT_DATA_SEND,
+	/** The write buffer should be written to flash. Internal to the storage module. */
+	STORAGE_EVT_FLUSH,
+	/** The backlog drain should be retried. Internal to the storage module. */
+	STORAGE_EVT_DRAIN,
+	/** The write buffer has been written to flash. */
+	STORAGE_EVT_SHUTDOWN_READY,
+	STORAGE_EVT_ERROR,
+};
+
+struct storage_module_data {
+	const uint8_t *buf;
+	size_t len;
+};
+
+struct storage_module_event {
+	struct app_event_header header;
+	enum storage_module_event_type type;
+	union {
+		struct storage_module_data buffer;
+		uint32_t id;
+		int err;
+	} data;
+};
+
+APP_EVENT_TYPE_DECLARE(storage_module_event);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _STORAGE_MODULE_EVENT_H_ */
@@ -23,8 +23,11 @@ extern "C" {
 
 
 enum ui_module_event_type {
+	/** A debounced button has changed state. */
 	UI_EVT_BUTTON,
+	/** Request to show a pattern on an LED. Handled by the UI module. */
 	UI_EVT_LED,
+	UI_EVT_SHUTDOWN_READY,
 	UI_EVT_ERROR,
 };
 
@@ -32,6 +35,8 @@ struct ui_button {
 	enum buton_num {
 		BTN1 = DK_BTN1,
 		BTN2,
+		BTN3,
+		BTN4,
 	} num;
 	enum button_action {
 		BUTTON_PRESS,
@@ -41,10 +46,20 @@ struct ui_button {
 
 struct ui_led {
 	int num;
-	enum led_action {
-		LED_ON,
+	enum led_pattern {
 		LED_OFF,
-	} action;
+		LED_ON,
+		LED_BLINK_SLOW,
+		LED_BLINK_FAST,
+		LED_BREATHE,
+		/** Short flash every few seconds. */
+		LED_HEARTBEAT,
+		/** N flashes followed by a pause. */
+		LED_STATUS_CODE_1,
+		LED_STATUS_CODE_2,
+		LED_STATUS_CODE_3,
+		LED_PATTERN_COUNT,
+	} pattern;
 };
 
 struct ui_module_event {
@@ -53,6 +68,7 @@ struct ui_module_event {
 	union {
 		struct ui_button button;
 		struct ui_led led;
+		uint32_t id;
 		int err;
 	} data;
 };
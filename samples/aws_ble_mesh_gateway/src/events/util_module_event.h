@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef _UTIL_MODULE_EVENT_H_
+#define _UTIL_MODULE_EVENT_H_
+
+/**
+ * @brief Util Event
+ * @defgroup util_module_event Util Event
+ * @{
+ */
+
+#include <app_event_manager.h>
+#include <app_event_manager_profiler_tracer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum util_module_event_type {
+	/** The application is shutting down. Every module that supports shutdown
+	 *  flushes its buffers and acknowledges with its SHUTDOWN_READY event.
+	 */
+	UTIL_EVT_SHUTDOWN_REQUEST,
+	/** The shutdown deadline has expired. Internal to the util module. */
+	UTIL_EVT_SHUTDOWN_DEADLINE,
+};
+
+enum shutdown_reason {
+	/** Reboot after an unrecoverable error. */
+	REASON_GENERIC,
+	/** Power off until the battery is replaced or charged. */
+	REASON_LOW_BATTERY,
+};
+
+struct util_module_event {
+	struct app_event_header header;
+	enum util_module_event_type type;
+	union {
+		enum shutdown_reason reason;
+	} data;
+};
+
+APP_EVENT_TYPE_DECLARE(util_module_event);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* _UTIL_MODULE_EVENT_H_ */
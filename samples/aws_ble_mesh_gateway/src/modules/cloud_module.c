@@ -0,0 +1,1078 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/mqtt.h>
+
+#define MODULE cloud_module
+
+#include "modules_common.h"
+#include "app_module_event.h"
+#include "cloud_module_event.h"
+#include "data_module_event.h"
+#include "modem_module_event.h"
+#include "storage_module_event.h"
+#include "util_module_event.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(MODULE, CONFIG_CLOUD_MODULE_LOG_LEVEL);
+
+/* Cloud module super states. */
+static enum state_type {
+	STATE_LTE_DISCONNECTED,
+	STATE_LTE_CONNECTED,
+} state;
+
+/* Cloud module sub states. */
+static enum sub_state_type {
+	SUB_STATE_CLOUD_DISCONNECTED,
+	SUB_STATE_CLOUD_CONNECTING,
+	SUB_STATE_CLOUD_CONNECTED,
+} sub_state;
+
+struct cloud_msg_data {
+	union {
+		struct app_module_event app;
+		struct cloud_module_event cloud;
+		struct data_module_event data;
+		struct modem_module_event modem;
+		struct storage_module_event storage;
+		struct util_module_event util;
+	} module;
+};
+
+/* Cloud module message queue. */
+#define CLOUD_QUEUE_ENTRY_COUNT		20
+#define CLOUD_QUEUE_BYTE_ALIGNMENT	4
+
+K_MSGQ_DEFINE(msgq_cloud, sizeof(struct cloud_msg_data),
+	      CLOUD_QUEUE_ENTRY_COUNT, CLOUD_QUEUE_BYTE_ALIGNMENT);
+
+static struct module_data self = {
+	.name = "cloud",
+	.msg_q = &msgq_cloud,
+	.supports_shutdown = true,
+};
+
+/* MQTT client and buffers. */
+static struct mqtt_client client;
+static struct sockaddr_storage broker;
+static uint8_t rx_buffer[CONFIG_CLOUD_MQTT_MESSAGE_BUFFER_SIZE];
+static uint8_t tx_buffer[CONFIG_CLOUD_MQTT_MESSAGE_BUFFER_SIZE];
+
+/* Outgoing records are concatenated in the batch buffer and published
+ * together once per batch interval, or when the buffer is full.
+ */
+static uint8_t batch_buf[CONFIG_CLOUD_BATCH_BUFFER_SIZE];
+static size_t batch_len;
+static uint32_t batch_records;
+
+/* QoS 1 publications waiting for PUBACK. Accessed from the module thread and
+ * from the MQTT poll thread.
+ */
+static struct in_flight {
+	uint16_t message_id;
+	int64_t sent_at;
+	/* The payload is a STORAGE_EVT_DATA_SEND entry. */
+	bool backlog;
+	/* Copy of a batch payload, handed to the storage module if the
+	 * publication is not acknowledged. NULL for backlog entries.
+	 */
+	uint8_t *buf;
+	size_t len;
+} in_flight[CONFIG_CLOUD_MQTT_MAX_IN_FLIGHT];
+static struct k_spinlock in_flight_lock;
+
+/* Last message ID handed out, under in_flight_lock. */
+static uint16_t last_message_id;
+
+/* Number of consecutive failed connection attempts. */
+static uint32_t connect_retries;
+
+static bool shutdown_requested;
+
+/* Signals the poll thread that a connection has been set up. */
+static K_SEM_DEFINE(poll_sem, 0, 1);
+
+/* Given by the poll thread once it no longer uses the client, so the client is not
+ * initialized again under it. mqtt_client_init() also initializes the mutex the MQTT
+ * library uses to serialize calls from the module thread and the poll thread.
+ */
+static K_SEM_DEFINE(poll_idle_sem, 1, 1);
+
+/* Time for the poll thread to notice that the socket has been closed. */
+#define POLL_STOP_TIMEOUT K_SECONDS(1)
+
+static void connection_retry_work_fn(struct k_work *work)
+{
+	SEND_EVENT(cloud, CLOUD_EVT_CONNECTION_RETRY);
+}
+
+static void batch_work_fn(struct k_work *work)
+{
+	SEND_EVENT(cloud, CLOUD_EVT_BATCH_TIMEOUT);
+}
+
+static void connect_timeout_work_fn(struct k_work *work)
+{
+	SEND_EVENT(cloud, CLOUD_EVT_CONNECT_TIMEOUT);
+}
+
+static K_WORK_DELAYABLE_DEFINE(connection_retry_work, connection_retry_work_fn);
+static K_WORK_DELAYABLE_DEFINE(batch_work, batch_work_fn);
+static void shutdown_work_fn(struct k_work *work)
+{
+	SEND_EVENT(cloud, CLOUD_EVT_SHUTDOWN_DISCONNECT);
+}
+
+static K_WORK_DELAYABLE_DEFINE(connect_timeout_work, connect_timeout_work_fn);
+static K_WORK_DELAYABLE_DEFINE(shutdown_work, shutdown_work_fn);
+
+/* Convenience functions used in internal state handling. */
+static char *state2str(enum state_type state)
+{
+	switch (state) {
+	case STATE_LTE_DISCONNECTED:
+		return "STATE_LTE_DISCONNECTED";
+	case STATE_LTE_CONNECTED:
+		return "STATE_LTE_CONNECTED";
+	default:
+		return "Unknown state";
+	}
+}
+
+static char *sub_state2str(enum sub_state_type new_state)
+{
+	switch (new_state) {
+	case SUB_STATE_CLOUD_DISCONNECTED:
+		return "SUB_STATE_CLOUD_DISCONNECTED";
+	case SUB_STATE_CLOUD_CONNECTING:
+		return "SUB_STATE_CLOUD_CONNECTING";
+	case SUB_STATE_CLOUD_CONNECTED:
+		return "SUB_STATE_CLOUD_CONNECTED";
+	default:
+		return "Unknown sub state";
+	}
+}
+
+static void state_set(enum state_type new_state)
+{
+	if (new_state == state) {
+		LOG_DBG("State: %s", state2str(state));
+		return;
+	}
+
+	LOG_DBG("State transition %s --> %s",
+		state2str(state),
+		state2str(new_state));
+
+	state = new_state;
+}
+
+static void sub_state_set(enum sub_state_type new_state)
+{
+	if (new_state == sub_state) {
+		LOG_DBG("Sub state: %s", sub_state2str(sub_state));
+		return;
+	}
+
+	LOG_DBG("Sub state transition %s --> %s",
+		sub_state2str(sub_state),
+		sub_state2str(new_state));
+
+	sub_state = new_state;
+}
+
+/* Message IDs are used by the module thread and the poll thread. 0 is not allowed. */
+static uint16_t message_id_get(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&in_flight_lock);
+
+	last_message_id = last_message_id == UINT16_MAX ? 1 : last_message_id + 1;
+
+	uint16_t message_id = last_message_id;
+
+	k_spin_unlock(&in_flight_lock, key);
+	return message_id;
+}
+
+/* Stop waiting for PUBACKs if shutdown() is waiting for them. */
+static void shutdown_wait_end(void)
+{
+	if (k_work_delayable_is_pending(&shutdown_work)) {
+		k_work_reschedule(&shutdown_work, K_NO_WAIT);
+	}
+}
+
+/* In-flight tracking */
+static int in_flight_add(uint16_t message_id, bool backlog, uint8_t *buf, size_t len)
+{
+	int err = -ENOBUFS;
+	k_spinlock_key_t key = k_spin_lock(&in_flight_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i].message_id == 0) {
+			in_flight[i].message_id = message_id;
+			in_flight[i].sent_at = k_uptime_get();
+			in_flight[i].backlog = backlog;
+			in_flight[i].buf = buf;
+			in_flight[i].len = len;
+			err = 0;
+			break;
+		}
+	}
+
+	k_spin_unlock(&in_flight_lock, key);
+	return err;
+}
+
+static void in_flight_ack(uint16_t message_id)
+{
+	int64_t latency = -1;
+	bool backlog = false;
+	bool empty = true;
+	uint8_t *buf = NULL;
+	k_spinlock_key_t key = k_spin_lock(&in_flight_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i].message_id == message_id) {
+			latency = k_uptime_get() - in_flight[i].sent_at;
+			backlog = in_flight[i].backlog;
+			buf = in_flight[i].buf;
+			in_flight[i].message_id = 0;
+			in_flight[i].buf = NULL;
+		} else if (in_flight[i].message_id != 0) {
+			empty = false;
+		}
+	}
+
+	k_spin_unlock(&in_flight_lock, key);
+
+	k_free(buf);
+
+	if (empty) {
+		shutdown_wait_end();
+	}
+
+	if (latency < 0) {
+		LOG_WRN("PUBACK for unknown message ID %d", message_id);
+		return;
+	}
+
+	LOG_DBG("Message ID %d acknowledged after %lld ms", message_id, latency);
+
+	/* Only now may the storage module drop the entry from flash. */
+	if (backlog) {
+		struct cloud_module_event *event = new_cloud_module_event();
+
+		event->type = CLOUD_EVT_BACKLOG_SENT;
+		event->data.err = 0;
+		APP_EVENT_SUBMIT(event);
+	}
+}
+
+static bool in_flight_full(void)
+{
+	bool full = true;
+	k_spinlock_key_t key = k_spin_lock(&in_flight_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i].message_id == 0) {
+			full = false;
+			break;
+		}
+	}
+
+	k_spin_unlock(&in_flight_lock, key);
+	return full;
+}
+
+static bool in_flight_empty(void)
+{
+	bool empty = true;
+	k_spinlock_key_t key = k_spin_lock(&in_flight_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		if (in_flight[i].message_id != 0) {
+			empty = false;
+			break;
+		}
+	}
+
+	k_spin_unlock(&in_flight_lock, key);
+	return empty;
+}
+
+/* Forget the publications waiting for PUBACK. Batches are handed to the storage
+ * module, to be published again. Backlog entries stay in flash, the storage
+ * module rewinds to them on disconnect.
+ */
+static void in_flight_clear(void)
+{
+	uint32_t lost = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(in_flight); i++) {
+		k_spinlock_key_t key = k_spin_lock(&in_flight_lock);
+		uint16_t message_id = in_flight[i].message_id;
+		bool backlog = in_flight[i].backlog;
+		uint8_t *buf = in_flight[i].buf;
+		size_t len = in_flight[i].len;
+
+		in_flight[i].message_id = 0;
+		in_flight[i].buf = NULL;
+		k_spin_unlock(&in_flight_lock, key);
+
+		if (message_id == 0 || backlog) {
+			continue;
+		}
+
+		if (buf == NULL) {
+			lost++;
+			continue;
+		}
+
+		struct cloud_module_event *event = new_cloud_module_event();
+
+		event->type = CLOUD_EVT_DATA_UNSENT;
+		event->data.data.buf = buf;
+		event->data.data.len = len;
+		APP_EVENT_SUBMIT(event);
+	}
+
+	if (lost) {
+		LOG_WRN("%d unacknowledged publications lost", lost);
+	}
+
+	shutdown_wait_end();
+}
+
+/* MQTT */
+
+/* Returns true if the message was handed to the application, so it may be acknowledged.
+ * Otherwise the broker delivers it again.
+ */
+static bool data_received(const struct mqtt_publish_param *p)
+{
+	size_t len = p->message.payload.len;
+	uint8_t *buf = k_malloc(len);
+	int err;
+
+	if (buf == NULL) {
+		LOG_ERR("No memory for %zu byte message", len);
+		/* Drain the payload from the socket anyway. */
+		uint8_t discard[32];
+
+		while (len) {
+			size_t chunk = MIN(len, sizeof(discard));
+
+			err = mqtt_read_publish_payload_blocking(&client, discard, chunk);
+			if (err <= 0) {
+				break;
+			}
+			len -= err;
+		}
+		return false;
+	}
+
+	err = mqtt_readall_publish_payload(&client, buf, len);
+	if (err) {
+		LOG_ERR("mqtt_readall_publish_payload, error: %d", err);
+		k_free(buf);
+		return false;
+	}
+
+	struct cloud_module_event *event = new_cloud_module_event();
+
+	event->type = CLOUD_EVT_DATA_RECEIVED;
+	event->data.data.buf = buf;
+	event->data.data.len = len;
+	APP_EVENT_SUBMIT(event);
+	return true;
+}
+
+static void mqtt_evt_handler(struct mqtt_client *const c, const struct mqtt_evt *evt)
+{
+	int err;
+
+	switch (evt->type) {
+	case MQTT_EVT_CONNACK: {
+		if (evt->result != 0) {
+			LOG_ERR("MQTT connect failed: %d", evt->result);
+			break;
+		}
+
+		struct mqtt_topic topic = {
+			.topic = {
+				.utf8 = CONFIG_CLOUD_MQTT_SUB_TOPIC,
+				.size = sizeof(CONFIG_CLOUD_MQTT_SUB_TOPIC) - 1,
+			},
+			.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+		};
+		const struct mqtt_subscription_list list = {
+			.list = &topic,
+			.list_count = 1,
+			.message_id = message_id_get(),
+		};
+
+		err = mqtt_subscribe(c, &list);
+		if (err) {
+			LOG_ERR("mqtt_subscribe, error: %d", err);
+		}
+
+		SEND_EVENT(cloud, CLOUD_EVT_CONNECTED);
+		break;
+	}
+	case MQTT_EVT_DISCONNECT: {
+		SEND_EVENT(cloud, CLOUD_EVT_DISCONNECTED);
+		break;
+	}
+	case MQTT_EVT_PUBLISH: {
+		const struct mqtt_publish_param *p = &evt->param.publish;
+
+		if (data_received(p) && p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+			const struct mqtt_puback_param ack = {
+				.message_id = p->message_id,
+			};
+
+			mqtt_publish_qos1_ack(c, &ack);
+		}
+		break;
+	}
+	case MQTT_EVT_PUBACK:
+		in_flight_ack(evt->param.puback.message_id);
+		break;
+	case MQTT_EVT_SUBACK:
+		LOG_DBG("Subscribed to %s", CONFIG_CLOUD_MQTT_SUB_TOPIC);
+		break;
+	default:
+		break;
+	}
+}
+
+static int broker_init(void)
+{
+	struct addrinfo *result;
+	struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct sockaddr_in *broker4 = (struct sockaddr_in *)&broker;
+	int err;
+
+	err = getaddrinfo(CONFIG_CLOUD_MQTT_BROKER_HOSTNAME, NULL, &hints, &result);
+	if (err) {
+		LOG_ERR("getaddrinfo, error: %d", err);
+		return -ECHILD;
+	}
+
+	broker4->sin_family = AF_INET;
+	broker4->sin_port = htons(CONFIG_CLOUD_MQTT_BROKER_PORT);
+	broker4->sin_addr.s_addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+
+	freeaddrinfo(result);
+	return 0;
+}
+
+static void client_init(void)
+{
+	mqtt_client_init(&client);
+
+	client.broker = &broker;
+	client.evt_cb = mqtt_evt_handler;
+	client.client_id.utf8 = CONFIG_CLOUD_MQTT_CLIENT_ID;
+	client.client_id.size = sizeof(CONFIG_CLOUD_MQTT_CLIENT_ID) - 1;
+	client.protocol_version = MQTT_VERSION_3_1_1;
+	client.rx_buf = rx_buffer;
+	client.rx_buf_size = sizeof(rx_buffer);
+	client.tx_buf = tx_buffer;
+	client.tx_buf_size = sizeof(tx_buffer);
+	client.transport.type = MQTT_TRANSPORT_NON_SECURE;
+}
+
+static int cloud_connect(void)
+{
+	int err;
+
+	SEND_EVENT(cloud, CLOUD_EVT_CONNECTING);
+
+	err = broker_init();
+	if (err) {
+		return err;
+	}
+
+	if (k_sem_take(&poll_idle_sem, POLL_STOP_TIMEOUT)) {
+		LOG_ERR("MQTT poll thread still running");
+		return -EBUSY;
+	}
+
+	client_init();
+
+	err = mqtt_connect(&client);
+	if (err) {
+		LOG_ERR("mqtt_connect, error: %d", err);
+		k_sem_give(&poll_idle_sem);
+		return err;
+	}
+
+	k_sem_give(&poll_sem);
+	return 0;
+}
+
+/* Close the connection, politely if the broker has accepted it. Either way the
+ * socket is closed, which ends the poll thread.
+ */
+static void cloud_disconnect(void)
+{
+	if (sub_state == SUB_STATE_CLOUD_CONNECTED) {
+		mqtt_disconnect(&client);
+	} else {
+		mqtt_abort(&client);
+	}
+}
+
+/* Schedule the next connection attempt with exponential backoff and jitter,
+ * so a fleet of gateways does not reconnect in lockstep after an outage.
+ */
+static void connection_retry_schedule(void)
+{
+	uint32_t shift = MIN(connect_retries, 16);
+	uint32_t delay = MIN(CONFIG_CLOUD_CONNECT_BACKOFF_BASE_SEC << shift,
+			     CONFIG_CLOUD_CONNECT_BACKOFF_MAX_SEC) * MSEC_PER_SEC;
+
+	delay = delay / 2 + sys_rand32_get() % (delay / 2 + 1);
+	connect_retries++;
+
+	LOG_INF("Reconnecting to broker in %d ms, attempt %d", delay, connect_retries);
+	k_work_reschedule(&connection_retry_work, K_MSEC(delay));
+}
+
+static void connect_or_retry(void)
+{
+	int err = cloud_connect();
+
+	if (err) {
+		sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+		connection_retry_schedule();
+		return;
+	}
+
+	k_work_reschedule(&connect_timeout_work, K_SECONDS(CONFIG_CLOUD_CONNACK_TIMEOUT_SEC));
+	sub_state_set(SUB_STATE_CLOUD_CONNECTING);
+}
+
+static int publish(uint8_t *buf, size_t len, bool backlog)
+{
+	uint16_t message_id;
+	int err;
+
+	if (CONFIG_CLOUD_MQTT_PUBLISH_QOS > 0 && in_flight_full()) {
+		return -EBUSY;
+	}
+
+	message_id = message_id_get();
+
+	/* The batch buffer is reused once published, keep a copy to store if the
+	 * broker never acknowledges it.
+	 */
+	uint8_t *copy = NULL;
+
+	if (CONFIG_CLOUD_MQTT_PUBLISH_QOS > 0 && !backlog) {
+		copy = k_malloc(len);
+		if (copy == NULL) {
+			LOG_WRN("No memory to keep %zu bytes until acknowledged", len);
+		} else {
+			memcpy(copy, buf, len);
+		}
+	}
+
+	struct mqtt_publish_param param = {
+		.message.topic.qos = CONFIG_CLOUD_MQTT_PUBLISH_QOS,
+		.message.topic.topic.utf8 = CONFIG_CLOUD_MQTT_PUB_TOPIC,
+		.message.topic.topic.size = sizeof(CONFIG_CLOUD_MQTT_PUB_TOPIC) - 1,
+		.message.payload.data = buf,
+		.message.payload.len = len,
+		.message_id = message_id,
+	};
+
+	err = mqtt_publish(&client, &param);
+	if (err) {
+		LOG_ERR("mqtt_publish, error: %d", err);
+		k_free(copy);
+		return err;
+	}
+
+	if (CONFIG_CLOUD_MQTT_PUBLISH_QOS > 0) {
+		in_flight_add(message_id, backlog, copy, len);
+	}
+
+	return 0;
+}
+
+/* Stored entries may be read straight from flash, so they are published from a copy. */
+static int backlog_publish(const uint8_t *buf, size_t len)
+{
+	uint8_t *payload = k_malloc(len);
+	int err;
+
+	if (payload == NULL) {
+		LOG_WRN("No memory to publish %zu stored bytes", len);
+		return -ENOMEM;
+	}
+
+	memcpy(payload, buf, len);
+	err = publish(payload, len, true);
+	k_free(payload);
+	return err;
+}
+
+/* Batching */
+static int batch_publish(void)
+{
+	int err;
+
+	if (batch_len == 0) {
+		return 0;
+	}
+
+	err = publish(batch_buf, batch_len, false);
+	if (err == -EBUSY) {
+		LOG_DBG("Too many publications in flight, keeping %zu bytes batched", batch_len);
+	}
+	if (err) {
+		return err;
+	}
+
+	LOG_DBG("Published %d records in %zu bytes", batch_records, batch_len);
+
+	struct cloud_module_event *event = new_cloud_module_event();
+
+	event->type = CLOUD_EVT_DATA_SENT;
+	event->data.data.buf = NULL;
+	event->data.data.len = batch_len;
+	APP_EVENT_SUBMIT(event);
+
+	batch_len = 0;
+	batch_records = 0;
+	return 0;
+}
+
+/* Hand the batch over to the storage module, to be published from flash
+ * once the broker is reachable again.
+ */
+static void batch_store(void)
+{
+	if (batch_len == 0) {
+		return;
+	}
+
+	uint8_t *buf = k_malloc(batch_len);
+
+	if (buf == NULL) {
+		LOG_WRN("No memory to store batch, dropping %d records", batch_records);
+	} else {
+		memcpy(buf, batch_buf, batch_len);
+
+		struct cloud_module_event *event = new_cloud_module_event();
+
+		event->type = CLOUD_EVT_DATA_UNSENT;
+		event->data.data.buf = buf;
+		event->data.data.len = batch_len;
+		APP_EVENT_SUBMIT(event);
+	}
+
+	batch_len = 0;
+	batch_records = 0;
+}
+
+static void batch_add(struct data_module_data *data)
+{
+	if (data->len > sizeof(batch_buf)) {
+		LOG_ERR("Record of %zu bytes does not fit the batch buffer", data->len);
+		goto exit;
+	}
+
+	if (batch_len + data->len > sizeof(batch_buf)) {
+		if (sub_state != SUB_STATE_CLOUD_CONNECTED || batch_publish()) {
+			batch_store();
+		}
+	}
+
+	if (batch_len == 0) {
+		k_work_reschedule(&batch_work, K_SECONDS(CONFIG_CLOUD_BATCH_INTERVAL_SEC));
+	}
+
+	memcpy(&batch_buf[batch_len], data->buf, data->len);
+	batch_len += data->len;
+	batch_records++;
+
+exit:
+	k_free(data->buf);
+}
+
+/* Leave the broker, handing what is still unacknowledged to the storage module. */
+static void shutdown_finish(void)
+{
+	static bool done;
+
+	if (done) {
+		return;
+	}
+
+	done = true;
+	k_work_cancel_delayable(&shutdown_work);
+	k_work_cancel_delayable(&connection_retry_work);
+
+	if (sub_state != SUB_STATE_CLOUD_DISCONNECTED) {
+		cloud_disconnect();
+	}
+
+	in_flight_clear();
+
+	state_set(STATE_LTE_DISCONNECTED);
+	sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+
+	SEND_SHUTDOWN_ACK(cloud, CLOUD_EVT_SHUTDOWN_READY, self.id);
+}
+
+/* Publish or store what is batched, and wait for the publications in flight to
+ * be acknowledged. Called once the data module has handed over its last records.
+ */
+static void shutdown(void)
+{
+	k_work_cancel_delayable(&batch_work);
+	k_work_cancel_delayable(&connection_retry_work);
+	k_work_cancel_delayable(&connect_timeout_work);
+
+	if (sub_state != SUB_STATE_CLOUD_CONNECTED || batch_publish()) {
+		batch_store();
+	}
+
+	if (sub_state != SUB_STATE_CLOUD_CONNECTED || in_flight_empty()) {
+		shutdown_finish();
+		return;
+	}
+
+	/* Ended early by the last PUBACK or a disconnect. Checked again after
+	 * scheduling, in case the last PUBACK came in between.
+	 */
+	k_work_reschedule(&shutdown_work, K_SECONDS(CONFIG_CLOUD_SHUTDOWN_PUBACK_TIMEOUT_SEC));
+
+	if (in_flight_empty()) {
+		shutdown_wait_end();
+	}
+}
+
+/* Handlers */
+static bool app_event_handler(const struct app_event_header *aeh)
+{
+	struct cloud_msg_data msg = {0};
+	bool enqueue_msg = false;
+
+	if (is_app_module_event(aeh)) {
+		struct app_module_event *evt = cast_app_module_event(aeh);
+
+		msg.module.app = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_cloud_module_event(aeh)) {
+		struct cloud_module_event *evt = cast_cloud_module_event(aeh);
+
+		msg.module.cloud = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_data_module_event(aeh)) {
+		struct data_module_event *evt = cast_data_module_event(aeh);
+
+		msg.module.data = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_modem_module_event(aeh)) {
+		struct modem_module_event *evt = cast_modem_module_event(aeh);
+
+		msg.module.modem = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_storage_module_event(aeh)) {
+		struct storage_module_event *evt = cast_storage_module_event(aeh);
+
+		if (evt->type == STORAGE_EVT_DATA_SEND) {
+			msg.module.storage = *evt;
+			enqueue_msg = true;
+		}
+	}
+
+	if (is_util_module_event(aeh)) {
+		struct util_module_event *evt = cast_util_module_event(aeh);
+
+		msg.module.util = *evt;
+		enqueue_msg = true;
+	}
+
+	if (enqueue_msg) {
+		int err = module_enqueue_msg(&self, &msg);
+
+		if (err) {
+			LOG_ERR("Message could not be enqueued");
+			SEND_ERROR(cloud, CLOUD_EVT_ERROR, err);
+		}
+	}
+
+	return false;
+}
+
+/* Message handler for SUB_STATE_CLOUD_DISCONNECTED. */
+static void on_sub_state_cloud_disconnected(struct cloud_msg_data *msg)
+{
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_CONNECTION_RETRY)) {
+		connect_or_retry();
+	}
+}
+
+/* Message handler for SUB_STATE_CLOUD_CONNECTING. */
+static void on_sub_state_cloud_connecting(struct cloud_msg_data *msg)
+{
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_CONNECTED)) {
+		LOG_INF("Connected to broker");
+		k_work_cancel_delayable(&connect_timeout_work);
+		connect_retries = 0;
+		sub_state_set(SUB_STATE_CLOUD_CONNECTED);
+		batch_publish();
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DISCONNECTED)) {
+		k_work_cancel_delayable(&connect_timeout_work);
+		sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+		connection_retry_schedule();
+	}
+
+	/* The socket is closed, the disconnect event it causes arrives after the state change
+	 * and is ignored.
+	 */
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_CONNECT_TIMEOUT)) {
+		LOG_WRN("No CONNACK from broker");
+		mqtt_abort(&client);
+		sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+		connection_retry_schedule();
+	}
+}
+
+/* Message handler for SUB_STATE_CLOUD_CONNECTED. */
+static void on_sub_state_cloud_connected(struct cloud_msg_data *msg)
+{
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_BATCH_TIMEOUT)) {
+		int err = batch_publish();
+
+		if (err == -EBUSY) {
+			k_work_reschedule(&batch_work, K_SECONDS(CONFIG_CLOUD_BATCH_INTERVAL_SEC));
+		} else if (err) {
+			batch_store();
+		}
+	}
+
+	if (IS_EVENT(msg, storage, STORAGE_EVT_DATA_SEND)) {
+		int err = backlog_publish(msg->module.storage.data.buffer.buf,
+					  msg->module.storage.data.buffer.len);
+
+		/* With QoS 1, success is reported when the PUBACK arrives. */
+		if (err || CONFIG_CLOUD_MQTT_PUBLISH_QOS == 0) {
+			struct cloud_module_event *event = new_cloud_module_event();
+
+			event->type = CLOUD_EVT_BACKLOG_SENT;
+			event->data.err = err;
+			APP_EVENT_SUBMIT(event);
+		}
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DISCONNECTED)) {
+		LOG_WRN("Disconnected from broker");
+		in_flight_clear();
+		sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+		connection_retry_schedule();
+	}
+}
+
+/* Message handler for STATE_LTE_DISCONNECTED. */
+static void on_state_lte_disconnected(struct cloud_msg_data *msg)
+{
+	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_CONNECTED) && !shutdown_requested) {
+		state_set(STATE_LTE_CONNECTED);
+		connect_retries = 0;
+		connect_or_retry();
+	}
+}
+
+/* Message handler for STATE_LTE_CONNECTED. */
+static void on_state_lte_connected(struct cloud_msg_data *msg)
+{
+	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_DISCONNECTED)) {
+		state_set(STATE_LTE_DISCONNECTED);
+		k_work_cancel_delayable(&connection_retry_work);
+		k_work_cancel_delayable(&connect_timeout_work);
+
+		if (sub_state != SUB_STATE_CLOUD_DISCONNECTED) {
+			cloud_disconnect();
+			in_flight_clear();
+		}
+
+		sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+		return;
+	}
+
+	switch (sub_state) {
+	case SUB_STATE_CLOUD_DISCONNECTED:
+		on_sub_state_cloud_disconnected(msg);
+		break;
+	case SUB_STATE_CLOUD_CONNECTING:
+		on_sub_state_cloud_connecting(msg);
+		break;
+	case SUB_STATE_CLOUD_CONNECTED:
+		on_sub_state_cloud_connected(msg);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Message handler for all states. */
+static void on_all_states(struct cloud_msg_data *msg)
+{
+	if (IS_EVENT(msg, app, APP_EVT_START) && IS_ENABLED(CONFIG_CLOUD_CONNECT_ON_START)) {
+		/* No LTE link to wait for, e.g. when running on a host network. */
+		state_set(STATE_LTE_CONNECTED);
+		connect_or_retry();
+	}
+
+	if (IS_EVENT(msg, data, DATA_EVT_DATA_SEND)) {
+		batch_add(&msg->module.data.data.buffer);
+	}
+
+	if (IS_EVENT(msg, util, UTIL_EVT_SHUTDOWN_REQUEST)) {
+		shutdown_requested = true;
+	}
+
+	if (IS_EVENT(msg, data, DATA_EVT_SHUTDOWN_READY) && shutdown_requested) {
+		shutdown();
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_SHUTDOWN_DISCONNECT)) {
+		shutdown_finish();
+	}
+
+	if (sub_state == SUB_STATE_CLOUD_CONNECTED) {
+		return;
+	}
+
+	/* Not connected to the broker, keep nothing in RAM longer than a batch interval. */
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_BATCH_TIMEOUT)) {
+		batch_store();
+	}
+
+	if (IS_EVENT(msg, storage, STORAGE_EVT_DATA_SEND)) {
+		struct cloud_module_event *event = new_cloud_module_event();
+
+		event->type = CLOUD_EVT_BACKLOG_SENT;
+		event->data.err = -ENOTCONN;
+		APP_EVENT_SUBMIT(event);
+	}
+}
+
+static void poll_thread_fn(void)
+{
+	while (true) {
+		k_sem_take(&poll_sem, K_FOREVER);
+
+		struct pollfd fds = {
+			.fd = client.transport.tcp.sock,
+			.events = POLLIN,
+		};
+
+		while (true) {
+			int err = poll(&fds, 1, mqtt_keepalive_time_left(&client));
+
+			if (err < 0) {
+				LOG_ERR("poll, error: %d", errno);
+				break;
+			}
+
+			if (err == 0) {
+				mqtt_live(&client);
+				continue;
+			}
+
+			if ((fds.revents & POLLIN) && mqtt_input(&client)) {
+				break;
+			}
+
+			if (fds.revents & (POLLNVAL | POLLERR | POLLHUP)) {
+				break;
+			}
+		}
+
+		/* Reports MQTT_EVT_DISCONNECT unless the connection is already closed. The
+		 * module thread may abort at the same time, the MQTT library serializes both.
+		 */
+		mqtt_abort(&client);
+		k_sem_give(&poll_idle_sem);
+	}
+}
+
+static void module_thread_fn(void)
+{
+	int err;
+	struct cloud_msg_data msg;
+
+	self.thread_id = k_current_get();
+
+	err = module_start(&self);
+	if (err) {
+		LOG_ERR("Failed starting module, error: %d", err);
+		SEND_ERROR(cloud, CLOUD_EVT_ERROR, err);
+	}
+
+	state_set(STATE_LTE_DISCONNECTED);
+	sub_state_set(SUB_STATE_CLOUD_DISCONNECTED);
+
+	while (true) {
+		module_get_next_msg(&self, &msg);
+
+		switch (state) {
+		case STATE_LTE_DISCONNECTED:
+			on_state_lte_disconnected(&msg);
+			break;
+		case STATE_LTE_CONNECTED:
+			on_state_lte_connected(&msg);
+			break;
+		default:
+			break;
+		}
+
+		on_all_states(&msg);
+	}
+}
+
+K_THREAD_DEFINE(cloud_module_thread, CONFIG_CLOUD_THREAD_STACK_SIZE,
+		module_thread_fn, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+K_THREAD_DEFINE(cloud_poll_thread, CONFIG_CLOUD_POLL_THREAD_STACK_SIZE,
+		poll_thread_fn, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, app_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, cloud_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, data_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, modem_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, storage_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
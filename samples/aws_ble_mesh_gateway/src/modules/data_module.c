@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zcbor_encode.h>
+
+#define MODULE data_module
+
+#include "modules_common.h"
+#include "data_module_event.h"
+#include "mesh_bridge_module_event.h"
+#include "util_module_event.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(MODULE, CONFIG_DATA_MODULE_LOG_LEVEL);
+
+struct data_msg_data {
+	union {
+		struct data_module_event data;
+		struct mesh_bridge_module_event mesh_bridge;
+		struct util_module_event util;
+	} module;
+};
+
+/* Data module message queue. */
+#define DATA_QUEUE_ENTRY_COUNT		10
+#define DATA_QUEUE_BYTE_ALIGNMENT	4
+
+K_MSGQ_DEFINE(msgq_data, sizeof(struct data_msg_data),
+	      DATA_QUEUE_ENTRY_COUNT, DATA_QUEUE_BYTE_ALIGNMENT);
+
+static struct module_data self = {
+	.name = "data",
+	.msg_q = &msgq_data,
+	.supports_shutdown = true,
+};
+
+/* Telemetry payload
+ *
+ * One CBOR map per upload window. Key 0 holds the window number shifted left
+ * by one, with bit 0 set for keyframes. Every other key is a robot unicast
+ * address, mapping to a map of the fields that changed since the last upload,
+ * keyed by enum robot_field. Keyframes contain all fields of all robots.
+ */
+enum robot_field {
+	FIELD_STATE,
+	FIELD_BATTERY_MV,
+	FIELD_RSSI,
+	FIELD_HOPS,
+	FIELD_COUNT,
+};
+
+#define HEADER_KEY 0
+
+static struct robot {
+	struct mesh_bridge_robot_status current;
+	/* Status as last uploaded. */
+	struct mesh_bridge_robot_status reported;
+	/* Fields changed since the last upload, BIT(enum robot_field). */
+	uint8_t dirty;
+} robots[CONFIG_DATA_MAX_ROBOTS];
+
+static uint32_t window;
+
+/* Uptime the next keyframe is due at. */
+static int64_t keyframe_at;
+
+static struct {
+	int64_t since;
+	uint32_t bytes;
+	uint32_t uploads;
+	uint32_t last_encode_cycles;
+} upload_stats;
+
+static void window_work_fn(struct k_work *work)
+{
+	SEND_EVENT(data, DATA_EVT_UPLOAD_WINDOW);
+}
+
+static K_WORK_DELAYABLE_DEFINE(window_work, window_work_fn);
+
+/* Close the window early, so the keyframe goes out even if no status changed. */
+static void keyframe_work_fn(struct k_work *work)
+{
+	k_work_reschedule(&window_work, K_NO_WAIT);
+}
+
+static K_WORK_DELAYABLE_DEFINE(keyframe_work, keyframe_work_fn);
+
+static int32_t field_get(const struct mesh_bridge_robot_status *status, enum robot_field field)
+{
+	switch (field) {
+	case FIELD_STATE:
+		return status->state;
+	case FIELD_BATTERY_MV:
+		return status->battery_mv;
+	case FIELD_RSSI:
+		return status->rssi;
+	case FIELD_HOPS:
+		return status->hops;
+	default:
+		return 0;
+	}
+}
+
+/* Noisy fields are only reported once they move outside a deadband. */
+static int32_t field_deadband(enum robot_field field)
+{
+	switch (field) {
+	case FIELD_BATTERY_MV:
+		return CONFIG_DATA_BATTERY_DEADBAND_MV;
+	case FIELD_RSSI:
+		return CONFIG_DATA_RSSI_DEADBAND_DB;
+	default:
+		return 0;
+	}
+}
+
+static struct robot *robot_get(uint16_t addr)
+{
+	for (int i = 0; i < ARRAY_SIZE(robots); i++) {
+		if (robots[i].current.addr == addr || robots[i].current.addr == 0) {
+			return &robots[i];
+		}
+	}
+	return NULL;
+}
+
+static void status_update(const struct mesh_bridge_robot_status *status)
+{
+	struct robot *robot = robot_get(status->addr);
+
+	if (robot == NULL) {
+		LOG_WRN("Robot table full, ignoring status from 0x%04x", status->addr);
+		return;
+	}
+
+	bool is_new = robot->current.addr == 0;
+
+	robot->current = *status;
+
+	for (enum robot_field field = 0; field < FIELD_COUNT; field++) {
+		int32_t change = field_get(status, field) - field_get(&robot->reported, field);
+
+		if (is_new || abs(change) > field_deadband(field)) {
+			robot->dirty |= BIT(field);
+		}
+	}
+
+	if (robot->dirty && !k_work_delayable_is_pending(&window_work)) {
+		k_work_reschedule(&window_work, K_SECONDS(CONFIG_DATA_UPLOAD_INTERVAL_SEC));
+	}
+}
+
+static bool robot_encode(zcbor_state_t *state, struct robot *robot, uint8_t fields)
+{
+	bool ok = zcbor_uint32_put(state, robot->current.addr) &&
+		  zcbor_map_start_encode(state, FIELD_COUNT);
+
+	for (enum robot_field field = 0; ok && field < FIELD_COUNT; field++) {
+		if (fields & BIT(field)) {
+			ok = zcbor_uint32_put(state, field) &&
+			     zcbor_int32_put(state, field_get(&robot->current, field));
+		}
+	}
+
+	return ok && zcbor_map_end_encode(state, FIELD_COUNT);
+}
+
+static int encode(uint8_t *buf, size_t size, size_t *len, bool keyframe)
+{
+	ZCBOR_STATE_E(state, 2, buf, size, 1);
+	bool ok = zcbor_map_start_encode(state, ARRAY_SIZE(robots) + 1) &&
+		  zcbor_uint32_put(state, HEADER_KEY) &&
+		  zcbor_uint32_put(state, (window << 1) | keyframe);
+
+	for (int i = 0; ok && i < ARRAY_SIZE(robots); i++) {
+		struct robot *robot = &robots[i];
+		uint8_t fields = keyframe ? BIT_MASK(FIELD_COUNT) : robot->dirty;
+
+		if (robot->current.addr == 0 || fields == 0) {
+			continue;
+		}
+
+		ok = robot_encode(state, robot, fields);
+	}
+
+	if (!ok || !zcbor_map_end_encode(state, ARRAY_SIZE(robots) + 1)) {
+		return -ENOMEM;
+	}
+
+	*len = state->payload - buf;
+	return 0;
+}
+
+static void upload(void)
+{
+	static uint8_t encode_buf[CONFIG_DATA_ENCODE_BUFFER_SIZE];
+	bool keyframe = window == 0 || k_uptime_get() >= keyframe_at;
+	uint32_t start = k_cycle_get_32();
+	size_t len;
+	int err;
+
+	err = encode(encode_buf, sizeof(encode_buf), &len, keyframe);
+	upload_stats.last_encode_cycles = k_cycle_get_32() - start;
+	if (err) {
+		LOG_ERR("Telemetry does not fit in %zu bytes", sizeof(encode_buf));
+		SEND_ERROR(data, DATA_EVT_ERROR, err);
+		return;
+	}
+
+	uint8_t *buf = k_malloc(len);
+
+	if (buf == NULL) {
+		LOG_ERR("No memory for %zu byte telemetry payload", len);
+		return;
+	}
+
+	memcpy(buf, encode_buf, len);
+
+	struct data_module_event *event = new_data_module_event();
+
+	event->type = DATA_EVT_DATA_SEND;
+	event->data.buffer.buf = buf;
+	event->data.buffer.len = len;
+	APP_EVENT_SUBMIT(event);
+
+	uint32_t robot_count = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(robots); i++) {
+		if (robots[i].current.addr != 0) {
+			robots[i].reported = robots[i].current;
+			robots[i].dirty = 0;
+			robot_count++;
+		}
+	}
+
+	if (keyframe) {
+		keyframe_at = k_uptime_get() + CONFIG_DATA_KEYFRAME_INTERVAL_SEC * MSEC_PER_SEC;
+		k_work_reschedule(&keyframe_work, K_SECONDS(CONFIG_DATA_KEYFRAME_INTERVAL_SEC));
+	}
+
+	window++;
+	upload_stats.bytes += len;
+	upload_stats.uploads++;
+
+	int64_t elapsed = k_uptime_get() - upload_stats.since;
+
+	LOG_INF("Window %d: %zu bytes%s, encoded in %d cycles", window - 1, len,
+		keyframe ? " (keyframe)" : "", upload_stats.last_encode_cycles);
+
+	if (robot_count && elapsed > 0) {
+		LOG_INF("%lld bytes per robot per minute over %d uploads",
+			((int64_t)upload_stats.bytes * MSEC_PER_SEC * 60) / (robot_count * elapsed),
+			upload_stats.uploads);
+	}
+}
+
+/* Encode a synthetic fleet to measure encoder cost without waiting for real traffic. */
+static void encoder_benchmark(void)
+{
+	static uint8_t bench_buf[CONFIG_DATA_ENCODE_BUFFER_SIZE];
+	size_t full_len, delta_len;
+	uint32_t start, full_cycles, delta_cycles;
+
+	for (int i = 0; i < ARRAY_SIZE(robots); i++) {
+		robots[i].current = (struct mesh_bridge_robot_status) {
+			.addr = 0x0100 + i,
+			.state = 1,
+			.hops = 2,
+			.rssi = -60,
+			.battery_mv = 3700,
+		};
+		robots[i].dirty = (i % 4) == 0 ? BIT(FIELD_BATTERY_MV) : 0;
+	}
+
+	start = k_cycle_get_32();
+	encode(bench_buf, sizeof(bench_buf), &full_len, true);
+	full_cycles = k_cycle_get_32() - start;
+
+	start = k_cycle_get_32();
+	encode(bench_buf, sizeof(bench_buf), &delta_len, false);
+	delta_cycles = k_cycle_get_32() - start;
+
+	LOG_INF("Encoder benchmark, %d robots: keyframe %zu bytes in %d cycles, "
+		"25%% changed %zu bytes in %d cycles",
+		ARRAY_SIZE(robots), full_len, full_cycles, delta_len, delta_cycles);
+
+	memset(robots, 0, sizeof(robots));
+}
+
+/* Handlers */
+static bool app_event_handler(const struct app_event_header *aeh)
+{
+	struct data_msg_data msg = {0};
+	bool enqueue_msg = false;
+
+	if (is_data_module_event(aeh)) {
+		struct data_module_event *evt = cast_data_module_event(aeh);
+
+		if (evt->type == DATA_EVT_UPLOAD_WINDOW) {
+			msg.module.data = *evt;
+			enqueue_msg = true;
+		}
+	}
+
+	if (is_mesh_bridge_module_event(aeh)) {
+		struct mesh_bridge_module_event *evt = cast_mesh_bridge_module_event(aeh);
+
+		if (evt->type == MESH_BRIDGE_EVT_ROBOT_STATUS) {
+			msg.module.mesh_bridge = *evt;
+			enqueue_msg = true;
+		}
+	}
+
+	if (is_util_module_event(aeh)) {
+		struct util_module_event *evt = cast_util_module_event(aeh);
+
+		msg.module.util = *evt;
+		enqueue_msg = true;
+	}
+
+	if (enqueue_msg) {
+		int err = module_enqueue_msg(&self, &msg);
+
+		if (err) {
+			LOG_ERR("Message could not be enqueued");
+			SEND_ERROR(data, DATA_EVT_ERROR, err);
+		}
+	}
+
+	return false;
+}
+
+/* Message handler for all states. */
+static void on_all_states(struct data_msg_data *msg)
+{
+	if (IS_EVENT(msg, mesh_bridge, MESH_BRIDGE_EVT_ROBOT_STATUS)) {
+		status_update(&msg->module.mesh_bridge.data.status);
+	}
+
+	if (IS_EVENT(msg, data, DATA_EVT_UPLOAD_WINDOW)) {
+		upload();
+	}
+
+	if (IS_EVENT(msg, util, UTIL_EVT_SHUTDOWN_REQUEST)) {
+		k_work_cancel_delayable(&keyframe_work);
+
+		/* Do not wait for the window to close. */
+		if (k_work_delayable_is_pending(&window_work)) {
+			k_work_cancel_delayable(&window_work);
+			upload();
+		}
+
+		SEND_SHUTDOWN_ACK(data, DATA_EVT_SHUTDOWN_READY, self.id);
+	}
+}
+
+static void module_thread_fn(void)
+{
+	int err;
+	struct data_msg_data msg;
+
+	self.thread_id = k_current_get();
+
+	err = module_start(&self);
+	if (err) {
+		LOG_ERR("Failed starting module, error: %d", err);
+		SEND_ERROR(data, DATA_EVT_ERROR, err);
+	}
+
+	if (IS_ENABLED(CONFIG_DATA_ENCODER_BENCHMARK)) {
+		encoder_benchmark();
+	}
+
+	upload_stats.since = k_uptime_get();
+
+	while (true) {
+		module_get_next_msg(&self, &msg);
+		on_all_states(&msg);
+	}
+}
+
+K_THREAD_DEFINE(data_module_thread, CONFIG_DATA_THREAD_STACK_SIZE,
+		module_thread_fn, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, data_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, mesh_bridge_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
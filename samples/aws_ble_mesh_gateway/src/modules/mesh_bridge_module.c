@@ -0,0 +1,777 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/byteorder.h>
+#if defined(CONFIG_MESH_LINK_UART)
+#include <mesh_link_uart.h>
+#endif
+
+#define MODULE mesh_bridge_module
+
+#include "modules_common.h"
+#include "cloud_module_event.h"
+#include "mesh_bridge_module_event.h"
+#include "util_module_event.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(MODULE, CONFIG_MESH_BRIDGE_MODULE_LOG_LEVEL);
+
+struct mesh_bridge_msg_data {
+	union {
+		struct cloud_module_event cloud;
+		struct mesh_bridge_module_event mesh_bridge;
+		struct util_module_event util;
+	} module;
+};
+
+/* Mesh bridge module message queue. */
+#define MESH_BRIDGE_QUEUE_ENTRY_COUNT		10
+#define MESH_BRIDGE_QUEUE_BYTE_ALIGNMENT	4
+
+K_MSGQ_DEFINE(msgq_mesh_bridge, sizeof(struct mesh_bridge_msg_data),
+	      MESH_BRIDGE_QUEUE_ENTRY_COUNT, MESH_BRIDGE_QUEUE_BYTE_ALIGNMENT);
+
+static void msg_free(void *msg);
+
+static struct module_data self = {
+	.name = "mesh_bridge",
+	.msg_q = &msgq_mesh_bridge,
+	.supports_shutdown = true,
+	.msg_free = msg_free,
+};
+
+/* Cloud command records, little endian:
+ *
+ *   MESH_BRIDGE_CMD_MOVE:  type (1), dst (2), time in ms (4), angle in degrees (2)
+ *   MESH_BRIDGE_CMD_START: type (1), dst (2), network start time in us (6), 0 for immediately
+ */
+#define CMD_RECORD_LEN 9
+
+/* Token bucket in millitokens. Every message costs one token per transmission
+ * along the relay path, and the bucket holds no more than the mesh
+ * advertising buffers can absorb.
+ */
+#define TOKEN_COST		(1000 * (CONFIG_MESH_BRIDGE_RELAY_DEPTH + 1))
+#define BUCKET_CAPACITY		(1000 * MAX(CONFIG_MESH_BRIDGE_ADV_BUF_COUNT, CONFIG_MESH_BRIDGE_RELAY_DEPTH + 1))
+/* Millitokens gained per millisecond. */
+#define TOKEN_RATE		(1000 / CONFIG_MESH_BRIDGE_PDU_AIRTIME_MS)
+
+static struct token_bucket {
+	uint32_t tokens;
+	int64_t last_refill;
+} bucket = {
+	.tokens = BUCKET_CAPACITY,
+};
+
+/* Commands waiting for airtime, oldest first. */
+static struct mesh_bridge_cmd queue[CONFIG_MESH_BRIDGE_QUEUE_SIZE];
+static size_t queue_len;
+
+/* Per-destination delivery state. */
+enum delivery_state {
+	DELIVERY_IDLE,
+	DELIVERY_QUEUED,
+	DELIVERY_SENT,
+	DELIVERY_DROPPED,
+	DELIVERY_UNREACHABLE,
+};
+
+static struct delivery {
+	uint16_t addr;
+	enum delivery_state state;
+	int64_t last_sent;
+	uint32_t sent;
+	uint32_t merged;
+	uint32_t dropped;
+	uint32_t unreachable;
+} deliveries[CONFIG_MESH_BRIDGE_MAX_ROBOTS];
+
+/* Robots heard from recently, by unicast address. Open addressing with linear
+ * probing, so lookups and updates take constant time on average. Entries are
+ * removed by shifting the rest of their probe sequence back, which keeps the
+ * table free of tombstones.
+ */
+#define PRESENCE_SIZE		CONFIG_MESH_BRIDGE_PRESENCE_TABLE_SIZE
+#define PRESENCE_MASK		(PRESENCE_SIZE - 1)
+#define PRESENCE_MAX_COUNT	(PRESENCE_SIZE * 3 / 4)
+#define PRESENCE_TIMEOUT_MS	(CONFIG_MESH_BRIDGE_PRESENCE_TIMEOUT_SEC * MSEC_PER_SEC)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(PRESENCE_SIZE), "Presence table size must be a power of two");
+
+static struct presence {
+	/* 0 for free slots. */
+	uint16_t addr;
+	uint8_t hops;
+	int8_t rssi;
+	uint32_t last_seen;
+} presence[PRESENCE_SIZE];
+
+static size_t presence_count;
+/* Uptime when any robot was last heard from. */
+static int64_t presence_heard;
+
+/* Transaction ID and sequence number of the next command. */
+static uint8_t tid;
+static uint8_t seq;
+
+static bool shutdown_requested;
+/* The fleet stop is queued, acknowledge the shutdown once it has been sent. */
+static bool shutdown_pending;
+
+static void schedule_work_fn(struct k_work *work)
+{
+	SEND_EVENT(mesh_bridge, MESH_BRIDGE_EVT_SCHEDULE);
+}
+
+static K_WORK_DELAYABLE_DEFINE(schedule_work, schedule_work_fn);
+
+static void presence_work_fn(struct k_work *work)
+{
+	SEND_EVENT(mesh_bridge, MESH_BRIDGE_EVT_PRESENCE_EXPIRE);
+}
+
+static K_WORK_DELAYABLE_DEFINE(presence_work, presence_work_fn);
+
+static inline bool addr_is_unicast(uint16_t addr)
+{
+	return addr != 0 && addr < 0x8000;
+}
+
+/* Fibonacci hashing, robots pick addresses in strides of their element count. */
+static inline size_t presence_slot(uint16_t addr)
+{
+	return ((addr * 2654435769u) >> 16) & PRESENCE_MASK;
+}
+
+static struct presence *presence_find(uint16_t addr)
+{
+	for (size_t i = presence_slot(addr); presence[i].addr; i = (i + 1) & PRESENCE_MASK) {
+		if (presence[i].addr == addr) {
+			return &presence[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void presence_update(uint16_t addr, uint8_t hops, int8_t rssi)
+{
+	size_t i = presence_slot(addr);
+
+	if (!addr_is_unicast(addr)) {
+		return;
+	}
+
+	while (presence[i].addr && presence[i].addr != addr) {
+		i = (i + 1) & PRESENCE_MASK;
+	}
+
+	if (presence[i].addr == 0) {
+		if (presence_count == PRESENCE_MAX_COUNT) {
+			LOG_WRN("Presence table full, not tracking 0x%04x", addr);
+			return;
+		}
+
+		presence_count++;
+		LOG_INF("Robot 0x%04x online, %d hops, %zu robots online", addr, hops, presence_count);
+	}
+
+	presence[i].addr = addr;
+	presence[i].hops = hops;
+	presence[i].rssi = rssi;
+	presence[i].last_seen = k_uptime_get_32();
+	presence_heard = k_uptime_get();
+}
+
+static void presence_remove(size_t i)
+{
+	size_t j = i;
+
+	presence[i].addr = 0;
+	presence_count--;
+
+	/* Move back every following entry whose probe sequence passes the free slot. */
+	while (true) {
+		j = (j + 1) & PRESENCE_MASK;
+
+		if (presence[j].addr == 0) {
+			break;
+		}
+
+		size_t home = presence_slot(presence[j].addr);
+
+		if (((j - home) & PRESENCE_MASK) >= ((j - i) & PRESENCE_MASK)) {
+			presence[i] = presence[j];
+			presence[j].addr = 0;
+			i = j;
+		}
+	}
+}
+
+static void presence_expire(void)
+{
+	uint32_t now = k_uptime_get_32();
+
+	for (size_t i = 0; i < ARRAY_SIZE(presence); i++) {
+		/* A removal may move another entry into this slot, check it again. */
+		while (presence[i].addr && now - presence[i].last_seen > PRESENCE_TIMEOUT_MS) {
+			LOG_INF("Robot 0x%04x offline, last seen %d ms ago", presence[i].addr,
+				now - presence[i].last_seen);
+			presence_remove(i);
+		}
+	}
+
+	k_work_reschedule(&presence_work, K_MSEC(PRESENCE_TIMEOUT_MS / 4));
+}
+
+/* Group addresses are always reachable. Robots are not considered offline until
+ * the gateway has been listening for a full timeout, and only while the mesh
+ * radio reports robot status at all.
+ */
+static bool is_reachable(uint16_t dst)
+{
+	int64_t now = k_uptime_get();
+
+	return !addr_is_unicast(dst) ||
+	       now < PRESENCE_TIMEOUT_MS ||
+	       presence_heard == 0 || now - presence_heard > PRESENCE_TIMEOUT_MS ||
+	       presence_find(dst) != NULL;
+}
+
+static struct delivery *delivery_get(uint16_t addr)
+{
+	struct delivery *free_entry = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(deliveries); i++) {
+		if (deliveries[i].addr == addr) {
+			return &deliveries[i];
+		}
+		if (free_entry == NULL && deliveries[i].addr == 0) {
+			free_entry = &deliveries[i];
+		}
+	}
+
+	if (free_entry) {
+		free_entry->addr = addr;
+	} else {
+		LOG_WRN("Delivery table full, not tracking 0x%04x", addr);
+	}
+
+	return free_entry;
+}
+
+static void delivery_update(uint16_t addr, enum delivery_state new_state)
+{
+	struct delivery *delivery = delivery_get(addr);
+
+	if (delivery == NULL) {
+		return;
+	}
+
+	delivery->state = new_state;
+
+	switch (new_state) {
+	case DELIVERY_SENT:
+		delivery->sent++;
+		delivery->last_sent = k_uptime_get();
+		break;
+	case DELIVERY_DROPPED:
+		delivery->dropped++;
+		break;
+	case DELIVERY_UNREACHABLE:
+		delivery->unreachable++;
+		break;
+	default:
+		break;
+	}
+}
+
+/* Mesh link
+ *
+ * Commands are passed to the mesh radio over the mesh link. Robot status comes
+ * back the same way.
+ */
+#if defined(CONFIG_MESH_LINK_UART)
+
+/* Time to wait for a congested link. */
+#define LINK_RETRY_MS 10
+
+BUILD_ASSERT(MESH_BRIDGE_CMD_MOVE == MESH_LINK_CMD_MOVE &&
+	     MESH_BRIDGE_CMD_START == MESH_LINK_CMD_START);
+
+static void link_msg_received(uint8_t type, const uint8_t *body, size_t len, void *user_data)
+{
+	struct mesh_bridge_module_event *event;
+
+	switch (type) {
+	case MESH_LINK_MSG_STATUS:
+		if (len < MESH_LINK_STATUS_LEN) {
+			break;
+		}
+
+		event = new_mesh_bridge_module_event();
+		event->type = MESH_BRIDGE_EVT_ROBOT_STATUS;
+		event->data.status.addr = sys_get_le16(&body[0]);
+		event->data.status.state = body[2];
+		event->data.status.hops = body[3];
+		event->data.status.rssi = (int8_t)body[4];
+		event->data.status.battery_mv = sys_get_le16(&body[5]);
+		APP_EVENT_SUBMIT(event);
+		break;
+	default:
+		LOG_DBG("Unknown link message type %d", type);
+		break;
+	}
+}
+
+/* The commands in frames given up on may not have reached the robots. */
+static void link_frames_lost(uint8_t frames)
+{
+	LOG_ERR("Mesh radio did not acknowledge %d frames of commands", frames);
+}
+
+static int link_send(const struct mesh_bridge_cmd *cmd)
+{
+	uint8_t body[MESH_LINK_CMD_LEN] = {0};
+
+	sys_put_le16(cmd->dst, &body[0]);
+	body[2] = cmd->type;
+	body[3] = cmd->tid;
+	body[4] = cmd->seq;
+
+	switch (cmd->type) {
+	case MESH_BRIDGE_CMD_MOVE:
+		sys_put_le32(cmd->move.time, &body[5]);
+		sys_put_le16(cmd->move.angle, &body[9]);
+		break;
+	case MESH_BRIDGE_CMD_START:
+		sys_put_le48(cmd->start.start_time, &body[5]);
+		break;
+	}
+
+	return mesh_link_uart_send(MESH_LINK_MSG_CMD, body, sizeof(body));
+}
+
+/* Ping the mesh radio and log the link counters, once per interval. */
+static void link_stats_work_fn(struct k_work *work)
+{
+	static struct mesh_link_uart_stats last;
+	static int64_t last_time;
+	struct mesh_link_uart_stats stats;
+	int64_t now = k_uptime_get();
+	int64_t elapsed = MAX(now - last_time, 1);
+
+	mesh_link_uart_stats_get(&stats);
+
+	LOG_INF("Link: %lld msg/s out, %lld msg/s in, RTT %d us (min %d, max %d)",
+		(int64_t)(stats.msgs_tx - last.msgs_tx) * MSEC_PER_SEC / elapsed,
+		(int64_t)(stats.msgs_rx - last.msgs_rx) * MSEC_PER_SEC / elapsed,
+		stats.rtt_us, stats.rtt_min_us, stats.rtt_max_us);
+
+	if (stats.frames_dropped || stats.frames_lost || stats.ack_timeouts || stats.rx_overruns) {
+		LOG_WRN("Link: %d frames dropped, %d lost, %d ack timeouts, %d resent, %d failed, "
+			"%d bytes overrun", stats.frames_dropped, stats.frames_lost, stats.ack_timeouts,
+			stats.frames_resent, stats.frames_failed, stats.rx_overruns);
+	}
+
+	last = stats;
+	last_time = now;
+
+	(void)mesh_link_uart_ping();
+	k_work_reschedule(k_work_delayable_from_work(work),
+			  K_SECONDS(CONFIG_MESH_BRIDGE_LINK_STATS_INTERVAL_SEC));
+}
+
+static K_WORK_DELAYABLE_DEFINE(link_stats_work, link_stats_work_fn);
+
+static int link_init(void)
+{
+	int err = mesh_link_uart_init(link_msg_received, link_frames_lost);
+
+	if (err) {
+		LOG_ERR("mesh_link_uart_init, error: %d", err);
+		return err;
+	}
+
+	k_work_reschedule(&link_stats_work, K_NO_WAIT);
+	return 0;
+}
+
+#else
+
+#define LINK_RETRY_MS 0
+
+static int link_send(const struct mesh_bridge_cmd *cmd)
+{
+	return 0;
+}
+
+static int link_init(void)
+{
+	return 0;
+}
+
+#endif /* CONFIG_MESH_LINK_UART */
+
+static void cmd_unreachable(const struct mesh_bridge_cmd *cmd)
+{
+	struct mesh_bridge_module_event *event = new_mesh_bridge_module_event();
+
+	LOG_WRN("0x%04x is offline, not sending command", cmd->dst);
+
+	event->type = MESH_BRIDGE_EVT_UNREACHABLE;
+	event->data.cmd = *cmd;
+	APP_EVENT_SUBMIT(event);
+
+	delivery_update(cmd->dst, DELIVERY_UNREACHABLE);
+}
+
+static void bucket_refill(void)
+{
+	int64_t now = k_uptime_get();
+	int64_t gained = (now - bucket.last_refill) * TOKEN_RATE;
+
+	bucket.tokens = MIN(bucket.tokens + gained, BUCKET_CAPACITY);
+	bucket.last_refill = now;
+}
+
+/* Group addresses may include any robot, so their commands are ordered against
+ * every other command.
+ */
+static inline bool cmd_dst_overlap(uint16_t a, uint16_t b)
+{
+	return a == b || !addr_is_unicast(a) || !addr_is_unicast(b);
+}
+
+/* Queue a command, merging it with a pending command of the same type for the
+ * same destination. Only the newest movement or start for a destination matters.
+ * The merged command takes the place of the pending one, so it is not merged past
+ * any other command for robots it reaches.
+ */
+static void cmd_enqueue(const struct mesh_bridge_cmd *cmd)
+{
+	if (!is_reachable(cmd->dst)) {
+		cmd_unreachable(cmd);
+		return;
+	}
+
+	for (size_t i = queue_len; i-- > 0;) {
+		if (!cmd_dst_overlap(queue[i].dst, cmd->dst)) {
+			continue;
+		}
+
+		if (queue[i].dst == cmd->dst && queue[i].type == cmd->type) {
+			uint8_t merged_tid = queue[i].tid;
+			uint8_t merged_seq = queue[i].seq;
+
+			queue[i] = *cmd;
+			queue[i].tid = merged_tid;
+			queue[i].seq = merged_seq;
+
+			struct delivery *delivery = delivery_get(cmd->dst);
+
+			if (delivery) {
+				delivery->merged++;
+			}
+			return;
+		}
+		/* A different command is pending for these robots, keep the order. */
+		break;
+	}
+
+	if (queue_len == ARRAY_SIZE(queue)) {
+		LOG_WRN("Command queue full, dropping command for 0x%04x", cmd->dst);
+		delivery_update(cmd->dst, DELIVERY_DROPPED);
+		return;
+	}
+
+	queue[queue_len] = *cmd;
+	queue[queue_len].tid = tid;
+	queue[queue_len].seq = seq;
+	queue_len++;
+
+	/* Robots compare sequence numbers within a window of 127 */
+	if (++seq == 0x80) {
+		seq = 0;
+		tid++;
+	}
+
+	delivery_update(cmd->dst, DELIVERY_QUEUED);
+}
+
+/* Send as many queued commands as the token bucket and the mesh link allow,
+ * and come back when the next token is available or the link has room.
+ * Commands for robots that went offline while waiting are dropped without
+ * using airtime.
+ */
+static void cmd_schedule(void)
+{
+	bool link_busy = false;
+	size_t kept = 0;
+	int err;
+
+	bucket_refill();
+
+	for (size_t i = 0; i < queue_len; i++) {
+		if (!is_reachable(queue[i].dst)) {
+			cmd_unreachable(&queue[i]);
+			continue;
+		}
+
+		if (bucket.tokens < TOKEN_COST || link_busy) {
+			queue[kept++] = queue[i];
+			continue;
+		}
+
+		err = link_send(&queue[i]);
+		if (err == -EBUSY) {
+			link_busy = true;
+			queue[kept++] = queue[i];
+			continue;
+		} else if (err) {
+			LOG_ERR("Failed to pass command for 0x%04x to the mesh radio, error: %d",
+				queue[i].dst, err);
+			delivery_update(queue[i].dst, DELIVERY_DROPPED);
+			continue;
+		}
+
+		struct mesh_bridge_module_event *event = new_mesh_bridge_module_event();
+
+		event->type = MESH_BRIDGE_EVT_SEND;
+		event->data.cmd = queue[i];
+		APP_EVENT_SUBMIT(event);
+
+		delivery_update(queue[i].dst, DELIVERY_SENT);
+		bucket.tokens -= TOKEN_COST;
+	}
+
+	queue_len = kept;
+
+	if (shutdown_pending && queue_len == 0) {
+		shutdown_pending = false;
+		SEND_SHUTDOWN_ACK(mesh_bridge, MESH_BRIDGE_EVT_SHUTDOWN_READY, self.id);
+		return;
+	}
+
+	if (queue_len) {
+		uint32_t wait = bucket.tokens < TOKEN_COST ?
+				DIV_ROUND_UP(TOKEN_COST - bucket.tokens, TOKEN_RATE) : LINK_RETRY_MS;
+
+		k_work_reschedule(&schedule_work, K_MSEC(wait));
+	}
+}
+
+static int cmd_parse(struct net_buf_simple *buf, struct mesh_bridge_cmd *cmd)
+{
+	cmd->type = net_buf_simple_pull_u8(buf);
+	cmd->dst = net_buf_simple_pull_le16(buf);
+
+	switch (cmd->type) {
+	case MESH_BRIDGE_CMD_MOVE:
+		cmd->move.time = net_buf_simple_pull_le32(buf);
+		cmd->move.angle = (int16_t)net_buf_simple_pull_le16(buf);
+		return 0;
+	case MESH_BRIDGE_CMD_START:
+		cmd->start.start_time = sys_get_le48(net_buf_simple_pull_mem(buf, 6));
+		return 0;
+	default:
+		net_buf_simple_pull(buf, CMD_RECORD_LEN - 3);
+		return -EINVAL;
+	}
+}
+
+/* Replace whatever the robots have been told to do next with a movement of zero
+ * length, started right away. Robots already moving finish their movement.
+ */
+static void fleet_stop(void)
+{
+	const struct mesh_bridge_cmd cmds[] = {
+		{
+			.dst = CONFIG_MESH_BRIDGE_FLEET_GROUP_ADDR,
+			.type = MESH_BRIDGE_CMD_MOVE,
+			.move = { .time = 0, .angle = 0 },
+		},
+		{
+			.dst = CONFIG_MESH_BRIDGE_FLEET_GROUP_ADDR,
+			.type = MESH_BRIDGE_CMD_START,
+			.start = { .start_time = 0 },
+		},
+	};
+
+	tid++;
+	seq = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(cmds); i++) {
+		cmd_enqueue(&cmds[i]);
+	}
+}
+
+static void cloud_data_handle(struct cloud_module_data *data)
+{
+	struct net_buf_simple buf;
+	struct mesh_bridge_cmd cmd;
+
+	if (data->len % CMD_RECORD_LEN) {
+		LOG_ERR("Command payload of %zu bytes is not a whole number of records", data->len);
+		goto exit;
+	}
+
+	net_buf_simple_init_with_data(&buf, data->buf, data->len);
+
+	/* Commands from one download form a transaction. */
+	tid++;
+	seq = 0;
+
+	while (buf.len) {
+		if (cmd_parse(&buf, &cmd)) {
+			LOG_ERR("Unknown command type %d", cmd.type);
+			continue;
+		}
+
+		cmd_enqueue(&cmd);
+	}
+
+	cmd_schedule();
+
+exit:
+	k_free(data->buf);
+}
+
+/* Called for messages dropped from a full queue. */
+static void msg_free(void *msg)
+{
+	struct mesh_bridge_msg_data *data = msg;
+
+	if (IS_EVENT(data, cloud, CLOUD_EVT_DATA_RECEIVED)) {
+		k_free(data->module.cloud.data.data.buf);
+	}
+}
+
+/* Handlers */
+static bool app_event_handler(const struct app_event_header *aeh)
+{
+	struct mesh_bridge_msg_data msg = {0};
+	bool enqueue_msg = false;
+
+	if (is_cloud_module_event(aeh)) {
+		struct cloud_module_event *evt = cast_cloud_module_event(aeh);
+
+		msg.module.cloud = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_mesh_bridge_module_event(aeh)) {
+		struct mesh_bridge_module_event *evt = cast_mesh_bridge_module_event(aeh);
+
+		if (evt->type == MESH_BRIDGE_EVT_SCHEDULE ||
+		    evt->type == MESH_BRIDGE_EVT_PRESENCE_EXPIRE ||
+		    evt->type == MESH_BRIDGE_EVT_ROBOT_STATUS) {
+			msg.module.mesh_bridge = *evt;
+			enqueue_msg = true;
+		}
+	}
+
+	if (is_util_module_event(aeh)) {
+		struct util_module_event *evt = cast_util_module_event(aeh);
+
+		msg.module.util = *evt;
+		enqueue_msg = true;
+	}
+
+	if (enqueue_msg) {
+		int err = module_enqueue_msg(&self, &msg);
+
+		if (err) {
+			LOG_ERR("Message could not be enqueued");
+			SEND_ERROR(mesh_bridge, MESH_BRIDGE_EVT_ERROR, err);
+		}
+	}
+
+	return false;
+}
+
+/* Message handler for all states. */
+static void on_all_states(struct mesh_bridge_msg_data *msg)
+{
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DATA_RECEIVED)) {
+		if (shutdown_requested) {
+			k_free(msg->module.cloud.data.data.buf);
+		} else {
+			cloud_data_handle(&msg->module.cloud.data.data);
+		}
+	}
+
+	if (IS_EVENT(msg, mesh_bridge, MESH_BRIDGE_EVT_SCHEDULE)) {
+		cmd_schedule();
+	}
+
+	if (IS_EVENT(msg, mesh_bridge, MESH_BRIDGE_EVT_ROBOT_STATUS)) {
+		struct mesh_bridge_robot_status *status = &msg->module.mesh_bridge.data.status;
+
+		presence_update(status->addr, status->hops, status->rssi);
+	}
+
+	if (IS_EVENT(msg, mesh_bridge, MESH_BRIDGE_EVT_PRESENCE_EXPIRE)) {
+		presence_expire();
+	}
+
+	if (IS_EVENT(msg, util, UTIL_EVT_SHUTDOWN_REQUEST) && !shutdown_requested) {
+		/* Commands are only meaningful in the moment. Do not let stale
+		 * movements reach the robots around the restart, and do not leave
+		 * robots waiting for a start that never comes.
+		 */
+		k_work_cancel_delayable(&presence_work);
+
+		if (queue_len) {
+			LOG_WRN("Discarding %zu queued commands", queue_len);
+			queue_len = 0;
+		}
+
+		/* Acknowledged by cmd_schedule() once the stop is on the link */
+		shutdown_requested = true;
+		shutdown_pending = true;
+		fleet_stop();
+		cmd_schedule();
+	}
+}
+
+static void module_thread_fn(void)
+{
+	int err;
+	struct mesh_bridge_msg_data msg;
+
+	self.thread_id = k_current_get();
+
+	err = module_start(&self);
+	if (err) {
+		LOG_ERR("Failed starting module, error: %d", err);
+		SEND_ERROR(mesh_bridge, MESH_BRIDGE_EVT_ERROR, err);
+	}
+
+	err = link_init();
+	if (err) {
+		SEND_ERROR(mesh_bridge, MESH_BRIDGE_EVT_ERROR, err);
+	}
+
+	bucket.last_refill = k_uptime_get();
+	k_work_reschedule(&presence_work, K_MSEC(PRESENCE_TIMEOUT_MS / 4));
+
+	while (true) {
+		module_get_next_msg(&self, &msg);
+		on_all_states(&msg);
+	}
+}
+
+K_THREAD_DEFINE(mesh_bridge_module_thread, CONFIG_MESH_BRIDGE_THREAD_STACK_SIZE,
+		module_thread_fn, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, cloud_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, mesh_bridge_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
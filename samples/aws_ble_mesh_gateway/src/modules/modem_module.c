@@ -6,14 +6,18 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
+#include <zephyr/random/rand32.h>
 #include <modem/lte_lc.h>
+#include <modem/nrf_modem_lib.h>
 
 #define MODULE modem_module
 
 #include "modules_common.h"
 #include "app_module_event.h"
+#include "cloud_module_event.h"
 #include "modem_module_event.h"
 #include "ui_module_event.h"
+#include "util_module_event.h"
 
 #include <zephyr/logging/log.h>
 #define MODEM_MODULE_LOG_LEVEL 4
@@ -29,8 +33,10 @@ static enum state_type {
 struct modem_msg_data {
 	union {
 		struct app_module_event app;
+		struct cloud_module_event cloud;
 		struct modem_module_event modem;
 		struct ui_module_event ui;
+		struct util_module_event util;
 	} module;
 };
 
@@ -47,6 +53,98 @@ static struct module_data self = {
 	.supports_shutdown = true,
 };
 
+/* Power saving presets. The interactive profile keeps downlink latency low
+ * while commands arrive from the cloud. The low power profile is used when
+ * the downlink has been idle, and only requests PSM if uplink traffic is
+ * sparse enough for the modem to actually enter it between publishes.
+ */
+enum {
+	POWER_PROFILE_INTERACTIVE,
+	POWER_PROFILE_LOW_POWER,
+	POWER_PROFILE_LOW_POWER_PSM,
+};
+
+static const struct power_profile {
+	const char *name;
+	bool psm;
+	const char *psm_rptau;
+	const char *psm_rat;
+	const char *edrx;
+	const char *ptw;
+} power_profiles[] = {
+	[POWER_PROFILE_INTERACTIVE] = {
+		.name = "interactive",
+		.psm = false,
+		.edrx = CONFIG_MODEM_INTERACTIVE_EDRX,
+		.ptw = CONFIG_MODEM_INTERACTIVE_PTW,
+	},
+	[POWER_PROFILE_LOW_POWER] = {
+		.name = "low power",
+		.psm = false,
+		.edrx = CONFIG_MODEM_LOW_POWER_EDRX,
+		.ptw = CONFIG_MODEM_LOW_POWER_PTW,
+	},
+	[POWER_PROFILE_LOW_POWER_PSM] = {
+		.name = "low power with PSM",
+		.psm = true,
+		.psm_rptau = CONFIG_MODEM_LOW_POWER_PSM_RPTAU,
+		.psm_rat = CONFIG_MODEM_LOW_POWER_PSM_RAT,
+		.edrx = CONFIG_MODEM_LOW_POWER_EDRX,
+		.ptw = CONFIG_MODEM_LOW_POWER_PTW,
+	},
+};
+
+static const struct power_profile *power_profile;
+
+/* Observed uplink pattern, as an exponentially weighted mean interval. */
+static struct {
+	int64_t last;
+	uint32_t interval_ms;
+} uplink;
+
+/* Time spent in each RRC mode. Updated from the LTE link controller callback. */
+static struct {
+	enum lte_lc_rrc_mode mode;
+	int64_t since;
+	uint64_t connected_ms;
+	uint64_t idle_ms;
+	uint32_t connections;
+	int64_t connect_start;
+} rrc_stats;
+
+/* Connection manager state and metrics. */
+static struct {
+	/* Failed attempts since the link was last up. */
+	uint32_t attempts;
+	/* Disconnected on request or shutting down, do not reconnect. */
+	bool user_offline;
+	int64_t outage_start;
+	int64_t up_since;
+	int64_t started;
+	uint64_t uptime_ms;
+	uint32_t retries;
+	uint32_t resets;
+} conn;
+
+static void downlink_idle_work_fn(struct k_work *work)
+{
+	SEND_EVENT(modem, MODEM_EVT_DOWNLINK_IDLE);
+}
+
+static void connect_timeout_work_fn(struct k_work *work)
+{
+	SEND_EVENT(modem, MODEM_EVT_CONNECT_TIMEOUT);
+}
+
+static void connect_retry_work_fn(struct k_work *work)
+{
+	SEND_EVENT(modem, MODEM_EVT_CONNECT_RETRY);
+}
+
+static K_WORK_DELAYABLE_DEFINE(downlink_idle_work, downlink_idle_work_fn);
+static K_WORK_DELAYABLE_DEFINE(connect_timeout_work, connect_timeout_work_fn);
+static K_WORK_DELAYABLE_DEFINE(connect_retry_work, connect_retry_work_fn);
+
 /* Convenience functions used in internal state handling. */
 static char *state2str(enum state_type state)
 {
@@ -76,6 +174,104 @@ static void state_set(enum state_type new_state)
 	state = new_state;
 }
 
+static void rrc_update(enum lte_lc_rrc_mode mode)
+{
+	int64_t now = k_uptime_get();
+	int64_t elapsed = rrc_stats.since ? now - rrc_stats.since : 0;
+
+	if (rrc_stats.mode == LTE_LC_RRC_MODE_CONNECTED) {
+		rrc_stats.connected_ms += elapsed;
+	} else {
+		rrc_stats.idle_ms += elapsed;
+	}
+
+	if (mode == LTE_LC_RRC_MODE_CONNECTED) {
+		rrc_stats.connections++;
+	}
+
+	rrc_stats.mode = mode;
+	rrc_stats.since = now;
+
+	LOG_DBG("RRC mode: %s after %lld ms, connected %d%% of the time over %d connections",
+		mode == LTE_LC_RRC_MODE_CONNECTED ? "Connected" : "Idle", elapsed,
+		(int)((100 * rrc_stats.connected_ms) /
+		      MAX(rrc_stats.connected_ms + rrc_stats.idle_ms, 1)),
+		rrc_stats.connections);
+}
+
+static int power_profile_set(const struct power_profile *profile)
+{
+	int err;
+
+	if (profile == power_profile) {
+		return 0;
+	}
+
+	if (profile->psm) {
+		err = lte_lc_psm_param_set(profile->psm_rptau, profile->psm_rat);
+		if (err) {
+			LOG_ERR("lte_lc_psm_param_set, error: %d", err);
+			return err;
+		}
+	}
+
+	err = lte_lc_psm_req(profile->psm);
+	if (err) {
+		LOG_ERR("lte_lc_psm_req, error: %d", err);
+		return err;
+	}
+
+	err = lte_lc_edrx_param_set(LTE_LC_LTE_MODE_LTEM, profile->edrx);
+	if (err) {
+		LOG_ERR("lte_lc_edrx_param_set, error: %d", err);
+		return err;
+	}
+
+	err = lte_lc_ptw_set(LTE_LC_LTE_MODE_LTEM, profile->ptw);
+	if (err) {
+		LOG_ERR("lte_lc_ptw_set, error: %d", err);
+		return err;
+	}
+
+	err = lte_lc_edrx_req(true);
+	if (err) {
+		LOG_ERR("lte_lc_edrx_req, error: %d", err);
+		return err;
+	}
+
+	LOG_INF("Power profile: %s", profile->name);
+
+	power_profile = profile;
+	return 0;
+}
+
+/* Pick the low power profile from the observed uplink interval. PSM is not
+ * worth negotiating if publishes keep the modem out of it anyway.
+ */
+static const struct power_profile *low_power_profile(void)
+{
+	if (uplink.interval_ms >= CONFIG_MODEM_PSM_MIN_UPLINK_INTERVAL_SEC * MSEC_PER_SEC) {
+		return &power_profiles[POWER_PROFILE_LOW_POWER_PSM];
+	}
+
+	return &power_profiles[POWER_PROFILE_LOW_POWER];
+}
+
+static void uplink_update(void)
+{
+	int64_t now = k_uptime_get();
+
+	if (uplink.last) {
+		uint32_t interval = MIN(now - uplink.last, UINT32_MAX);
+
+		uplink.interval_ms = uplink.interval_ms ?
+				     uplink.interval_ms - uplink.interval_ms / 4 + interval / 4 :
+				     interval;
+	}
+
+	uplink.last = now;
+}
+
 /* Handlers */
 static bool app_event_handler(const struct app_event_header *aeh)
 {
@@ -89,6 +285,16 @@ static bool app_event_handler(const struct app_event_header *aeh)
 		enqueue_msg = true;
 	}
 
+	if (is_cloud_module_event(aeh)) {
+		struct cloud_module_event *evt = cast_cloud_module_event(aeh);
+
+		if (evt->type == CLOUD_EVT_DATA_RECEIVED || evt->type == CLOUD_EVT_DATA_SENT ||
+		    evt->type == CLOUD_EVT_SHUTDOWN_READY) {
+			msg.module.cloud = *evt;
+			enqueue_msg = true;
+		}
+	}
+
 	if (is_modem_module_event(aeh)) {
 		struct modem_module_event *evt = cast_modem_module_event(aeh);
 		LOG_INF("event %d", evt->type);
@@ -103,6 +309,13 @@ static bool app_event_handler(const struct app_event_header *aeh)
 		enqueue_msg = true;
 	}
 
+	if (is_util_module_event(aeh)) {
+		struct util_module_event *evt = cast_util_module_event(aeh);
+
+		msg.module.util = *evt;
+		enqueue_msg = true;
+	}
+
 	if (enqueue_msg) {
 		int err = module_enqueue_msg(&self, &msg);
 
@@ -132,59 +345,75 @@ static void lte_evt_handler(const struct lte_lc_evt *const evt)
 
         LOG_INF("Connected to: %s network\n",
              evt->nw_reg_status == LTE_LC_NW_REG_REGISTERED_HOME ? "home" : "roaming");
+
 		SEND_EVENT(modem, MODEM_EVT_LTE_CONNECTED);
 		break;
 	}
-	// case LTE_LC_EVT_EDRX_UPDATE: {
-	// 	LOG_INF("eDRX update event!")
-	// 	break;
-	// }
-	// case LTE_LC_EVT_RRC_UPDATE:
-	// 	LOG_DBG("RRC mode: %s",
-	// 		evt->rrc_mode == LTE_LC_RRC_MODE_CONNECTED ?
-	// 		"Connected" : "Idle");
-	// 	break;
-	// case LTE_LC_EVT_CELL_UPDATE:
-	// 	LOG_DBG("LTE cell changed: Cell ID: %d, Tracking area: %d",
-	// 		evt->cell.id, evt->cell.tac);
-	// 	break;
-	// case LTE_LC_EVT_NEIGHBOR_CELL_MEAS:
-	// 	if (evt->cells_info.current_cell.id != LTE_LC_CELL_EUTRAN_ID_INVALID) {
-	// 		LOG_DBG("Neighbor cell measurements received");
-	// 		send_neighbor_cell_update((struct lte_lc_cells_info *)&evt->cells_info);
-	// 	} else {
-	// 		LOG_DBG("Neighbor cell measurement was not successful");
-	// 		SEND_EVENT(modem, MODEM_EVT_NEIGHBOR_CELLS_DATA_NOT_READY);
-	// 	}
-	// 	break;
-	// case LTE_LC_EVT_LTE_MODE_UPDATE:
-	// 	nw_mode_latest = evt->lte_mode;
-	// 	break;
-	// case LTE_LC_EVT_MODEM_EVENT:
-	// 	LOG_DBG("Modem domain event, type: %s",
-	// 		evt->modem_evt == LTE_LC_MODEM_EVT_LIGHT_SEARCH_DONE ?
-	// 			"Light search done" :
-	// 		evt->modem_evt == LTE_LC_MODEM_EVT_SEARCH_DONE ?
-	// 			"Search done" :
-	// 		evt->modem_evt == LTE_LC_MODEM_EVT_RESET_LOOP ?
-	// 			"Reset loop" :
-	// 		evt->modem_evt == LTE_LC_MODEM_EVT_BATTERY_LOW ?
-	// 			"Low battery" :
-	// 		evt->modem_evt == LTE_LC_MODEM_EVT_OVERHEATED ?
-	// 			"Modem is overheated" :
-	// 			"Unknown");
-
-		// /* If a reset loop happens in the field, it should not be necessary
-		//  * to perform any action. The modem will try to re-attach to the LTE network after
-		//  * the 30-minute block.
-		//  */
-		// if (evt->modem_evt == LTE_LC_MODEM_EVT_RESET_LOOP) {
-		// 	LOG_WRN("The modem has detected a reset loop. LTE network attach is now "
-		// 		"restricted for the next 30 minutes. Power-cycle the device to "
-		// 		"circumvent this restriction. For more information see the "
-		// 		"nRF91 AT Commands - Command Reference Guide v2.0 - chpt. 5.36");
-		// }
-		// break;
+	case LTE_LC_EVT_PSM_UPDATE: {
+		struct modem_module_event *modem_module_event = new_modem_module_event();
+
+		LOG_DBG("PSM parameter update: TAU: %d s, Active time: %d s",
+			evt->psm_cfg.tau, evt->psm_cfg.active_time);
+
+		modem_module_event->type = MODEM_EVT_LTE_PSM_UPDATE;
+		modem_module_event->data.psm = evt->psm_cfg;
+		APP_EVENT_SUBMIT(modem_module_event);
+		break;
+	}
+	case LTE_LC_EVT_EDRX_UPDATE: {
+		struct modem_module_event *modem_module_event = new_modem_module_event();
+
+		LOG_DBG("eDRX parameter update: eDRX: %.2f s, PTW: %.2f s",
+			evt->edrx_cfg.edrx, evt->edrx_cfg.ptw);
+
+		modem_module_event->type = MODEM_EVT_LTE_EDRX_UPDATE;
+		modem_module_event->data.edrx = evt->edrx_cfg;
+		APP_EVENT_SUBMIT(modem_module_event);
+		break;
+	}
+	case LTE_LC_EVT_RRC_UPDATE:
+		rrc_update(evt->rrc_mode);
+		break;
+	case LTE_LC_EVT_CELL_UPDATE: {
+		struct modem_module_event *modem_module_event = new_modem_module_event();
+
+		LOG_DBG("LTE cell changed: Cell ID: %d, Tracking area: %d",
+			evt->cell.id, evt->cell.tac);
+
+		modem_module_event->type = MODEM_EVT_LTE_CELL_UPDATE;
+		modem_module_event->data.cell = evt->cell;
+		APP_EVENT_SUBMIT(modem_module_event);
+		break;
+	}
+	case LTE_LC_EVT_MODEM_EVENT:
+		LOG_DBG("Modem domain event, type: %s",
+			evt->modem_evt == LTE_LC_MODEM_EVT_LIGHT_SEARCH_DONE ?
+				"Light search done" :
+			evt->modem_evt == LTE_LC_MODEM_EVT_SEARCH_DONE ?
+				"Search done" :
+			evt->modem_evt == LTE_LC_MODEM_EVT_RESET_LOOP ?
+				"Reset loop" :
+			evt->modem_evt == LTE_LC_MODEM_EVT_BATTERY_LOW ?
+				"Low battery" :
+			evt->modem_evt == LTE_LC_MODEM_EVT_OVERHEATED ?
+				"Modem is overheated" :
+				"Unknown");
+
+		/* If a reset loop happens in the field, it should not be necessary
+		 * to perform any action. The modem will try to re-attach to the LTE network after
+		 * the 30-minute block.
+		 */
+		if (evt->modem_evt == LTE_LC_MODEM_EVT_RESET_LOOP) {
+			LOG_WRN("The modem has detected a reset loop. LTE network attach is now "
+				"restricted for the next 30 minutes. Power-cycle the device to "
+				"circumvent this restriction. For more information see the "
+				"nRF91 AT Commands - Command Reference Guide v2.0 - chpt. 5.36");
+		}
+
+		if (evt->modem_evt == LTE_LC_MODEM_EVT_BATTERY_LOW) {
+			SEND_EVENT(modem, MODEM_EVT_BATTERY_LOW);
+		}
+		break;
 	default:
 		break;
 	}
@@ -208,6 +437,8 @@ static int lte_connect(void)
 {
 	int err;
 
+	rrc_stats.connect_start = k_uptime_get();
+
 	err = lte_lc_connect_async(lte_evt_handler);
 	if (err) {
 		LOG_ERR("lte_lc_connect_async, error: %d", err);
@@ -234,25 +465,134 @@ static int lte_disconnect(void)
 	return 0;
 }
 
+static int modem_reset(void)
+{
+	int err;
+
+	LOG_WRN("No connection after %d attempts, resetting the modem", conn.attempts);
+	conn.resets++;
+
+	err = lte_lc_deinit();
+	if (err) {
+		LOG_ERR("lte_lc_deinit, error: %d", err);
+	}
+
+	err = nrf_modem_lib_shutdown();
+	if (err) {
+		LOG_ERR("nrf_modem_lib_shutdown, error: %d", err);
+		return err;
+	}
+
+	err = nrf_modem_lib_init(NORMAL_MODE);
+	if (err) {
+		LOG_ERR("nrf_modem_lib_init, error: %d", err);
+		return err;
+	}
+
+	/* The power saving requests are lost with the reset. */
+	power_profile = NULL;
+
+	return setup();
+}
+
+static void conn_stats_log(void)
+{
+	int64_t total = k_uptime_get() - conn.started;
+
+	LOG_INF("LTE up %d%% of %lld s, %d retries, %d modem resets",
+		(int)((100 * conn.uptime_ms) / MAX(total, 1)), total / MSEC_PER_SEC,
+		conn.retries, conn.resets);
+}
+
+/* Give up on the current attempt and schedule the next one with exponential
+ * backoff and jitter, so gateways sharing a cell do not retry in lockstep.
+ */
+static void connect_failed(void)
+{
+	uint32_t shift = MIN(conn.attempts, 16);
+	uint32_t delay = MIN(CONFIG_MODEM_CONNECT_BACKOFF_BASE_SEC << shift,
+			     CONFIG_MODEM_CONNECT_BACKOFF_MAX_SEC) * MSEC_PER_SEC;
+
+	k_work_cancel_delayable(&connect_timeout_work);
+
+	/* Stop searching until the next attempt. */
+	lte_disconnect();
+
+	conn.attempts++;
+	conn.retries++;
+
+	if ((conn.attempts % CONFIG_MODEM_RESET_AFTER_ATTEMPTS) == 0 && modem_reset()) {
+		SEND_ERROR(modem, MODEM_EVT_ERROR, -EIO);
+	}
+
+	delay = delay / 2 + sys_rand32_get() % (delay / 2 + 1);
+
+	LOG_INF("Retrying LTE connection in %d ms, attempt %d", delay, conn.attempts + 1);
+	k_work_reschedule(&connect_retry_work, K_MSEC(delay));
+}
+
+static void connect_attempt(void)
+{
+	int err;
+
+	err = lte_connect();
+	if (err) {
+		LOG_ERR("Failed connecting to LTE, error: %d", err);
+		SEND_ERROR(modem, MODEM_EVT_ERROR, err);
+		connect_failed();
+		return;
+	}
+
+	k_work_reschedule(&connect_timeout_work, K_SECONDS(CONFIG_MODEM_CONNECT_TIMEOUT_SEC));
+}
+
+static void conn_up(void)
+{
+	int64_t now = k_uptime_get();
+
+	k_work_cancel_delayable(&connect_timeout_work);
+
+	if (rrc_stats.connect_start) {
+		LOG_INF("LTE connection setup took %lld ms", now - rrc_stats.connect_start);
+		rrc_stats.connect_start = 0;
+	}
+
+	LOG_INF("LTE registered %lld ms after losing the link, %d retries",
+		now - conn.outage_start, conn.attempts);
+
+	conn.attempts = 0;
+	conn.up_since = now;
+	conn_stats_log();
+}
+
+static void conn_down(void)
+{
+	int64_t now = k_uptime_get();
+
+	conn.uptime_ms += now - conn.up_since;
+	conn.outage_start = now;
+	conn_stats_log();
+}
+
 /* Message handler for STATE_DISCONNECTED. */
 static void on_state_disconnected(struct modem_msg_data *msg)
 {
 	if (IS_EVENT(msg, ui, UI_EVT_BUTTON)) {
-		int err;
-		
 		LOG_INF("button event");
 		if ((msg->module.ui.data.button.action == BUTTON_PRESS) &&
 		(msg->module.ui.data.button.num == BTN2)) {
-			
-			err = lte_connect();
-			if (err) {
-				LOG_ERR("Failed connecting to LTE, error: %d", err);
-				SEND_ERROR(modem, MODEM_EVT_ERROR, err);
-				return;
-			}
+			conn.user_offline = false;
+			conn.attempts = 0;
+			conn.outage_start = k_uptime_get();
+			k_work_cancel_delayable(&connect_retry_work);
+			connect_attempt();
 		}
 	}
 
+	if (IS_EVENT(msg, modem, MODEM_EVT_CONNECT_RETRY) && !conn.user_offline) {
+		connect_attempt();
+	}
+
 	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_CONNECTING)) {
 		state_set(STATE_CONNECTING);
 	}
@@ -263,6 +603,18 @@ static void on_state_connecting(struct modem_msg_data *msg)
 {
 	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_CONNECTED)) {
 		state_set(STATE_CONNECTED);
+		conn_up();
+
+		/* Expect the backlog and pending commands to flow right after connecting. */
+		power_profile_set(&power_profiles[POWER_PROFILE_INTERACTIVE]);
+		k_work_reschedule(&downlink_idle_work,
+				  K_SECONDS(CONFIG_MODEM_INTERACTIVE_TIMEOUT_SEC));
+	}
+
+	if (IS_EVENT(msg, modem, MODEM_EVT_CONNECT_TIMEOUT)) {
+		LOG_WRN("No LTE connection within %d s", CONFIG_MODEM_CONNECT_TIMEOUT_SEC);
+		state_set(STATE_DISCONNECTED);
+		connect_failed();
 	}
 }
 
@@ -275,7 +627,8 @@ static void on_state_connected(struct modem_msg_data *msg)
 		LOG_INF("button event");
 		if ((msg->module.ui.data.button.action == BUTTON_PRESS) &&
 		(msg->module.ui.data.button.num == BTN1)) {
-			
+			conn.user_offline = true;
+
 			err = lte_disconnect();
 			if (err) {
 				LOG_ERR("Failed disconnecting from LTE, error: %d", err);
@@ -285,23 +638,76 @@ static void on_state_connected(struct modem_msg_data *msg)
 		}
 	}
 
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DATA_RECEIVED)) {
+		power_profile_set(&power_profiles[POWER_PROFILE_INTERACTIVE]);
+		k_work_reschedule(&downlink_idle_work,
+				  K_SECONDS(CONFIG_MODEM_INTERACTIVE_TIMEOUT_SEC));
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DATA_SENT) &&
+	    power_profile != &power_profiles[POWER_PROFILE_INTERACTIVE]) {
+		power_profile_set(low_power_profile());
+	}
+
+	if (IS_EVENT(msg, modem, MODEM_EVT_DOWNLINK_IDLE)) {
+		power_profile_set(low_power_profile());
+	}
+
 	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_DISCONNECTED)) {
-		state_set(STATE_DISCONNECTED);
+		k_work_cancel_delayable(&downlink_idle_work);
+		conn_down();
+
+		if (conn.user_offline) {
+			state_set(STATE_DISCONNECTED);
+			return;
+		}
+
+		/* The modem keeps searching on its own. Give it one attempt
+		 * period before starting over.
+		 */
+		LOG_WRN("LTE link lost");
+		state_set(STATE_CONNECTING);
+		k_work_reschedule(&connect_timeout_work,
+				  K_SECONDS(CONFIG_MODEM_CONNECT_TIMEOUT_SEC));
 	}
 }
 
 /* Message handler for all states. */
 static void on_all_states(struct modem_msg_data *msg)
 {
-		if (IS_EVENT(msg, app, APP_EVT_START)) {
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DATA_SENT)) {
+		uplink_update();
+	}
+
+	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_PSM_UPDATE) && power_profile && power_profile->psm) {
+		LOG_INF("PSM granted: TAU %d s, active time %d s",
+			msg->module.modem.data.psm.tau, msg->module.modem.data.psm.active_time);
+	}
+
+	if (IS_EVENT(msg, util, UTIL_EVT_SHUTDOWN_REQUEST)) {
+		conn.user_offline = true;
+		k_work_cancel_delayable(&connect_retry_work);
+		k_work_cancel_delayable(&connect_timeout_work);
+	}
+
+	/* The cloud module is done with the link. */
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_SHUTDOWN_READY)) {
 		int err;
 
-		err = lte_connect();
+		k_work_cancel_delayable(&downlink_idle_work);
+
+		err = lte_lc_power_off();
 		if (err) {
-			LOG_ERR("Failed connecting to LTE, error: %d", err);
-			SEND_ERROR(modem, MODEM_EVT_ERROR, err);
-			return;
+			LOG_ERR("lte_lc_power_off, error: %d", err);
 		}
+
+		SEND_SHUTDOWN_ACK(modem, MODEM_EVT_SHUTDOWN_READY, self.id);
+	}
+
+	if (IS_EVENT(msg, app, APP_EVT_START)) {
+		conn.started = k_uptime_get();
+		conn.outage_start = conn.started;
+		connect_attempt();
 	}
 }
 
@@ -354,7 +760,9 @@ K_THREAD_DEFINE(modem_module_thread, CONFIG_MODEM_THREAD_STACK_SIZE,
 
 APP_EVENT_LISTENER(MODULE, app_event_handler);
 APP_EVENT_SUBSCRIBE(MODULE, app_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, cloud_module_event);
 APP_EVENT_SUBSCRIBE(MODULE, modem_module_event);
 APP_EVENT_SUBSCRIBE(MODULE, ui_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
 
 
@@ -30,6 +30,108 @@ static struct modules_info {
 	atomic_t active_modules_count;
 } modules_info;
 
+#if defined(CONFIG_MODULES_COMMON_STATS)
+/* Statistics are updated from event listeners and module threads. */
+static struct k_spinlock stats_lock;
+static struct module_event_stats event_stats;
+
+static void stats_log_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(stats_log_work, stats_log_work_fn);
+
+static void stats_enqueued(struct module_data *module, int err, uint32_t start)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	if (err) {
+		module->stats.enqueue_failures++;
+	} else {
+		module->stats.enqueued++;
+		module->stats.high_water = MAX(module->stats.high_water,
+					       k_msgq_num_used_get(module->msg_q));
+	}
+	module->stats.enqueue_cycles += k_cycle_get_32() - start;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+/* Called by the module thread when it is done with the previous message. */
+static void stats_handled(struct module_data *module)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	if (module->handling) {
+		module->stats.handle_cycles += k_cycle_get_32() - module->handle_start;
+		module->handling = false;
+	}
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void stats_dequeued(struct module_data *module)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	module->stats.dequeued++;
+	module->handle_start = k_cycle_get_32();
+	module->handling = true;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+/* Replaces the weak allocator of the Application Event Manager to count the
+ * allocations. Callers of new_*_event() do not check for NULL, so a failure is
+ * fatal, as with the weak allocator.
+ */
+void *app_event_manager_alloc(size_t size)
+{
+	void *event = k_malloc(size);
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	if (event) {
+		event_stats.allocs++;
+	} else {
+		event_stats.alloc_failures++;
+	}
+
+	k_spin_unlock(&stats_lock, key);
+
+	if (unlikely(event == NULL)) {
+		LOG_ERR("No memory for a %zu byte event", size);
+		k_panic();
+	}
+
+	return event;
+}
+
+static void stats_log_work_fn(struct k_work *work)
+{
+	module_stats_log_all();
+	k_work_schedule(&stats_log_work, K_SECONDS(CONFIG_MODULES_COMMON_STATS_LOG_INTERVAL_SEC));
+}
+#else
+static void stats_enqueued(struct module_data *module, int err, uint32_t start) {}
+static void stats_handled(struct module_data *module) {}
+static void stats_dequeued(struct module_data *module) {}
+#endif /* defined(CONFIG_MODULES_COMMON_STATS) */
+
+/* Release the rejected message and all queued messages. Once released, the buffer of the
+ * rejected message is reused to dequeue the others.
+ */
+static void queue_drop(struct module_data *module, void *msg)
+{
+	if (module->msg_free == NULL) {
+		k_msgq_purge(module->msg_q);
+		return;
+	}
+
+	module->msg_free(msg);
+
+	while (k_msgq_get(module->msg_q, msg, K_NO_WAIT) == 0) {
+		module->msg_free(msg);
+	}
+}
+
 /* Public interface */
 void module_purge_queue(struct module_data *module)
 {
@@ -38,7 +140,14 @@ void module_purge_queue(struct module_data *module)
 
 int module_get_next_msg(struct module_data *module, void *msg)
 {
-	int err = k_msgq_get(module->msg_q, msg, K_FOREVER);
+	int err;
+
+	stats_handled(module);
+
+	err = k_msgq_get(module->msg_q, msg, K_FOREVER);
+	if (err == 0) {
+		stats_dequeued(module);
+	}
 
 	if (err == 0 && IS_ENABLED(CONFIG_MODULES_COMMON_LOG_LEVEL_DBG)) {
 		struct event_prototype *evt_proto =
@@ -65,10 +174,12 @@ int module_get_next_msg(struct module_data *module, void *msg)
 
 int module_enqueue_msg(struct module_data *module, void *msg)
 {
+	uint32_t start = k_cycle_get_32();
 	int err;
 
 	err = k_msgq_put(module->msg_q, msg, K_NO_WAIT);
 	if (err) {
+		stats_enqueued(module, err, start);
 		LOG_WRN("%s: Message could not be enqueued, error code: %d",
 			module->name, err);
 			/* Purge message queue before reporting an error. This
@@ -79,7 +190,7 @@ int module_enqueue_msg(struct module_data *module, void *msg)
 			 * This error is concidered irrecoverable and should be
 			 * rebooted on.
 			 */
-			module_purge_queue(module);
+			queue_drop(module, msg);
 		return err;
 	}
 
@@ -102,6 +213,7 @@ int module_enqueue_msg(struct module_data *module, void *msg)
 #endif
 	}
 
+	stats_enqueued(module, 0, start);
 	return 0;
 }
 
@@ -169,6 +281,14 @@ int module_start(struct module_data *module)
 	sys_slist_append(&module_list, &module->header);
 	k_mutex_unlock(&module_list_lock);
 
+#if defined(CONFIG_MODULES_COMMON_STATS)
+	if (CONFIG_MODULES_COMMON_STATS_LOG_INTERVAL_SEC > 0) {
+		/* Only the first module to start schedules the log. */
+		k_work_schedule(&stats_log_work,
+				K_SECONDS(CONFIG_MODULES_COMMON_STATS_LOG_INTERVAL_SEC));
+	}
+#endif
+
 	if (module->thread_id) {
 		LOG_DBG("Module \"%s\" with thread ID %p started", module->name, module->thread_id);
 	} else {
@@ -182,3 +302,69 @@ uint32_t module_active_count_get(void)
 {
 	return atomic_get(&modules_info.active_modules_count);
 }
+
+int module_stats_get(struct module_data *module, struct module_stats *stats, bool reset)
+{
+#if defined(CONFIG_MODULES_COMMON_STATS)
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*stats = module->stats;
+	if (reset) {
+		module->stats = (struct module_stats){ 0 };
+	}
+
+	k_spin_unlock(&stats_lock, key);
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+int module_event_stats_get(struct module_event_stats *stats, bool reset)
+{
+#if defined(CONFIG_MODULES_COMMON_STATS)
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*stats = event_stats;
+	if (reset) {
+		event_stats = (struct module_event_stats){ 0 };
+	}
+
+	k_spin_unlock(&stats_lock, key);
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+void module_stats_log_all(void)
+{
+	struct module_data *module;
+	struct module_stats stats;
+	struct module_event_stats events;
+
+	if (!IS_ENABLED(CONFIG_MODULES_COMMON_STATS)) {
+		return;
+	}
+
+	(void)module_event_stats_get(&events, true);
+
+	LOG_INF("Events: %u allocated, %u failed", events.allocs, events.alloc_failures);
+
+	k_mutex_lock(&module_list_lock, K_FOREVER);
+	SYS_SLIST_FOR_EACH_CONTAINER(&module_list, module, header) {
+		if (module->msg_q == NULL) {
+			continue;
+		}
+
+		(void)module_stats_get(module, &stats, true);
+
+		LOG_INF("%s: %u enqueued, %u failed, %u dequeued, high water %u/%u, "
+			"%u cycles per enqueue, %u cycles per message",
+			module->name, stats.enqueued, stats.enqueue_failures, stats.dequeued,
+			stats.high_water, module->msg_q->max_msgs,
+			stats.enqueued ? (uint32_t)(stats.enqueue_cycles / stats.enqueued) : 0,
+			stats.dequeued ? (uint32_t)(stats.handle_cycles / stats.dequeued) : 0);
+	}
+	k_mutex_unlock(&module_list_lock);
+}
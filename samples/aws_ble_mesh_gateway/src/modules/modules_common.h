@@ -69,6 +69,30 @@ extern "C" {
 	event->data.id = _id;								\
 	APP_EVENT_SUBMIT(event)
 
+/** @brief Message statistics of a module. Only updated with CONFIG_MODULES_COMMON_STATS. */
+struct module_stats {
+	/* Messages put in the module's queue. */
+	uint32_t enqueued;
+	/* Messages that did not fit in the module's queue. */
+	uint32_t enqueue_failures;
+	/* Messages taken from the module's queue. */
+	uint32_t dequeued;
+	/* Largest number of messages in the queue at once. */
+	uint32_t high_water;
+	/* Cycles spent in module_enqueue_msg(), logging included. */
+	uint64_t enqueue_cycles;
+	/* Cycles the module thread spent handling dequeued messages. */
+	uint64_t handle_cycles;
+};
+
+/** @brief Event allocation statistics. Only updated with CONFIG_MODULES_COMMON_STATS. */
+struct module_event_stats {
+	/* Events allocated by new_*_event(). */
+	uint32_t allocs;
+	/* Events that could not be allocated. */
+	uint32_t alloc_failures;
+};
+
 /** @brief Structure that contains module metadata. */
 struct module_data {
 	/* Variable used to construct a linked list of module metadata. */
@@ -83,6 +107,18 @@ struct module_data {
 	struct k_msgq *msg_q;
 	/* Flag signifying if the module supports shutdown. */
 	bool supports_shutdown;
+	/* Optional function that releases the resources a message owns. Called for messages
+	 * that are dropped instead of being handled by the module thread.
+	 */
+	void (*msg_free)(void *msg);
+#if defined(CONFIG_MODULES_COMMON_STATS)
+	/* Message statistics. */
+	struct module_stats stats;
+	/* Cycle count when the message being handled was dequeued. */
+	uint32_t handle_start;
+	/* Flag signifying that the module thread is handling a message. */
+	bool handling;
+#endif
 };
 
 /** @brief Purge a module's queue.
@@ -103,6 +139,9 @@ void module_purge_queue(struct module_data *module);
 int module_get_next_msg(struct module_data *module, void *msg);
 
 /** @brief Enqueue message to a module's queue.
+ *
+ *  If the queue is full, the queue is purged. The rejected message and the purged messages
+ *  are passed to the msg_free function of the module, if it has one.
  *
  *  @param[in] module Pointer to a structure containing module metadata.
  *  @param[in] msg Pointer to a message that will be enqueued.
@@ -134,6 +173,30 @@ int module_start(struct module_data *module);
  */
 uint32_t module_active_count_get(void);
 
+/** @brief Get the message statistics of a module.
+ *
+ *  @param[in] module Pointer to a structure containing module metadata.
+ *  @param[out] stats Statistics of the module.
+ *  @param[in] reset Reset the statistics after reading them.
+ *
+ *  @return 0 if successful, or -ENOTSUP if statistics are not enabled.
+ */
+int module_stats_get(struct module_data *module, struct module_stats *stats, bool reset);
+
+/** @brief Get the event allocation statistics.
+ *
+ *  @param[out] stats Statistics of the event allocations.
+ *  @param[in] reset Reset the statistics after reading them.
+ *
+ *  @return 0 if successful, or -ENOTSUP if statistics are not enabled.
+ */
+int module_event_stats_get(struct module_event_stats *stats, bool reset);
+
+/** @brief Log the message statistics of all active modules and the event allocation
+ *	   statistics, and reset them.
+ */
+void module_stats_log_all(void);
+
 /**
  *@}
  */
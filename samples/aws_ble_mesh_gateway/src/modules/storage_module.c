@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/storage/flash_map.h>
+
+#define MODULE storage_module
+
+#include "modules_common.h"
+#include "cloud_module_event.h"
+#include "modem_module_event.h"
+#include "storage_module_event.h"
+#include "util_module_event.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(MODULE, CONFIG_STORAGE_MODULE_LOG_LEVEL);
+
+struct storage_msg_data {
+	union {
+		struct cloud_module_event cloud;
+		struct modem_module_event modem;
+		struct storage_module_event storage;
+		struct util_module_event util;
+	} module;
+};
+
+/* Storage module message queue. */
+#define STORAGE_QUEUE_ENTRY_COUNT	10
+#define STORAGE_QUEUE_BYTE_ALIGNMENT	4
+
+K_MSGQ_DEFINE(msgq_storage, sizeof(struct storage_msg_data),
+	      STORAGE_QUEUE_ENTRY_COUNT, STORAGE_QUEUE_BYTE_ALIGNMENT);
+
+static struct module_data self = {
+	.name = "storage",
+	.msg_q = &msgq_storage,
+	.supports_shutdown = true,
+};
+
+#define STORAGE_AREA_ID		FLASH_AREA_ID(telemetry_storage)
+#define STORAGE_MAGIC		0x544c4d31
+#define STORAGE_VERSION		1
+
+/* Unsent telemetry is kept in a flash circular buffer. When it fills up, the
+ * oldest sector is erased. Batches are coalesced in RAM first, so every flash
+ * entry is large and the sectors see as few writes and erases as possible.
+ */
+static struct fcb fcb;
+static struct flash_sector sectors[CONFIG_STORAGE_MAX_SECTORS];
+
+static uint8_t write_buf[ROUND_UP(CONFIG_STORAGE_WRITE_BUFFER_SIZE, 8)] __aligned(4);
+static size_t write_len;
+
+#if !defined(CONFIG_STORAGE_MMAP_READS)
+static uint8_t read_buf[CONFIG_STORAGE_WRITE_BUFFER_SIZE];
+#endif
+
+/* Drain position. Entries up to and including drain_loc have been acknowledged
+ * by the broker. A null sector means nothing in flash has been acknowledged yet.
+ */
+static struct fcb_entry drain_loc;
+/* Entry handed to the cloud module, waiting for CLOUD_EVT_BACKLOG_SENT. */
+static struct fcb_entry pending_loc;
+static bool pending;
+
+/* The broker is reachable. */
+static bool uplink;
+
+static bool shutdown_requested;
+
+static struct {
+	uint32_t entries_written;
+	uint32_t sectors_erased;
+	uint32_t sectors_lost;
+	uint32_t drain_bytes;
+	int64_t drain_start;
+} stats;
+
+static void flush_work_fn(struct k_work *work)
+{
+	SEND_EVENT(storage, STORAGE_EVT_FLUSH);
+}
+
+static void drain_work_fn(struct k_work *work)
+{
+	SEND_EVENT(storage, STORAGE_EVT_DRAIN);
+}
+
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_fn);
+static K_WORK_DELAYABLE_DEFINE(drain_work, drain_work_fn);
+
+static int storage_init(void)
+{
+	uint32_t sector_count = ARRAY_SIZE(sectors);
+	int err;
+
+	err = flash_area_get_sectors(STORAGE_AREA_ID, &sector_count, sectors);
+	if (err) {
+		LOG_ERR("flash_area_get_sectors, error: %d", err);
+		return err;
+	}
+
+	fcb.f_magic = STORAGE_MAGIC;
+	fcb.f_version = STORAGE_VERSION;
+	fcb.f_sectors = sectors;
+	fcb.f_sector_cnt = sector_count;
+	fcb.f_scratch_cnt = 0;
+
+	err = fcb_init(STORAGE_AREA_ID, &fcb);
+	if (err) {
+		const struct flash_area *fa;
+
+		LOG_WRN("Telemetry storage corrupt, erasing");
+
+		err = flash_area_open(STORAGE_AREA_ID, &fa);
+		if (err) {
+			return err;
+		}
+
+		err = flash_area_erase(fa, 0, fa->fa_size);
+		flash_area_close(fa);
+		if (err) {
+			return err;
+		}
+
+		err = fcb_init(STORAGE_AREA_ID, &fcb);
+		if (err) {
+			LOG_ERR("fcb_init, error: %d", err);
+			return err;
+		}
+	}
+
+	LOG_INF("Telemetry storage: %d sectors, %s", sector_count,
+		fcb_is_empty(&fcb) ? "empty" : "backlog pending");
+	return 0;
+}
+
+/* Write the coalesced batches to flash as one entry. */
+static int flush(void)
+{
+	struct fcb_entry loc;
+	size_t padded_len;
+	int err;
+
+	if (write_len == 0) {
+		return 0;
+	}
+
+	err = fcb_append(&fcb, write_len, &loc);
+	if (err == -ENOSPC) {
+		/* Erasing the oldest sector could pull flash from under the
+		 * cloud module. Keep the data in RAM until the publish is done.
+		 */
+		if (pending) {
+			return -EBUSY;
+		}
+
+		if (drain_loc.fe_sector == fcb.f_oldest) {
+			drain_loc.fe_sector = NULL;
+		}
+
+		LOG_WRN("Telemetry storage full, discarding oldest sector");
+		stats.sectors_lost++;
+
+		err = fcb_rotate(&fcb);
+		if (err == 0) {
+			err = fcb_append(&fcb, write_len, &loc);
+		}
+	}
+
+	if (err) {
+		LOG_ERR("fcb_append, error: %d", err);
+		return err;
+	}
+
+	/* The flash may only be written in whole blocks. */
+	padded_len = ROUND_UP(write_len, fcb.f_align);
+	memset(&write_buf[write_len], 0xff, padded_len - write_len);
+
+	err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), write_buf, padded_len);
+	if (err) {
+		LOG_ERR("flash_area_write, error: %d", err);
+		return err;
+	}
+
+	err = fcb_append_finish(&fcb, &loc);
+	if (err) {
+		LOG_ERR("fcb_append_finish, error: %d", err);
+		return err;
+	}
+
+	LOG_DBG("Stored %zu bytes", write_len);
+
+	stats.entries_written++;
+	write_len = 0;
+	return 0;
+}
+
+static void store(struct cloud_module_data *data)
+{
+	if (data->len > CONFIG_STORAGE_WRITE_BUFFER_SIZE) {
+		LOG_ERR("Batch of %zu bytes does not fit the write buffer", data->len);
+		goto exit;
+	}
+
+	if (write_len + data->len > CONFIG_STORAGE_WRITE_BUFFER_SIZE && flush()) {
+		LOG_WRN("Write buffer full, dropping %zu bytes", data->len);
+		goto exit;
+	}
+
+	if (write_len == 0) {
+		k_work_reschedule(&flush_work, K_SECONDS(CONFIG_STORAGE_FLUSH_INTERVAL_SEC));
+	}
+
+	memcpy(&write_buf[write_len], data->buf, data->len);
+	write_len += data->len;
+
+exit:
+	k_free(data->buf);
+}
+
+static const uint8_t *entry_data(struct fcb_entry loc)
+{
+#if defined(CONFIG_STORAGE_MMAP_READS)
+	/* Internal flash is memory mapped, the cloud module can publish straight from it. */
+	return (const uint8_t *)(CONFIG_FLASH_BASE_ADDRESS + fcb.fap->fa_off +
+				 FCB_ENTRY_FA_DATA_OFF(loc));
+#else
+	int err = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), read_buf, loc.fe_data_len);
+
+	if (err) {
+		LOG_ERR("flash_area_read, error: %d", err);
+		return NULL;
+	}
+
+	return read_buf;
+#endif
+}
+
+static void drain_done(void)
+{
+	int64_t elapsed = k_uptime_get() - stats.drain_start;
+	int err;
+
+	/* Everything is published, erase the sectors holding it. */
+	err = fcb_clear(&fcb);
+	if (err) {
+		LOG_ERR("fcb_clear, error: %d", err);
+	}
+
+	drain_loc.fe_sector = NULL;
+
+	if (stats.drain_bytes) {
+		LOG_INF("Backlog of %d bytes published in %lld ms", stats.drain_bytes, elapsed);
+		stats.drain_bytes = 0;
+	}
+}
+
+/* Publish the next stored entry. Entries are handed to the cloud module one at
+ * a time, and the next one follows as soon as the broker has acknowledged the
+ * previous, so the drain runs as fast as the uplink acknowledges.
+ */
+static void drain_next(void)
+{
+	struct fcb_entry next = drain_loc;
+	const uint8_t *data;
+	int err;
+
+	if (!uplink || pending) {
+		return;
+	}
+
+	if (stats.drain_bytes == 0) {
+		/* Include what has not reached flash yet. */
+		flush();
+		stats.drain_start = k_uptime_get();
+	}
+
+	err = fcb_getnext(&fcb, &next);
+	if (err) {
+		drain_done();
+		return;
+	}
+
+	data = entry_data(next);
+	if (data == NULL) {
+		SEND_ERROR(storage, STORAGE_EVT_ERROR, -EIO);
+		return;
+	}
+
+	struct storage_module_event *event = new_storage_module_event();
+
+	event->type = STORAGE_EVT_DATA_SEND;
+	event->data.buffer.buf = data;
+	event->data.buffer.len = next.fe_data_len;
+	APP_EVENT_SUBMIT(event);
+
+	pending_loc = next;
+	pending = true;
+}
+
+static void backlog_sent(int err)
+{
+	/* Reported after the drain was rewound. */
+	if (!pending) {
+		return;
+	}
+
+	pending = false;
+
+	if (err == -EBUSY) {
+		/* No room for more publications in flight, let the uplink catch up. */
+		k_work_reschedule(&drain_work, K_MSEC(CONFIG_STORAGE_DRAIN_RETRY_MS));
+		return;
+	} else if (err) {
+		LOG_WRN("Backlog publish failed, error: %d", err);
+		return;
+	}
+
+	stats.drain_bytes += pending_loc.fe_data_len;
+
+	/* Erase sectors as soon as they are acknowledged, so a reset does not
+	 * publish more than one sector twice.
+	 */
+	if (drain_loc.fe_sector && drain_loc.fe_sector != pending_loc.fe_sector &&
+	    drain_loc.fe_sector == fcb.f_oldest) {
+		err = fcb_rotate(&fcb);
+		if (err) {
+			LOG_ERR("fcb_rotate, error: %d", err);
+		}
+		stats.sectors_erased++;
+	}
+
+	drain_loc = pending_loc;
+	drain_next();
+}
+
+/* Handlers */
+static bool app_event_handler(const struct app_event_header *aeh)
+{
+	struct storage_msg_data msg = {0};
+	bool enqueue_msg = false;
+
+	if (is_cloud_module_event(aeh)) {
+		struct cloud_module_event *evt = cast_cloud_module_event(aeh);
+
+		msg.module.cloud = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_modem_module_event(aeh)) {
+		struct modem_module_event *evt = cast_modem_module_event(aeh);
+
+		msg.module.modem = *evt;
+		enqueue_msg = true;
+	}
+
+	if (is_storage_module_event(aeh)) {
+		struct storage_module_event *evt = cast_storage_module_event(aeh);
+
+		if (evt->type == STORAGE_EVT_FLUSH || evt->type == STORAGE_EVT_DRAIN) {
+			msg.module.storage = *evt;
+			enqueue_msg = true;
+		}
+	}
+
+	if (is_util_module_event(aeh)) {
+		struct util_module_event *evt = cast_util_module_event(aeh);
+
+		msg.module.util = *evt;
+		enqueue_msg = true;
+	}
+
+	if (enqueue_msg) {
+		int err = module_enqueue_msg(&self, &msg);
+
+		if (err) {
+			LOG_ERR("Message could not be enqueued");
+			SEND_ERROR(storage, STORAGE_EVT_ERROR, err);
+		}
+	}
+
+	return false;
+}
+
+/* Message handler for all states. */
+static void on_all_states(struct storage_msg_data *msg)
+{
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DATA_UNSENT)) {
+		store(&msg->module.cloud.data.data);
+	}
+
+	if (IS_EVENT(msg, storage, STORAGE_EVT_FLUSH)) {
+		if (flush() == -EBUSY) {
+			k_work_reschedule(&flush_work, K_MSEC(CONFIG_STORAGE_DRAIN_RETRY_MS));
+		}
+
+		drain_next();
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_CONNECTED)) {
+		uplink = true;
+		drain_next();
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DISCONNECTED) ||
+	    IS_EVENT(msg, modem, MODEM_EVT_LTE_DISCONNECTED)) {
+		uplink = false;
+		k_work_cancel_delayable(&drain_work);
+
+		/* The pending entry may not have reached the broker. Start again after
+		 * the last acknowledged entry once reconnected.
+		 */
+		if (pending) {
+			LOG_DBG("Backlog drain interrupted, rewinding");
+			pending = false;
+		}
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_BACKLOG_SENT)) {
+		backlog_sent(msg->module.cloud.data.err);
+	}
+
+	if (IS_EVENT(msg, storage, STORAGE_EVT_DRAIN)) {
+		drain_next();
+	}
+
+	if (IS_EVENT(msg, util, UTIL_EVT_SHUTDOWN_REQUEST)) {
+		shutdown_requested = true;
+	}
+
+	/* The cloud module has handed over its last batch and no longer
+	 * publishes from flash.
+	 */
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_SHUTDOWN_READY) && shutdown_requested) {
+		uplink = false;
+		pending = false;
+		k_work_cancel_delayable(&flush_work);
+		k_work_cancel_delayable(&drain_work);
+
+		if (flush()) {
+			LOG_ERR("%zu bytes of telemetry lost", write_len);
+		}
+
+		SEND_SHUTDOWN_ACK(storage, STORAGE_EVT_SHUTDOWN_READY, self.id);
+	}
+}
+
+static void module_thread_fn(void)
+{
+	int err;
+	struct storage_msg_data msg;
+
+	self.thread_id = k_current_get();
+
+	err = module_start(&self);
+	if (err) {
+		LOG_ERR("Failed starting module, error: %d", err);
+		SEND_ERROR(storage, STORAGE_EVT_ERROR, err);
+	}
+
+	err = storage_init();
+	if (err) {
+		LOG_ERR("Failed to initialize telemetry storage, error: %d", err);
+		SEND_ERROR(storage, STORAGE_EVT_ERROR, err);
+	}
+
+	while (true) {
+		module_get_next_msg(&self, &msg);
+		on_all_states(&msg);
+	}
+}
+
+K_THREAD_DEFINE(storage_module_thread, CONFIG_STORAGE_THREAD_STACK_SIZE,
+		module_thread_fn, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, cloud_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, modem_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, storage_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
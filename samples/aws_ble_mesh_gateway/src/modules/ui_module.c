@@ -12,21 +12,30 @@
 
 #include "modules_common.h"
 #include "app_module_event.h"
+#include "cloud_module_event.h"
+#include "modem_module_event.h"
+#include "storage_module_event.h"
 #include "ui_module_event.h"
+#include "util_module_event.h"
 
 #include <zephyr/logging/log.h>
-#define UI_MODULE_LOG_LEVEL 4
-LOG_MODULE_REGISTER(MODULE, UI_MODULE_LOG_LEVEL);
+LOG_MODULE_REGISTER(MODULE, CONFIG_UI_MODULE_LOG_LEVEL);
 
 /* Ui module super states. */
 static enum state_type {
 	STATE_INIT,
 	STATE_RUNNING,
+	STATE_SHUTDOWN,
 } state;
 
 struct ui_msg_data {
 	union {
 		struct app_module_event app;
+		struct cloud_module_event cloud;
+		struct modem_module_event modem;
+		struct storage_module_event storage;
+		struct ui_module_event ui;
+		struct util_module_event util;
 	} module;
 };
 
@@ -36,6 +45,72 @@ static struct module_data self = {
 	.supports_shutdown = true,
 };
 
+/* LEDs showing connectivity and errors. */
+#define LED_STATUS	DK_LED1
+#define LED_ERROR	DK_LED2
+#define LED_COUNT	4
+
+/* LED patterns
+ *
+ * A pattern is a cycle of steps, each holding a brightness level for a number
+ * of milliseconds. A step of 0 ms is held until the pattern changes.
+ * Intermediate levels are made with software PWM.
+ */
+#define LEVEL_MAX	10
+
+struct led_step {
+	uint8_t level;
+	uint16_t ms;
+};
+
+#define STEP(_level, _ms) { .level = (_level), .ms = (_ms) }
+#define FLASH STEP(LEVEL_MAX, 200), STEP(0, 300)
+#define PAUSE STEP(0, 1500)
+
+static const struct led_step steps_off[] = { STEP(0, 0) };
+static const struct led_step steps_on[] = { STEP(LEVEL_MAX, 0) };
+static const struct led_step steps_blink_slow[] = { STEP(LEVEL_MAX, 500), STEP(0, 500) };
+static const struct led_step steps_blink_fast[] = { STEP(LEVEL_MAX, 100), STEP(0, 100) };
+static const struct led_step steps_breathe[] = {
+	STEP(1, 100), STEP(2, 100), STEP(3, 100), STEP(4, 100), STEP(5, 100),
+	STEP(6, 100), STEP(7, 100), STEP(8, 100), STEP(9, 100), STEP(10, 200),
+	STEP(9, 100), STEP(8, 100), STEP(7, 100), STEP(6, 100), STEP(5, 100),
+	STEP(4, 100), STEP(3, 100), STEP(2, 100), STEP(1, 100), STEP(0, 200),
+};
+static const struct led_step steps_heartbeat[] = { STEP(LEVEL_MAX, 50), STEP(0, 4950) };
+static const struct led_step steps_code_1[] = { FLASH, PAUSE };
+static const struct led_step steps_code_2[] = { FLASH, FLASH, PAUSE };
+static const struct led_step steps_code_3[] = { FLASH, FLASH, FLASH, PAUSE };
+
+static const struct led_pattern_def {
+	const struct led_step *steps;
+	uint8_t step_count;
+} patterns[LED_PATTERN_COUNT] = {
+#define PATTERN(_pattern, _steps) [_pattern] = { _steps, ARRAY_SIZE(_steps) }
+	PATTERN(LED_OFF, steps_off),
+	PATTERN(LED_ON, steps_on),
+	PATTERN(LED_BLINK_SLOW, steps_blink_slow),
+	PATTERN(LED_BLINK_FAST, steps_blink_fast),
+	PATTERN(LED_BREATHE, steps_breathe),
+	PATTERN(LED_HEARTBEAT, steps_heartbeat),
+	PATTERN(LED_STATUS_CODE_1, steps_code_1),
+	PATTERN(LED_STATUS_CODE_2, steps_code_2),
+	PATTERN(LED_STATUS_CODE_3, steps_code_3),
+#undef PATTERN
+};
+
+static struct led {
+	const struct led_pattern_def *pattern;
+	uint8_t step;
+	int64_t step_end;
+} leds[LED_COUNT];
+
+static struct k_spinlock led_lock;
+
+/* Buttons, as last published and as last reported by the DK library. */
+static uint32_t button_states;
+static atomic_t button_states_raw;
+
 /* Forward declarations. */
 static void message_handler(struct ui_msg_data *msg);
 
@@ -44,44 +119,148 @@ static inline void state_set(enum state_type new_state)
 	state = new_state;
 }
 
-/* Handlers */
-static bool app_event_handler(const struct app_event_header *aeh)
+/* All LEDs are driven from this timer. It expires at the next step of any
+ * pattern, or at the software PWM rate while an LED is dimmed.
+ */
+static void led_timer_fn(struct k_timer *timer)
 {
-	if (is_app_module_event(aeh)) {
-		struct app_module_event *event = cast_app_module_event(aeh);
-		struct ui_msg_data ui_msg = {
-			.module.app = *event
-		};
+	int64_t now = k_uptime_get();
+	int64_t next = INT64_MAX;
+	k_spinlock_key_t key = k_spin_lock(&led_lock);
 
-		message_handler(&ui_msg);
+	for (int i = 0; i < ARRAY_SIZE(leds); i++) {
+		struct led *led = &leds[i];
+		const struct led_step *step;
+
+		if (led->pattern == NULL) {
+			continue;
+		}
+
+		step = &led->pattern->steps[led->step];
+
+		while (step->ms && now >= led->step_end) {
+			led->step = (led->step + 1) % led->pattern->step_count;
+			step = &led->pattern->steps[led->step];
+			led->step_end += step->ms;
+		}
+
+		if (step->level == 0 || step->level == LEVEL_MAX) {
+			dk_set_led(i, step->level);
+		} else {
+			uint32_t phase = now % CONFIG_UI_LED_PWM_PERIOD_MS;
+
+			dk_set_led(i, phase * LEVEL_MAX < step->level * CONFIG_UI_LED_PWM_PERIOD_MS);
+			next = MIN(next, now + MAX(CONFIG_UI_LED_PWM_PERIOD_MS / LEVEL_MAX, 1));
+		}
+
+		if (step->ms) {
+			next = MIN(next, led->step_end);
+		}
 	}
 
-	return false;
+	k_spin_unlock(&led_lock, key);
+
+	if (next != INT64_MAX) {
+		k_timer_start(timer, K_MSEC(MAX(next - now, 1)), K_NO_WAIT);
+	}
+}
+
+static K_TIMER_DEFINE(led_timer, led_timer_fn, NULL);
+
+static void led_pattern_set(int num, enum led_pattern pattern)
+{
+	if (num < 0 || num >= ARRAY_SIZE(leds) || pattern >= LED_PATTERN_COUNT) {
+		LOG_WRN("Invalid LED %d or pattern %d", num, pattern);
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&led_lock);
+	struct led *led = &leds[num];
+
+	if (led->pattern != &patterns[pattern]) {
+		led->pattern = &patterns[pattern];
+		led->step = 0;
+		led->step_end = k_uptime_get() + led->pattern->steps[0].ms;
+	}
+
+	k_spin_unlock(&led_lock, key);
+
+	/* Apply the new pattern from the timer context right away. */
+	k_timer_start(&led_timer, K_NO_WAIT, K_NO_WAIT);
 }
 
-static void button_handler(uint32_t button_states, uint32_t has_changed)
+/* Buttons are published once they have been stable for the debounce time.
+ * Bounces within that time collapse into a single state change.
+ */
+static void button_debounce_work_fn(struct k_work *work)
 {
-	
+	uint32_t states = atomic_get(&button_states_raw);
+	uint32_t changed = states ^ button_states;
 
-	if (has_changed & button_states) 
-	{
+	button_states = states;
+
+	while (changed) {
+		int btn = find_lsb_set(changed) - 1;
 		struct ui_module_event *event = new_ui_module_event();
+
+		changed &= ~BIT(btn);
+
 		event->type = UI_EVT_BUTTON;
-		event->data.button.action = BUTTON_PRESS;
-
-		if (has_changed & DK_BTN1_MSK) 
-		{
-			event->data.button.num = DK_BTN1;
-		} 
-		else if (has_changed & DK_BTN2_MSK) 
-		{
-			event->data.button.num = DK_BTN2;
-		}
+		event->data.button.num = DK_BTN1 + btn;
+		event->data.button.action = (states & BIT(btn)) ? BUTTON_PRESS : BUTTON_RELEASE;
 		APP_EVENT_SUBMIT(event);
 	}
+}
 
-	
+static K_WORK_DELAYABLE_DEFINE(button_debounce_work, button_debounce_work_fn);
 
+static void button_handler(uint32_t states, uint32_t has_changed)
+{
+	atomic_set(&button_states_raw, states);
+	k_work_reschedule(&button_debounce_work, K_MSEC(CONFIG_UI_BUTTON_DEBOUNCE_MS));
+}
+
+/* Handlers */
+static bool app_event_handler(const struct app_event_header *aeh)
+{
+	struct ui_msg_data ui_msg = {0};
+	bool handle = false;
+
+	if (is_app_module_event(aeh)) {
+		ui_msg.module.app = *cast_app_module_event(aeh);
+		handle = true;
+	}
+
+	if (is_cloud_module_event(aeh)) {
+		ui_msg.module.cloud = *cast_cloud_module_event(aeh);
+		handle = true;
+	}
+
+	if (is_modem_module_event(aeh)) {
+		ui_msg.module.modem = *cast_modem_module_event(aeh);
+		handle = true;
+	}
+
+	if (is_storage_module_event(aeh)) {
+		ui_msg.module.storage = *cast_storage_module_event(aeh);
+		handle = true;
+	}
+
+	if (is_ui_module_event(aeh)) {
+		ui_msg.module.ui = *cast_ui_module_event(aeh);
+		handle = true;
+	}
+
+	if (is_util_module_event(aeh)) {
+		ui_msg.module.util = *cast_util_module_event(aeh);
+		handle = true;
+	}
+
+	if (handle) {
+		message_handler(&ui_msg);
+	}
+
+	return false;
 }
 
 /* Static module functions. */
@@ -91,6 +270,12 @@ static int setup(const struct device *dev)
 
 	int err;
 
+	err = dk_leds_init();
+	if (err) {
+		LOG_ERR("dk_leds_init, error: %d", err);
+		return err;
+	}
+
 	err = dk_buttons_init(button_handler);
 	if (err) {
 		LOG_ERR("dk_buttons_init, error: %d", err);
@@ -118,7 +303,50 @@ static void on_state_init(struct ui_msg_data *msg)
 /* Message handler for STATE_RUNNING. */
 static void on_state_running(struct ui_msg_data *msg)
 {
-	
+	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_CONNECTING)) {
+		led_pattern_set(LED_STATUS, LED_BLINK_SLOW);
+	}
+
+	if (IS_EVENT(msg, modem, MODEM_EVT_LTE_DISCONNECTED)) {
+		led_pattern_set(LED_STATUS, LED_OFF);
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_CONNECTING)) {
+		led_pattern_set(LED_STATUS, LED_BREATHE);
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_CONNECTED)) {
+		led_pattern_set(LED_STATUS, LED_HEARTBEAT);
+		led_pattern_set(LED_ERROR, LED_OFF);
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_DISCONNECTED)) {
+		led_pattern_set(LED_STATUS, LED_BLINK_FAST);
+	}
+
+	if (IS_EVENT(msg, modem, MODEM_EVT_ERROR)) {
+		led_pattern_set(LED_ERROR, LED_STATUS_CODE_1);
+	}
+
+	if (IS_EVENT(msg, cloud, CLOUD_EVT_ERROR)) {
+		led_pattern_set(LED_ERROR, LED_STATUS_CODE_2);
+	}
+
+	if (IS_EVENT(msg, storage, STORAGE_EVT_ERROR)) {
+		led_pattern_set(LED_ERROR, LED_STATUS_CODE_3);
+	}
+
+	if (IS_EVENT(msg, ui, UI_EVT_LED)) {
+		led_pattern_set(msg->module.ui.data.led.num, msg->module.ui.data.led.pattern);
+	}
+
+	if (IS_EVENT(msg, util, UTIL_EVT_SHUTDOWN_REQUEST)) {
+		k_timer_stop(&led_timer);
+		k_work_cancel_delayable(&button_debounce_work);
+		dk_set_leds(DK_NO_LEDS_MSK);
+		state_set(STATE_SHUTDOWN);
+		SEND_SHUTDOWN_ACK(ui, UI_EVT_SHUTDOWN_READY, self.id);
+	}
 }
 
 /* Message handler for all states. */
@@ -135,6 +363,9 @@ static void message_handler(struct ui_msg_data *msg)
 	case STATE_RUNNING:
 		on_state_running(msg);
 		break;
+	case STATE_SHUTDOWN:
+		/* The UI is off. */
+		break;
 	default:
 		break;
 	}
@@ -143,7 +374,11 @@ static void message_handler(struct ui_msg_data *msg)
 }
 
 APP_EVENT_LISTENER(MODULE, app_event_handler);
-APP_EVENT_SUBSCRIBE(MODULE, module_state_event);
+APP_EVENT_SUBSCRIBE(MODULE, app_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, cloud_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, modem_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, storage_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, ui_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
 
 SYS_INIT(setup, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
-
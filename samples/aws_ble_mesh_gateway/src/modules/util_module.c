@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2021 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/reboot.h>
+#include <hal/nrf_regulators.h>
+
+#define MODULE util_module
+
+#include "modules_common.h"
+#include "cloud_module_event.h"
+#include "data_module_event.h"
+#include "mesh_bridge_module_event.h"
+#include "modem_module_event.h"
+#include "storage_module_event.h"
+#include "ui_module_event.h"
+#include "util_module_event.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(MODULE, CONFIG_UTIL_MODULE_LOG_LEVEL);
+
+/* Util module super states. */
+static enum state_type {
+	STATE_RUNNING,
+	STATE_SHUTDOWN_PENDING,
+} state;
+
+static enum shutdown_reason shutdown_reason;
+static int64_t shutdown_start;
+
+static void shutdown_deadline_work_fn(struct k_work *work)
+{
+	SEND_EVENT(util, UTIL_EVT_SHUTDOWN_DEADLINE);
+}
+
+static K_WORK_DELAYABLE_DEFINE(shutdown_deadline_work, shutdown_deadline_work_fn);
+
+static char *reason2str(enum shutdown_reason reason)
+{
+	switch (reason) {
+	case REASON_GENERIC:
+		return "Error";
+	case REASON_LOW_BATTERY:
+		return "Low battery";
+	default:
+		return "Unknown reason";
+	}
+}
+
+static void shutdown_request(enum shutdown_reason reason)
+{
+	if (state == STATE_SHUTDOWN_PENDING) {
+		return;
+	}
+
+	state = STATE_SHUTDOWN_PENDING;
+	shutdown_reason = reason;
+	shutdown_start = k_uptime_get();
+
+	LOG_WRN("Shutting down: %s", reason2str(reason));
+
+	struct util_module_event *event = new_util_module_event();
+
+	event->type = UTIL_EVT_SHUTDOWN_REQUEST;
+	event->data.reason = reason;
+	APP_EVENT_SUBMIT(event);
+
+	k_work_reschedule(&shutdown_deadline_work, K_SECONDS(CONFIG_UTIL_SHUTDOWN_DEADLINE_SEC));
+}
+
+static void shutdown_finish(void)
+{
+	k_work_cancel_delayable(&shutdown_deadline_work);
+
+	LOG_WRN("%s in %lld ms",
+		shutdown_reason == REASON_LOW_BATTERY ? "Powering off" : "Rebooting",
+		k_uptime_get() - shutdown_start);
+	LOG_PANIC();
+
+	if (shutdown_reason == REASON_LOW_BATTERY) {
+		nrf_regulators_system_off(NRF_REGULATORS);
+	} else {
+		sys_reboot(SYS_REBOOT_COLD);
+	}
+}
+
+static void shutdown_ack(const char *name, uint32_t id)
+{
+	LOG_INF("%s module ready for shutdown after %lld ms", name,
+		k_uptime_get() - shutdown_start);
+
+	if (modules_shutdown_register(id)) {
+		shutdown_finish();
+	}
+}
+
+static bool is_error(const struct app_event_header *aeh)
+{
+	return (is_cloud_module_event(aeh) &&
+		cast_cloud_module_event(aeh)->type == CLOUD_EVT_ERROR) ||
+	       (is_data_module_event(aeh) &&
+		cast_data_module_event(aeh)->type == DATA_EVT_ERROR) ||
+	       (is_mesh_bridge_module_event(aeh) &&
+		cast_mesh_bridge_module_event(aeh)->type == MESH_BRIDGE_EVT_ERROR) ||
+	       (is_modem_module_event(aeh) &&
+		cast_modem_module_event(aeh)->type == MODEM_EVT_ERROR) ||
+	       (is_storage_module_event(aeh) &&
+		cast_storage_module_event(aeh)->type == STORAGE_EVT_ERROR) ||
+	       (is_ui_module_event(aeh) &&
+		cast_ui_module_event(aeh)->type == UI_EVT_ERROR);
+}
+
+/* Handlers */
+static bool app_event_handler(const struct app_event_header *aeh)
+{
+	if (IS_ENABLED(CONFIG_UTIL_REBOOT_ON_ERROR) && is_error(aeh)) {
+		shutdown_request(REASON_GENERIC);
+	}
+
+	if (is_modem_module_event(aeh)) {
+		struct modem_module_event *evt = cast_modem_module_event(aeh);
+
+		if (evt->type == MODEM_EVT_BATTERY_LOW) {
+			shutdown_request(REASON_LOW_BATTERY);
+		}
+	}
+
+	if (state != STATE_SHUTDOWN_PENDING) {
+		return false;
+	}
+
+	if (is_util_module_event(aeh) &&
+	    cast_util_module_event(aeh)->type == UTIL_EVT_SHUTDOWN_DEADLINE) {
+		LOG_ERR("Not all modules ready for shutdown within %d s",
+			CONFIG_UTIL_SHUTDOWN_DEADLINE_SEC);
+		shutdown_finish();
+	}
+
+	if (is_cloud_module_event(aeh) &&
+	    cast_cloud_module_event(aeh)->type == CLOUD_EVT_SHUTDOWN_READY) {
+		shutdown_ack("Cloud", cast_cloud_module_event(aeh)->data.id);
+	}
+
+	if (is_data_module_event(aeh) &&
+	    cast_data_module_event(aeh)->type == DATA_EVT_SHUTDOWN_READY) {
+		shutdown_ack("Data", cast_data_module_event(aeh)->data.id);
+	}
+
+	if (is_mesh_bridge_module_event(aeh) &&
+	    cast_mesh_bridge_module_event(aeh)->type == MESH_BRIDGE_EVT_SHUTDOWN_READY) {
+		shutdown_ack("Mesh bridge", cast_mesh_bridge_module_event(aeh)->data.id);
+	}
+
+	if (is_modem_module_event(aeh) &&
+	    cast_modem_module_event(aeh)->type == MODEM_EVT_SHUTDOWN_READY) {
+		shutdown_ack("Modem", cast_modem_module_event(aeh)->data.id);
+	}
+
+	if (is_storage_module_event(aeh) &&
+	    cast_storage_module_event(aeh)->type == STORAGE_EVT_SHUTDOWN_READY) {
+		shutdown_ack("Storage", cast_storage_module_event(aeh)->data.id);
+	}
+
+	if (is_ui_module_event(aeh) &&
+	    cast_ui_module_event(aeh)->type == UI_EVT_SHUTDOWN_READY) {
+		shutdown_ack("UI", cast_ui_module_event(aeh)->data.id);
+	}
+
+	return false;
+}
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, cloud_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, data_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, mesh_bridge_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, modem_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, storage_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, ui_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, util_module_event);
@@ -0,0 +1,47 @@
+#pragma once
+#include <zephyr.h>
+#include <device.h>
+
+typedef int (*edge_rate_get_t)(const struct device *dev, uint32_t *rate_mhz);
+
+typedef int (*edge_count_get_t)(const struct device *dev, uint32_t *count);
+
+struct encoder_api
+{
+    edge_rate_get_t edge_rate_get;
+    edge_count_get_t edge_count_get;
+};
+
+/**
+ * @brief Get the edge rate of an encoder.
+ *
+ * The rate is the number of edges since the previous call over the time between the last
+ * edges seen by the two calls, so it is exact to the edge at any speed. Without new edges,
+ * the rate decays as if the next edge would come right now, and drops to zero after
+ * CONFIG_WHEEL_ENCODER_TIMEOUT_MS. Meant to be called at a fixed rate from a control loop.
+ *
+ * @param dev Encoder device
+ * @param rate_mhz Edge rate in millihertz. Unsigned, as the encoder does not tell the
+ *                 direction.
+ * @return 0 on success, negative errno code otherwise.
+ */
+static inline int encoder_edge_rate_get(const struct device *dev, uint32_t *rate_mhz)
+{
+    const struct encoder_api *api = (struct encoder_api *)dev->api;
+
+    return api->edge_rate_get(dev, rate_mhz);
+}
+
+/**
+ * @brief Get the number of edges since the encoder was initialized.
+ *
+ * @param dev Encoder device
+ * @param count Edge count. Wraps around.
+ * @return 0 on success, negative errno code otherwise.
+ */
+static inline int encoder_edge_count_get(const struct device *dev, uint32_t *count)
+{
+    const struct encoder_api *api = (struct encoder_api *)dev->api;
+
+    return api->edge_count_get(dev, count);
+}
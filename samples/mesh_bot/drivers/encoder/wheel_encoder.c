@@ -0,0 +1,317 @@
+#include <devicetree.h>
+#include <device.h>
+#include <drivers/gpio.h>
+#include "encoder.h"
+
+#if defined(CONFIG_WHEEL_ENCODER_PPI)
+#include <nrfx_gpiote.h>
+#include <nrfx_timer.h>
+#include <helpers/nrfx_gppi.h>
+#endif
+
+#define DT_DRV_COMPAT wheel_encoder
+#define WHEEL_ENCODER_INIT_PRIORITY 60
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(wheel_encoder_driver, CONFIG_WHEEL_ENCODER_DRIVER_LOG_LEVEL);
+
+struct encoder_data
+{
+    /* Protects the edge and estimator state */
+    struct k_spinlock lock;
+#if !defined(CONFIG_WHEEL_ENCODER_PPI)
+    struct gpio_callback cb;
+    /* Updated by the edge interrupt */
+    uint32_t count;
+    uint32_t edge_time;
+#endif
+    /* Estimator state */
+    uint32_t prev_count;
+    uint32_t prev_edge_time;
+    uint32_t rate_mhz;
+    bool moving;
+};
+
+struct encoder_conf
+{
+    struct gpio_dt_spec gpio;
+#if defined(CONFIG_WHEEL_ENCODER_PPI)
+    uint32_t abs_pin;
+    nrfx_timer_t counter;
+    nrf_timer_cc_channel_t capture;
+#endif
+};
+
+/* Speed estimation
+ *
+ * Edges are counted, and the time of the last edge is kept. The rate is the
+ * number of edges between two readings over the time between the last edges
+ * of each reading. At high speed this counts many edges over an interval
+ * close to the reading interval, at low speed it measures the period of the
+ * last edges, without switching between the two.
+ *
+ * Called with the lock of the encoder held, with count and times read under
+ * the same lock, so the state never moves back to an older reading.
+ */
+static uint32_t rate_update(struct encoder_data *data, uint32_t count, uint32_t edge_time,
+                            uint32_t now, uint32_t ticks_per_sec)
+{
+    uint32_t edges = count - data->prev_count;
+
+    if (edges) {
+        uint32_t interval = edge_time - data->prev_edge_time;
+
+        /* After a stop the previous edge is too old to time the new ones */
+        if (data->moving && interval) {
+            data->rate_mhz = MIN((uint64_t)edges * ticks_per_sec * 1000 / interval, UINT32_MAX);
+        }
+        data->prev_count = count;
+        data->prev_edge_time = edge_time;
+        data->moving = true;
+        return data->rate_mhz;
+    }
+
+    if (!data->moving) {
+        return 0;
+    }
+
+    uint32_t since = now - data->prev_edge_time;
+
+    if (since > (uint64_t)ticks_per_sec * CONFIG_WHEEL_ENCODER_TIMEOUT_MS / 1000) {
+        data->moving = false;
+        data->rate_mhz = 0;
+    } else if (since) {
+        /* The next edge is at least this late, so the wheel is at most this fast */
+        data->rate_mhz = MIN(data->rate_mhz, (uint64_t)ticks_per_sec * 1000 / since);
+    }
+    return data->rate_mhz;
+}
+
+#if defined(CONFIG_WHEEL_ENCODER_PPI)
+
+/* Edges are captured without the CPU. GPIOTE turns each edge into an event,
+ * which PPI forwards to the COUNT task of the encoder's counter and to a
+ * CAPTURE task of the shared timestamp timer.
+ */
+#define TIMESTAMP_HZ 1000000
+#define NOW_CAPTURE (NRF_TIMER_CC_CHANNEL_COUNT(CONFIG_WHEEL_ENCODER_TIMESTAMP_TIMER) - 1)
+
+BUILD_ASSERT(DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) <= NOW_CAPTURE,
+             "Timestamp timer has too few capture channels for all encoders");
+
+static const nrfx_timer_t timestamp_timer = NRFX_TIMER_INSTANCE(CONFIG_WHEEL_ENCODER_TIMESTAMP_TIMER);
+static struct k_spinlock now_lock;
+
+/* Required by nrfx, the timers raise no interrupts */
+static void timer_handler(nrf_timer_event_t event_type, void *context)
+{
+}
+
+static int timer_start(const nrfx_timer_t *timer, nrf_timer_mode_t mode)
+{
+    nrfx_timer_config_t config = {
+        .frequency = NRF_TIMER_FREQ_1MHz,
+        .mode = mode,
+        .bit_width = NRF_TIMER_BIT_WIDTH_32,
+    };
+
+    if (nrfx_timer_init(timer, &config, timer_handler) != NRFX_SUCCESS) {
+        return -EBUSY;
+    }
+    nrfx_timer_enable(timer);
+    return 0;
+}
+
+static int _edge_count_get(const struct device *dev, uint32_t *count)
+{
+    struct encoder_conf *conf = (struct encoder_conf *)dev->config;
+
+    *count = nrfx_timer_capture(&conf->counter, NRF_TIMER_CC_CHANNEL0);
+    return 0;
+}
+
+static int _edge_rate_get(const struct device *dev, uint32_t *rate_mhz)
+{
+    struct encoder_conf *conf = (struct encoder_conf *)dev->config;
+    struct encoder_data *data = (struct encoder_data *)dev->data;
+    uint32_t count, edge_time, check, now;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    /* Retry if an edge came in between, so count and time belong together */
+    do {
+        edge_time = nrfx_timer_capture_get(&timestamp_timer, conf->capture);
+        count = nrfx_timer_capture(&conf->counter, NRF_TIMER_CC_CHANNEL0);
+        check = nrfx_timer_capture_get(&timestamp_timer, conf->capture);
+    } while (edge_time != check);
+
+    k_spinlock_key_t now_key = k_spin_lock(&now_lock);
+    now = nrfx_timer_capture(&timestamp_timer, NOW_CAPTURE);
+    k_spin_unlock(&now_lock, now_key);
+
+    *rate_mhz = rate_update(data, count, edge_time, now, TIMESTAMP_HZ);
+    k_spin_unlock(&data->lock, key);
+    return 0;
+}
+
+static int init_capture(const struct device *dev)
+{
+    static bool timestamp_started;
+    struct encoder_conf *conf = (struct encoder_conf *)dev->config;
+    uint8_t gpiote_ch;
+    uint8_t ppi_ch;
+    int err;
+
+    if (!timestamp_started) {
+        err = timer_start(&timestamp_timer, NRF_TIMER_MODE_TIMER);
+        if (err) {
+            LOG_ERR("Timestamp timer %d unavailable", CONFIG_WHEEL_ENCODER_TIMESTAMP_TIMER);
+            return err;
+        }
+        timestamp_started = true;
+    }
+
+    err = timer_start(&conf->counter, NRF_TIMER_MODE_LOW_POWER_COUNTER);
+    if (err) {
+        LOG_ERR("Counter timer for %s unavailable", dev->name);
+        return err;
+    }
+
+    if (!nrfx_gpiote_is_init() && nrfx_gpiote_init(0) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+
+    if (nrfx_gpiote_channel_alloc(&gpiote_ch) != NRFX_SUCCESS ||
+        nrfx_gppi_channel_alloc(&ppi_ch) != NRFX_SUCCESS) {
+        LOG_ERR("No GPIOTE or PPI channel left for %s", dev->name);
+        return -ENOMEM;
+    }
+
+    /* The pin keeps the configuration from the devicetree flags */
+    nrfx_gpiote_trigger_config_t trigger = {
+        .trigger = NRFX_GPIOTE_TRIGGER_TOGGLE,
+        .p_in_channel = &gpiote_ch,
+    };
+
+    if (nrfx_gpiote_input_configure(conf->abs_pin, NULL, &trigger, NULL) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+
+    nrfx_gppi_channel_endpoints_setup(ppi_ch, nrfx_gpiote_in_event_addr_get(conf->abs_pin),
+                                      nrfx_timer_task_address_get(&conf->counter, NRF_TIMER_TASK_COUNT));
+    nrfx_gppi_fork_endpoint_setup(ppi_ch, nrfx_timer_capture_task_address_get(&timestamp_timer, conf->capture));
+    nrfx_gppi_channels_enable(BIT(ppi_ch));
+    nrfx_gpiote_trigger_enable(conf->abs_pin, false);
+    return 0;
+}
+
+#else
+
+/* Every edge raises an interrupt, which counts and timestamps it */
+static void edge_handler(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins)
+{
+    struct encoder_data *data = CONTAINER_OF(cb, struct encoder_data, cb);
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    data->count++;
+    data->edge_time = k_cycle_get_32();
+    k_spin_unlock(&data->lock, key);
+}
+
+static int _edge_count_get(const struct device *dev, uint32_t *count)
+{
+    struct encoder_data *data = (struct encoder_data *)dev->data;
+
+    *count = data->count;
+    return 0;
+}
+
+static int _edge_rate_get(const struct device *dev, uint32_t *rate_mhz)
+{
+    struct encoder_data *data = (struct encoder_data *)dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    *rate_mhz = rate_update(data, data->count, data->edge_time, k_cycle_get_32(),
+                            sys_clock_hw_cycles_per_sec());
+    k_spin_unlock(&data->lock, key);
+    return 0;
+}
+
+static int init_capture(const struct device *dev)
+{
+    struct encoder_conf *conf = (struct encoder_conf *)dev->config;
+    struct encoder_data *data = (struct encoder_data *)dev->data;
+    int err;
+
+    gpio_init_callback(&data->cb, edge_handler, BIT(conf->gpio.pin));
+    err = gpio_add_callback(conf->gpio.port, &data->cb);
+    if (err)
+    {
+        LOG_ERR("Failed to add gpio callback");
+        return err;
+    }
+
+    return gpio_pin_interrupt_configure_dt(&conf->gpio, GPIO_INT_EDGE_BOTH);
+}
+
+#endif /* defined(CONFIG_WHEEL_ENCODER_PPI) */
+
+struct encoder_api encoder_api = {
+    .edge_rate_get = _edge_rate_get,
+    .edge_count_get = _edge_count_get,
+};
+
+static int init_encoder(const struct device *dev)
+{
+    struct encoder_conf *conf = (struct encoder_conf *)dev->config;
+    int err;
+
+    if (!device_is_ready(conf->gpio.port))
+    {
+        LOG_ERR("Gpio, %s, is not ready", conf->gpio.port->name);
+        return -ENODEV;
+    }
+
+    err = gpio_pin_configure_dt(&conf->gpio, GPIO_INPUT);
+    if (err)
+    {
+        LOG_ERR("Failed to configure gpio");
+        return err;
+    }
+
+    err = init_capture(dev);
+    if (err)
+    {
+        LOG_ERR("Error while initializing edge capture: %d", err);
+        return err;
+    }
+    LOG_DBG("Encoder %s initialized", dev->name);
+    return 0;
+}
+
+#if defined(CONFIG_WHEEL_ENCODER_PPI)
+#define ENCODER_CAPTURE_CONF(inst)                                                        \
+    .abs_pin = NRF_GPIO_PIN_MAP(DT_PROP(DT_INST_GPIO_CTLR(inst, gpios), port),            \
+                                DT_INST_GPIO_PIN(inst, gpios)),                           \
+    .counter = NRFX_TIMER_INSTANCE(DT_INST_PROP(inst, counter_timer)),                    \
+    .capture = (nrf_timer_cc_channel_t)inst,
+#else
+#define ENCODER_CAPTURE_CONF(inst)
+#endif
+
+#define INIT_WHEEL_ENCODER(inst)                                    \
+    static struct encoder_conf conf_##inst = {                      \
+        .gpio = GPIO_DT_SPEC_INST_GET(inst, gpios),                 \
+        ENCODER_CAPTURE_CONF(inst)                                  \
+    };                                                              \
+    static struct encoder_data data_##inst = {};                    \
+    DEVICE_DT_INST_DEFINE(                                          \
+        inst,                                                       \
+        init_encoder,                                               \
+        NULL,                                                       \
+        &data_##inst,                                               \
+        &conf_##inst,                                               \
+        POST_KERNEL,                                                \
+        WHEEL_ENCODER_INIT_PRIORITY,                                \
+        &encoder_api);
+
+DT_INST_FOREACH_STATUS_OKAY(INIT_WHEEL_ENCODER)
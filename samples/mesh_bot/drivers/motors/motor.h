@@ -6,11 +6,17 @@ typedef int (*drive_continous_t)(const struct device *dev, int32_t power);
 
 typedef int (*set_position_t)(const struct device *dev, int position, int32_t power, bool hold);
 
+typedef int (*emergency_stop_t)(const struct device *dev);
+
+typedef int (*emergency_release_t)(const struct device *dev);
+
 
 struct motor_api
 {
     drive_continous_t drive_continous;
     set_position_t set_position;
+    emergency_stop_t emergency_stop;
+    emergency_release_t emergency_release;
 };
 
 /**
@@ -22,6 +28,7 @@ struct motor_api
  *              on the underlying driver
  * @return 0 on success, negative errno code otherwise.
  *         -ENOTSUP if motor does not support continous rotation. 
+ *         -EBUSY if power is non-zero and the motor is emergency stopped.
  *         Other error codes are defined by the underlying driver.
  */
 static inline int drive_continous(const struct device *dev, int32_t power)
@@ -56,4 +63,42 @@ static inline int set_position(const struct device *dev, int32_t position, int32
     }
 
     return api->set_position(dev, position, power, hold);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Stop the motor at once, and refuse power until released.
+ *
+ * Safe to call from interrupts. The motor is braked if the driver supports it.
+ *
+ * @param dev Motor device
+ * @return 0 on success, negative errno code otherwise.
+ *         -ENOTSUP if the driver does not support emergency stops.
+ */
+static inline int emergency_stop(const struct device *dev)
+{
+    const struct motor_api *api = (struct motor_api *)dev->api;
+
+    if (api->emergency_stop == NULL){
+        return -ENOTSUP;
+    }
+
+    return api->emergency_stop(dev);
+}
+
+/**
+ * @brief Accept power again after an emergency stop. The motor is left unpowered.
+ *
+ * @param dev Motor device
+ * @return 0 on success, negative errno code otherwise.
+ *         -ENOTSUP if the driver does not support emergency stops.
+ */
+static inline int emergency_release(const struct device *dev)
+{
+    const struct motor_api *api = (struct motor_api *)dev->api;
+
+    if (api->emergency_release == NULL){
+        return -ENOTSUP;
+    }
+
+    return api->emergency_release(dev);
+}
@@ -13,6 +13,8 @@ LOG_MODULE_REGISTER(tb6612fng_motor_driver, CONFIG_TB6612FNG_MOTOR_DRIVER_LOG_LE
 
 struct motor_data
 {
+    struct k_spinlock lock;
+    bool stopped; // Emergency stopped, power is refused until released.
 };
 
 struct motor_conf
@@ -22,11 +24,15 @@ struct motor_conf
     struct pwm_dt_spec pwm;
 };
 
-static int _drive_continous(const struct device *dev, int32_t power)
+static bool has_direction(const struct motor_conf *conf)
 {
-    struct motor_conf *conf = (struct motor_conf *)dev->config;
+    return conf->gpio1.port != NULL && conf->gpio2.port != NULL;
+}
 
-    if (conf->gpio1.port != NULL && conf->gpio2.port != NULL)
+/* Called with the lock held, so an emergency stop is never undone halfway through */
+static int set_outputs(const struct motor_conf *conf, int32_t power)
+{
+    if (has_direction(conf))
     {
         if (power > 0)
         { // CW
@@ -42,26 +48,75 @@ static int _drive_continous(const struct device *dev, int32_t power)
             gpio_pin_set_dt(&conf->gpio2, 0);
         }
     }
-    else if (power < 0)
+
+    return pwm_set_pulse_dt(&conf->pwm, power >= 0 ? power : -power);
+}
+
+static int _drive_continous(const struct device *dev, int32_t power)
+{
+    struct motor_conf *conf = (struct motor_conf *)dev->config;
+    struct motor_data *data = (struct motor_data *)dev->data;
+    int err;
+
+    if (power < 0 && !has_direction(conf))
     {
         LOG_WRN("Negative power %d given but driver has no direction control GPIOs", power);
     }
 
-    int32_t abs_power = power >= 0 ? power : -power;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    err = data->stopped && power != 0 ? -EBUSY : set_outputs(conf, power);
+    k_spin_unlock(&data->lock, key);
 
-    int err = pwm_set_pulse_dt(&conf->pwm, abs_power);
     if (err) {
-        LOG_ERR("Failed to set PWM pulse: Error %d", err);
+        LOG_ERR("Failed to set power on motor %s: Error %d", dev->name, err);
         return err;
     }
 
-    LOG_DBG("Setting power on motor %s to %d", dev->name, abs_power);
+    LOG_DBG("Setting power on motor %s to %d", dev->name, power >= 0 ? power : -power);
     return 0;
 }
 
+/* Both inputs high short brake the motor whatever the PWM output, so the motor
+ * stops at once, not when the new pulse width is loaded at the end of the period.
+ */
+static int _emergency_stop(const struct device *dev)
+{
+    struct motor_conf *conf = (struct motor_conf *)dev->config;
+    struct motor_data *data = (struct motor_data *)dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    data->stopped = true;
+    if (has_direction(conf))
+    {
+        gpio_pin_set_dt(&conf->gpio1, 1);
+        gpio_pin_set_dt(&conf->gpio2, 1);
+    }
+
+    int err = pwm_set_pulse_dt(&conf->pwm, 0);
+
+    k_spin_unlock(&data->lock, key);
+    return err;
+}
+
+static int _emergency_release(const struct device *dev)
+{
+    struct motor_conf *conf = (struct motor_conf *)dev->config;
+    struct motor_data *data = (struct motor_data *)dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    data->stopped = false;
+    int err = set_outputs(conf, 0);
+
+    k_spin_unlock(&data->lock, key);
+    return err;
+}
+
 struct motor_api api = {
     .drive_continous = _drive_continous,
     .set_position = NULL,
+    .emergency_stop = _emergency_stop,
+    .emergency_release = _emergency_release,
 };
 
 static int init_gpio(const struct device *dev)
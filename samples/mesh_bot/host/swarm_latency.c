@@ -0,0 +1,642 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Swarm command latency report for Linux hosts.
+ *
+ * Given the consoles of a swarm built with overlay-latency-trace.conf, joins the
+ * trace rows on commander, tid and seq, and reports the delivery ratio, the
+ * latency from sending a command to its reception and to motor actuation, and
+ * the copies each robot heard. Actuation of scheduled starts includes the
+ * scheduling delay.
+ *
+ * Without consoles, floods group commands through simulated swarms of 5, 20 and
+ * 50 robots instead, and also reports the airtime spent per command. The
+ * simulation uses the network and relay retransmissions of the mesh_bot
+ * configuration, a distance based link model and collisions between
+ * overlapping advertisements. It is seeded, so its results only change with
+ * the model.
+ *
+ * Results are CSV, one row per swarm. Given a baseline in the same format,
+ * rows that deliver less, or take longer or more airtime than the baseline
+ * allows, are reported and the exit code is 1.
+ *
+ * Build from the repository root:
+ *
+ *   gcc -O2 samples/mesh_bot/host/swarm_latency.c -o swarm_latency -lm
+ *
+ * Check the simulation against the committed baseline:
+ *
+ *   ./swarm_latency -b samples/mesh_bot/host/swarm_latency_baseline.csv
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_ROBOTS 256
+#define MAX_BASELINE 16
+
+/* Group addresses start here, commands to them are expected by all robots. */
+#define GROUP_ADDR_MIN 0xc000
+
+/* Allowed regression against the baseline. */
+#define DELIVERY_MARGIN 0.01
+#define LATENCY_MARGIN_PCT 10
+#define AIRTIME_MARGIN_PCT 10
+
+/* Simulation. mesh_bot uses the Zephyr defaults of 3 network and 3 relay transmissions,
+ * 20 ms apart, each delayed by up to 10 ms, and the default TTL of 7.
+ */
+#define SIM_COMMANDS 200
+#define NET_TRANSMITS 3
+#define RELAY_TRANSMITS 3
+#define TRANSMIT_INTERVAL_US 20000
+#define ADV_DELAY_MAX_US 10000
+#define TTL_DEFAULT 7
+/* 47 byte advertising PDU at 1 Mbps, sent on all three advertising channels. */
+#define PDU_AIR_US 376
+#define ADV_CHANNELS 3
+#define ADV_EVENT_US (ADV_CHANNELS * (PDU_AIR_US + 150))
+/* Robots are spread with one per square of this side, the commander in the middle. */
+#define SPACING_M 6.0
+/* Links are good up to the first range and gone beyond the second. */
+#define RANGE_GOOD_M 10.0
+#define RANGE_MAX_M 20.0
+#define LINK_GOOD 0.95
+#define MAX_EVENTS (NET_TRANSMITS + MAX_ROBOTS * RELAY_TRANSMITS)
+
+struct result
+{
+    uint32_t robots;
+    uint32_t commands;
+    double delivery_ratio;
+    /* Negative when there is nothing to report. */
+    double rx_p50_us;
+    double rx_p99_us;
+    double act_p50_us;
+    double act_p99_us;
+    double copies_per_robot;
+    double airtime_us_per_cmd;
+};
+
+struct samples
+{
+    uint64_t *val;
+    size_t count;
+    size_t size;
+};
+
+static void samples_add(struct samples *s, uint64_t val)
+{
+    if (s->count == s->size) {
+        s->size = s->size ? s->size * 2 : 256;
+        s->val = realloc(s->val, s->size * sizeof(*s->val));
+        if (s->val == NULL) {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    s->val[s->count++] = val;
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(struct samples *s, int pct)
+{
+    if (s->count == 0) {
+        return -1.0;
+    }
+
+    qsort(s->val, s->count, sizeof(*s->val), u64_cmp);
+    return s->val[(s->count - 1) * pct / 100];
+}
+
+static void result_header(void)
+{
+    printf("robots,commands,delivery_ratio,rx_p50_us,rx_p99_us,act_p50_us,act_p99_us,"
+           "copies_per_robot,airtime_us_per_cmd\n");
+}
+
+static void field_print(double val, const char *fmt)
+{
+    putchar(',');
+    if (val >= 0.0) {
+        printf(fmt, val);
+    }
+}
+
+static void result_print(const struct result *r)
+{
+    printf("%u,%u", r->robots, r->commands);
+    field_print(r->delivery_ratio, "%.4f");
+    field_print(r->rx_p50_us, "%.0f");
+    field_print(r->rx_p99_us, "%.0f");
+    field_print(r->act_p50_us, "%.0f");
+    field_print(r->act_p99_us, "%.0f");
+    field_print(r->copies_per_robot, "%.2f");
+    field_print(r->airtime_us_per_cmd, "%.0f");
+    putchar('\n');
+}
+
+/* Trace analysis */
+
+enum point
+{
+    POINT_TX,
+    POINT_RX,
+    POINT_DUP,
+    POINT_ACT,
+};
+
+struct row
+{
+    enum point point;
+    uint64_t time_us;
+    uint16_t node;
+    uint16_t peer;
+    uint8_t tid;
+    uint8_t seq;
+};
+
+static struct row *rows;
+static size_t row_count;
+
+static void row_add(const struct row *row)
+{
+    static size_t size;
+
+    if (row_count == size) {
+        size = size ? size * 2 : 1024;
+        rows = realloc(rows, size * sizeof(*rows));
+        if (rows == NULL) {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    rows[row_count++] = *row;
+}
+
+static int trace_read(const char *path)
+{
+    static const char *const point_str[] = {
+        [POINT_TX] = "tx",
+        [POINT_RX] = "rx",
+        [POINT_DUP] = "dup",
+        [POINT_ACT] = "act",
+    };
+    char line[256];
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        /* Rows may follow other console output on the same line. */
+        char *p = strstr(line, "lat,");
+        char point[8];
+        unsigned int node, peer, cmd, tid, seq;
+        int rssi;
+        struct row row;
+
+        if (p == NULL || sscanf(p, "lat,%7[^,],%" SCNu64 ",%u,%u,%u,%u,%u,%d", point,
+                                &row.time_us, &node, &peer, &cmd, &tid, &seq, &rssi) != 8) {
+            continue;
+        }
+
+        for (row.point = POINT_TX; row.point <= POINT_ACT; row.point++) {
+            if (strcmp(point, point_str[row.point]) == 0) {
+                break;
+            }
+        }
+
+        if (row.point > POINT_ACT) {
+            continue;
+        }
+
+        row.node = node;
+        row.peer = peer;
+        row.tid = tid;
+        row.seq = seq;
+        row_add(&row);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static bool robot_add(uint16_t *robots, uint32_t *count, uint16_t addr)
+{
+    for (uint32_t i = 0; i < *count; i++) {
+        if (robots[i] == addr) {
+            return false;
+        }
+    }
+
+    if (*count == MAX_ROBOTS) {
+        return false;
+    }
+
+    robots[(*count)++] = addr;
+    return true;
+}
+
+/* Finds the row a received or actuated command was sent in. */
+static const struct row *tx_find(const struct row *row)
+{
+    for (size_t i = 0; i < row_count; i++) {
+        if (rows[i].point == POINT_TX && rows[i].node == row->peer &&
+            rows[i].tid == row->tid && rows[i].seq == row->seq) {
+            return &rows[i];
+        }
+    }
+    return NULL;
+}
+
+static void trace_analyze(struct result *r)
+{
+    uint16_t robots[MAX_ROBOTS];
+    uint32_t robot_count = 0;
+    uint64_t expected = 0;
+    uint64_t delivered = 0;
+    uint64_t copies = 0;
+    struct samples rx = {0};
+    struct samples act = {0};
+
+    for (size_t i = 0; i < row_count; i++) {
+        if (rows[i].point == POINT_RX || rows[i].point == POINT_DUP) {
+            robot_add(robots, &robot_count, rows[i].node);
+        }
+    }
+
+    for (size_t i = 0; i < row_count; i++) {
+        const struct row *row = &rows[i];
+        const struct row *tx;
+
+        switch (row->point) {
+        case POINT_TX:
+            r->commands++;
+            if (row->peer < GROUP_ADDR_MIN) {
+                expected++;
+                break;
+            }
+
+            /* The commander does not receive its own group commands. */
+            expected += robot_count;
+            for (uint32_t j = 0; j < robot_count; j++) {
+                if (robots[j] == row->node) {
+                    expected--;
+                }
+            }
+            break;
+        case POINT_RX:
+            copies++;
+            tx = tx_find(row);
+            if (tx) {
+                delivered++;
+                samples_add(&rx, row->time_us - tx->time_us);
+            }
+            break;
+        case POINT_DUP:
+            copies++;
+            break;
+        case POINT_ACT:
+            tx = tx_find(row);
+            if (tx) {
+                samples_add(&act, row->time_us - tx->time_us);
+            }
+            break;
+        }
+    }
+
+    r->robots = robot_count;
+    r->delivery_ratio = expected ? (double)delivered / expected : -1.0;
+    r->rx_p50_us = percentile(&rx, 50);
+    r->rx_p99_us = percentile(&rx, 99);
+    r->act_p50_us = percentile(&act, 50);
+    r->act_p99_us = percentile(&act, 99);
+    r->copies_per_robot = robot_count && r->commands ?
+                              (double)copies / robot_count / r->commands : -1.0;
+    r->airtime_us_per_cmd = -1.0;
+
+    free(rx.val);
+    free(act.val);
+}
+
+/* Simulation */
+
+static uint64_t rng_state;
+
+static uint32_t rng(void)
+{
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+static double rng_unit(void)
+{
+    return rng() / 4294967296.0;
+}
+
+struct node
+{
+    double x;
+    double y;
+};
+
+/* One advertising event: a PDU on all advertising channels. */
+struct event
+{
+    uint64_t start;
+    uint32_t node;
+    uint8_t ttl;
+    bool done;
+};
+
+static struct node nodes[MAX_ROBOTS + 1];
+static double link_p[MAX_ROBOTS + 1][MAX_ROBOTS + 1];
+static struct event events[MAX_EVENTS];
+static uint32_t event_count;
+
+static double link_quality(const struct node *a, const struct node *b)
+{
+    double d = hypot(a->x - b->x, a->y - b->y);
+
+    if (d <= RANGE_GOOD_M) {
+        return LINK_GOOD;
+    }
+
+    if (d >= RANGE_MAX_M) {
+        return 0.0;
+    }
+
+    return LINK_GOOD * (RANGE_MAX_M - d) / (RANGE_MAX_M - RANGE_GOOD_M);
+}
+
+static void transmissions_add(uint32_t node, uint64_t first, int count, uint8_t ttl)
+{
+    uint64_t start = first;
+
+    for (int i = 0; i < count && event_count < MAX_EVENTS; i++) {
+        start += rng() % (ADV_DELAY_MAX_US + 1);
+        events[event_count++] = (struct event){
+            .start = start,
+            .node = node,
+            .ttl = ttl,
+        };
+        start += TRANSMIT_INTERVAL_US;
+    }
+}
+
+/* A reception is lost if the receiver hears another event overlapping it. */
+static bool collides(const struct event *e, uint32_t rx)
+{
+    for (uint32_t i = 0; i < event_count; i++) {
+        const struct event *other = &events[i];
+
+        if (other == e || other->node == rx || link_p[other->node][rx] == 0.0) {
+            continue;
+        }
+
+        if (other->start < e->start + ADV_EVENT_US && e->start < other->start + ADV_EVENT_US) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Floods one group command from the commander, node 0, through the robots. */
+static void sim_command(uint32_t robots, struct samples *rx, uint64_t *delivered,
+                        uint64_t *copies, uint64_t *airtime_us)
+{
+    bool accepted[MAX_ROBOTS + 1] = {0};
+
+    event_count = 0;
+    transmissions_add(0, 0, NET_TRANSMITS, TTL_DEFAULT);
+
+    /* Events in order of their end. Relays start after the reception that
+     * triggers them ends, so every event overlapping the current one is known.
+     */
+    while (true) {
+        struct event *e = NULL;
+
+        for (uint32_t i = 0; i < event_count; i++) {
+            if (!events[i].done && (e == NULL || events[i].start < e->start)) {
+                e = &events[i];
+            }
+        }
+
+        if (e == NULL) {
+            break;
+        }
+
+        e->done = true;
+        *airtime_us += ADV_CHANNELS * PDU_AIR_US;
+
+        for (uint32_t n = 1; n <= robots; n++) {
+            if (n == e->node || rng_unit() >= link_p[e->node][n] || collides(e, n)) {
+                continue;
+            }
+
+            (*copies)++;
+
+            if (accepted[n]) {
+                continue;
+            }
+
+            uint64_t end = e->start + ADV_EVENT_US;
+
+            accepted[n] = true;
+            (*delivered)++;
+            samples_add(rx, end);
+
+            if (e->ttl > 1) {
+                transmissions_add(n, end, RELAY_TRANSMITS, e->ttl - 1);
+            }
+        }
+    }
+}
+
+static void simulate(uint32_t robots, struct result *r)
+{
+    double side = sqrt(robots) * SPACING_M;
+    struct samples rx = {0};
+    uint64_t delivered = 0;
+    uint64_t copies = 0;
+    uint64_t airtime_us = 0;
+
+    rng_state = 0x9e3779b97f4a7c15ull ^ robots;
+
+    nodes[0] = (struct node){ side / 2, side / 2 };
+    for (uint32_t n = 1; n <= robots; n++) {
+        nodes[n] = (struct node){ rng_unit() * side, rng_unit() * side };
+    }
+
+    for (uint32_t a = 0; a <= robots; a++) {
+        for (uint32_t b = 0; b <= robots; b++) {
+            link_p[a][b] = a == b ? 0.0 : link_quality(&nodes[a], &nodes[b]);
+        }
+    }
+
+    for (int i = 0; i < SIM_COMMANDS; i++) {
+        sim_command(robots, &rx, &delivered, &copies, &airtime_us);
+    }
+
+    *r = (struct result){
+        .robots = robots,
+        .commands = SIM_COMMANDS,
+        .delivery_ratio = (double)delivered / ((uint64_t)robots * SIM_COMMANDS),
+        .rx_p50_us = percentile(&rx, 50),
+        .rx_p99_us = percentile(&rx, 99),
+        .act_p50_us = -1.0,
+        .act_p99_us = -1.0,
+        .copies_per_robot = (double)copies / robots / SIM_COMMANDS,
+        .airtime_us_per_cmd = (double)airtime_us / SIM_COMMANDS,
+    };
+
+    free(rx.val);
+}
+
+/* Baseline */
+
+static struct result baseline[MAX_BASELINE];
+static int baseline_count;
+
+static double field_parse(char **line)
+{
+    char *field = strsep(line, ",\n");
+
+    return field && *field ? strtod(field, NULL) : -1.0;
+}
+
+static int baseline_read(const char *path)
+{
+    char line[256];
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) && baseline_count < MAX_BASELINE) {
+        struct result *b = &baseline[baseline_count];
+        char *p = line;
+
+        if (line[0] < '0' || line[0] > '9') {
+            continue;
+        }
+
+        b->robots = field_parse(&p);
+        b->commands = field_parse(&p);
+        b->delivery_ratio = field_parse(&p);
+        b->rx_p50_us = field_parse(&p);
+        b->rx_p99_us = field_parse(&p);
+        b->act_p50_us = field_parse(&p);
+        b->act_p99_us = field_parse(&p);
+        b->copies_per_robot = field_parse(&p);
+        b->airtime_us_per_cmd = field_parse(&p);
+        baseline_count++;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static bool exceeds(const char *name, const struct result *r, double val, double base,
+                    int margin_pct)
+{
+    if (val < 0.0 || base < 0.0 || val <= base * (100 + margin_pct) / 100) {
+        return false;
+    }
+
+    fprintf(stderr, "%u robots: %s %.0f exceeds baseline %.0f by more than %d%%\n", r->robots,
+            name, val, base, margin_pct);
+    return true;
+}
+
+/* Returns true if the result is worse than the baseline for the same swarm size. */
+static bool regressed(const struct result *r)
+{
+    const struct result *b = NULL;
+    bool worse = false;
+
+    for (int i = 0; i < baseline_count; i++) {
+        if (baseline[i].robots == r->robots) {
+            b = &baseline[i];
+        }
+    }
+
+    if (b == NULL) {
+        return false;
+    }
+
+    if (r->delivery_ratio >= 0.0 && b->delivery_ratio >= 0.0 &&
+        r->delivery_ratio < b->delivery_ratio - DELIVERY_MARGIN) {
+        fprintf(stderr, "%u robots: delivery ratio %.4f below baseline %.4f\n", r->robots,
+                r->delivery_ratio, b->delivery_ratio);
+        worse = true;
+    }
+
+    worse |= exceeds("rx p99 latency [us]", r, r->rx_p99_us, b->rx_p99_us, LATENCY_MARGIN_PCT);
+    worse |= exceeds("act p99 latency [us]", r, r->act_p99_us, b->act_p99_us, LATENCY_MARGIN_PCT);
+    worse |= exceeds("airtime per command [us]", r, r->airtime_us_per_cmd,
+                     b->airtime_us_per_cmd, AIRTIME_MARGIN_PCT);
+    return worse;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t swarms[] = {5, 20, 50};
+    struct result r;
+    bool worse = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        if (opt != 'b' || baseline_read(optarg)) {
+            fprintf(stderr, "Usage: %s [-b baseline.csv] [console.log ...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    result_header();
+
+    if (optind == argc) {
+        for (size_t i = 0; i < sizeof(swarms) / sizeof(swarms[0]); i++) {
+            simulate(swarms[i], &r);
+            result_print(&r);
+            worse |= regressed(&r);
+        }
+        return worse;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (trace_read(argv[i])) {
+            return 2;
+        }
+    }
+
+    r = (struct result){0};
+    trace_analyze(&r);
+    result_print(&r);
+    return regressed(&r);
+}
@@ -0,0 +1,152 @@
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+
+#include "battery.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(battery, CONFIG_MOTOR_MODULE_LOG_LEVEL);
+
+#if !DT_HAS_COMPAT_STATUS_OKAY(battery_monitor)
+#error "The battery monitor needs a battery-monitor node in the devicetree"
+#endif
+
+#define BATTERY_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(battery_monitor)
+#define NOMINAL_MV CONFIG_MOTOR_BATTERY_NOMINAL_MV
+#define LOW_MV CONFIG_MOTOR_BATTERY_LOW_MV
+#define FILTER_SHIFT CONFIG_MOTOR_BATTERY_FILTER_SHIFT
+
+/* The voltage recovers once the power is limited, so the limit is only lifted well above
+ * the threshold.
+ */
+#define LOW_HYSTERESIS_MV 200
+
+static const struct adc_dt_spec adc = ADC_DT_SPEC_GET(BATTERY_NODE);
+static const uint32_t output_ohms = DT_PROP(BATTERY_NODE, output_ohms);
+static const uint32_t full_ohms = DT_PROP(BATTERY_NODE, full_ohms);
+
+static int16_t sample;
+static struct k_poll_signal sample_signal;
+
+/* Exponential moving average of the voltage, scaled by 2^FILTER_SHIFT to keep the
+ * fractions. Only updated from the ADC interrupt.
+ */
+static uint32_t filter_acc;
+
+static atomic_t battery_mv;
+static atomic_t low;
+static bool low_reported;
+
+static void filter_update(uint32_t mv)
+{
+    if (filter_acc == 0) {
+        filter_acc = mv << FILTER_SHIFT;
+    } else {
+        filter_acc = filter_acc - (filter_acc >> FILTER_SHIFT) + mv;
+    }
+
+    mv = filter_acc >> FILTER_SHIFT;
+    atomic_set(&battery_mv, mv);
+
+    if (mv < LOW_MV) {
+        atomic_set(&low, true);
+    } else if (mv >= LOW_MV + LOW_HYSTERESIS_MV) {
+        atomic_set(&low, false);
+    }
+}
+
+/* Called from the ADC interrupt once the conversion is done, so the system workqueue
+ * never waits for the SAADC.
+ */
+static enum adc_action sample_done(const struct device *dev, const struct adc_sequence *sequence,
+                                   uint16_t sampling_index)
+{
+    int32_t mv = sample;
+
+    if (adc_raw_to_millivolts_dt(&adc, &mv) == 0) {
+        filter_update((uint64_t)MAX(mv, 0) * full_ohms / output_ohms);
+    }
+    return ADC_ACTION_FINISH;
+}
+
+static const struct adc_sequence_options sequence_options = {
+    .callback = sample_done,
+};
+
+static struct adc_sequence sequence = {
+    .options = &sequence_options,
+    .buffer = &sample,
+    .buffer_size = sizeof(sample),
+};
+
+static void sample_work_fn(struct k_work *work)
+{
+    int err = adc_read_async(adc.dev, &sequence, &sample_signal);
+
+    if (err) {
+        LOG_WRN("Failed to sample the battery: Error %d", err);
+    }
+
+    if (battery_is_low() != low_reported) {
+        low_reported = !low_reported;
+        if (low_reported) {
+            LOG_WRN("Battery low at %u mV, limiting motor power", battery_mv_get());
+        } else {
+            LOG_INF("Battery recovered at %u mV", battery_mv_get());
+        }
+    }
+
+    k_work_reschedule(k_work_delayable_from_work(work), K_MSEC(CONFIG_MOTOR_BATTERY_INTERVAL_MS));
+}
+K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_fn);
+
+int battery_init(void)
+{
+    int err;
+
+    if (!device_is_ready(adc.dev)) {
+        LOG_ERR("Battery ADC not ready");
+        return -ENODEV;
+    }
+
+    err = adc_channel_setup_dt(&adc);
+    if (err) {
+        LOG_ERR("Failed to set up the battery ADC channel: Error %d", err);
+        return err;
+    }
+
+    err = adc_sequence_init_dt(&adc, &sequence);
+    if (err) {
+        return err;
+    }
+
+    k_poll_signal_init(&sample_signal);
+    k_work_schedule(&sample_work, K_NO_WAIT);
+    return 0;
+}
+
+uint16_t battery_mv_get(void)
+{
+    return atomic_get(&battery_mv);
+}
+
+bool battery_is_low(void)
+{
+    return atomic_get(&low);
+}
+
+int32_t battery_power_compensate(int32_t power, int32_t power_max)
+{
+    uint32_t mv = atomic_get(&battery_mv);
+    int64_t compensated = power;
+
+    if (mv) {
+        compensated = compensated * NOMINAL_MV / mv;
+    }
+
+    if (battery_is_low()) {
+        power_max = (int64_t)power_max * CONFIG_MOTOR_BATTERY_LOW_POWER_PCT / 100;
+    }
+
+    return CLAMP(compensated, -power_max, power_max);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+#if defined(CONFIG_MOTOR_BATTERY)
+
+/**
+ * @brief Start sampling the battery voltage of the battery-monitor node.
+ *
+ * @return 0 on success, or a negative errno code.
+ */
+int battery_init(void);
+
+/**
+ * @brief Get the filtered battery voltage.
+ *
+ * @return Battery voltage [mV], or 0 before the first sample.
+ */
+uint16_t battery_mv_get(void);
+
+/** @brief Check if the battery is below the low charge threshold. */
+bool battery_is_low(void);
+
+/**
+ * @brief Compensate motor power for the battery voltage.
+ *
+ * Scales the power from CONFIG_MOTOR_BATTERY_NOMINAL_MV to the present voltage, so the
+ * motors turn at the same speed as the battery drains. At low charge the power is limited
+ * to CONFIG_MOTOR_BATTERY_LOW_POWER_PCT of the maximum, which limits the peak current.
+ *
+ * @param power Motor power at the nominal voltage.
+ * @param power_max Largest power the motors take, in either direction.
+ * @return Compensated power.
+ */
+int32_t battery_power_compensate(int32_t power, int32_t power_max);
+
+#else
+
+static inline int battery_init(void)
+{
+    return 0;
+}
+
+static inline uint16_t battery_mv_get(void)
+{
+    return 0;
+}
+
+static inline bool battery_is_low(void)
+{
+    return false;
+}
+
+static inline int32_t battery_power_compensate(int32_t power, int32_t power_max)
+{
+    return CLAMP(power, -power_max, power_max);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#include <zephyr/kernel.h>
+
+#include "boot_profile.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(boot_profile, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+static const char *const phase_str[] = {
+    [BOOT_PHASE_THREAD_START] = "thread start",
+    [BOOT_PHASE_BT_ENABLED] = "bluetooth enabled",
+    [BOOT_PHASE_MESH_INIT] = "mesh initialized",
+    [BOOT_PHASE_SETTINGS] = "settings loaded",
+    [BOOT_PHASE_READY] = "ready",
+    [BOOT_PHASE_FIRST_COMMAND] = "first command",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(phase_str) == BOOT_PHASE_COUNT);
+
+/* Microseconds since the kernel started, 0 until the phase completes. */
+static uint32_t phase_us[BOOT_PHASE_COUNT];
+
+void boot_profile_mark(enum boot_phase phase)
+{
+    uint32_t now = k_ticks_to_us_floor32(k_uptime_ticks());
+    uint32_t prev = 0;
+
+    if (phase_us[phase]) {
+        return;
+    }
+
+    phase_us[phase] = now;
+    LOG_INF("Boot: %s at %u us", phase_str[phase], now);
+
+    if (phase != BOOT_PHASE_FIRST_COMMAND) {
+        return;
+    }
+
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        if (!phase_us[i]) {
+            continue;
+        }
+        LOG_INF("Boot: %-18s %8u us, +%u us", phase_str[i], phase_us[i], phase_us[i] - prev);
+        prev = phase_us[i];
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/** Boot phases, in the order they complete. */
+enum boot_phase
+{
+    BOOT_PHASE_THREAD_START,   // Mesh module thread started.
+    BOOT_PHASE_BT_ENABLED,     // Bluetooth controller and host up.
+    BOOT_PHASE_MESH_INIT,      // Mesh stack initialized.
+    BOOT_PHASE_SETTINGS,       // Mesh settings loaded.
+    BOOT_PHASE_READY,          // Robot accepts commands.
+    BOOT_PHASE_FIRST_COMMAND,  // First movement command accepted.
+    BOOT_PHASE_COUNT,
+};
+
+#if defined(CONFIG_MESH_BOOT_PROFILE)
+
+/**
+ * @brief Record the completion of a boot phase.
+ *
+ * Only the first completion of each phase is recorded. The phase is logged with the time
+ * since the kernel started, and the whole profile is logged once the first command is
+ * accepted.
+ *
+ * @param phase Completed phase.
+ */
+void boot_profile_mark(enum boot_phase phase);
+
+#else
+
+static inline void boot_profile_mark(enum boot_phase phase) {}
+
+#endif
@@ -0,0 +1,460 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+
+#include "choreography.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(choreography, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+#define AREA_ID FLASH_AREA_ID(choreography_storage)
+#define SLOT_SIZE CONFIG_MESH_CHOREOGRAPHY_SLOT_SIZE
+#define SLOT_COUNT (CONFIG_MESH_CHOREOGRAPHY_PARTITION_SIZE / SLOT_SIZE)
+#define NO_SLOT UINT8_MAX
+#define MAGIC 0x43485231
+
+/* Each choreography fills one slot: a header followed by the encoded segments. The header
+ * is written last, once the data is verified, so a slot with an erased header is free even
+ * if an upload to it was cut short. A replaced choreography is erased after the new one is
+ * stored. Should that be cut short, the higher generation wins on the next boot.
+ *
+ * Readers hold a reference to their slot. A choreography being played can not be deleted,
+ * and when it is replaced, its slot is only erased once the last reader is closed.
+ */
+struct slot_header
+{
+    uint32_t magic;
+    uint16_t id;
+    uint16_t len;
+    uint32_t crc;
+    uint32_t generation;
+};
+
+#define DATA_OFF sizeof(struct slot_header)
+#define DATA_MAX MIN(SLOT_SIZE - DATA_OFF, UINT16_MAX)
+
+BUILD_ASSERT(SLOT_COUNT >= 2, "A spare slot is needed to replace a choreography");
+BUILD_ASSERT(SLOT_COUNT < NO_SLOT, "Too many choreography slots");
+BUILD_ASSERT(DATA_OFF % CHOREOGRAPHY_CHUNK_ALIGN == 0);
+
+static const struct flash_area *fa;
+
+/* Headers of the stored choreographies, magic 0 for free slots */
+static struct slot_header slots[SLOT_COUNT];
+static uint32_t generation;
+/* Open readers of each slot. Taken under the lock, released without it, so playback
+ * never waits for an erase. A slot seen in use while it is released is only erased later.
+ */
+static atomic_t refs[SLOT_COUNT];
+/* Replaced, but still holding a choreography on flash */
+static bool stale[SLOT_COUNT];
+
+/* Upload in progress. Chunks are written as they come, and the CRC is accumulated
+ * over them, so the upload can be resumed at next without reading back flash.
+ */
+static struct
+{
+    bool active;
+    uint8_t slot;
+    uint16_t id;
+    uint16_t len;
+    uint32_t crc;
+    uint16_t next;
+    uint32_t crc_acc;
+} upload;
+
+/* Uploads come from the choreography work queue, playback from the motor module */
+static K_MUTEX_DEFINE(lock);
+
+static off_t slot_off(uint8_t slot)
+{
+    return (off_t)slot * SLOT_SIZE;
+}
+
+static uint8_t slot_find(uint16_t id)
+{
+    for (uint8_t i = 0; i < SLOT_COUNT; i++) {
+        if (slots[i].magic == MAGIC && slots[i].id == id) {
+            return i;
+        }
+    }
+    return NO_SLOT;
+}
+
+static uint8_t slot_free_find(void)
+{
+    for (uint8_t i = 0; i < SLOT_COUNT; i++) {
+        if (slots[i].magic != MAGIC && !atomic_get(&refs[i])) {
+            return i;
+        }
+    }
+    return NO_SLOT;
+}
+
+static int slot_erase(uint8_t slot)
+{
+    slots[slot].magic = 0;
+    stale[slot] = false;
+    return flash_area_erase(fa, slot_off(slot), SLOT_SIZE);
+}
+
+/* Erase the slot of a replaced choreography, or leave that to the last reader */
+static int slot_retire(uint8_t slot)
+{
+    if (atomic_get(&refs[slot])) {
+        slots[slot].magic = 0;
+        stale[slot] = true;
+        return 0;
+    }
+    return slot_erase(slot);
+}
+
+/* A stale slot left on flash would bring back its choreography on the next boot once the
+ * one replacing it is deleted, so it must be erased first.
+ */
+static int stale_erase(uint16_t id)
+{
+    for (uint8_t i = 0; i < SLOT_COUNT; i++) {
+        if (!stale[i] || slots[i].id != id) {
+            continue;
+        }
+
+        if (atomic_get(&refs[i])) {
+            return -EBUSY;
+        }
+
+        int err = slot_erase(i);
+
+        if (err) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int read_segment(struct choreography_reader *reader, struct trajectory_segment *segment)
+{
+    uint8_t data[TRAJECTORY_ENCODED_LEN_MAX];
+    struct net_buf_simple buf;
+    uint8_t len;
+    int err;
+
+    if (reader->off >= reader->end) {
+        return 0;
+    }
+
+    err = flash_area_read(fa, reader->off, &len, sizeof(len));
+    if (err) {
+        return err;
+    }
+
+    if (len > sizeof(data) || reader->off + sizeof(len) + len > reader->end) {
+        return -EBADMSG;
+    }
+
+    err = flash_area_read(fa, reader->off + sizeof(len), data, len);
+    if (err) {
+        return err;
+    }
+
+    net_buf_simple_init_with_data(&buf, data, len);
+    if (trajectory_decode(&buf, segment)) {
+        return -EBADMSG;
+    }
+
+    reader->off += sizeof(len) + len;
+    return 1;
+}
+
+/* Every segment is decoded once before the choreography is accepted, so playback can
+ * not stop half way through a show.
+ */
+static int segments_check(uint8_t slot, uint16_t len)
+{
+    struct choreography_reader reader = {
+        .off = slot_off(slot) + DATA_OFF,
+        .end = slot_off(slot) + DATA_OFF + len,
+    };
+    struct trajectory_segment segment;
+    int err;
+
+    do {
+        err = read_segment(&reader, &segment);
+    } while (err == 1);
+
+    return err;
+}
+
+static int upload_finish(void)
+{
+    struct slot_header header = {
+        .magic = MAGIC,
+        .id = upload.id,
+        .len = upload.len,
+        .crc = upload.crc,
+        .generation = generation + 1,
+    };
+    uint8_t old = slot_find(upload.id);
+    int err;
+
+    if (upload.crc_acc != upload.crc) {
+        LOG_WRN("Choreography %u failed CRC check", upload.id);
+        return -EBADMSG;
+    }
+
+    if (segments_check(upload.slot, upload.len)) {
+        LOG_WRN("Choreography %u has invalid segments", upload.id);
+        return -EBADMSG;
+    }
+
+    err = flash_area_write(fa, slot_off(upload.slot), &header, sizeof(header));
+    if (err) {
+        return err;
+    }
+
+    generation = header.generation;
+    slots[upload.slot] = header;
+    upload.active = false;
+    LOG_INF("Stored choreography %u, %u bytes", header.id, header.len);
+
+    if (old != NO_SLOT) {
+        return slot_retire(old);
+    }
+    return 0;
+}
+
+int choreography_init(void)
+{
+    uint8_t dup;
+    int count = 0;
+    int err;
+
+    err = flash_area_open(AREA_ID, &fa);
+    if (err) {
+        LOG_ERR("Failed to open choreography partition: Error %d", err);
+        return err;
+    }
+
+    if (fa->fa_size < SLOT_COUNT * SLOT_SIZE || flash_area_align(fa) > CHOREOGRAPHY_CHUNK_ALIGN) {
+        LOG_ERR("Choreography partition does not fit %d slots", SLOT_COUNT);
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0; i < SLOT_COUNT; i++) {
+        struct slot_header header;
+
+        err = flash_area_read(fa, slot_off(i), &header, sizeof(header));
+        if (err) {
+            return err;
+        }
+
+        if (header.magic != MAGIC || header.len > DATA_MAX) {
+            continue;
+        }
+
+        /* Finish a replacement that was cut short */
+        dup = slot_find(header.id);
+        if (dup != NO_SLOT) {
+            if (slots[dup].generation > header.generation) {
+                slot_erase(i);
+                continue;
+            }
+            slot_erase(dup);
+            count--;
+        }
+
+        slots[i] = header;
+        generation = MAX(generation, header.generation);
+        count++;
+    }
+
+    LOG_INF("%d choreographies stored", count);
+    return 0;
+}
+
+int choreography_upload_begin(uint16_t id, uint16_t len, uint32_t crc)
+{
+    uint8_t slot;
+    int err = 0;
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    if (upload.active && upload.id == id && upload.len == len && upload.crc == crc) {
+        LOG_DBG("Resuming upload of choreography %u at %u", id, upload.next);
+        goto out;
+    }
+
+    /* Only one upload at a time, anything else aborts it */
+    upload.active = false;
+    slot = slot_find(id);
+
+    if (len == 0) {
+        if (slot != NO_SLOT && atomic_get(&refs[slot])) {
+            LOG_WRN("Choreography %u is being played", id);
+            err = -EBUSY;
+            goto out;
+        }
+
+        err = stale_erase(id);
+        if (err || slot == NO_SLOT) {
+            goto out;
+        }
+
+        LOG_INF("Deleting choreography %u", id);
+        err = slot_erase(slot);
+        goto out;
+    }
+
+    if (slot != NO_SLOT && slots[slot].len == len && slots[slot].crc == crc) {
+        LOG_DBG("Choreography %u already stored", id);
+        goto out;
+    }
+
+    slot = slot_free_find();
+    if (len > DATA_MAX || slot == NO_SLOT) {
+        err = -ENOSPC;
+        goto out;
+    }
+
+    err = slot_erase(slot);
+    if (err) {
+        goto out;
+    }
+
+    upload.active = true;
+    upload.slot = slot;
+    upload.id = id;
+    upload.len = len;
+    upload.crc = crc;
+    upload.next = 0;
+    upload.crc_acc = 0;
+    LOG_DBG("Uploading choreography %u, %u bytes", id, len);
+
+out:
+    k_mutex_unlock(&lock);
+    return err;
+}
+
+int choreography_upload_chunk(uint16_t id, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    uint32_t end = (uint32_t)offset + len;
+    uint16_t aligned = ROUND_DOWN(len, CHOREOGRAPHY_CHUNK_ALIGN);
+    off_t off;
+    int err = 0;
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    if (!upload.active || upload.id != id) {
+        err = -ENOENT;
+        goto out;
+    }
+
+    if (end <= upload.next) {
+        goto out;
+    }
+
+    if (offset != upload.next) {
+        err = -EAGAIN;
+        goto out;
+    }
+
+    if (end > upload.len || (end < upload.len && aligned != len)) {
+        err = -EINVAL;
+        goto fail;
+    }
+
+    off = slot_off(upload.slot) + DATA_OFF + offset;
+
+    if (aligned) {
+        err = flash_area_write(fa, off, data, aligned);
+        if (err) {
+            goto fail;
+        }
+    }
+
+    /* Pad the end of the last chunk to the write block size */
+    if (aligned != len) {
+        uint8_t tail[CHOREOGRAPHY_CHUNK_ALIGN];
+
+        memset(tail, 0xff, sizeof(tail));
+        memcpy(tail, &data[aligned], len - aligned);
+        err = flash_area_write(fa, off + aligned, tail, sizeof(tail));
+        if (err) {
+            goto fail;
+        }
+    }
+
+    upload.crc_acc = crc32_ieee_update(upload.crc_acc, data, len);
+    upload.next = end;
+
+    if (upload.next == upload.len) {
+        err = upload_finish();
+    }
+
+fail:
+    if (err) {
+        upload.active = false;
+    }
+out:
+    k_mutex_unlock(&lock);
+    return err;
+}
+
+enum choreography_state choreography_state_get(uint16_t id, uint16_t *next_offset)
+{
+    enum choreography_state state = CHOREOGRAPHY_NONE;
+    uint8_t slot;
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    *next_offset = 0;
+    slot = slot_find(id);
+
+    if (upload.active && upload.id == id) {
+        state = CHOREOGRAPHY_PARTIAL;
+        *next_offset = upload.next;
+    } else if (slot != NO_SLOT) {
+        state = CHOREOGRAPHY_STORED;
+        *next_offset = slots[slot].len;
+    }
+
+    k_mutex_unlock(&lock);
+    return state;
+}
+
+int choreography_open(uint16_t id, struct choreography_reader *reader)
+{
+    int err = 0;
+    uint8_t slot;
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    slot = slot_find(id);
+    if (slot == NO_SLOT) {
+        err = -ENOENT;
+    } else {
+        atomic_inc(&refs[slot]);
+        reader->slot = slot;
+        reader->open = true;
+        reader->off = slot_off(slot) + DATA_OFF;
+        reader->end = reader->off + slots[slot].len;
+    }
+
+    k_mutex_unlock(&lock);
+    return err;
+}
+
+void choreography_close(struct choreography_reader *reader)
+{
+    if (reader->open) {
+        atomic_dec(&refs[reader->slot]);
+        reader->open = false;
+    }
+}
+
+int choreography_next(struct choreography_reader *reader, struct trajectory_segment *segment)
+{
+    return read_segment(reader, segment);
+}
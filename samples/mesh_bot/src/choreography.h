@@ -0,0 +1,130 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+#include "trajectory.h"
+
+/** Alignment of all upload chunks but the last, covering the flash write block size. */
+#define CHOREOGRAPHY_CHUNK_ALIGN 8
+
+/** State of a choreography in the library. */
+enum choreography_state
+{
+    CHOREOGRAPHY_NONE,     // Not stored and not being uploaded.
+    CHOREOGRAPHY_PARTIAL,  // Being uploaded.
+    CHOREOGRAPHY_STORED,   // Stored and verified, ready to play.
+};
+
+/** Position in a stored choreography during playback. */
+struct choreography_reader
+{
+    uint32_t off;
+    uint32_t end;
+    uint8_t slot;
+    bool open;
+};
+
+#if defined(CONFIG_MESH_CHOREOGRAPHY)
+
+/**
+ * @brief Open the choreography partition and index the stored choreographies.
+ *
+ * @return 0 on success, or a negative errno code.
+ */
+int choreography_init(void);
+
+/**
+ * @brief Begin or resume the upload of a choreography.
+ *
+ * A choreography is a sequence of segments, each encoded as a length byte followed by
+ * the segment as in trajectory_decode(). A begin matching the upload in progress resumes
+ * it, and a begin matching a stored choreography leaves it as is, so uploading a show
+ * again costs nothing. A stored choreography with the same ID is replaced once the new
+ * one is verified. A length of 0 deletes the choreography.
+ *
+ * Erases flash, which blocks for tens of milliseconds.
+ *
+ * @param id Choreography ID.
+ * @param len Encoded length in bytes.
+ * @param crc CRC-32 (IEEE) of the encoded choreography.
+ * @return 0 on success, -ENOSPC if the choreography is too large or no slot is free,
+ *         -EBUSY if a choreography to delete is being played, or another negative errno
+ *         code.
+ */
+int choreography_upload_begin(uint16_t id, uint16_t len, uint32_t crc);
+
+/**
+ * @brief Write a chunk of the choreography being uploaded.
+ *
+ * Chunks must come in order. All chunks but the last must be a multiple of
+ * CHOREOGRAPHY_CHUNK_ALIGN bytes long. Chunks already written are ignored, so a sender may
+ * repeat them. The choreography is verified and stored with the last chunk, which erases
+ * the choreography it replaces unless that is being played.
+ *
+ * @param id Choreography ID.
+ * @param offset Offset of the chunk in the encoded choreography.
+ * @param data Chunk data.
+ * @param len Chunk length.
+ * @return 0 if the chunk was written or ignored, -EAGAIN if it does not start at the next
+ *         expected offset, -ENOENT if the choreography is not being uploaded,
+ *         -EBADMSG if the CRC or the encoding is wrong, or another negative errno code.
+ *         The upload is aborted on any error but -EAGAIN.
+ */
+int choreography_upload_chunk(uint16_t id, uint16_t offset, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Get the state of a choreography.
+ *
+ * @param id Choreography ID.
+ * @param next_offset Offset of the next chunk expected, the full length once stored.
+ * @return State of the choreography.
+ */
+enum choreography_state choreography_state_get(uint16_t id, uint16_t *next_offset);
+
+/**
+ * @brief Open a stored choreography for playback.
+ *
+ * The choreography stays on flash until the reader is closed, even if it is replaced.
+ *
+ * @param id Choreography ID.
+ * @param reader Closed reader, positioned at the first segment on success.
+ * @return 0 on success, -ENOENT if the choreography is not stored.
+ */
+int choreography_open(uint16_t id, struct choreography_reader *reader);
+
+/**
+ * @brief Close a reader, so its choreography can be deleted or erased once replaced.
+ *
+ * Does nothing if the reader is not open.
+ *
+ * @param reader Reader from choreography_open().
+ */
+void choreography_close(struct choreography_reader *reader);
+
+/**
+ * @brief Read the next segment of a choreography.
+ *
+ * @param reader Reader from choreography_open().
+ * @param segment Next segment.
+ * @return 1 if a segment was read, 0 at the end, or a negative errno code.
+ */
+int choreography_next(struct choreography_reader *reader, struct trajectory_segment *segment);
+
+#else
+
+static inline int choreography_open(uint16_t id, struct choreography_reader *reader)
+{
+    return -ENOTSUP;
+}
+
+static inline int choreography_next(struct choreography_reader *reader,
+                                    struct trajectory_segment *segment)
+{
+    return 0;
+}
+
+static inline void choreography_close(struct choreography_reader *reader)
+{
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include <zephyr/kernel.h>
+
+#include "dup_filter.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(dup_filter, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+struct dup_filter_entry
+{
+    uint16_t src;
+    uint8_t tid;
+    uint8_t seq;
+    int64_t last_seen;
+};
+
+/* Most recently accepted message per source. Sources are evicted least recently seen first. */
+static struct dup_filter_entry cache[CONFIG_MESH_DUP_FILTER_SIZE];
+static struct dup_filter_stats stats;
+
+#if CONFIG_MESH_DUP_FILTER_LOG_INTERVAL > 0
+
+/* Logs the counters once an interval after messages came in, so the work saved shows in a
+ * normal build without a log line per message.
+ */
+static void stats_log_work_fn(struct k_work *work)
+{
+    LOG_INF("Movement messages: %u accepted, %u duplicates and %u stale dropped", stats.accepted,
+            stats.duplicates, stats.stale);
+}
+K_WORK_DELAYABLE_DEFINE(stats_log_work, stats_log_work_fn);
+
+static void stats_log_schedule(void)
+{
+    /* Does nothing while a log is already scheduled */
+    k_work_schedule(&stats_log_work, K_SECONDS(CONFIG_MESH_DUP_FILTER_LOG_INTERVAL));
+}
+
+#else
+
+static void stats_log_schedule(void) {}
+
+#endif
+
+static struct dup_filter_entry *entry_get(uint16_t src)
+{
+    struct dup_filter_entry *oldest = &cache[0];
+
+    for (int i = 0; i < ARRAY_SIZE(cache); i++) {
+        if (cache[i].src == src) {
+            return &cache[i];
+        }
+        if (cache[i].last_seen < oldest->last_seen) {
+            oldest = &cache[i];
+        }
+    }
+    return oldest;
+}
+
+bool dup_filter_check(uint16_t src, uint8_t tid, uint8_t seq)
+{
+    int64_t now = k_uptime_get();
+    struct dup_filter_entry *entry = entry_get(src);
+
+    stats_log_schedule();
+
+    /* Forget the source's history if it has been silent for long, the
+     * commander may have restarted its counters.
+     */
+    if (entry->src == src && now - entry->last_seen < CONFIG_MESH_DUP_FILTER_TIMEOUT * MSEC_PER_SEC) {
+        int8_t tid_diff = (int8_t)(tid - entry->tid);
+        int8_t seq_diff = (int8_t)(seq - entry->seq);
+
+        if (tid_diff == 0 && seq_diff == 0) {
+            stats.duplicates++;
+            LOG_DBG("Duplicate from 0x%04x tid %d seq %d (%u dropped)", src, tid, seq, stats.duplicates);
+            return false;
+        }
+
+        if (tid_diff < 0 || (tid_diff == 0 && seq_diff < 0)) {
+            stats.stale++;
+            LOG_DBG("Stale from 0x%04x tid %d seq %d (%u dropped)", src, tid, seq, stats.stale);
+            return false;
+        }
+    }
+
+    entry->src = src;
+    entry->tid = tid;
+    entry->seq = seq;
+    entry->last_seen = now;
+    stats.accepted++;
+    return true;
+}
+
+void dup_filter_stats_get(struct dup_filter_stats *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/** Movement message counters. */
+struct dup_filter_stats
+{
+    uint32_t accepted;   // Messages passed on to the application.
+    uint32_t duplicates; // Retransmissions or relayed copies of an accepted message.
+    uint32_t stale;      // Messages older than the last accepted message from the same source.
+};
+
+/**
+ * @brief Check whether a movement message should be processed.
+ *
+ * Messages are ordered per source by transaction ID, then by sequence number. Both wrap around
+ * and are compared with serial number arithmetic.
+ *
+ * @param src Source address of the message.
+ * @param tid Transaction ID of the message.
+ * @param seq Sequence number of the message within the transaction.
+ * @return true if the message is new, false if it is a duplicate or stale.
+ */
+bool dup_filter_check(uint16_t src, uint8_t tid, uint8_t seq);
+
+/**
+ * @brief Get the filter counters.
+ *
+ * @param stats Structure the counters are copied to.
+ */
+void dup_filter_stats_get(struct dup_filter_stats *stats);
@@ -17,6 +17,15 @@ static char *type_to_str(mesh_module_event_type type)
         case MESH_EVT_CLEAR_TO_MOVE_RECEIVED: {
             return "MESH_EVT_CLEAR_TO_MOVE_RECEIVED";
         }
+        case MESH_EVT_TRAJECTORY_RECEIVED: {
+            return "MESH_EVT_TRAJECTORY_RECEIVED";
+        }
+        case MESH_EVT_CHOREOGRAPHY_RECEIVED: {
+            return "MESH_EVT_CHOREOGRAPHY_RECEIVED";
+        }
+        case MESH_EVT_MOTOR_POWER_RECEIVED: {
+            return "MESH_EVT_MOTOR_POWER_RECEIVED";
+        }
     default:
         return "UNKNOWN";
     }
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <app_event_manager.h>
-#include "model_handler.h"
+#include <zephyr/device.h>
+#include "movement.h"
+#include "trajectory.h"
 
 typedef enum {
     MESH_EVT_PROVISIONED,
     MESH_EVT_DISCONNECTED,
     MESH_EVT_MOVEMENT_RECEIVED,
     MESH_EVT_CLEAR_TO_MOVE_RECEIVED,
+    MESH_EVT_TRAJECTORY_RECEIVED,
+    MESH_EVT_CHOREOGRAPHY_RECEIVED,
+    MESH_EVT_MOTOR_POWER_RECEIVED,
 } mesh_module_event_type;
 
 struct mesh_module_event {
@@ -15,6 +20,12 @@ struct mesh_module_event {
     mesh_module_event_type type;
     union {
         struct robot_movement_config movement; // Should only be read when type == MESH_EVT_MOVEMENT_RECEIVED
+        struct trajectory_segment trajectory; // Should only be read when type == MESH_EVT_TRAJECTORY_RECEIVED
+        uint16_t choreography; // Should only be read when type == MESH_EVT_CHOREOGRAPHY_RECEIVED
+        struct {
+            const struct device *motor;
+            int32_t power;
+        } motor_power; // Should only be read when type == MESH_EVT_MOTOR_POWER_RECEIVED
     } data;
 };
 
@@ -9,6 +9,8 @@ static char *type_to_str(motor_module_event_type type)
         return "MOTOR_EVT_MOVEMENT_START";
     case MOTOR_EVT_MOVEMENT_DONE:
         return "MOTOR_EVT_MOVEMENT_DONE";
+    case MOTOR_EVT_POWER_SET_DONE:
+        return "MOTOR_EVT_POWER_SET_DONE";
     default:
         return "UNKNOWN";
     }
@@ -19,6 +21,10 @@ static void log_motor_event(const struct app_event_header *header)
     struct motor_module_event *evt = cast_motor_module_event(header);
     char *type_str = type_to_str(evt->type);
 
+    if (evt->type == MOTOR_EVT_MOVEMENT_DONE && evt->reason == MOTOR_DONE_SAFETY_STOP) {
+        APP_EVENT_MANAGER_LOG(header, "Type: %s, safety stop", type_str);
+        return;
+    }
     APP_EVENT_MANAGER_LOG(header, "Type: %s", type_str);
 }
 
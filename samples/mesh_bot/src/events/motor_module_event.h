@@ -1,15 +1,25 @@
 #pragma once
 
+#include <zephyr/device.h>
 #include <app_event_manager.h>
 
 typedef enum {
     MOTOR_EVT_MOVEMENT_START,
     MOTOR_EVT_MOVEMENT_DONE,
+    MOTOR_EVT_POWER_SET_DONE,
 } motor_module_event_type;
 
+typedef enum {
+    MOTOR_DONE_COMPLETED,
+    MOTOR_DONE_SAFETY_STOP,
+} motor_done_reason;
+
 struct motor_module_event {
     struct app_event_header header;
     motor_module_event_type type;
+    motor_done_reason reason; // Should only be read when type == MOTOR_EVT_MOVEMENT_DONE
+    const struct device *motor; // Should only be read when type == MOTOR_EVT_POWER_SET_DONE
+    int err; // Should only be read when type == MOTOR_EVT_POWER_SET_DONE
 };
 
 APP_EVENT_TYPE_DECLARE(motor_module_event);
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include "latency_trace.h"
+#include "time_sync.h"
+
+static const char *const point_str[] = {
+    [LATENCY_TRACE_TX] = "tx",
+    [LATENCY_TRACE_RX] = "rx",
+    [LATENCY_TRACE_DUP] = "dup",
+    [LATENCY_TRACE_ACT] = "act",
+};
+
+/* Last accepted command that starts the motors, reported again when they start. */
+static struct
+{
+    uint16_t node;
+    uint16_t src;
+    enum latency_trace_cmd cmd;
+    uint8_t tid;
+    uint8_t seq;
+    int8_t rssi;
+} last_start;
+
+static void row_print(enum latency_trace_point point, uint16_t node, uint16_t peer,
+                      enum latency_trace_cmd cmd, uint8_t tid, uint8_t seq, int8_t rssi)
+{
+    static bool header_printed;
+
+    /* printk rather than the deferred logger, so rows come out in order and
+     * without the logger's own timestamps.
+     */
+    if (!header_printed) {
+        printk("lat,point,net_time_us,node,peer,cmd,tid,seq,rssi\n");
+        header_printed = true;
+    }
+
+    printk("lat,%s,%llu,%u,%u,%u,%u,%u,%d\n", point_str[point], time_sync_now(), node, peer, cmd,
+           tid, seq, rssi);
+}
+
+void latency_trace(enum latency_trace_point point, uint16_t node, uint16_t peer,
+                   enum latency_trace_cmd cmd, uint8_t tid, uint8_t seq, int8_t rssi)
+{
+    /* Movement configurations only take effect with the next start. */
+    if (point == LATENCY_TRACE_RX && cmd != LATENCY_TRACE_CMD_MOVE) {
+        last_start.node = node;
+        last_start.src = peer;
+        last_start.cmd = cmd;
+        last_start.tid = tid;
+        last_start.seq = seq;
+        last_start.rssi = rssi;
+    }
+
+    row_print(point, node, peer, cmd, tid, seq, rssi);
+}
+
+void latency_trace_actuation(void)
+{
+    row_print(LATENCY_TRACE_ACT, last_start.node, last_start.src, last_start.cmd, last_start.tid,
+              last_start.seq, last_start.rssi);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/** Points a movement command passes on its way from the commander to the motors. */
+enum latency_trace_point
+{
+    LATENCY_TRACE_TX,  // Sent by the commander.
+    LATENCY_TRACE_RX,  // Received and accepted by a robot.
+    LATENCY_TRACE_DUP, // Relayed copy or retransmission of an accepted command.
+    LATENCY_TRACE_ACT, // Motors started by the last accepted start, trajectory or choreography.
+};
+
+/** Command types, as in the trace. */
+enum latency_trace_cmd
+{
+    LATENCY_TRACE_CMD_MOVE = 1,
+    LATENCY_TRACE_CMD_START = 2,
+    LATENCY_TRACE_CMD_TRAJECTORY = 3,
+    LATENCY_TRACE_CMD_CHOREOGRAPHY = 4,
+};
+
+#if defined(CONFIG_MESH_LATENCY_TRACE)
+
+/**
+ * @brief Trace a movement command.
+ *
+ * Prints a CSV row with the network time, so rows from all nodes can be joined on the
+ * commander address, transaction ID and sequence number.
+ *
+ * @param point Trace point.
+ * @param node Address of the tracing node.
+ * @param peer Destination for sent commands, source for received commands.
+ * @param cmd Command type.
+ * @param tid Transaction ID of the command.
+ * @param seq Sequence number of the command.
+ * @param rssi RSSI of received commands, 0 for sent commands.
+ */
+void latency_trace(enum latency_trace_point point, uint16_t node, uint16_t peer,
+                   enum latency_trace_cmd cmd, uint8_t tid, uint8_t seq, int8_t rssi);
+
+/** @brief Trace motor actuation caused by the last accepted command that starts the motors. */
+void latency_trace_actuation(void);
+
+#else
+
+static inline void latency_trace(enum latency_trace_point point, uint16_t node, uint16_t peer,
+                                 enum latency_trace_cmd cmd, uint8_t tid, uint8_t seq, int8_t rssi) {}
+
+static inline void latency_trace_actuation(void) {}
+
+#endif
@@ -0,0 +1,119 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <mesh_link_uart.h>
+
+#include "model_handler.h"
+#include "link_bridge.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(link_bridge, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+static void cmd_received(const uint8_t *body, size_t len)
+{
+    if (len < MESH_LINK_CMD_LEN) {
+        LOG_WRN("Command of %zu bytes too short", len);
+        return;
+    }
+
+    uint16_t dst = sys_get_le16(&body[0]);
+    uint8_t type = body[2];
+    uint8_t tid = body[3];
+    uint8_t seq = body[4];
+    int err;
+
+    switch (type) {
+        case MESH_LINK_CMD_MOVE: {
+            err = model_handler_movement_send(dst, tid, seq, sys_get_le32(&body[5]),
+                                              (int16_t)sys_get_le16(&body[9]));
+            break;
+        }
+        case MESH_LINK_CMD_START: {
+            err = model_handler_start_send(dst, tid, seq, sys_get_le48(&body[5]));
+            break;
+        }
+        default: {
+            err = -EINVAL;
+            break;
+        }
+    }
+
+    if (err) {
+        LOG_ERR("Failed to send command %d to 0x%04x: Error %d", type, dst, err);
+    }
+}
+
+/* Called from the system workqueue */
+static void msg_received(uint8_t type, const uint8_t *body, size_t len, void *user_data)
+{
+    if (type == MESH_LINK_MSG_CMD) {
+        cmd_received(body, len);
+    } else {
+        LOG_DBG("Unknown link message type %d", type);
+    }
+}
+
+/* Device tags of the robots last seen at each address. Self-provisioned robots pick
+ * their addresses without coordination, so two of them may end up sharing one.
+ */
+static struct
+{
+    uint16_t addr;
+    uint16_t tag;
+} robots[CONFIG_MESH_LINK_BRIDGE_MAX_ROBOTS];
+
+static void collision_check(uint16_t addr, uint16_t tag)
+{
+    int free = -1;
+
+    for (int i = 0; i < ARRAY_SIZE(robots); i++) {
+        if (robots[i].addr == addr) {
+            if (robots[i].tag != tag) {
+                LOG_WRN("Robots %04x and %04x share address 0x%04x", robots[i].tag, tag, addr);
+                robots[i].tag = tag;
+            }
+            return;
+        }
+
+        if (robots[i].addr == BT_MESH_ADDR_UNASSIGNED && free < 0) {
+            free = i;
+        }
+    }
+
+    if (free >= 0) {
+        robots[free].addr = addr;
+        robots[free].tag = tag;
+    }
+}
+
+int link_bridge_status_send(uint16_t addr, uint16_t tag, uint8_t state, uint8_t hops, int8_t rssi,
+                            uint16_t battery_mv)
+{
+    uint8_t body[MESH_LINK_STATUS_LEN];
+    int err;
+
+    collision_check(addr, tag);
+
+    sys_put_le16(addr, &body[0]);
+    body[2] = state;
+    body[3] = hops;
+    body[4] = (uint8_t)rssi;
+    sys_put_le16(battery_mv, &body[5]);
+
+    /* The next status from the robot follows soon, so a congested link drops this one */
+    err = mesh_link_uart_send(MESH_LINK_MSG_STATUS, body, sizeof(body));
+    if (err) {
+        LOG_DBG("Dropped status of 0x%04x: Error %d", addr, err);
+    }
+    return err;
+}
+
+int link_bridge_init(void)
+{
+    /* Lost status reports are not reported, the next ones follow soon */
+    int err = mesh_link_uart_init(msg_received, NULL);
+
+    if (err) {
+        LOG_ERR("Failed to start mesh link: Error %d", err);
+    }
+    return err;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Bridge the gateway to the mesh over the mesh link.
+ *
+ * Commands received from the gateway are sent to the robots as movement messages. The
+ * link answers pings from the gateway by itself.
+ *
+ * @return 0 on success, negative errno code otherwise.
+ */
+int link_bridge_init(void);
+
+/**
+ * @brief Forward the status of a robot to the gateway.
+ *
+ * Robots reporting different device tags from the same address are logged, as they
+ * share the address.
+ *
+ * @param addr Address of the robot.
+ * @param tag Device tag of the robot.
+ * @param state Robot state.
+ * @param hops Hops the status took to the bridge.
+ * @param rssi RSSI of the status from the last hop.
+ * @param battery_mv Battery voltage of the robot in mV.
+ * @return 0 on success, -EBUSY if the link is congested, or another negative errno code.
+ */
+int link_bridge_status_send(uint16_t addr, uint16_t tag, uint8_t state, uint8_t hops, int8_t rssi,
+                            uint16_t battery_mv);
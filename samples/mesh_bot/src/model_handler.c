@@ -1,12 +1,30 @@
+#include <string.h>
 #include <zephyr/sys/byteorder.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
 #include <zephyr/bluetooth/mesh/msg.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/sys/crc.h>
 
 #include "model_handler.h"
+#include "time_sync.h"
+#include "dup_filter.h"
+#include "latency_trace.h"
+#include "thread_monitor.h"
+#include "choreography.h"
+#include "battery.h"
+#include "link_bridge.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(model_handler, CONFIG_MESH_MODULE_LOG_LEVEL);
 
 /* Application handler functions */
 
 movement_received_handler_t app_movement_handler;
 start_movement_handler_t app_start_movement_handler;
+trajectory_received_handler_t app_trajectory_handler;
+choreography_play_handler_t app_choreography_play_handler;
+motor_power_handler_t app_motor_power_handler;
 
 /* SIG models */
 
@@ -22,9 +40,63 @@ static void attention_off(struct bt_mesh_model *model)
     printk("attention_off()\n");
 }
 
+#if defined(CONFIG_MESH_THREAD_MONITOR)
+
+/* Thread monitor faults are reported as vendor specific health faults. Test 0
+ * takes a new sample, so the faults can be checked on demand.
+ */
+static int fault_get_cur(struct bt_mesh_model *model, uint8_t *test_id, uint16_t *company_id,
+                         uint8_t *faults, uint8_t *fault_count)
+{
+    *test_id = 0;
+    *company_id = CONFIG_BT_COMPANY_ID;
+    *fault_count = thread_monitor_faults_get(faults, *fault_count, false);
+    return 0;
+}
+
+static int fault_get_reg(struct bt_mesh_model *model, uint16_t company_id, uint8_t *test_id,
+                         uint8_t *faults, uint8_t *fault_count)
+{
+    if (company_id != CONFIG_BT_COMPANY_ID) {
+        return -EINVAL;
+    }
+
+    *test_id = 0;
+    *fault_count = thread_monitor_faults_get(faults, *fault_count, true);
+    return 0;
+}
+
+static int fault_clear(struct bt_mesh_model *model, uint16_t company_id)
+{
+    if (company_id != CONFIG_BT_COMPANY_ID) {
+        return -EINVAL;
+    }
+
+    thread_monitor_faults_clear();
+    return 0;
+}
+
+static int fault_test(struct bt_mesh_model *model, uint8_t test_id, uint16_t company_id)
+{
+    if (company_id != CONFIG_BT_COMPANY_ID || test_id != 0) {
+        return -EINVAL;
+    }
+
+    thread_monitor_sample();
+    return 0;
+}
+
+#endif
+
 static const struct bt_mesh_health_srv_cb health_srv_cb = {
     .attn_on = attention_on,
     .attn_off = attention_off,
+#if defined(CONFIG_MESH_THREAD_MONITOR)
+    .fault_get_cur = fault_get_cur,
+    .fault_get_reg = fault_get_reg,
+    .fault_clear = fault_clear,
+    .fault_test = fault_test,
+#endif
 };
 
 static struct bt_mesh_health_srv health_srv = {
@@ -40,43 +112,735 @@ static struct bt_mesh_model sig_models[] = {
 };
 
 /* Vendor models */
-#define MOVEMENT_SERVER_MODEL_ID 0x0000
 #define OP_VENDOR_MOVEMENT_RECIEVED BT_MESH_MODEL_OP_3(0x00, CONFIG_BT_COMPANY_ID)
 
+/* Movement messages start with a transaction ID and a sequence number, which
+ * let retransmissions and relayed copies be dropped before they reach the application.
+ */
+#define MOVEMENT_HDR_LEN 2
+#define MOVEMENT_CONFIG_LEN (MOVEMENT_HDR_LEN + 6)
+
+static bool movement_is_new(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+                            struct net_buf_simple *buf, enum latency_trace_cmd cmd)
+{
+    uint8_t tid = net_buf_simple_pull_u8(buf);
+    uint8_t seq = net_buf_simple_pull_u8(buf);
+    bool is_new = dup_filter_check(ctx->addr, tid, seq);
+
+    latency_trace(is_new ? LATENCY_TRACE_RX : LATENCY_TRACE_DUP, bt_mesh_model_elem(model)->addr,
+                  ctx->addr, cmd, tid, seq, ctx->recv_rssi);
+
+    return is_new;
+}
+
 static int movement_config_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
 {
-    struct robot_movement_config *mov_conf = (struct robot_movement_config *)buf->data;
-    int err = 0;
+    if (!movement_is_new(model, ctx, buf, LATENCY_TRACE_CMD_MOVE)) {
+        return 0;
+    }
+
+    struct robot_movement_config mov_conf = {
+        .time = net_buf_simple_pull_le32(buf),
+        .angle = (int16_t)net_buf_simple_pull_le16(buf),
+    };
+
     if (app_movement_handler != NULL)
     {
-        app_movement_handler(mov_conf);
+        app_movement_handler(&mov_conf);
     }
-    return err;
+    return 0;
 }
 
 #define OP_VENDOR_START_MOVEMENT BT_MESH_MODEL_OP_3(0x01, CONFIG_BT_COMPANY_ID)
+/* Network time instants are sent as 48 bit microsecond counters */
+#define NET_TIME_LEN 6
+
+/* A start instant is either absent or complete. A truncated one is rejected rather
+ * than taken as an immediate start, which would put the robot ahead of the swarm.
+ */
+static bool start_time_len_valid(uint16_t len)
+{
+    return len == 0 || len == NET_TIME_LEN;
+}
 
 static int start_movement_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
 {
+    if (!start_time_len_valid(buf->len - MOVEMENT_HDR_LEN)) {
+        return -EINVAL;
+    }
+
+    if (!movement_is_new(model, ctx, buf, LATENCY_TRACE_CMD_START)) {
+        return 0;
+    }
+
+    /* A message without a start instant starts the movement immediately.
+     * Otherwise it carries the network time at which the movement should start.
+     */
+    bool scheduled = buf->len == NET_TIME_LEN;
+    uint64_t start_time = scheduled ? sys_get_le48(net_buf_simple_pull_mem(buf, NET_TIME_LEN)) : 0;
+
     if (app_start_movement_handler != NULL){
-        app_start_movement_handler();
+        app_start_movement_handler(scheduled, start_time);
+    }
+    return 0;
+}
+
+/* A trajectory replaces the movement configuration */
+#define OP_VENDOR_TRAJECTORY BT_MESH_MODEL_OP_3(0x08, CONFIG_BT_COMPANY_ID)
+
+static int trajectory_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    struct trajectory_segment segment;
+
+    if (!movement_is_new(model, ctx, buf, LATENCY_TRACE_CMD_TRAJECTORY)) {
+        return 0;
+    }
+
+    if (trajectory_decode(buf, &segment)) {
+        return -EINVAL;
+    }
+
+    if (app_trajectory_handler != NULL) {
+        app_trajectory_handler(&segment);
+    }
+    return 0;
+}
+
+#if defined(CONFIG_MESH_CHOREOGRAPHY)
+
+/* Choreography library
+ *
+ * A choreography is uploaded with a begin message giving its ID (2), length (2) and
+ * CRC-32 (4), followed by chunks with the ID (2), offset (2) and data. Chunks are usually
+ * sent to a group, so the whole swarm stores the choreography at once. Receivers only
+ * answer unicast messages, with a status holding the ID (2), status code (1) and next
+ * expected offset (2). A sender polls each robot with get messages, and resends from the
+ * next expected offset to the robots that missed chunks.
+ *
+ * A play message starts a stored choreography like a start movement message, with the
+ * choreography ID (2) after the header and an optional start instant.
+ *
+ * Begin, chunk and get messages are queued in order and handled on a work queue of their
+ * own, as uploads erase flash, which would block the mesh RX thread for tens of
+ * milliseconds per page. They are decoded straight into one of a fixed set of slots, and
+ * the slot index is queued. Each status is sent once the message is handled. Messages
+ * that find no free slot are dropped, and sent again from the next expected offset.
+ *
+ * Without the library, which fails to start if its flash partition is unusable, every
+ * begin, chunk and get message is answered with a storage error right away.
+ */
+#define OP_VENDOR_CHOREOGRAPHY_BEGIN BT_MESH_MODEL_OP_3(0x09, CONFIG_BT_COMPANY_ID)
+#define OP_VENDOR_CHOREOGRAPHY_CHUNK BT_MESH_MODEL_OP_3(0x0a, CONFIG_BT_COMPANY_ID)
+#define OP_VENDOR_CHOREOGRAPHY_GET BT_MESH_MODEL_OP_3(0x0b, CONFIG_BT_COMPANY_ID)
+#define OP_VENDOR_CHOREOGRAPHY_STATUS BT_MESH_MODEL_OP_3(0x0c, CONFIG_BT_COMPANY_ID)
+#define OP_VENDOR_CHOREOGRAPHY_PLAY BT_MESH_MODEL_OP_3(0x0d, CONFIG_BT_COMPANY_ID)
+#define CHOREOGRAPHY_BEGIN_LEN 8
+#define CHOREOGRAPHY_CHUNK_HDR_LEN 4
+#define CHOREOGRAPHY_STATUS_LEN 5
+#define CHOREOGRAPHY_CHUNK_DATA_MAX (BT_MESH_RX_SDU_MAX - BT_MESH_MIC_SHORT - 3 - CHOREOGRAPHY_CHUNK_HDR_LEN)
+#define CHOREOGRAPHY_QUEUE_LEN 8
+
+enum choreography_status
+{
+    CHOREOGRAPHY_STATUS_STORED,
+    CHOREOGRAPHY_STATUS_PARTIAL,
+    CHOREOGRAPHY_STATUS_NOT_FOUND,
+    CHOREOGRAPHY_STATUS_NO_SPACE,
+    CHOREOGRAPHY_STATUS_BAD_DATA,
+    CHOREOGRAPHY_STATUS_STORAGE_ERROR,
+    CHOREOGRAPHY_STATUS_BUSY,
+};
+
+struct choreography_msg
+{
+    uint32_t opcode;
+    struct bt_mesh_model *model;
+    struct bt_mesh_msg_ctx ctx;
+    uint16_t id;
+    uint16_t arg; // Length of a begin, offset of a chunk
+    uint32_t crc;
+    uint16_t len;
+    uint8_t data[CHOREOGRAPHY_CHUNK_DATA_MAX];
+};
+
+static struct choreography_msg choreography_slots[CHOREOGRAPHY_QUEUE_LEN];
+/* Indices of the free slots, and of the slots waiting to be handled, in order */
+K_MSGQ_DEFINE(choreography_free_msgq, sizeof(uint8_t), CHOREOGRAPHY_QUEUE_LEN, 1);
+K_MSGQ_DEFINE(choreography_msgq, sizeof(uint8_t), CHOREOGRAPHY_QUEUE_LEN, 1);
+static bool choreography_ready;
+static K_THREAD_STACK_DEFINE(choreography_stack, CONFIG_MESH_CHOREOGRAPHY_THREAD_STACK_SIZE);
+static struct k_work_q choreography_work_q;
+
+static int choreography_status_msg_send(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+                                        uint16_t id, uint8_t status, uint16_t next_offset)
+{
+    if (!BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst)) {
+        return 0;
+    }
+
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_VENDOR_CHOREOGRAPHY_STATUS, CHOREOGRAPHY_STATUS_LEN);
+    bt_mesh_model_msg_init(&msg, OP_VENDOR_CHOREOGRAPHY_STATUS);
+    net_buf_simple_add_le16(&msg, id);
+    net_buf_simple_add_u8(&msg, status);
+    net_buf_simple_add_le16(&msg, next_offset);
+
+    return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+static int send_choreography_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+                                    uint16_t id, int err)
+{
+    static const uint8_t states[] = {
+        [CHOREOGRAPHY_NONE] = CHOREOGRAPHY_STATUS_NOT_FOUND,
+        [CHOREOGRAPHY_PARTIAL] = CHOREOGRAPHY_STATUS_PARTIAL,
+        [CHOREOGRAPHY_STORED] = CHOREOGRAPHY_STATUS_STORED,
+    };
+    uint16_t next_offset;
+    uint8_t status;
+
+    status = states[choreography_state_get(id, &next_offset)];
+
+    /* An out of order chunk or a resumed upload is reported by the next expected offset */
+    switch (err) {
+    case 0:
+    case -EAGAIN:
+    case -ENOENT:
+        break;
+    case -ENOSPC:
+        status = CHOREOGRAPHY_STATUS_NO_SPACE;
+        break;
+    case -EINVAL:
+    case -EBADMSG:
+        status = CHOREOGRAPHY_STATUS_BAD_DATA;
+        break;
+    case -EBUSY:
+        status = CHOREOGRAPHY_STATUS_BUSY;
+        break;
+    default:
+        status = CHOREOGRAPHY_STATUS_STORAGE_ERROR;
+        break;
+    }
+
+    return choreography_status_msg_send(model, ctx, id, status, next_offset);
+}
+
+static void choreography_work_fn(struct k_work *work)
+{
+    struct choreography_msg *msg;
+    uint16_t next_offset;
+    uint8_t slot;
+    int err;
+
+    while (!k_msgq_get(&choreography_msgq, &slot, K_NO_WAIT)) {
+        msg = &choreography_slots[slot];
+
+        switch (msg->opcode) {
+        case OP_VENDOR_CHOREOGRAPHY_BEGIN:
+            err = choreography_upload_begin(msg->id, msg->arg, msg->crc);
+            break;
+        case OP_VENDOR_CHOREOGRAPHY_CHUNK:
+            err = choreography_upload_chunk(msg->id, msg->arg, msg->data, msg->len);
+
+            /* Accepted chunks are not acknowledged until the upload is complete */
+            if (!err && choreography_state_get(msg->id, &next_offset) == CHOREOGRAPHY_PARTIAL) {
+                err = -EINPROGRESS;
+            }
+            break;
+        default:
+            err = 0;
+            break;
+        }
+
+        if (err != -EINPROGRESS) {
+            send_choreography_status(msg->model, &msg->ctx, msg->id, err);
+        }
+        (void)k_msgq_put(&choreography_free_msgq, &slot, K_NO_WAIT);
+    }
+}
+K_WORK_DEFINE(choreography_work, choreography_work_fn);
+
+/* Take a free slot for a received message, or answer right away if there is no library */
+static struct choreography_msg *choreography_msg_alloc(struct bt_mesh_model *model,
+                                                       struct bt_mesh_msg_ctx *ctx, uint32_t opcode,
+                                                       uint16_t id, uint8_t *slot)
+{
+    struct choreography_msg *msg;
+
+    if (!choreography_ready) {
+        (void)choreography_status_msg_send(model, ctx, id, CHOREOGRAPHY_STATUS_STORAGE_ERROR, 0);
+        return NULL;
+    }
+
+    if (k_msgq_get(&choreography_free_msgq, slot, K_NO_WAIT)) {
+        return NULL;
+    }
+
+    msg = &choreography_slots[*slot];
+    msg->opcode = opcode;
+    msg->model = model;
+    msg->ctx = *ctx;
+    msg->id = id;
+    return msg;
+}
+
+static void choreography_msg_queue(uint8_t slot)
+{
+    /* Never full, there are as many entries as slots */
+    (void)k_msgq_put(&choreography_msgq, &slot, K_NO_WAIT);
+    k_work_submit_to_queue(&choreography_work_q, &choreography_work);
+}
+
+static int choreography_begin_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    uint16_t id = net_buf_simple_pull_le16(buf);
+    struct choreography_msg *msg;
+    uint8_t slot;
+
+    msg = choreography_msg_alloc(model, ctx, OP_VENDOR_CHOREOGRAPHY_BEGIN, id, &slot);
+    if (msg == NULL) {
+        return choreography_ready ? -ENOBUFS : 0;
+    }
+
+    msg->arg = net_buf_simple_pull_le16(buf);
+    msg->crc = net_buf_simple_pull_le32(buf);
+    choreography_msg_queue(slot);
+    return 0;
+}
+
+static int choreography_chunk_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    uint16_t id = net_buf_simple_pull_le16(buf);
+    uint16_t offset = net_buf_simple_pull_le16(buf);
+    struct choreography_msg *msg;
+    uint8_t slot;
+
+    if (buf->len > CHOREOGRAPHY_CHUNK_DATA_MAX) {
+        return -EMSGSIZE;
+    }
+
+    msg = choreography_msg_alloc(model, ctx, OP_VENDOR_CHOREOGRAPHY_CHUNK, id, &slot);
+    if (msg == NULL) {
+        return choreography_ready ? -ENOBUFS : 0;
+    }
+
+    msg->arg = offset;
+    msg->len = buf->len;
+    memcpy(msg->data, buf->data, buf->len);
+    choreography_msg_queue(slot);
+    return 0;
+}
+
+static int choreography_get_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    uint16_t id = net_buf_simple_pull_le16(buf);
+    uint8_t slot;
+
+    if (choreography_msg_alloc(model, ctx, OP_VENDOR_CHOREOGRAPHY_GET, id, &slot) == NULL) {
+        return choreography_ready ? -ENOBUFS : 0;
+    }
+
+    choreography_msg_queue(slot);
+    return 0;
+}
+
+static int choreography_start(void)
+{
+    struct k_work_queue_config config = {
+        .name = "choreography",
+    };
+    int err = choreography_init();
+
+    if (err) {
+        return err;
+    }
+
+    for (uint8_t slot = 0; slot < ARRAY_SIZE(choreography_slots); slot++) {
+        (void)k_msgq_put(&choreography_free_msgq, &slot, K_NO_WAIT);
+    }
+
+    k_work_queue_init(&choreography_work_q);
+    k_work_queue_start(&choreography_work_q, choreography_stack,
+                       K_THREAD_STACK_SIZEOF(choreography_stack), K_LOWEST_APPLICATION_THREAD_PRIO,
+                       &config);
+    choreography_ready = true;
+    return 0;
+}
+
+static int choreography_play_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    if (!start_time_len_valid(buf->len - MOVEMENT_HDR_LEN - 2)) {
+        return -EINVAL;
+    }
+
+    /* Nothing is stored to play without the library */
+    if (!choreography_ready || !movement_is_new(model, ctx, buf, LATENCY_TRACE_CMD_CHOREOGRAPHY)) {
+        return 0;
+    }
+
+    uint16_t id = net_buf_simple_pull_le16(buf);
+    bool scheduled = buf->len == NET_TIME_LEN;
+    uint64_t start_time = scheduled ? sys_get_le48(net_buf_simple_pull_mem(buf, NET_TIME_LEN)) : 0;
+
+    if (app_choreography_play_handler != NULL) {
+        app_choreography_play_handler(id, scheduled, start_time);
     }
     return 0;
 }
 
+#endif
+
 static const struct bt_mesh_model_op movement_server_ops[] = {
-    {OP_VENDOR_MOVEMENT_RECIEVED, BT_MESH_LEN_EXACT(sizeof(struct robot_movement_config)), movement_config_recieved},
-    {OP_VENDOR_START_MOVEMENT, BT_MESH_LEN_EXACT(0), start_movement_recieved},
+    {OP_VENDOR_MOVEMENT_RECIEVED, BT_MESH_LEN_EXACT(MOVEMENT_CONFIG_LEN), movement_config_recieved},
+    {OP_VENDOR_START_MOVEMENT, BT_MESH_LEN_MIN(MOVEMENT_HDR_LEN), start_movement_recieved},
+    {OP_VENDOR_TRAJECTORY, BT_MESH_LEN_MIN(MOVEMENT_HDR_LEN + 1), trajectory_recieved},
+#if defined(CONFIG_MESH_CHOREOGRAPHY)
+    {OP_VENDOR_CHOREOGRAPHY_BEGIN, BT_MESH_LEN_EXACT(CHOREOGRAPHY_BEGIN_LEN), choreography_begin_recieved},
+    {OP_VENDOR_CHOREOGRAPHY_CHUNK, BT_MESH_LEN_MIN(CHOREOGRAPHY_CHUNK_HDR_LEN + 1), choreography_chunk_recieved},
+    {OP_VENDOR_CHOREOGRAPHY_GET, BT_MESH_LEN_EXACT(2), choreography_get_recieved},
+    {OP_VENDOR_CHOREOGRAPHY_PLAY, BT_MESH_LEN_MIN(MOVEMENT_HDR_LEN + 2), choreography_play_recieved},
+#endif
+    BT_MESH_MODEL_OP_END,
+};
+
+#define OP_VENDOR_TIME_BEACON BT_MESH_MODEL_OP_3(0x02, CONFIG_BT_COMPANY_ID)
+#define TIME_BEACON_LEN 7
+
+static int time_beacon_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    uint64_t net_time = sys_get_le48(net_buf_simple_pull_mem(buf, NET_TIME_LEN));
+    uint8_t send_ttl = net_buf_simple_pull_u8(buf);
+    uint8_t hops = send_ttl > ctx->recv_ttl ? send_ttl - ctx->recv_ttl : 0;
+
+    time_sync_beacon_received(net_time, hops);
+    return 0;
+}
+
+static const struct bt_mesh_model_op time_sync_ops[] = {
+    {OP_VENDOR_TIME_BEACON, BT_MESH_LEN_EXACT(TIME_BEACON_LEN), time_beacon_recieved},
+    BT_MESH_MODEL_OP_END,
+};
+
+/* Called by the access layer right before each periodic publication, so the
+ * timestamp is as fresh as possible when the beacon goes on air.
+ */
+static int time_beacon_update(struct bt_mesh_model *model)
+{
+    if (!IS_ENABLED(CONFIG_MESH_TIME_SYNC_ROOT)) {
+        return -ENOTSUP;
+    }
+
+    uint8_t ttl = model->pub->ttl == BT_MESH_TTL_DEFAULT ? bt_mesh_default_ttl_get() : model->pub->ttl;
+
+    bt_mesh_model_msg_init(model->pub->msg, OP_VENDOR_TIME_BEACON);
+    sys_put_le48(time_sync_now(), net_buf_simple_add(model->pub->msg, NET_TIME_LEN));
+    net_buf_simple_add_u8(model->pub->msg, ttl);
+    return 0;
+}
+
+BT_MESH_MODEL_PUB_DEFINE(time_sync_pub, time_beacon_update, TIME_BEACON_LEN);
+
+#if defined(CONFIG_MESH_THREAD_MONITOR)
+
+/* Thread status
+ *
+ * Lists the CPU and stack usage of every thread, in the order the threads were
+ * first sampled. Each entry is the thread name prefix (4), CPU usage in percent (1),
+ * stack high water mark in percent (1) and unused stack bytes (2).
+ */
+#define OP_VENDOR_THREAD_GET BT_MESH_MODEL_OP_3(0x06, CONFIG_BT_COMPANY_ID)
+#define OP_VENDOR_THREAD_STATUS BT_MESH_MODEL_OP_3(0x07, CONFIG_BT_COMPANY_ID)
+#define THREAD_ENTRY_NAME_LEN 4
+#define THREAD_ENTRY_LEN (THREAD_ENTRY_NAME_LEN + 4)
+/* As many entries as fit in a message of BT_MESH_TX_SEG_MAX segments */
+#define THREAD_ENTRY_MAX ((BT_MESH_TX_SDU_MAX - BT_MESH_MIC_SHORT - 3 - 1) / THREAD_ENTRY_LEN)
+
+static int thread_get_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    struct thread_monitor_sample samples[THREAD_ENTRY_MAX];
+    size_t count = thread_monitor_samples_get(samples, ARRAY_SIZE(samples));
+
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_VENDOR_THREAD_STATUS, 1 + THREAD_ENTRY_MAX * THREAD_ENTRY_LEN);
+    bt_mesh_model_msg_init(&msg, OP_VENDOR_THREAD_STATUS);
+    net_buf_simple_add_u8(&msg, count);
+
+    for (int i = 0; i < count; i++) {
+        net_buf_simple_add_mem(&msg, samples[i].name, THREAD_ENTRY_NAME_LEN);
+        net_buf_simple_add_u8(&msg, samples[i].cpu_pct);
+        net_buf_simple_add_u8(&msg, samples[i].stack_pct);
+        net_buf_simple_add_le16(&msg, samples[i].stack_unused);
+    }
+
+    return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+static const struct bt_mesh_model_op thread_monitor_ops[] = {
+    {OP_VENDOR_THREAD_GET, BT_MESH_LEN_EXACT(0), thread_get_recieved},
+    BT_MESH_MODEL_OP_END,
+};
+
+#endif
+
+#if defined(CONFIG_MESH_ROBOT_STATUS)
+
+/* Robot status
+ *
+ * Robot state (1), battery voltage in mV (2), 0 without battery monitor, the TTL the
+ * status was published with (1), so the receiver can count the hops, and a tag derived
+ * from the hardware device ID (2), which tells apart robots sharing an address.
+ */
+#define OP_VENDOR_ROBOT_STATUS BT_MESH_MODEL_OP_3(0x0e, CONFIG_BT_COMPANY_ID)
+#define ROBOT_STATUS_LEN 6
+
+static atomic_t robot_state = ATOMIC_INIT(ROBOT_STATE_STANDBY);
+static uint16_t device_tag;
+
+static void robot_status_init(void)
+{
+    uint8_t id[16];
+    ssize_t len = hwinfo_get_device_id(id, sizeof(id));
+
+    device_tag = len > 0 ? crc16_ccitt(0xffff, id, len) : 0;
+}
+
+static int robot_status_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    uint8_t state = net_buf_simple_pull_u8(buf);
+    uint16_t battery_mv = net_buf_simple_pull_le16(buf);
+    uint8_t send_ttl = net_buf_simple_pull_u8(buf);
+    uint8_t hops = send_ttl > ctx->recv_ttl ? send_ttl - ctx->recv_ttl : 0;
+    uint16_t tag = net_buf_simple_pull_le16(buf);
+
+    if (IS_ENABLED(CONFIG_MESH_LINK_BRIDGE)) {
+        link_bridge_status_send(ctx->addr, tag, state, hops, ctx->recv_rssi, battery_mv);
+    }
+    return 0;
+}
+
+static const struct bt_mesh_model_op robot_status_ops[] = {
+    {OP_VENDOR_ROBOT_STATUS, BT_MESH_LEN_EXACT(ROBOT_STATUS_LEN), robot_status_recieved},
     BT_MESH_MODEL_OP_END,
 };
 
+static int robot_status_update(struct bt_mesh_model *model)
+{
+    uint8_t ttl = model->pub->ttl == BT_MESH_TTL_DEFAULT ? bt_mesh_default_ttl_get() : model->pub->ttl;
+
+    bt_mesh_model_msg_init(model->pub->msg, OP_VENDOR_ROBOT_STATUS);
+    net_buf_simple_add_u8(model->pub->msg, atomic_get(&robot_state));
+    net_buf_simple_add_le16(model->pub->msg, battery_mv_get());
+    net_buf_simple_add_u8(model->pub->msg, ttl);
+    net_buf_simple_add_le16(model->pub->msg, device_tag);
+    return 0;
+}
+
+BT_MESH_MODEL_PUB_DEFINE(robot_status_pub, robot_status_update, ROBOT_STATUS_LEN);
+
+/* Publishes from the system workqueue, like the periodic publication, so the two never
+ * fill the publication message at the same time.
+ */
+static void robot_status_publish_work_fn(struct k_work *work)
+{
+    struct bt_mesh_model *model = robot_status_pub.mod;
+    int err;
+
+    if (model == NULL) {
+        return;
+    }
+
+    robot_status_update(model);
+    err = bt_mesh_model_publish(model);
+    if (err && err != -EADDRNOTAVAIL) {
+        LOG_ERR("Failed to publish robot status: Error %d", err);
+    }
+}
+K_WORK_DEFINE(robot_status_publish_work, robot_status_publish_work_fn);
+
+void model_handler_robot_state_set(enum robot_state state)
+{
+    if (atomic_set(&robot_state, state) != state) {
+        k_work_submit(&robot_status_publish_work);
+    }
+}
+
+#endif
+
 static struct bt_mesh_model vendor_models[] = {
     BT_MESH_MODEL_VND(CONFIG_BT_COMPANY_ID, MOVEMENT_SERVER_MODEL_ID, movement_server_ops, NULL, NULL),
+    BT_MESH_MODEL_VND(CONFIG_BT_COMPANY_ID, TIME_SYNC_MODEL_ID, time_sync_ops, &time_sync_pub, NULL),
+#if defined(CONFIG_MESH_THREAD_MONITOR)
+    BT_MESH_MODEL_VND(CONFIG_BT_COMPANY_ID, THREAD_MONITOR_MODEL_ID, thread_monitor_ops, NULL, NULL),
+#endif
+#if defined(CONFIG_MESH_ROBOT_STATUS)
+    BT_MESH_MODEL_VND(CONFIG_BT_COMPANY_ID, ROBOT_STATUS_MODEL_ID, robot_status_ops, &robot_status_pub, NULL),
+#endif
 };
 
+/* The robot bridging the gateway to the mesh sends movement messages on
+ * behalf of the gateway, from its own movement server model.
+ */
+static int movement_send(uint16_t dst, uint32_t opcode, const uint8_t *params, size_t len,
+                         enum latency_trace_cmd cmd)
+{
+    struct bt_mesh_model *model = &vendor_models[0];
+    struct bt_mesh_msg_ctx ctx = {
+        .app_idx = model->keys[0],
+        .addr = dst,
+        .send_ttl = BT_MESH_TTL_DEFAULT,
+    };
+
+    if (ctx.app_idx == BT_MESH_KEY_UNUSED) {
+        return -EAGAIN;
+    }
+
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_VENDOR_MOVEMENT_RECIEVED, MOVEMENT_CONFIG_LEN);
+    bt_mesh_model_msg_init(&msg, opcode);
+    net_buf_simple_add_mem(&msg, params, len);
+
+    int err = bt_mesh_model_send(model, &ctx, &msg, NULL, NULL);
+
+    if (!err) {
+        latency_trace(LATENCY_TRACE_TX, bt_mesh_model_elem(model)->addr, dst, cmd, params[0],
+                      params[1], 0);
+    }
+    return err;
+}
+
+int model_handler_movement_send(uint16_t dst, uint8_t tid, uint8_t seq, uint32_t time, int16_t angle)
+{
+    uint8_t params[MOVEMENT_CONFIG_LEN] = {tid, seq};
+
+    sys_put_le32(time, &params[MOVEMENT_HDR_LEN]);
+    sys_put_le16(angle, &params[MOVEMENT_HDR_LEN + 4]);
+    return movement_send(dst, OP_VENDOR_MOVEMENT_RECIEVED, params, sizeof(params),
+                         LATENCY_TRACE_CMD_MOVE);
+}
+
+int model_handler_start_send(uint16_t dst, uint8_t tid, uint8_t seq, uint64_t start_time)
+{
+    uint8_t params[MOVEMENT_HDR_LEN + NET_TIME_LEN] = {tid, seq};
+    size_t len = MOVEMENT_HDR_LEN;
+
+    if (start_time) {
+        sys_put_le48(start_time, &params[MOVEMENT_HDR_LEN]);
+        len += NET_TIME_LEN;
+    }
+    return movement_send(dst, OP_VENDOR_START_MOVEMENT, params, len, LATENCY_TRACE_CMD_START);
+}
+
+/* Motor elements
+ *
+ * Every motor in the devicetree gets its own element with a motor server
+ * model, so test and calibration commands can address a single motor directly.
+ * The commands are handed to the motor module like any other movement, so they get
+ * the battery compensation and respect the safety stop. The status is sent once
+ * the motor module has handled the command.
+ */
+#if defined(CONFIG_MESH_MOTOR_ELEMENTS)
+
+#define OP_VENDOR_MOTOR_POWER_SET BT_MESH_MODEL_OP_3(0x03, CONFIG_BT_COMPANY_ID)
+/* 0x04 is reserved for a position command, the motor drivers have no position control */
+#define OP_VENDOR_MOTOR_STATUS BT_MESH_MODEL_OP_3(0x05, CONFIG_BT_COMPANY_ID)
+
+#define MOTOR_DEVICE(node_id) DEVICE_DT_GET(node_id),
+
+/* Motor of each motor element, in element order after the primary element */
+static const struct device *const motors[] = {
+    DT_FOREACH_STATUS_OKAY(toshiba_tb6612fng_motor, MOTOR_DEVICE)
+};
+
+/* Unicast command of each motor that waits for its status. Only the last one is answered. */
+static struct motor_reply
+{
+    struct bt_mesh_model *model;
+    struct bt_mesh_msg_ctx ctx;
+    bool pending;
+} motor_replies[ARRAY_SIZE(motors)];
+static struct k_spinlock motor_reply_lock;
+
+static const struct device *model_motor(const struct bt_mesh_model *model)
+{
+    return motors[model->elem_idx - 1];
+}
+
+static int send_motor_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, int motor_err)
+{
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_VENDOR_MOTOR_STATUS, 2);
+    bt_mesh_model_msg_init(&msg, OP_VENDOR_MOTOR_STATUS);
+    net_buf_simple_add_le16(&msg, (uint16_t)(int16_t)motor_err);
+
+    return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+static int motor_power_set_recieved(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf)
+{
+    struct motor_reply *reply = &motor_replies[model->elem_idx - 1];
+    int32_t power = (int32_t)net_buf_simple_pull_le32(buf);
+
+    if (app_motor_power_handler == NULL) {
+        return send_motor_status(model, ctx, -ENOTSUP);
+    }
+
+    /* Only acknowledge unicast commands, a group command would make every motor respond at once */
+    if (BT_MESH_ADDR_IS_UNICAST(ctx->recv_dst)) {
+        k_spinlock_key_t key = k_spin_lock(&motor_reply_lock);
+
+        reply->model = model;
+        reply->ctx = *ctx;
+        reply->pending = true;
+        k_spin_unlock(&motor_reply_lock, key);
+    }
+
+    app_motor_power_handler(model_motor(model), power);
+    return 0;
+}
+
+static const struct bt_mesh_model_op motor_server_ops[] = {
+    {OP_VENDOR_MOTOR_POWER_SET, BT_MESH_LEN_EXACT(4), motor_power_set_recieved},
+    BT_MESH_MODEL_OP_END,
+};
+
+#define MOTOR_MODELS_NAME(node_id) _CONCAT(motor_models_, DT_DEP_ORD(node_id))
+
+#define MOTOR_MODELS_DEFINE(node_id)                                                     \
+    static struct bt_mesh_model MOTOR_MODELS_NAME(node_id)[] = {                         \
+        BT_MESH_MODEL_VND(CONFIG_BT_COMPANY_ID, MOTOR_SERVER_MODEL_ID, motor_server_ops, \
+                          NULL, NULL),                                                   \
+    };
+
+#define MOTOR_ELEM(node_id) BT_MESH_ELEM(0, BT_MESH_MODEL_NONE, MOTOR_MODELS_NAME(node_id)),
+
+DT_FOREACH_STATUS_OKAY(toshiba_tb6612fng_motor, MOTOR_MODELS_DEFINE)
+
+#endif
+
+void model_handler_motor_status_send(const struct device *motor, int err)
+{
+#if defined(CONFIG_MESH_MOTOR_ELEMENTS)
+    for (size_t i = 0; i < ARRAY_SIZE(motors); i++) {
+        if (motors[i] != motor) {
+            continue;
+        }
+
+        k_spinlock_key_t key = k_spin_lock(&motor_reply_lock);
+        struct motor_reply reply = motor_replies[i];
+
+        motor_replies[i].pending = false;
+        k_spin_unlock(&motor_reply_lock, key);
+
+        if (reply.pending) {
+            (void)send_motor_status(reply.model, &reply.ctx, err);
+        }
+        return;
+    }
+#endif
+}
+
 /* Composition */
 static struct bt_mesh_elem elements[] = {
     BT_MESH_ELEM(0, sig_models, vendor_models),
+#if defined(CONFIG_MESH_MOTOR_ELEMENTS)
+    DT_FOREACH_STATUS_OKAY(toshiba_tb6612fng_motor, MOTOR_ELEM)
+#endif
 };
 
 static struct bt_mesh_comp comp = {
@@ -85,10 +849,36 @@ static struct bt_mesh_comp comp = {
     .elem_count = ARRAY_SIZE(elements),
 };
 
+/* Publish the health status right away when a thread monitor fault appears or clears */
+static void thread_faults_changed(void)
+{
+    bt_mesh_health_srv_fault_update(&elements[0]);
+}
+
 const struct bt_mesh_comp *model_handler_init(movement_received_handler_t movement_handler,
-    start_movement_handler_t start_movement_handler)
+    start_movement_handler_t start_movement_handler, trajectory_received_handler_t trajectory_handler,
+    choreography_play_handler_t choreography_play_handler, motor_power_handler_t motor_power_handler)
 {
     app_movement_handler = movement_handler;
     app_start_movement_handler = start_movement_handler;
+    app_trajectory_handler = trajectory_handler;
+    app_choreography_play_handler = choreography_play_handler;
+    app_motor_power_handler = motor_power_handler;
+
+    if (IS_ENABLED(CONFIG_MESH_THREAD_MONITOR)) {
+        thread_monitor_init(thread_faults_changed);
+    }
+
+#if defined(CONFIG_MESH_CHOREOGRAPHY)
+    int err = choreography_start();
+
+    if (err) {
+        LOG_ERR("Choreography library unavailable: Error %d", err);
+    }
+#endif
+
+#if defined(CONFIG_MESH_ROBOT_STATUS)
+    robot_status_init();
+#endif
     return &comp;
 }
\ No newline at end of file
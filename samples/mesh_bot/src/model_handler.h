@@ -2,15 +2,110 @@
 
 #include <zephyr/bluetooth/mesh.h>
 
-struct robot_movement_config
+#include "movement.h"
+#include "trajectory.h"
+
+/* Vendor model IDs */
+#define MOVEMENT_SERVER_MODEL_ID 0x0000
+#define TIME_SYNC_MODEL_ID 0x0001
+#define MOTOR_SERVER_MODEL_ID 0x0002
+#define THREAD_MONITOR_MODEL_ID 0x0003
+#define ROBOT_STATUS_MODEL_ID 0x0004
+
+/** Robot state in the robot status. */
+enum robot_state
 {
-    uint32_t time;
-    int32_t angle;
+    ROBOT_STATE_STANDBY = 0,     // Not moving.
+    ROBOT_STATE_MOVING = 1,      // Executing a movement.
+    ROBOT_STATE_SAFETY_STOP = 2, // Last movement ended by the safety stop.
 };
 
 typedef void (*movement_received_handler_t)(struct robot_movement_config *);
-typedef void (*start_movement_handler_t)();
+
+/**
+ * @brief Handler for the start movement message.
+ *
+ * @param scheduled true if the message carries a start instant, false if the movement should
+ *                  start immediately.
+ * @param start_time Network time in microseconds at which the movement should start.
+ *                   Only valid if @p scheduled is true.
+ */
+typedef void (*start_movement_handler_t)(bool scheduled, uint64_t start_time);
+
+/**
+ * @brief Handler for the trajectory message.
+ *
+ * @param segment Trajectory to follow at the next start movement message.
+ */
+typedef void (*trajectory_received_handler_t)(const struct trajectory_segment *segment);
+
+/**
+ * @brief Handler for the choreography play message.
+ *
+ * @param id Choreography to play.
+ * @param scheduled true if the message carries a start instant, false if the choreography
+ *                  should start immediately.
+ * @param start_time Network time in microseconds at which the choreography should start.
+ *                   Only valid if @p scheduled is true.
+ */
+typedef void (*choreography_play_handler_t)(uint16_t id, bool scheduled, uint64_t start_time);
+
+/**
+ * @brief Handler for the power command of a motor element.
+ *
+ * The result is reported back with @ref model_handler_motor_status_send.
+ *
+ * @param motor Motor of the element the command was sent to.
+ * @param power Requested power, in the unit of the motor driver.
+ */
+typedef void (*motor_power_handler_t)(const struct device *motor, int32_t power);
 
 const struct bt_mesh_comp *model_handler_init(
     movement_received_handler_t movement_received_handler,
-    start_movement_handler_t start_movement_handler);
\ No newline at end of file
+    start_movement_handler_t start_movement_handler,
+    trajectory_received_handler_t trajectory_received_handler,
+    choreography_play_handler_t choreography_play_handler,
+    motor_power_handler_t motor_power_handler);
+
+/**
+ * @brief Send a movement configuration to other robots.
+ *
+ * @param dst Destination address.
+ * @param tid Transaction ID, for the duplicate filter of the receivers.
+ * @param seq Sequence number within the transaction.
+ * @param time Movement time in milliseconds.
+ * @param angle Movement angle in degrees.
+ * @return 0 on success, -EAGAIN if the movement model has no application key yet,
+ *         or another negative errno code.
+ */
+int model_handler_movement_send(uint16_t dst, uint8_t tid, uint8_t seq, uint32_t time, int16_t angle);
+
+/**
+ * @brief Send a start movement message to other robots.
+ *
+ * @param dst Destination address.
+ * @param tid Transaction ID, for the duplicate filter of the receivers.
+ * @param seq Sequence number within the transaction.
+ * @param start_time Network time in microseconds at which the movement should start,
+ *                   or 0 to start immediately.
+ * @return 0 on success, -EAGAIN if the movement model has no application key yet,
+ *         or another negative errno code.
+ */
+int model_handler_start_send(uint16_t dst, uint8_t tid, uint8_t seq, uint64_t start_time);
+
+/**
+ * @brief Set the state in the robot status, and publish the status if it changed.
+ *
+ * @param state New state.
+ */
+void model_handler_robot_state_set(enum robot_state state);
+
+/**
+ * @brief Answer the last unicast power command of a motor element.
+ *
+ * Does nothing if no command of that motor is waiting for its status.
+ *
+ * @param motor Motor the command was for.
+ * @param err Result of the command, 0 or a negative errno code.
+ */
+void model_handler_motor_status_send(const struct device *motor, int err);
@@ -10,6 +10,10 @@
 #include "../events/mesh_module_event.h"
 
 #include "../model_handler.h"
+#include "../time_sync.h"
+#include "../self_provision.h"
+#include "../link_bridge.h"
+#include "../boot_profile.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(MODULE, CONFIG_MESH_MODULE_LOG_LEVEL);
@@ -35,6 +39,7 @@ static void set_module_state(enum mesh_module_state new_state)
 /* Mesh handlers */
 
 static void movement_received_handler(struct robot_movement_config *movement) {
+    boot_profile_mark(BOOT_PHASE_FIRST_COMMAND);
     LOG_DBG("Movement received: Time:%d  Angle:%d", movement->time, movement->angle);
     struct mesh_module_event *evt = new_mesh_module_event();
     evt->type = MESH_EVT_MOVEMENT_RECEIVED;
@@ -43,15 +48,257 @@ static void movement_received_handler(struct robot_movement_config *movement) {
     APP_EVENT_SUBMIT(evt);
 }
 
-static void start_movement_handler(void) {
-    LOG_DBG("Starting movement");
+static void trajectory_received_handler(const struct trajectory_segment *segment) {
+    boot_profile_mark(BOOT_PHASE_FIRST_COMMAND);
+    LOG_DBG("Trajectory of type %d received", segment->type);
+    struct mesh_module_event *evt = new_mesh_module_event();
+    evt->type = MESH_EVT_TRAJECTORY_RECEIVED;
+    evt->data.trajectory = *segment;
+    APP_EVENT_SUBMIT(evt);
+}
+
+static void send_clear_to_move(void)
+{
     struct mesh_module_event *evt = new_mesh_module_event();
     evt->type = MESH_EVT_CLEAR_TO_MOVE_RECEIVED;
     APP_EVENT_SUBMIT(evt);
 }
 
+static uint64_t scheduled_start_time;
+
+static void scheduled_start_work_fn(struct k_work *work)
+{
+    /* Lateness relative to the shared clock. Together with the sync error
+     * reported by each node this gives the start skew across the swarm.
+     */
+    LOG_INF("Scheduled start at %llu us, skew %lld us", scheduled_start_time,
+            -time_sync_until(scheduled_start_time));
+    send_clear_to_move();
+}
+K_WORK_DELAYABLE_DEFINE(scheduled_start_work, scheduled_start_work_fn);
+
+static void start_movement_handler(bool scheduled, uint64_t start_time) {
+    boot_profile_mark(BOOT_PHASE_FIRST_COMMAND);
+
+    if (!scheduled) {
+        LOG_DBG("Starting movement");
+        send_clear_to_move();
+        return;
+    }
+
+    if (!time_sync_is_synced()) {
+        LOG_WRN("Network clock not synchronized, starting movement immediately");
+        send_clear_to_move();
+        return;
+    }
+
+    int64_t delay = time_sync_until(start_time);
+
+    if (delay <= 0) {
+        LOG_WRN("Start time passed %lld us ago, starting movement immediately", -delay);
+        send_clear_to_move();
+        return;
+    }
+
+    LOG_DBG("Starting movement in %lld us", delay);
+    scheduled_start_time = start_time;
+    k_work_reschedule(&scheduled_start_work, K_USEC(delay));
+}
+
+/* A choreography is selected like a movement, then started like one */
+static void choreography_play_handler(uint16_t id, bool scheduled, uint64_t start_time) {
+    LOG_DBG("Choreography %u received", id);
+    struct mesh_module_event *evt = new_mesh_module_event();
+    evt->type = MESH_EVT_CHOREOGRAPHY_RECEIVED;
+    evt->data.choreography = id;
+    APP_EVENT_SUBMIT(evt);
+
+    start_movement_handler(scheduled, start_time);
+}
+
+/* Power commands of the motor elements are answered when the motor module is done */
+static void motor_power_handler(const struct device *motor, int32_t power) {
+    LOG_DBG("Motor power %d received for %s", power, motor->name);
+    struct mesh_module_event *evt = new_mesh_module_event();
+    evt->type = MESH_EVT_MOTOR_POWER_RECEIVED;
+    evt->data.motor_power.motor = motor;
+    evt->data.motor_power.power = power;
+    APP_EVENT_SUBMIT(evt);
+}
+
+/* Robot status */
+
+static void robot_state_update(const struct motor_module_event *evt)
+{
+    if (!IS_ENABLED(CONFIG_MESH_ROBOT_STATUS)) {
+        return;
+    }
+
+    if (evt->type == MOTOR_EVT_MOVEMENT_START) {
+        model_handler_robot_state_set(ROBOT_STATE_MOVING);
+    } else if (evt->reason == MOTOR_DONE_SAFETY_STOP) {
+        model_handler_robot_state_set(ROBOT_STATE_SAFETY_STOP);
+    } else {
+        model_handler_robot_state_set(ROBOT_STATE_STANDBY);
+    }
+}
+
+/* Low Power Node */
+
+#if defined(CONFIG_BT_MESH_LOW_POWER)
+
+/* Radio usage bookkeeping. Scanning keeps the receiver on continuously, while
+ * an LPN only listens for the friend's response after each poll.
+ */
+static struct
+{
+    int64_t mode_since;        // Uptime at the last mode switch, in ms.
+    int64_t lpn_ms;            // Time spent as LPN, in ms.
+    int64_t scan_ms;           // Time spent scanning continuously, in ms.
+    int64_t last_poll;         // Uptime of the last friend poll, in ms.
+    int64_t max_poll_interval; // Worst case wait for a queued command, in ms.
+    uint32_t polls;
+    uint8_t recv_win;          // Receive window negotiated with the friend, in ms.
+} lpn_stats;
+
+static bool lpn_enabled;
+
+static void lpn_log_stats(void)
+{
+    int64_t total = lpn_stats.lpn_ms + lpn_stats.scan_ms;
+    /* The radio is off during the receive delay, only the receive window counts */
+    int64_t rx_ms = lpn_stats.scan_ms + (int64_t)lpn_stats.polls * lpn_stats.recv_win;
+
+    LOG_INF("LPN %lld ms, scanning %lld ms, %u polls, max poll interval %lld ms, est. RX duty %lld permille",
+            lpn_stats.lpn_ms, lpn_stats.scan_ms, lpn_stats.polls, lpn_stats.max_poll_interval,
+            total > 0 ? (rx_ms * 1000) / total : 0);
+}
+
+static void lpn_mode_set(bool enable)
+{
+    if (enable == lpn_enabled) {
+        return;
+    }
+
+    int err = bt_mesh_lpn_set(enable);
+    if (err) {
+        LOG_ERR("Failed to %s LPN mode: Error %d", enable ? "enable" : "disable", err);
+        return;
+    }
+
+    int64_t now = k_uptime_get();
+
+    if (lpn_enabled) {
+        lpn_stats.lpn_ms += now - lpn_stats.mode_since;
+    } else {
+        lpn_stats.scan_ms += now - lpn_stats.mode_since;
+    }
+    lpn_stats.mode_since = now;
+    lpn_enabled = enable;
+
+    LOG_DBG("Switched to %s", enable ? "LPN mode" : "continuous scanning");
+    lpn_log_stats();
+}
+
+static void lpn_idle_work_fn(struct k_work *work)
+{
+    if (!bt_mesh_is_provisioned()) {
+        k_work_reschedule(k_work_delayable_from_work(work), K_SECONDS(CONFIG_MESH_LPN_IDLE_TIMEOUT));
+        return;
+    }
+    lpn_mode_set(true);
+}
+K_WORK_DELAYABLE_DEFINE(lpn_idle_work, lpn_idle_work_fn);
+
+static void lpn_established(uint16_t net_idx, uint16_t friend_addr, uint8_t queue_size, uint8_t recv_win)
+{
+    LOG_INF("Friendship established with 0x%04x", friend_addr);
+    lpn_stats.recv_win = recv_win;
+    lpn_stats.last_poll = k_uptime_get();
+}
+
+static void lpn_terminated(uint16_t net_idx, uint16_t friend_addr)
+{
+    LOG_INF("Friendship with 0x%04x terminated", friend_addr);
+}
+
+static void lpn_polled(uint16_t net_idx, uint16_t friend_addr, bool retry)
+{
+    int64_t now = k_uptime_get();
+
+    lpn_stats.max_poll_interval = MAX(lpn_stats.max_poll_interval, now - lpn_stats.last_poll);
+    lpn_stats.last_poll = now;
+    lpn_stats.polls++;
+}
+
+BT_MESH_LPN_CB_DEFINE(lpn_cb) = {
+    .established = lpn_established,
+    .terminated = lpn_terminated,
+    .polled = lpn_polled,
+};
+
+/* Scan continuously while the robot is busy, and fall back to LPN mode once
+ * no movement has been received or executed for a while.
+ */
+static void lpn_on_activity(bool command)
+{
+    if (command) {
+        lpn_mode_set(false);
+    }
+    k_work_reschedule(&lpn_idle_work, K_SECONDS(CONFIG_MESH_LPN_IDLE_TIMEOUT));
+}
+
+#else
+
+static void lpn_on_activity(bool command) {}
+
+#endif
+
 /* Setup */
 
+#if defined(CONFIG_MESH_FAST_BOOT)
+
+/* Only the Bluetooth and mesh state, and the self-provisioning progress that
+ * goes with it, is needed to accept commands. Everything else is loaded in the
+ * background from the system workqueue.
+ */
+static void settings_load_rest_work_fn(struct k_work *work)
+{
+    const char *subtree = CONFIG_MESH_FAST_BOOT_DEFERRED_SUBTREE;
+    int err;
+
+    if (subtree[0] == '\0') {
+        return;
+    }
+
+    err = settings_load_subtree(subtree);
+    if (err) {
+        LOG_ERR("Failed to load %s settings: Error %d", subtree, err);
+    }
+}
+K_WORK_DEFINE(settings_load_rest_work, settings_load_rest_work_fn);
+
+static int load_settings(void)
+{
+    int err = settings_load_subtree("bt");
+
+    if (!err && IS_ENABLED(CONFIG_MESH_SELF_PROVISION)) {
+        err = settings_load_subtree(SELF_PROV_SETTINGS_SUBTREE);
+    }
+
+    k_work_submit(&settings_load_rest_work);
+    return err;
+}
+
+#else
+
+static int load_settings(void)
+{
+    return settings_load();
+}
+
+#endif
+
 static int setup_mesh()
 {
     int err;
@@ -61,18 +308,40 @@ static int setup_mesh()
         return err;
     }
     LOG_DBG("Bluetooth initialized");
-    err = bt_mesh_init(bt_mesh_dk_prov_init(), model_handler_init(movement_received_handler, start_movement_handler));
+    boot_profile_mark(BOOT_PHASE_BT_ENABLED);
+
+    const struct bt_mesh_comp *comp = model_handler_init(movement_received_handler, start_movement_handler,
+                                                          trajectory_received_handler,
+                                                          choreography_play_handler,
+                                                          motor_power_handler);
+    err = bt_mesh_init(bt_mesh_dk_prov_init(), comp);
     if (err) {
         LOG_ERR("Failed to initialize mesh: Error %d", err);
         return err;
     }
+    boot_profile_mark(BOOT_PHASE_MESH_INIT);
 
     if (IS_ENABLED(CONFIG_SETTINGS)) {
-        err = settings_load();
+        err = load_settings();
         if (err) {
             LOG_ERR("Failed to load settings: Error %d", err);
         }
     }
+    boot_profile_mark(BOOT_PHASE_SETTINGS);
+
+    if (IS_ENABLED(CONFIG_MESH_SELF_PROVISION)) {
+        err = self_provision(comp);
+        if (err) {
+            LOG_ERR("Self-provisioning failed, waiting for provisioner: Error %d", err);
+        }
+    }
+
+    if (IS_ENABLED(CONFIG_MESH_LINK_BRIDGE)) {
+        err = link_bridge_init();
+        if (err) {
+            LOG_ERR("Failed to bridge the gateway: Error %d", err);
+        }
+    }
 
     err = bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
     if (err == -EALREADY) {
@@ -83,6 +352,7 @@ static int setup_mesh()
         APP_EVENT_SUBMIT(evt);
     }
     LOG_DBG("Mesh initialized");
+    boot_profile_mark(BOOT_PHASE_READY);
     return 0;
 }
 
@@ -93,6 +363,7 @@ struct mesh_msg_data
 {
     union
     {
+        struct mesh_module_event mesh;
         struct motor_module_event motor;
     } event;
 };
@@ -108,6 +379,7 @@ static void module_thread_fn(void)
 
     int err;
 
+    boot_profile_mark(BOOT_PHASE_THREAD_START);
     err = setup_mesh();
 
     if (err) {
@@ -115,9 +387,33 @@ static void module_thread_fn(void)
         return;
     }
 
+    lpn_on_activity(false);
+
     while (true) {
         k_msgq_get(&mesh_module_msg_q, &msg, K_FOREVER);
 
+        if (is_mesh_module_event(&msg.event.mesh.header)) {
+            switch (msg.event.mesh.type) {
+                case MESH_EVT_MOVEMENT_RECEIVED:
+                case MESH_EVT_TRAJECTORY_RECEIVED:
+                case MESH_EVT_CHOREOGRAPHY_RECEIVED:
+                case MESH_EVT_CLEAR_TO_MOVE_RECEIVED: {
+                    lpn_on_activity(true);
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+        } else if (is_motor_module_event(&msg.event.motor.header)) {
+            if (msg.event.motor.type == MOTOR_EVT_POWER_SET_DONE) {
+                model_handler_motor_status_send(msg.event.motor.motor, msg.event.motor.err);
+            } else {
+                lpn_on_activity(false);
+                robot_state_update(&msg.event.motor);
+            }
+        }
+
         switch(module_state) {
             case UNPROVISIONED: {
                 break;
@@ -155,6 +451,12 @@ static bool app_event_handler(const struct app_event_header *header)
     struct mesh_msg_data msg = {0};
     bool enqueue = false;
 
+    if (is_mesh_module_event(header) && IS_ENABLED(CONFIG_BT_MESH_LOW_POWER))
+    {
+        msg.event.mesh = *cast_mesh_module_event(header);
+        enqueue = true;
+    }
+
     if (is_motor_module_event(header))
     {
         LOG_DBG("Motor module event received");
@@ -176,4 +478,5 @@ static bool app_event_handler(const struct app_event_header *header)
 }
 
 APP_EVENT_LISTENER(MODULE, app_event_handler);
-APP_EVENT_SUBSCRIBE(MODULE, motor_module_event);
\ No newline at end of file
+APP_EVENT_SUBSCRIBE(MODULE, motor_module_event);
+APP_EVENT_SUBSCRIBE(MODULE, mesh_module_event);
\ No newline at end of file
@@ -8,6 +8,11 @@
 #include "../events/motor_module_event.h"
 
 #include "../../drivers/motors/motor.h"
+#include "../latency_trace.h"
+#include "../trajectory.h"
+#include "../choreography.h"
+#include "../safety_stop.h"
+#include "../battery.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(MODULE, CONFIG_MOTOR_MODULE_LOG_LEVEL);
@@ -34,12 +39,19 @@ struct motor_msg_data
 K_MSGQ_DEFINE(motor_module_msg_q, sizeof(struct motor_msg_data), 10, 4);
 
 /* Global module data */
-static const int32_t motor_power = 10000000;
+static const int32_t motor_power = 10000000; // At the nominal battery voltage
+static const int32_t motor_power_max = 20000000; // Full duty of the 20 ms PWM period
 
 static const struct device *motor_a = DEVICE_DT_GET(DT_NODELABEL(motor_a));
 static const struct device *motor_b = DEVICE_DT_GET(DT_NODELABEL(motor_b));
 
 struct robot_movement_config next_movement = {0};
+static struct trajectory_segment next_trajectory;
+static bool trajectory_pending; // Next movement follows next_trajectory
+static struct choreography_reader choreography;
+static bool choreography_pending; // next_trajectory is the first segment of choreography
+static bool choreography_playing;
+
 static int set_next_angle(int32_t angle)
 {
     next_movement.angle = angle;
@@ -51,17 +63,130 @@ static int set_next_time(uint32_t time)
     return 0;
 }
 
+static int set_next_choreography(uint16_t id)
+{
+    int err;
+
+    choreography_close(&choreography);
+    err = choreography_open(id, &choreography);
+
+    if (!err && choreography_next(&choreography, &next_trajectory) != 1) {
+        choreography_close(&choreography);
+        err = -ENODATA;
+    }
+
+    if (err) {
+        LOG_WRN("Choreography %u can not be played: Error %d", id, err);
+        return err;
+    }
+
+    trajectory_pending = true;
+    choreography_pending = true;
+    return 0;
+}
+
 /* Motor actuation */
 
-static void stop_motor_work_fn(struct k_work_user *work)
+static void send_motor_event(motor_module_event_type type)
+{
+    struct motor_module_event *evt = new_motor_module_event();
+    evt->type = type;
+    evt->reason = MOTOR_DONE_COMPLETED;
+    APP_EVENT_SUBMIT(evt);
+}
+
+static void send_movement_done(motor_done_reason reason)
+{
+    struct motor_module_event *evt = new_motor_module_event();
+    evt->type = MOTOR_EVT_MOVEMENT_DONE;
+    evt->reason = reason;
+    APP_EVENT_SUBMIT(evt);
+}
+
+static void send_power_set_done(const struct device *motor, int err)
+{
+    struct motor_module_event *evt = new_motor_module_event();
+    evt->type = MOTOR_EVT_POWER_SET_DONE;
+    evt->motor = motor;
+    evt->err = err;
+    APP_EVENT_SUBMIT(evt);
+}
+
+static void stop_motor_work_fn(struct k_work *work)
 {
     drive_continous(motor_a, 0);
     drive_continous(motor_b, 0);
     LOG_DBG("Stopped motors");
     set_module_state(STANDBY);
+    send_movement_done(MOTOR_DONE_COMPLETED);
 }
 K_WORK_DELAYABLE_DEFINE(stop_motor_work, stop_motor_work_fn);
 
+/* Trajectories are evaluated at the control rate from the system workqueue. Wheel
+ * speeds are turned into power in proportion, without feedback, and compensated for the
+ * battery voltage at every step.
+ */
+static int32_t speed_to_power(int32_t speed)
+{
+    int64_t power = (int64_t)speed * motor_power / CONFIG_MOTOR_FULL_SPEED_MM_S;
+
+    return battery_power_compensate(CLAMP(power, -motor_power_max, motor_power_max), motor_power_max);
+}
+
+static void trajectory_work_fn(struct k_work *work);
+K_WORK_DEFINE(trajectory_work, trajectory_work_fn);
+
+static void trajectory_timer_fn(struct k_timer *timer)
+{
+    k_work_submit(&trajectory_work);
+}
+K_TIMER_DEFINE(trajectory_timer, trajectory_timer_fn, NULL);
+
+/* The segments of a choreography follow each other without stopping the wheels */
+static bool next_segment(void)
+{
+    struct trajectory_segment segment;
+
+    return choreography_playing && choreography_next(&choreography, &segment) == 1 &&
+           trajectory_start(&segment) == 0;
+}
+
+static void trajectory_work_fn(struct k_work *work)
+{
+    struct trajectory_setpoint setpoint;
+    bool running = trajectory_step(&setpoint);
+
+    if (!running && next_segment()) {
+        running = trajectory_step(&setpoint);
+    }
+
+    drive_continous(motor_a, speed_to_power(setpoint.left));
+    drive_continous(motor_b, speed_to_power(setpoint.right));
+
+    if (!running) {
+        k_timer_stop(&trajectory_timer);
+        choreography_close(&choreography);
+        LOG_DBG("Trajectory done");
+        set_module_state(STANDBY);
+        send_movement_done(MOTOR_DONE_COMPLETED);
+    }
+}
+
+static int follow_trajectory(void)
+{
+    int err = trajectory_start(&next_trajectory);
+
+    if (err) {
+        return err;
+    }
+
+    choreography_playing = choreography_pending;
+    latency_trace_actuation();
+    k_timer_start(&trajectory_timer, K_NO_WAIT, K_USEC(USEC_PER_SEC / CONFIG_MESH_TRAJECTORY_RATE_HZ));
+    send_motor_event(MOTOR_EVT_MOVEMENT_START);
+    return 0;
+}
+
 static int turn_degrees(int32_t angle)
 {
     // TODO: Implement somewhat accurate turning
@@ -70,10 +195,14 @@ static int turn_degrees(int32_t angle)
 
 static int drive_forward(uint32_t time)
 {
-    drive_continous(motor_a, motor_power);
-    drive_continous(motor_b, motor_power);
+    int32_t power = battery_power_compensate(motor_power, motor_power_max);
+
+    drive_continous(motor_a, power);
+    drive_continous(motor_b, power);
+    latency_trace_actuation();
     LOG_DBG("Started motors");
     k_work_schedule(&stop_motor_work, K_MSEC(time));
+    send_motor_event(MOTOR_EVT_MOVEMENT_START);
     return 0;
 }
 
@@ -86,6 +215,55 @@ static void set_module_state(enum motor_module_state new_state)
     module_state = new_state;
 }
 
+/* The safety stop has already braked the motors, and they refuse power until
+ * released. Runs on the system workqueue like the movement work, so neither can be
+ * halfway through.
+ */
+static void safety_stopped(void)
+{
+    k_timer_stop(&trajectory_timer);
+    k_work_cancel(&trajectory_work);
+    k_work_cancel_delayable(&stop_motor_work);
+    trajectory_stop();
+    choreography_playing = false;
+    choreography_close(&choreography);
+
+    if (module_state == MOVING)
+    {
+        set_module_state(STANDBY);
+        send_movement_done(MOTOR_DONE_SAFETY_STOP);
+    }
+}
+
+/* Power command of a single motor, for tests and calibration. Only taken when no
+ * movement is running, and compensated and held back by the safety stop like one.
+ */
+static void set_motor_power(const struct device *motor, int32_t power)
+{
+    int err;
+
+    if (motor != motor_a && motor != motor_b)
+    {
+        err = -ENODEV;
+    }
+    else if (module_state == MOVING)
+    {
+        err = -EBUSY;
+    }
+    else if (power != 0 && safety_stop_is_active() && safety_stop_release())
+    {
+        LOG_WRN("Obstacle ahead, not powering %s", motor->name);
+        err = -EBUSY;
+    }
+    else
+    {
+        power = CLAMP(power, -motor_power_max, motor_power_max);
+        err = drive_continous(motor, battery_power_compensate(power, motor_power_max));
+    }
+
+    send_power_set_done(motor, err);
+}
+
 static int on_state_standby(struct motor_msg_data *msg)
 {
     if (is_mesh_module_event((struct event_header *)(&msg->event.mesh)))
@@ -97,9 +275,34 @@ static int on_state_standby(struct motor_msg_data *msg)
             set_next_time(msg->event.mesh.data.movement.time);
             set_next_angle(msg->event.mesh.data.movement.angle);
             LOG_DBG("New movement received: Time:%d  Angle:%d", next_movement.time, next_movement.angle);
+            trajectory_pending = false;
+            choreography_pending = false;
+            choreography_close(&choreography);
             set_module_state(READY_TO_MOVE);
             return 0;
         }
+        case MESH_EVT_TRAJECTORY_RECEIVED:
+        {
+            next_trajectory = msg->event.mesh.data.trajectory;
+            trajectory_pending = true;
+            choreography_pending = false;
+            choreography_close(&choreography);
+            set_module_state(READY_TO_MOVE);
+            return 0;
+        }
+        case MESH_EVT_CHOREOGRAPHY_RECEIVED:
+        {
+            if (set_next_choreography(msg->event.mesh.data.choreography) == 0)
+            {
+                set_module_state(READY_TO_MOVE);
+            }
+            return 0;
+        }
+        case MESH_EVT_MOTOR_POWER_RECEIVED:
+        {
+            set_motor_power(msg->event.mesh.data.motor_power.motor, msg->event.mesh.data.motor_power.power);
+            return 0;
+        }
         default:
         {
             return 0;
@@ -120,14 +323,56 @@ static int on_state_ready_to_move(struct motor_msg_data *msg)
             set_next_time(msg->event.mesh.data.movement.time);
             set_next_angle(msg->event.mesh.data.movement.angle);
             LOG_DBG("New movement received: Time:%d  Angle:%d", next_movement.time, next_movement.angle);
+            trajectory_pending = false;
+            choreography_pending = false;
+            choreography_close(&choreography);
+            return 0;
+        }
+        case MESH_EVT_TRAJECTORY_RECEIVED:
+        {
+            next_trajectory = msg->event.mesh.data.trajectory;
+            trajectory_pending = true;
+            choreography_pending = false;
+            choreography_close(&choreography);
+            return 0;
+        }
+        case MESH_EVT_CHOREOGRAPHY_RECEIVED:
+        {
+            // Do not fall back to the previous movement when the start follows
+            if (set_next_choreography(msg->event.mesh.data.choreography))
+            {
+                set_module_state(STANDBY);
+            }
+            return 0;
+        }
+        case MESH_EVT_MOTOR_POWER_RECEIVED:
+        {
+            set_motor_power(msg->event.mesh.data.motor_power.motor, msg->event.mesh.data.motor_power.power);
             return 0;
         }
         case MESH_EVT_CLEAR_TO_MOVE_RECEIVED:
         {
+            if (safety_stop_is_active() && safety_stop_release())
+            {
+                LOG_WRN("Obstacle ahead, not moving");
+                set_module_state(STANDBY);
+                send_movement_done(MOTOR_DONE_SAFETY_STOP);
+                return 0;
+            }
+            // Moving before the motors start, so a safety stop right away ends the movement
+            set_module_state(MOVING);
+            if (trajectory_pending)
+            {
+                LOG_DBG("Starting trajectory");
+                if (follow_trajectory())
+                {
+                    set_module_state(READY_TO_MOVE);
+                }
+                return 0;
+            }
             LOG_DBG("Starting movement");
             turn_degrees(next_movement.angle);
             drive_forward(next_movement.time);
-            set_module_state(MOVING);
             return 0;
         }
         default:
@@ -141,6 +386,10 @@ static int on_state_ready_to_move(struct motor_msg_data *msg)
 
 static int on_state_moving(struct motor_msg_data *msg)
 {
+    if (is_mesh_module_event(&msg->event.mesh) && msg->event.mesh.type == MESH_EVT_MOTOR_POWER_RECEIVED)
+    {
+        set_motor_power(msg->event.mesh.data.motor_power.motor, msg->event.mesh.data.motor_power.power);
+    }
     return 0;
 }
 
@@ -180,6 +429,20 @@ static void module_thread_fn(void)
         return;
     }
 
+    err = safety_stop_init(safety_stopped);
+    if (err)
+    {
+        LOG_ERR("Failed to arm the safety stop: Error %d", err);
+        return;
+    }
+
+    // The motors still run without the battery monitor, only uncompensated
+    err = battery_init();
+    if (err)
+    {
+        LOG_ERR("Failed to start the battery monitor: Error %d", err);
+    }
+
     while (true)
     {
         k_msgq_get(&motor_module_msg_q, &msg, K_FOREVER);
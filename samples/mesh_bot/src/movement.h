@@ -0,0 +1,10 @@
+#pragma once
+
+#include <zephyr/types.h>
+
+/** Movement of the robot, as configured by the movement message. */
+struct robot_movement_config
+{
+    uint32_t time;
+    int32_t angle;
+};
@@ -0,0 +1,405 @@
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
+
+#if defined(CONFIG_MOTOR_SAFETY_STOP_PPI)
+#include <nrfx_gpiote.h>
+#include <hal/nrf_pwm.h>
+#include <helpers/nrfx_gppi.h>
+#endif
+
+#include "safety_stop.h"
+#include "../drivers/motors/motor.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(safety_stop, CONFIG_MOTOR_MODULE_LOG_LEVEL);
+
+#if !DT_HAS_COMPAT_STATUS_OKAY(safety_stop)
+#error "The safety stop needs a safety-stop node in the devicetree"
+#endif
+
+#define SAFETY_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(safety_stop)
+#define DISTANCE_MM CONFIG_MOTOR_SAFETY_STOP_DISTANCE_MM
+
+#define PHANDLE_DEVICE(node_id, prop, idx) DEVICE_DT_GET(DT_PHANDLE_BY_IDX(node_id, prop, idx)),
+
+static const struct device *const sensors[] = {
+    DT_FOREACH_PROP_ELEM(SAFETY_NODE, sensors, PHANDLE_DEVICE)
+};
+
+static const struct device *const motors[] = {
+    DT_FOREACH_PROP_ELEM(SAFETY_NODE, motors, PHANDLE_DEVICE)
+};
+
+BUILD_ASSERT(ARRAY_SIZE(sensors) <= 32, "Too many safety stop sensors");
+
+static safety_stop_handler_t stop_handler;
+
+/* Serializes stops and releases, so a stop is never undone by a release in progress */
+static struct k_spinlock lock;
+static bool active;
+static struct safety_stop_stats stats;
+
+static void notify_work_fn(struct k_work *work)
+{
+    struct safety_stop_stats current;
+
+    safety_stop_stats_get(&current);
+    LOG_WRN("Obstacle closer than %d mm, motors stopped %u ns after detection", DISTANCE_MM,
+            current.last_ns);
+
+    if (stop_handler != NULL) {
+        stop_handler();
+    }
+}
+K_WORK_DEFINE(notify_work, notify_work_fn);
+
+/* Timed from the detection of the obstacle, in cycles, to the motors braked */
+static void stop(uint32_t detected)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    bool was_active = active;
+
+    for (int i = 0; i < ARRAY_SIZE(motors); i++) {
+        emergency_stop(motors[i]);
+    }
+    active = true;
+
+    /* Sensors keep triggering while the obstacle is close, only the first stop counts */
+    if (!was_active) {
+        stats.last_ns = k_cyc_to_ns_floor32(k_cycle_get_32() - detected);
+        stats.max_ns = MAX(stats.max_ns, stats.last_ns);
+        stats.count++;
+    }
+    k_spin_unlock(&lock, key);
+
+    if (!was_active) {
+        k_work_submit(&notify_work);
+    }
+}
+
+void safety_stop_trigger(void)
+{
+    stop(k_cycle_get_32());
+}
+
+bool safety_stop_is_active(void)
+{
+    return active;
+}
+
+void safety_stop_stats_get(struct safety_stop_stats *out)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *out = stats;
+    k_spin_unlock(&lock, key);
+}
+
+/* Distance sensors */
+
+static const struct sensor_trigger threshold_trigger = {
+    .type = SENSOR_TRIG_THRESHOLD,
+    .chan = SENSOR_CHAN_DISTANCE,
+};
+
+/* Sensors without a threshold trigger, one bit each */
+static uint32_t polled;
+/* Polled sensors that saw an obstacle in their last sample */
+static atomic_t polled_seen;
+
+static K_THREAD_STACK_DEFINE(poll_stack, CONFIG_MOTOR_SAFETY_STOP_THREAD_STACK_SIZE);
+static struct k_thread poll_thread;
+
+/* Sensor drivers call trigger handlers from their own thread or workqueue, after the
+ * interrupt of the sensor, and do not tell when it fired. The stop is timed from here,
+ * so the time the driver takes to get to the handler is not in the stats.
+ */
+static void threshold_triggered(const struct device *dev, const struct sensor_trigger *trigger)
+{
+    safety_stop_trigger();
+}
+
+static int sensor_arm(const struct device *dev)
+{
+    struct sensor_value threshold = {
+        .val1 = DISTANCE_MM / 1000,
+        .val2 = (DISTANCE_MM % 1000) * 1000,
+    };
+    int err = sensor_attr_set(dev, SENSOR_CHAN_DISTANCE, SENSOR_ATTR_LOWER_THRESH, &threshold);
+
+    if (err) {
+        return err;
+    }
+    return sensor_trigger_set(dev, &threshold_trigger, threshold_triggered);
+}
+
+/* A sensor that can not be read does not count as clear */
+static bool obstacle_seen(const struct device *dev)
+{
+    struct sensor_value distance;
+
+    if (sensor_sample_fetch(dev) || sensor_channel_get(dev, SENSOR_CHAN_DISTANCE, &distance)) {
+        return true;
+    }
+    return distance.val1 * 1000 + distance.val2 / 1000 < DISTANCE_MM;
+}
+
+/* A fetch blocks for a whole measurement, about 33 ms on the VL53L0X, so sensors are
+ * polled from a thread of their own. Stops are timed from the start of the sample that
+ * saw the obstacle.
+ */
+static void poll_thread_fn(void *p1, void *p2, void *p3)
+{
+    while (true) {
+        int64_t start = k_uptime_get();
+
+        for (int i = 0; i < ARRAY_SIZE(sensors); i++) {
+            if (!(polled & BIT(i))) {
+                continue;
+            }
+
+            uint32_t sampled = k_cycle_get_32();
+
+            if (obstacle_seen(sensors[i])) {
+                atomic_set_bit(&polled_seen, i);
+                stop(sampled);
+            } else {
+                atomic_clear_bit(&polled_seen, i);
+            }
+        }
+
+        int64_t wait = CONFIG_MOTOR_SAFETY_STOP_POLL_MS - (k_uptime_get() - start);
+
+        if (wait > 0) {
+            k_msleep(wait);
+        }
+    }
+}
+
+/* Stop pins */
+
+#if DT_NODE_HAS_PROP(SAFETY_NODE, stop_gpios)
+
+#define STOP_PIN(node_id, prop, idx) GPIO_DT_SPEC_GET_BY_IDX(node_id, prop, idx),
+
+static const struct gpio_dt_spec stop_pins[] = {
+    DT_FOREACH_PROP_ELEM(SAFETY_NODE, stop_gpios, STOP_PIN)
+};
+
+#if defined(CONFIG_MOTOR_SAFETY_STOP_PPI)
+
+/* Each pin raises a GPIOTE event, which PPI forwards to the STOP task of the PWM
+ * instances driving the motors. The event also raises an interrupt, which brakes the
+ * motors and latches the stop like a sensor trigger.
+ */
+#define STOP_PIN_ABS(node_id, prop, idx)                                              \
+    NRF_GPIO_PIN_MAP(DT_PROP(DT_GPIO_CTLR_BY_IDX(node_id, prop, idx), port),          \
+                     DT_GPIO_PIN_BY_IDX(node_id, prop, idx)),
+#define MOTOR_PWM(node_id, prop, idx)                                                 \
+    (NRF_PWM_Type *)DT_REG_ADDR(DT_PWMS_CTLR(DT_PHANDLE_BY_IDX(node_id, prop, idx))),
+
+static const uint32_t stop_pins_abs[] = {
+    DT_FOREACH_PROP_ELEM(SAFETY_NODE, stop_gpios, STOP_PIN_ABS)
+};
+
+static NRF_PWM_Type *const motor_pwms[] = {
+    DT_FOREACH_PROP_ELEM(SAFETY_NODE, motors, MOTOR_PWM)
+};
+
+static void stop_pin_handler(nrfx_gpiote_pin_t pin, nrfx_gpiote_trigger_t trigger, void *context)
+{
+    safety_stop_trigger();
+}
+
+static int stop_pin_arm(int i)
+{
+    const struct gpio_dt_spec *spec = &stop_pins[i];
+    NRF_PWM_Type *pwms[2];
+    size_t pwm_count = 0;
+    uint8_t gpiote_ch;
+    uint8_t ppi_ch;
+
+    /* A PPI channel triggers one task and forks to one more */
+    for (int m = 0; m < ARRAY_SIZE(motor_pwms); m++) {
+        bool listed = false;
+
+        for (int p = 0; p < pwm_count; p++) {
+            listed |= pwms[p] == motor_pwms[m];
+        }
+        if (listed) {
+            continue;
+        }
+        if (pwm_count == ARRAY_SIZE(pwms)) {
+            LOG_WRN("Only two PWM instances are stopped in hardware");
+            break;
+        }
+        pwms[pwm_count++] = motor_pwms[m];
+    }
+
+    if (!nrfx_gpiote_is_init() && nrfx_gpiote_init(0) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+
+    if (nrfx_gpiote_channel_alloc(&gpiote_ch) != NRFX_SUCCESS ||
+        nrfx_gppi_channel_alloc(&ppi_ch) != NRFX_SUCCESS) {
+        LOG_ERR("No GPIOTE or PPI channel left for stop pin %d", i);
+        return -ENOMEM;
+    }
+
+    /* The pin keeps the configuration from the devicetree flags */
+    nrfx_gpiote_trigger_config_t trigger = {
+        .trigger = spec->dt_flags & GPIO_ACTIVE_LOW ? NRFX_GPIOTE_TRIGGER_HITOLO : NRFX_GPIOTE_TRIGGER_LOTOHI,
+        .p_in_channel = &gpiote_ch,
+    };
+    nrfx_gpiote_handler_config_t handler = {
+        .handler = stop_pin_handler,
+    };
+
+    if (nrfx_gpiote_input_configure(stop_pins_abs[i], NULL, &trigger, &handler) != NRFX_SUCCESS) {
+        return -EIO;
+    }
+
+    nrfx_gppi_channel_endpoints_setup(ppi_ch, nrfx_gpiote_in_event_addr_get(stop_pins_abs[i]),
+                                      nrf_pwm_task_address_get(pwms[0], NRF_PWM_TASK_STOP));
+    if (pwm_count > 1) {
+        nrfx_gppi_fork_endpoint_setup(ppi_ch, nrf_pwm_task_address_get(pwms[1], NRF_PWM_TASK_STOP));
+    }
+    nrfx_gppi_channels_enable(BIT(ppi_ch));
+    nrfx_gpiote_trigger_enable(stop_pins_abs[i], true);
+    return 0;
+}
+
+#else
+
+static struct gpio_callback stop_pin_cbs[ARRAY_SIZE(stop_pins)];
+
+static void stop_pin_isr(const struct device *port, struct gpio_callback *cb, gpio_port_pins_t pins)
+{
+    safety_stop_trigger();
+}
+
+static int stop_pin_arm(int i)
+{
+    const struct gpio_dt_spec *spec = &stop_pins[i];
+    int err;
+
+    gpio_init_callback(&stop_pin_cbs[i], stop_pin_isr, BIT(spec->pin));
+    err = gpio_add_callback(spec->port, &stop_pin_cbs[i]);
+    if (err) {
+        return err;
+    }
+    return gpio_pin_interrupt_configure_dt(spec, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+#endif /* defined(CONFIG_MOTOR_SAFETY_STOP_PPI) */
+
+static int stop_pins_arm(void)
+{
+    int err;
+
+    for (int i = 0; i < ARRAY_SIZE(stop_pins); i++) {
+        if (!device_is_ready(stop_pins[i].port)) {
+            return -ENODEV;
+        }
+
+        err = gpio_pin_configure_dt(&stop_pins[i], GPIO_INPUT);
+        if (!err) {
+            err = stop_pin_arm(i);
+        }
+        if (err) {
+            LOG_ERR("Failed to arm stop pin %d: Error %d", i, err);
+            return err;
+        }
+    }
+    return 0;
+}
+
+static bool stop_pin_active(void)
+{
+    for (int i = 0; i < ARRAY_SIZE(stop_pins); i++) {
+        if (gpio_pin_get_dt(&stop_pins[i]) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#else
+
+static int stop_pins_arm(void)
+{
+    return 0;
+}
+
+static bool stop_pin_active(void)
+{
+    return false;
+}
+
+#endif /* DT_NODE_HAS_PROP(SAFETY_NODE, stop_gpios) */
+
+/* Public interface */
+
+int safety_stop_init(safety_stop_handler_t handler)
+{
+    int err;
+
+    stop_handler = handler;
+
+    for (int i = 0; i < ARRAY_SIZE(sensors); i++) {
+        if (!device_is_ready(sensors[i])) {
+            LOG_ERR("Sensor %s is not ready", sensors[i]->name);
+            return -ENODEV;
+        }
+
+        err = sensor_arm(sensors[i]);
+        if (err) {
+            LOG_INF("Sensor %s has no distance threshold trigger, polling it", sensors[i]->name);
+            polled |= BIT(i);
+        }
+    }
+
+    err = stop_pins_arm();
+    if (err) {
+        return err;
+    }
+
+    if (polled) {
+        /* Not clear until sampled */
+        atomic_set(&polled_seen, polled);
+        k_thread_create(&poll_thread, poll_stack, K_THREAD_STACK_SIZEOF(poll_stack), poll_thread_fn,
+                        NULL, NULL, NULL, CONFIG_MOTOR_SAFETY_STOP_THREAD_PRIORITY, 0, K_NO_WAIT);
+        k_thread_name_set(&poll_thread, "safety_stop");
+    }
+
+    LOG_INF("Safety stop armed at %d mm", DISTANCE_MM);
+    return 0;
+}
+
+int safety_stop_release(void)
+{
+    k_spinlock_key_t key;
+
+    if (stop_pin_active()) {
+        return -EBUSY;
+    }
+
+    /* Polled sensors are not fetched from two threads, their last sample is used */
+    for (int i = 0; i < ARRAY_SIZE(sensors); i++) {
+        if ((polled & BIT(i)) ? atomic_test_bit(&polled_seen, i) : obstacle_seen(sensors[i])) {
+            return -EBUSY;
+        }
+    }
+
+    key = k_spin_lock(&lock);
+    for (int i = 0; i < ARRAY_SIZE(motors); i++) {
+        emergency_release(motors[i]);
+    }
+    active = false;
+    k_spin_unlock(&lock, key);
+
+    LOG_INF("Safety stop released");
+    return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+struct safety_stop_stats
+{
+    uint32_t count;   // Stops since boot.
+    uint32_t last_ns; // Detection to motors stopped, last stop. Polled sensors detect at
+                      // the start of the sample, triggered sensors when the driver thread
+                      // calls the trigger handler, stop pins at the pin interrupt.
+    uint32_t max_ns;  // Detection to motors stopped, slowest stop.
+};
+
+/** Called from the system workqueue after the motors have been stopped. */
+typedef void (*safety_stop_handler_t)(void);
+
+#if defined(CONFIG_MOTOR_SAFETY_STOP)
+
+/**
+ * @brief Arm the safety stop on the sensors and stop pins of the safety-stop node.
+ *
+ * @param handler Called after each stop.
+ * @return 0 on success, or a negative errno code.
+ */
+int safety_stop_init(safety_stop_handler_t handler);
+
+/**
+ * @brief Stop all motors at once.
+ *
+ * Safe to call from interrupts. The motors refuse power until the stop is released.
+ */
+void safety_stop_trigger(void);
+
+/** @brief Check if the motors are stopped. */
+bool safety_stop_is_active(void);
+
+/**
+ * @brief Release the motors if no obstacle is close anymore.
+ *
+ * @return 0 on success, -EBUSY if a sensor still sees an obstacle.
+ */
+int safety_stop_release(void);
+
+/** @brief Get the stop latency statistics. */
+void safety_stop_stats_get(struct safety_stop_stats *stats);
+
+#else
+
+static inline int safety_stop_init(safety_stop_handler_t handler)
+{
+    return 0;
+}
+
+static inline bool safety_stop_is_active(void)
+{
+    return false;
+}
+
+static inline int safety_stop_release(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,264 @@
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/settings/settings.h>
+
+#include "model_handler.h"
+#include "self_provision.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(self_provision, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+#define NET_IDX 0
+#define APP_IDX 0
+#define KEY_LEN 16
+#define UNICAST_ADDR_MAX 0x7fff
+
+/* Progress of the self-provisioning. A node that was provisioned but not fully configured
+ * finishes the configuration on the next boot. Fast boot loads the subtree with the mesh
+ * state.
+ */
+enum prov_state
+{
+    PROV_NONE,        // Not self-provisioned, or provisioned by an external provisioner.
+    PROV_PROVISIONED, // Self-provisioned, configuration not finished.
+    PROV_CONFIGURED,  // Self-provisioned and configured.
+};
+
+static uint8_t prov_state = PROV_NONE;
+
+#if defined(CONFIG_SETTINGS)
+
+static int prov_state_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    const char *next;
+    ssize_t ret;
+
+    if (!settings_name_steq(name, "state", &next) || next) {
+        return -ENOENT;
+    }
+
+    if (len != sizeof(prov_state)) {
+        return -EINVAL;
+    }
+
+    ret = read_cb(cb_arg, &prov_state, sizeof(prov_state));
+    return ret < 0 ? ret : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(self_prov, SELF_PROV_SETTINGS_SUBTREE, NULL, prov_state_set, NULL, NULL);
+
+#endif
+
+static void prov_state_store(enum prov_state state)
+{
+    prov_state = state;
+
+    if (IS_ENABLED(CONFIG_SETTINGS)) {
+        int err = settings_save_one(SELF_PROV_SETTINGS_SUBTREE "/state", &prov_state, sizeof(prov_state));
+
+        if (err) {
+            LOG_ERR("Failed to store self-provisioning state: Error %d", err);
+        }
+    }
+}
+
+static int parse_key(const char *hex, uint8_t key[KEY_LEN])
+{
+    if (strlen(hex) != 2 * KEY_LEN || hex2bin(hex, 2 * KEY_LEN, key, KEY_LEN) != KEY_LEN) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/* Derive the unicast address and device key from the hardware device ID. The
+ * device key is not secret, which is acceptable for test fleets only.
+ */
+static int derive_identity(const struct bt_mesh_comp *comp, uint16_t *addr, uint8_t dev_key[KEY_LEN])
+{
+    uint8_t id[KEY_LEN] = {0};
+    ssize_t len = hwinfo_get_device_id(id, sizeof(id));
+
+    if (len <= 0) {
+        LOG_ERR("Failed to read device ID: Error %d", (int)len);
+        return len < 0 ? len : -EIO;
+    }
+
+    for (int i = 0; i < KEY_LEN; i++) {
+        dev_key[i] = id[i % len];
+    }
+
+    /* Each element takes one address, leave room for all of them */
+    uint32_t slots = (UNICAST_ADDR_MAX + 1 - CONFIG_MESH_SELF_PROV_ADDR_BASE) / comp->elem_count;
+
+    if (CONFIG_MESH_SELF_PROV_ADDR_RANGE > slots) {
+        LOG_ERR("%d address slots of %d elements do not fit below 0x%04x",
+                CONFIG_MESH_SELF_PROV_ADDR_RANGE, comp->elem_count, UNICAST_ADDR_MAX);
+        return -EINVAL;
+    }
+
+    if (CONFIG_MESH_SELF_PROV_ADDR_RANGE) {
+        slots = CONFIG_MESH_SELF_PROV_ADDR_RANGE;
+    }
+
+    /* Addresses are not coordinated, so robots can collide. The widest range keeps that
+     * unlikely, and the gateway bridge reports collisions from the robot status.
+     */
+    uint32_t slot = crc32_ieee(id, len) % slots;
+
+    *addr = CONFIG_MESH_SELF_PROV_ADDR_BASE + slot * comp->elem_count;
+    LOG_INF("Address slot %u of %u", slot, slots);
+    return 0;
+}
+
+static bool is_cfg_model(const struct bt_mesh_model *model)
+{
+    return model->id == BT_MESH_MODEL_ID_CFG_SRV || model->id == BT_MESH_MODEL_ID_CFG_CLI;
+}
+
+static int configure(const struct bt_mesh_comp *comp, uint16_t addr, const uint8_t app_key[KEY_LEN])
+{
+    uint8_t status;
+    int err;
+
+    err = bt_mesh_cfg_app_key_add(NET_IDX, addr, NET_IDX, APP_IDX, app_key, &status);
+    if (err || status) {
+        LOG_ERR("Failed to add app key: Error %d, status %d", err, status);
+        return err ? err : -EIO;
+    }
+
+    for (int i = 0; i < comp->elem_count; i++) {
+        const struct bt_mesh_elem *elem = &comp->elem[i];
+        uint16_t elem_addr = addr + i;
+
+        for (int j = 0; j < elem->model_count; j++) {
+            const struct bt_mesh_model *model = &elem->models[j];
+
+            if (is_cfg_model(model)) {
+                continue;
+            }
+
+            err = bt_mesh_cfg_mod_app_bind(NET_IDX, addr, elem_addr, APP_IDX, model->id, &status);
+            if (err || status) {
+                LOG_ERR("Failed to bind model 0x%04x: Error %d, status %d", model->id, err, status);
+                return err ? err : -EIO;
+            }
+        }
+
+        for (int j = 0; j < elem->vnd_model_count; j++) {
+            const struct bt_mesh_model *model = &elem->vnd_models[j];
+
+            err = bt_mesh_cfg_mod_app_bind_vnd(NET_IDX, addr, elem_addr, APP_IDX,
+                                               model->vnd.id, model->vnd.company, &status);
+            if (err || status) {
+                LOG_ERR("Failed to bind vendor model 0x%04x: Error %d, status %d", model->vnd.id, err, status);
+                return err ? err : -EIO;
+            }
+
+            if (i != 0) {
+                continue;
+            }
+
+            err = bt_mesh_cfg_mod_sub_add_vnd(NET_IDX, addr, elem_addr, CONFIG_MESH_SELF_PROV_GROUP_ADDR,
+                                              model->vnd.id, model->vnd.company, &status);
+            if (err || status) {
+                LOG_ERR("Failed to subscribe vendor model 0x%04x: Error %d, status %d", model->vnd.id, err, status);
+                return err ? err : -EIO;
+            }
+        }
+    }
+
+    if (IS_ENABLED(CONFIG_MESH_TIME_SYNC_ROOT)) {
+        struct bt_mesh_cfg_mod_pub pub = {
+            .addr = CONFIG_MESH_SELF_PROV_GROUP_ADDR,
+            .app_idx = APP_IDX,
+            .ttl = BT_MESH_TTL_DEFAULT,
+            .period = BT_MESH_PUB_PERIOD_SEC(CONFIG_MESH_SELF_PROV_TIME_BEACON_PERIOD),
+        };
+
+        err = bt_mesh_cfg_mod_pub_set_vnd(NET_IDX, addr, addr, TIME_SYNC_MODEL_ID, CONFIG_BT_COMPANY_ID,
+                                          &pub, &status);
+        if (err || status) {
+            LOG_ERR("Failed to set time beacon publication: Error %d, status %d", err, status);
+            return err ? err : -EIO;
+        }
+    }
+
+#if defined(CONFIG_MESH_ROBOT_STATUS)
+    /* The robot status also lets the gateway tell which robots are in range */
+    struct bt_mesh_cfg_mod_pub status_pub = {
+        .addr = CONFIG_MESH_SELF_PROV_STATUS_ADDR,
+        .app_idx = APP_IDX,
+        .ttl = BT_MESH_TTL_DEFAULT,
+        .period = BT_MESH_PUB_PERIOD_SEC(CONFIG_MESH_SELF_PROV_ROBOT_STATUS_PERIOD),
+    };
+
+    err = bt_mesh_cfg_mod_pub_set_vnd(NET_IDX, addr, addr, ROBOT_STATUS_MODEL_ID, CONFIG_BT_COMPANY_ID,
+                                      &status_pub, &status);
+    if (err || status) {
+        LOG_ERR("Failed to set robot status publication: Error %d, status %d", err, status);
+        return err ? err : -EIO;
+    }
+
+    /* The bridge forwards the status of all robots to the gateway */
+    if (IS_ENABLED(CONFIG_MESH_LINK_BRIDGE)) {
+        err = bt_mesh_cfg_mod_sub_add_vnd(NET_IDX, addr, addr, CONFIG_MESH_SELF_PROV_STATUS_ADDR,
+                                          ROBOT_STATUS_MODEL_ID, CONFIG_BT_COMPANY_ID, &status);
+        if (err || status) {
+            LOG_ERR("Failed to subscribe robot status: Error %d, status %d", err, status);
+            return err ? err : -EIO;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+int self_provision(const struct bt_mesh_comp *comp)
+{
+    uint8_t net_key[KEY_LEN];
+    uint8_t app_key[KEY_LEN];
+    uint8_t dev_key[KEY_LEN];
+    uint16_t addr;
+    int err;
+
+    if (parse_key(CONFIG_MESH_SELF_PROV_NET_KEY, net_key) ||
+        parse_key(CONFIG_MESH_SELF_PROV_APP_KEY, app_key)) {
+        LOG_ERR("Invalid fleet key configuration");
+        return -EINVAL;
+    }
+
+    if (bt_mesh_is_provisioned()) {
+        if (prov_state != PROV_PROVISIONED) {
+            return 0;
+        }
+
+        addr = comp->elem[0].addr;
+        LOG_INF("Finishing configuration of address 0x%04x", addr);
+    } else {
+        err = derive_identity(comp, &addr, dev_key);
+        if (err) {
+            return err;
+        }
+
+        err = bt_mesh_provision(net_key, NET_IDX, 0, CONFIG_MESH_SELF_PROV_IV_INDEX, addr, dev_key);
+        if (err) {
+            LOG_ERR("Failed to self-provision: Error %d", err);
+            return err;
+        }
+
+        LOG_INF("Self-provisioned with address 0x%04x", addr);
+        prov_state_store(PROV_PROVISIONED);
+    }
+
+    err = configure(comp, addr, app_key);
+    if (err) {
+        return err;
+    }
+
+    prov_state_store(PROV_CONFIGURED);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <zephyr/bluetooth/mesh.h>
+
+/** Settings subtree of the self-provisioning progress */
+#define SELF_PROV_SETTINGS_SUBTREE "self_prov"
+
+/**
+ * @brief Provision and configure the node with the fleet keys.
+ *
+ * The unicast address is derived from the hardware device ID. After provisioning, the
+ * application key is added, bound to all application models and the vendor models of the
+ * primary element are subscribed to the fleet group, using the local configuration client.
+ *
+ * Call after the settings are loaded. A node self-provisioned on an earlier boot whose
+ * configuration did not finish is configured again. Nodes already configured, or
+ * provisioned by an external provisioner, are left as they are.
+ *
+ * @param comp Node composition, as passed to bt_mesh_init().
+ * @return 0 on success, negative errno code otherwise.
+ */
+int self_provision(const struct bt_mesh_comp *comp);
@@ -0,0 +1,183 @@
+#include <zephyr/kernel.h>
+#include <string.h>
+
+#include "thread_monitor.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(thread_monitor, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+#define FAULT_STACK BIT(0)
+#define FAULT_CPU BIT(1)
+
+struct thread_entry
+{
+    k_tid_t thread;
+    uint64_t cycles;
+    bool seen;
+    struct thread_monitor_sample sample;
+};
+
+/* Threads in the order they were first seen, so the table stays stable between samples. */
+static struct thread_entry threads[CONFIG_MESH_THREAD_MONITOR_MAX_THREADS];
+static uint32_t last_sample;
+static uint8_t faults;
+static uint8_t faults_latched;
+static thread_monitor_faults_cb_t faults_cb;
+static K_MUTEX_DEFINE(lock);
+
+static void sample_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_fn);
+
+static struct thread_entry *entry_get(k_tid_t thread)
+{
+    struct thread_entry *free = NULL;
+
+    for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+        if (threads[i].thread == thread) {
+            return &threads[i];
+        }
+        if (!free && !threads[i].thread) {
+            free = &threads[i];
+        }
+    }
+
+    if (free) {
+        free->thread = thread;
+        free->cycles = 0;
+    }
+    return free;
+}
+
+static void thread_sample(const struct k_thread *cthread, void *user_data)
+{
+    k_tid_t thread = (k_tid_t)cthread;
+    uint32_t interval = *(uint32_t *)user_data;
+    struct thread_entry *entry = entry_get(thread);
+    k_thread_runtime_stats_t rt;
+    const char *name = k_thread_name_get(thread);
+    size_t unused = 0;
+    size_t size = thread->stack_info.size;
+
+    if (!entry) {
+        return;
+    }
+
+    (void)k_thread_runtime_stats_get(thread, &rt);
+    (void)k_thread_stack_space_get(thread, &unused);
+
+    /* A thread new to the table only counts from this sample onwards. */
+    uint64_t cycles = entry->cycles ? rt.execution_cycles - entry->cycles : 0;
+
+    entry->cycles = rt.execution_cycles;
+    entry->seen = true;
+    entry->sample.cpu_pct = interval ? MIN(cycles * 100 / interval, 100) : 0;
+    entry->sample.stack_pct = size ? (size - unused) * 100 / size : 0;
+    entry->sample.stack_unused = MIN(unused, UINT16_MAX);
+    strncpy(entry->sample.name, name ? name : "", sizeof(entry->sample.name));
+}
+
+void thread_monitor_sample(void)
+{
+    uint32_t now = k_cycle_get_32();
+    uint32_t interval = now - last_sample;
+    uint8_t new_faults = 0;
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+        threads[i].seen = false;
+    }
+
+    /* Stack scans are slow, so do not hold the scheduler lock while they run. */
+    k_thread_foreach_unlocked(thread_sample, &interval);
+    last_sample = now;
+
+    for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+        struct thread_entry *entry = &threads[i];
+
+        if (!entry->thread) {
+            continue;
+        }
+        if (!entry->seen) {
+            /* Thread has exited. */
+            memset(entry, 0, sizeof(*entry));
+            continue;
+        }
+
+        if (entry->sample.stack_pct >= CONFIG_MESH_THREAD_MONITOR_STACK_THRESHOLD) {
+            new_faults |= FAULT_STACK;
+            LOG_WRN("%.*s: %u%% of stack used", THREAD_MONITOR_NAME_LEN, entry->sample.name,
+                    entry->sample.stack_pct);
+        }
+        if (entry->sample.cpu_pct >= CONFIG_MESH_THREAD_MONITOR_CPU_THRESHOLD) {
+            new_faults |= FAULT_CPU;
+            LOG_WRN("%.*s: %u%% CPU", THREAD_MONITOR_NAME_LEN, entry->sample.name,
+                    entry->sample.cpu_pct);
+        }
+
+        LOG_DBG("%.*s: cpu %u%%, stack %u%%, %u bytes unused", THREAD_MONITOR_NAME_LEN,
+                entry->sample.name, entry->sample.cpu_pct, entry->sample.stack_pct,
+                entry->sample.stack_unused);
+    }
+
+    bool changed = new_faults != faults;
+
+    faults = new_faults;
+    faults_latched |= new_faults;
+
+    k_mutex_unlock(&lock);
+
+    if (changed && faults_cb) {
+        faults_cb();
+    }
+}
+
+static void sample_work_fn(struct k_work *work)
+{
+    thread_monitor_sample();
+    k_work_schedule(&sample_work, K_SECONDS(CONFIG_MESH_THREAD_MONITOR_INTERVAL));
+}
+
+void thread_monitor_init(thread_monitor_faults_cb_t faults_changed)
+{
+    faults_cb = faults_changed;
+    last_sample = k_cycle_get_32();
+    k_work_schedule(&sample_work, K_SECONDS(CONFIG_MESH_THREAD_MONITOR_INTERVAL));
+}
+
+size_t thread_monitor_samples_get(struct thread_monitor_sample *samples, size_t max)
+{
+    size_t count = 0;
+
+    k_mutex_lock(&lock, K_FOREVER);
+    for (int i = 0; i < ARRAY_SIZE(threads) && count < max; i++) {
+        if (threads[i].thread) {
+            samples[count++] = threads[i].sample;
+        }
+    }
+    k_mutex_unlock(&lock);
+
+    return count;
+}
+
+uint8_t thread_monitor_faults_get(uint8_t *codes, uint8_t max, bool latched)
+{
+    uint8_t active = latched ? faults_latched : faults;
+    uint8_t count = 0;
+
+    if ((active & FAULT_STACK) && count < max) {
+        codes[count++] = THREAD_MONITOR_FAULT_STACK;
+    }
+    if ((active & FAULT_CPU) && count < max) {
+        codes[count++] = THREAD_MONITOR_FAULT_CPU;
+    }
+    return count;
+}
+
+void thread_monitor_faults_clear(void)
+{
+    k_mutex_lock(&lock, K_FOREVER);
+    faults_latched = faults;
+    k_mutex_unlock(&lock);
+}
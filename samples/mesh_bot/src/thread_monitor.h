@@ -0,0 +1,64 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/** Length of the thread name prefix kept per thread. */
+#define THREAD_MONITOR_NAME_LEN 8
+
+/** Vendor specific health fault codes. */
+#define THREAD_MONITOR_FAULT_STACK 0x80 // A thread uses more stack than the threshold.
+#define THREAD_MONITOR_FAULT_CPU 0x81   // A thread uses more CPU time than the threshold.
+
+/** Usage of one thread over the last sample interval. */
+struct thread_monitor_sample
+{
+    char name[THREAD_MONITOR_NAME_LEN]; // Not terminated if the name fills it.
+    uint8_t cpu_pct;                    // Share of the interval the thread was running.
+    uint8_t stack_pct;                  // Highest stack usage since the thread started.
+    uint16_t stack_unused;              // Stack bytes never used since the thread started.
+};
+
+/**
+ * @brief Called when the set of active faults changes.
+ */
+typedef void (*thread_monitor_faults_cb_t)(void);
+
+/**
+ * @brief Start sampling thread CPU and stack usage.
+ *
+ * @param faults_changed Called from the system workqueue when a threshold is crossed
+ *                       in either direction.
+ */
+void thread_monitor_init(thread_monitor_faults_cb_t faults_changed);
+
+/**
+ * @brief Take a sample now, rather than waiting for the interval to pass.
+ *
+ * The CPU usage covers the time since the previous sample.
+ */
+void thread_monitor_sample(void);
+
+/**
+ * @brief Get the last samples.
+ *
+ * @param samples Array the samples are copied to.
+ * @param max Length of the array.
+ * @return Number of samples copied. Threads beyond @p max are left out.
+ */
+size_t thread_monitor_samples_get(struct thread_monitor_sample *samples, size_t max);
+
+/**
+ * @brief Get the faults of the last sample.
+ *
+ * @param faults Array the fault codes are copied to.
+ * @param max Length of the array.
+ * @param latched Also report faults that have cleared since the last call to
+ *                @ref thread_monitor_faults_clear.
+ * @return Number of fault codes copied.
+ */
+uint8_t thread_monitor_faults_get(uint8_t *faults, uint8_t max, bool latched);
+
+/**
+ * @brief Clear the latched faults.
+ */
+void thread_monitor_faults_clear(void);
@@ -0,0 +1,117 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include "time_sync.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(time_sync, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+#define PPB 1000000000LL
+
+/* Network clock state. The network time is extrapolated from the last
+ * reference point using the estimated skew between the local clock and the
+ * clock of the time root.
+ */
+static struct
+{
+    bool synced;
+    uint64_t local_ref; // Local uptime at the reference point, in us.
+    uint64_t net_ref;   // Network time at the reference point, in us.
+    int32_t skew_ppb;   // Estimated rate of the network clock relative to the local clock.
+} net_clock;
+
+static struct k_spinlock lock;
+
+static uint64_t local_now(void)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static uint64_t extrapolate(uint64_t local)
+{
+    int64_t elapsed = local - net_clock.local_ref;
+
+    return net_clock.net_ref + elapsed + (elapsed * net_clock.skew_ppb) / PPB;
+}
+
+void time_sync_beacon_received(uint64_t net_time, uint8_t hops)
+{
+    if (IS_ENABLED(CONFIG_MESH_TIME_SYNC_ROOT)) {
+        return;
+    }
+
+    uint64_t local = local_now();
+    /* Compensate for the time the beacon spent in the advertiser and relays. */
+    uint64_t estimate = net_time + CONFIG_MESH_TIME_SYNC_TX_DELAY_US +
+                        (uint64_t)hops * CONFIG_MESH_TIME_SYNC_HOP_DELAY_US;
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (!net_clock.synced) {
+        net_clock.local_ref = local;
+        net_clock.net_ref = estimate;
+        net_clock.synced = true;
+        k_spin_unlock(&lock, key);
+        LOG_INF("Network clock synchronized");
+        return;
+    }
+
+    int64_t local_elapsed = local - net_clock.local_ref;
+    int64_t error = estimate - extrapolate(local);
+
+    if (error > CONFIG_MESH_TIME_SYNC_RESYNC_THRESHOLD_US ||
+        error < -CONFIG_MESH_TIME_SYNC_RESYNC_THRESHOLD_US) {
+        /* The time root has restarted or changed. Start over. */
+        net_clock.local_ref = local;
+        net_clock.net_ref = estimate;
+        net_clock.skew_ppb = 0;
+        k_spin_unlock(&lock, key);
+        LOG_WRN("Network clock off by %lld us, resynchronizing", error);
+        return;
+    }
+
+    if (local_elapsed > 0) {
+        /* The remaining error over the interval is the skew we did not
+         * account for. Low-pass filter it to suppress advertising jitter.
+         */
+        int64_t sample = net_clock.skew_ppb + (error * PPB) / local_elapsed;
+        int64_t skew = net_clock.skew_ppb + (sample - net_clock.skew_ppb) / 4;
+
+        net_clock.skew_ppb = CLAMP(skew, -CONFIG_MESH_TIME_SYNC_MAX_SKEW_PPM * 1000LL,
+                                   CONFIG_MESH_TIME_SYNC_MAX_SKEW_PPM * 1000LL);
+    }
+
+    net_clock.net_ref = extrapolate(local) + error / 2;
+    net_clock.local_ref = local;
+
+    int32_t skew_ppb = net_clock.skew_ppb;
+
+    k_spin_unlock(&lock, key);
+
+    LOG_DBG("Beacon: hops %d, error %lld us, skew %d ppb", hops, error, skew_ppb);
+}
+
+bool time_sync_is_synced(void)
+{
+    return IS_ENABLED(CONFIG_MESH_TIME_SYNC_ROOT) || net_clock.synced;
+}
+
+uint64_t time_sync_now(void)
+{
+    uint64_t local = local_now();
+
+    if (IS_ENABLED(CONFIG_MESH_TIME_SYNC_ROOT)) {
+        return local;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint64_t now = net_clock.synced ? extrapolate(local) : local;
+
+    k_spin_unlock(&lock, key);
+    return now;
+}
+
+int64_t time_sync_until(uint64_t net_time)
+{
+    return (int64_t)(net_time - time_sync_now());
+}
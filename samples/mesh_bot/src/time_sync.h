@@ -0,0 +1,33 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Feed a received time beacon into the network clock.
+ *
+ * @param net_time Network time carried by the beacon, in microseconds.
+ * @param hops Number of relay hops the beacon travelled before reaching this node.
+ */
+void time_sync_beacon_received(uint64_t net_time, uint8_t hops);
+
+/**
+ * @brief Check whether the network clock has been synchronized.
+ *
+ * @return true if at least one beacon has been received, or if this node is the time root.
+ */
+bool time_sync_is_synced(void);
+
+/**
+ * @brief Get the current network time.
+ *
+ * @return Network time in microseconds. Equal to the local uptime until the first beacon is received.
+ */
+uint64_t time_sync_now(void);
+
+/**
+ * @brief Get the time left until a network time instant.
+ *
+ * @param net_time Network time instant, in microseconds.
+ * @return Microseconds until @p net_time is reached. Negative if the instant has passed.
+ */
+int64_t time_sync_until(uint64_t net_time);
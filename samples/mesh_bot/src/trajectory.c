@@ -0,0 +1,349 @@
+#include <zephyr/kernel.h>
+#include <zephyr/net/buf.h>
+
+#include "trajectory.h"
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(trajectory, CONFIG_MESH_MODULE_LOG_LEVEL);
+
+#define RATE CONFIG_MESH_TRAJECTORY_RATE_HZ
+#define HALF_BASE (CONFIG_MESH_TRAJECTORY_WHEEL_BASE_MM / 2)
+
+/* Velocity profiles run in Q16 millimeters, and millimeters per period. */
+#define Q 16
+#define ONE (1 << Q)
+/* pi / 180 in Q16 */
+#define DEG_TO_RAD 1144
+/* Spline derivatives are kept in Q8 millimeters, so their squares fit 64 bits. */
+#define QS 8
+
+static struct
+{
+    struct trajectory_segment segment;
+    bool running;
+
+    /* Trapezoidal profile along the path */
+    int64_t length;
+    int64_t pos;
+    int32_t speed;
+    int32_t max_speed;
+    int32_t accel;
+    /* Wheel speed over path speed, Q16 */
+    int32_t left_ratio;
+    int32_t right_ratio;
+
+    /* Spline piece being followed, in mm. Tangents are per piece. */
+    uint8_t piece;
+    uint32_t tick;
+    uint32_t piece_ticks;
+    int32_t p0[2];
+    int32_t p1[2];
+    int32_t m0[2];
+    int32_t m1[2];
+} traj;
+
+static uint32_t isqrt64(uint64_t x)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+/* Velocity profile */
+
+static int profile_start(uint64_t length_q, uint16_t speed, uint16_t accel)
+{
+    if (speed == 0) {
+        return -EINVAL;
+    }
+
+    traj.length = length_q;
+    traj.pos = 0;
+    traj.speed = 0;
+    traj.max_speed = MAX(((int64_t)speed << Q) / RATE, 1);
+    /* No acceleration limit given means full speed right away */
+    traj.accel = accel ? MAX(((int64_t)accel << Q) / (RATE * RATE), 1) : traj.max_speed;
+    return 0;
+}
+
+static bool profile_step(int32_t *speed_mm_s)
+{
+    int64_t remaining = traj.length - traj.pos;
+
+    if (remaining <= 0) {
+        return false;
+    }
+
+    int64_t braking = (int64_t)traj.speed * traj.speed / (2 * traj.accel);
+
+    if (braking >= remaining) {
+        /* Keep a crawl, so the end is reached even with rounding */
+        traj.speed = MAX(traj.speed - traj.accel, traj.accel);
+    } else {
+        traj.speed = MIN(traj.speed + traj.accel, traj.max_speed);
+    }
+    traj.speed = MIN(traj.speed, remaining);
+    traj.pos += traj.speed;
+
+    *speed_mm_s = ((int64_t)traj.speed * RATE) >> Q;
+    return true;
+}
+
+static int line_start(const struct trajectory_line *line)
+{
+    int32_t dir = line->distance < 0 ? -ONE : ONE;
+
+    traj.left_ratio = dir;
+    traj.right_ratio = dir;
+    return profile_start((uint64_t)abs(line->distance) << Q, line->speed, line->accel);
+}
+
+static int arc_start(const struct trajectory_arc *arc)
+{
+    /* Heading change in Q16 radians. Arc lengths in Q16 exceed 32 bits from about
+     * 65 m, so they are computed in 64 bits.
+     */
+    uint32_t angle = (uint32_t)abs(arc->angle) * DEG_TO_RAD;
+    int32_t dir = arc->angle < 0 ? -1 : 1;
+
+    if (arc->radius == 0) {
+        /* The wheels follow a circle of half the wheel base, in opposite directions */
+        traj.left_ratio = -dir * ONE;
+        traj.right_ratio = dir * ONE;
+        return profile_start((uint64_t)HALF_BASE * angle, arc->speed, arc->accel);
+    }
+
+    traj.left_ratio = dir * (((int64_t)(arc->radius - HALF_BASE) << Q) / arc->radius);
+    traj.right_ratio = dir * (((int64_t)(arc->radius + HALF_BASE) << Q) / arc->radius);
+    return profile_start((uint64_t)abs(arc->radius) * angle, arc->speed, arc->accel);
+}
+
+/* Cubic Hermite spline */
+
+static void point_get(const struct trajectory_spline *spline, int i, int32_t p[2])
+{
+    /* Point 0 is the start pose */
+    p[0] = i ? spline->points[i - 1].x : 0;
+    p[1] = i ? spline->points[i - 1].y : 0;
+}
+
+static void tangent_get(const struct trajectory_spline *spline, int i, int32_t m[2])
+{
+    int32_t prev[2], next[2];
+
+    if (i == 0) {
+        /* Leave straight ahead, the robot can not move sideways */
+        point_get(spline, 1, next);
+        m[0] = isqrt64((int64_t)next[0] * next[0] + (int64_t)next[1] * next[1]);
+        m[1] = 0;
+        return;
+    }
+
+    if (i == spline->count) {
+        point_get(spline, i - 1, prev);
+        point_get(spline, i, next);
+        m[0] = next[0] - prev[0];
+        m[1] = next[1] - prev[1];
+        return;
+    }
+
+    /* Catmull-Rom tangent */
+    point_get(spline, i - 1, prev);
+    point_get(spline, i + 1, next);
+    m[0] = (next[0] - prev[0]) / 2;
+    m[1] = (next[1] - prev[1]) / 2;
+}
+
+static void piece_start(uint8_t piece)
+{
+    const struct trajectory_spline *spline = &traj.segment.spline;
+
+    traj.piece = piece;
+    traj.tick = 0;
+    point_get(spline, piece, traj.p0);
+    point_get(spline, piece + 1, traj.p1);
+    tangent_get(spline, piece, traj.m0);
+    tangent_get(spline, piece + 1, traj.m1);
+}
+
+static int spline_start(const struct trajectory_spline *spline)
+{
+    if (spline->count == 0 || spline->count > TRAJECTORY_SPLINE_POINTS_MAX) {
+        return -EINVAL;
+    }
+
+    traj.piece_ticks = MAX((uint32_t)spline->duration * RATE / 1000 / spline->count, 1);
+    piece_start(0);
+    return 0;
+}
+
+static bool spline_step(struct trajectory_setpoint *setpoint)
+{
+    if (traj.tick == traj.piece_ticks) {
+        if (traj.piece + 1 == traj.segment.spline.count) {
+            return false;
+        }
+        piece_start(traj.piece + 1);
+    }
+
+    /* Evaluate in the middle of the coming period */
+    int64_t u = ((int64_t)(2 * traj.tick + 1) << Q) / (2 * traj.piece_ticks);
+    int64_t u2 = (u * u) >> Q;
+
+    /* First and second derivatives of the Hermite basis, Q16 */
+    int64_t d[4] = {6 * u2 - 6 * u, 3 * u2 - 4 * u + ONE, -6 * u2 + 6 * u, 3 * u2 - 2 * u};
+    int64_t dd[4] = {12 * u - 6 * ONE, 6 * u - 4 * ONE, -12 * u + 6 * ONE, 6 * u - 2 * ONE};
+    int64_t vel[2], acc[2];
+
+    for (int i = 0; i < 2; i++) {
+        vel[i] = (d[0] * traj.p0[i] + d[1] * traj.m0[i] + d[2] * traj.p1[i] + d[3] * traj.m1[i]) >> (Q - QS);
+        acc[i] = (dd[0] * traj.p0[i] + dd[1] * traj.m0[i] + dd[2] * traj.p1[i] + dd[3] * traj.m1[i]) >> (Q - QS);
+    }
+
+    int64_t len = isqrt64(vel[0] * vel[0] + vel[1] * vel[1]);
+
+    traj.tick++;
+
+    if (len == 0) {
+        setpoint->left = 0;
+        setpoint->right = 0;
+        return true;
+    }
+
+    /* Speed of the centre, and the wheel offset from turning: curvature times half the
+     * wheel base, both per unit of the spline parameter and in Q8 mm.
+     */
+    int64_t cross = vel[0] * acc[1] - vel[1] * acc[0];
+    int64_t turn = (cross / len) * HALF_BASE * (1 << QS) / len;
+    int32_t centre = (len * RATE / traj.piece_ticks) >> QS;
+    int32_t offset = (turn * RATE / traj.piece_ticks) >> QS;
+
+    setpoint->left = centre - offset;
+    setpoint->right = centre + offset;
+    return true;
+}
+
+/* Encoding */
+
+#define LINE_LEN 6
+#define ARC_LEN 8
+#define SPLINE_HDR_LEN 3
+#define POINT_LEN 4
+
+/* Public interface */
+
+int trajectory_decode(struct net_buf_simple *buf, struct trajectory_segment *segment)
+{
+    if (buf->len < 1) {
+        return -EINVAL;
+    }
+
+    segment->type = net_buf_simple_pull_u8(buf);
+
+    switch (segment->type) {
+    case TRAJECTORY_LINE:
+        if (buf->len != LINE_LEN) {
+            return -EINVAL;
+        }
+        segment->line.distance = (int16_t)net_buf_simple_pull_le16(buf);
+        segment->line.speed = net_buf_simple_pull_le16(buf);
+        segment->line.accel = net_buf_simple_pull_le16(buf);
+        return 0;
+    case TRAJECTORY_ARC:
+        if (buf->len != ARC_LEN) {
+            return -EINVAL;
+        }
+        segment->arc.radius = (int16_t)net_buf_simple_pull_le16(buf);
+        segment->arc.angle = (int16_t)net_buf_simple_pull_le16(buf);
+        segment->arc.speed = net_buf_simple_pull_le16(buf);
+        segment->arc.accel = net_buf_simple_pull_le16(buf);
+        return 0;
+    case TRAJECTORY_SPLINE:
+        if (buf->len < SPLINE_HDR_LEN) {
+            return -EINVAL;
+        }
+        segment->spline.duration = net_buf_simple_pull_le16(buf);
+        segment->spline.count = net_buf_simple_pull_u8(buf);
+        if (segment->spline.count > TRAJECTORY_SPLINE_POINTS_MAX ||
+            buf->len != segment->spline.count * POINT_LEN) {
+            return -EINVAL;
+        }
+        for (int i = 0; i < segment->spline.count; i++) {
+            segment->spline.points[i].x = (int16_t)net_buf_simple_pull_le16(buf);
+            segment->spline.points[i].y = (int16_t)net_buf_simple_pull_le16(buf);
+        }
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+int trajectory_start(const struct trajectory_segment *segment)
+{
+    int err;
+
+    traj.running = false;
+    traj.segment = *segment;
+
+    switch (segment->type) {
+    case TRAJECTORY_LINE:
+        err = line_start(&traj.segment.line);
+        break;
+    case TRAJECTORY_ARC:
+        err = arc_start(&traj.segment.arc);
+        break;
+    case TRAJECTORY_SPLINE:
+        err = spline_start(&traj.segment.spline);
+        break;
+    default:
+        err = -EINVAL;
+        break;
+    }
+
+    if (err) {
+        LOG_WRN("Invalid trajectory of type %d", segment->type);
+        return err;
+    }
+
+    traj.running = true;
+    return 0;
+}
+
+bool trajectory_step(struct trajectory_setpoint *setpoint)
+{
+    int32_t speed = 0;
+
+    if (traj.running) {
+        if (traj.segment.type == TRAJECTORY_SPLINE) {
+            traj.running = spline_step(setpoint);
+        } else {
+            traj.running = profile_step(&speed);
+            setpoint->left = ((int64_t)speed * traj.left_ratio) >> Q;
+            setpoint->right = ((int64_t)speed * traj.right_ratio) >> Q;
+        }
+    }
+
+    if (!traj.running) {
+        setpoint->left = 0;
+        setpoint->right = 0;
+    }
+    return traj.running;
+}
+
+void trajectory_stop(void)
+{
+    traj.running = false;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/** Largest number of spline waypoints, the start point not included. */
+#define TRAJECTORY_SPLINE_POINTS_MAX 8
+
+/** Largest encoded segment: type, spline header and all waypoints. */
+#define TRAJECTORY_ENCODED_LEN_MAX (1 + 3 + TRAJECTORY_SPLINE_POINTS_MAX * 4)
+
+struct net_buf_simple;
+
+enum trajectory_type
+{
+    TRAJECTORY_LINE = 1,
+    TRAJECTORY_ARC = 2,
+    TRAJECTORY_SPLINE = 3,
+};
+
+/** Straight line with a trapezoidal velocity profile. */
+struct trajectory_line
+{
+    int16_t distance; // [mm], negative drives backwards.
+    uint16_t speed;   // Cruise speed [mm/s].
+    uint16_t accel;   // Acceleration and deceleration [mm/s^2].
+};
+
+/** Circular arc with a trapezoidal velocity profile along the arc. */
+struct trajectory_arc
+{
+    int16_t radius; // [mm], positive turns left. 0 turns in place.
+    int16_t angle;  // Heading change [deg], negative drives backwards. In place, positive turns left.
+    uint16_t speed; // Cruise speed of the robot centre, or of the wheels when turning in place [mm/s].
+    uint16_t accel; // [mm/s^2].
+};
+
+struct trajectory_point
+{
+    int16_t x; // [mm], ahead of the robot at the start.
+    int16_t y; // [mm], left of the robot at the start.
+};
+
+/**
+ * Cubic spline from the current pose through waypoints. Each piece takes the same time. The
+ * curve leaves the start point straight ahead, and ends heading away from the second to last
+ * point.
+ */
+struct trajectory_spline
+{
+    uint16_t duration; // [ms]
+    uint8_t count;
+    struct trajectory_point points[TRAJECTORY_SPLINE_POINTS_MAX];
+};
+
+struct trajectory_segment
+{
+    enum trajectory_type type;
+    union
+    {
+        struct trajectory_line line;
+        struct trajectory_arc arc;
+        struct trajectory_spline spline;
+    };
+};
+
+/** Wheel speed setpoints. */
+struct trajectory_setpoint
+{
+    int32_t left;  // [mm/s]
+    int32_t right; // [mm/s]
+};
+
+/**
+ * @brief Decode a segment.
+ *
+ * A segment is encoded as a type byte followed by the little endian fields of the segment,
+ * with as many spline points as given. The buffer must hold exactly one segment.
+ *
+ * @param buf Encoded segment, pulled.
+ * @param segment Decoded segment.
+ * @return 0 on success, -EINVAL if the encoding is malformed.
+ */
+int trajectory_decode(struct net_buf_simple *buf, struct trajectory_segment *segment);
+
+/**
+ * @brief Start following a segment.
+ *
+ * @param segment Segment, copied.
+ * @return 0 on success, -EINVAL if the segment is malformed.
+ */
+int trajectory_start(const struct trajectory_segment *segment);
+
+/**
+ * @brief Advance the trajectory by one control period.
+ *
+ * Call at CONFIG_MESH_TRAJECTORY_RATE_HZ. The segment is evaluated incrementally in fixed
+ * point.
+ *
+ * @param setpoint Wheel speeds for the coming period.
+ * @return true while the segment runs, false once it is done. The setpoint is zero then.
+ */
+bool trajectory_step(struct trajectory_setpoint *setpoint);
+
+/** @brief Abort the segment. */
+void trajectory_stop(void);
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Cloud module test against a local Mosquitto broker.
+ *
+ * Runs the cloud module of the gateway on native_posix, connected to the host
+ * through the TAP interface of the Zephyr net-tools:
+ *
+ *   net-setup.sh                                    (Zephyr net-tools, as root)
+ *   mosquitto -c tests/cloud_module/mosquitto.conf
+ *   twister -T tests/cloud_module -p native_posix --fixture mosquitto
+ *
+ * The module publishes to the topic it subscribes to, so every batch it
+ * publishes comes back from the broker as received data.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <app_event_manager.h>
+
+#include "modules_common.h"
+#include "app_module_event.h"
+#include "cloud_module_event.h"
+#include "data_module_event.h"
+#include "modem_module_event.h"
+
+#define CONNECT_TIMEOUT_MS ((CONFIG_CLOUD_CONNACK_TIMEOUT_SEC + 1) * MSEC_PER_SEC)
+#define LOOPBACK_TIMEOUT_MS ((CONFIG_CLOUD_BATCH_INTERVAL_SEC + 2) * MSEC_PER_SEC)
+#define RECORD_COUNT 4
+
+/* Cloud events seen by the test, in order */
+K_MSGQ_DEFINE(cloud_events, sizeof(struct cloud_module_event), 16, 4);
+
+static bool test_event_handler(const struct app_event_header *aeh)
+{
+	if (is_cloud_module_event(aeh)) {
+		(void)k_msgq_put(&cloud_events, cast_cloud_module_event(aeh), K_NO_WAIT);
+	}
+
+	return false;
+}
+
+APP_EVENT_LISTENER(cloud_module_test, test_event_handler);
+APP_EVENT_SUBSCRIBE(cloud_module_test, cloud_module_event);
+
+/* Wait for the next event of the given type. Buffers of the events skipped on the
+ * way belong to the test, as it is their only receiver.
+ */
+static void cloud_event_wait(enum cloud_module_event_type type, uint32_t timeout_ms,
+			     struct cloud_module_event *out)
+{
+	int64_t deadline = k_uptime_get() + timeout_ms;
+	struct cloud_module_event evt;
+
+	while (true) {
+		int64_t left = deadline - k_uptime_get();
+
+		zassert_ok(k_msgq_get(&cloud_events, &evt, K_MSEC(MAX(left, 0))),
+			   "No cloud event %d within %u ms", type, timeout_ms);
+
+		if (evt.type == type) {
+			break;
+		}
+
+		if (evt.type == CLOUD_EVT_DATA_RECEIVED || evt.type == CLOUD_EVT_DATA_UNSENT) {
+			k_free(evt.data.data.buf);
+		}
+	}
+
+	if (out != NULL) {
+		*out = evt;
+	}
+}
+
+static void modem_event_send(enum modem_module_event_type type)
+{
+	struct modem_module_event *event = new_modem_module_event();
+
+	event->type = type;
+	APP_EVENT_SUBMIT(event);
+}
+
+/* Hand a record over like the data module, which gives up the buffer */
+static void record_send(const char *record)
+{
+	struct data_module_event *event = new_data_module_event();
+	size_t len = strlen(record);
+	uint8_t *buf = k_malloc(len);
+
+	zassert_not_null(buf, "No memory for the record");
+	memcpy(buf, record, len);
+
+	event->type = DATA_EVT_DATA_SEND;
+	event->data.buffer.buf = buf;
+	event->data.buffer.len = len;
+	APP_EVENT_SUBMIT(event);
+}
+
+static void *cloud_setup(void)
+{
+	zassert_ok(app_event_manager_init(), "Application Event Manager not initialized");
+
+	struct app_module_event *event = new_app_module_event();
+
+	event->type = APP_EVT_START;
+	APP_EVENT_SUBMIT(event);
+
+	cloud_event_wait(CLOUD_EVT_CONNECTED, CONNECT_TIMEOUT_MS, NULL);
+	return NULL;
+}
+
+ZTEST(cloud_module, test_batch_loopback)
+{
+	static const char *const records[RECORD_COUNT] = { "{\"a\":1}", "{\"b\":2}",
+							   "{\"c\":3}", "{\"d\":4}" };
+	char expected[64] = "";
+	struct cloud_module_event evt;
+
+	for (int i = 0; i < RECORD_COUNT; i++) {
+		record_send(records[i]);
+		strcat(expected, records[i]);
+	}
+
+	/* All records go out as one publication at the end of the batch interval */
+	cloud_event_wait(CLOUD_EVT_DATA_SENT, LOOPBACK_TIMEOUT_MS, &evt);
+	zassert_equal(evt.data.data.len, strlen(expected), "Batch of %zu bytes",
+		      evt.data.data.len);
+
+	cloud_event_wait(CLOUD_EVT_DATA_RECEIVED, LOOPBACK_TIMEOUT_MS, &evt);
+	zassert_equal(evt.data.data.len, strlen(expected), "Received %zu bytes",
+		      evt.data.data.len);
+	zassert_mem_equal(evt.data.data.buf, expected, strlen(expected), "Batch changed");
+	k_free(evt.data.data.buf);
+}
+
+/* The client is initialized again for the next connection while the poll thread of
+ * the last one winds down.
+ */
+ZTEST(cloud_module, test_reconnect)
+{
+	struct cloud_module_event evt;
+
+	for (int i = 0; i < 3; i++) {
+		modem_event_send(MODEM_EVT_LTE_DISCONNECTED);
+		cloud_event_wait(CLOUD_EVT_DISCONNECTED, CONNECT_TIMEOUT_MS, NULL);
+		modem_event_send(MODEM_EVT_LTE_CONNECTED);
+		cloud_event_wait(CLOUD_EVT_CONNECTED, CONNECT_TIMEOUT_MS, NULL);
+	}
+
+	/* Still publishing on the last connection */
+	record_send("{\"e\":5}");
+	cloud_event_wait(CLOUD_EVT_DATA_RECEIVED, LOOPBACK_TIMEOUT_MS, &evt);
+	k_free(evt.data.data.buf);
+}
+
+ZTEST_SUITE(cloud_module, NULL, cloud_setup, NULL, NULL, NULL);
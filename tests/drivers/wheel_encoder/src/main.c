@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Wheel encoder driver test.
+ *
+ * Edges are driven through the GPIO emulator, which calls the edge interrupt
+ * handler of the driver right away. k_busy_wait() advances the simulated time
+ * exactly, so edge timestamps and the resulting rates are exact.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+
+#include "encoder.h"
+
+#define ENCODER_A DT_NODELABEL(encoder_a)
+#define ENCODER_B DT_NODELABEL(encoder_b)
+
+/* 2 kHz edge rate */
+#define EDGE_PERIOD_US 500
+#define EDGE_RATE_MHZ (USEC_PER_SEC / EDGE_PERIOD_US * 1000)
+
+struct encoder_pin {
+    const struct device *dev;
+    struct gpio_dt_spec gpio;
+    int level;
+};
+
+static struct encoder_pin pin_a = {
+    .dev = DEVICE_DT_GET(ENCODER_A),
+    .gpio = GPIO_DT_SPEC_GET(ENCODER_A, gpios),
+};
+
+static struct encoder_pin pin_b = {
+    .dev = DEVICE_DT_GET(ENCODER_B),
+    .gpio = GPIO_DT_SPEC_GET(ENCODER_B, gpios),
+};
+
+/* Toggle the pin count times, period_us apart, starting period_us from now */
+static void edges(struct encoder_pin *pin, int count, uint32_t period_us)
+{
+    for (int i = 0; i < count; i++) {
+        k_busy_wait(period_us);
+        pin->level = !pin->level;
+        zassert_ok(gpio_emul_input_set(pin->gpio.port, pin->gpio.pin, pin->level),
+                   "Failed to set pin %u", pin->gpio.pin);
+    }
+}
+
+static uint32_t rate_get(struct encoder_pin *pin)
+{
+    uint32_t rate_mhz;
+
+    zassert_ok(encoder_edge_rate_get(pin->dev, &rate_mhz), "Failed to get rate");
+    return rate_mhz;
+}
+
+static uint32_t count_get(struct encoder_pin *pin)
+{
+    uint32_t count;
+
+    zassert_ok(encoder_edge_count_get(pin->dev, &count), "Failed to get count");
+    return count;
+}
+
+static void *encoder_setup(void)
+{
+    zassert_true(device_is_ready(pin_a.dev), "Encoder A not ready");
+    zassert_true(device_is_ready(pin_b.dev), "Encoder B not ready");
+    return NULL;
+}
+
+/* Start every test with both wheels stopped */
+static void encoder_before(void *fixture)
+{
+    k_sleep(K_MSEC(CONFIG_WHEEL_ENCODER_TIMEOUT_MS + 1));
+    zassert_equal(rate_get(&pin_a), 0, "Encoder A still moving");
+    zassert_equal(rate_get(&pin_b), 0, "Encoder B still moving");
+}
+
+ZTEST(wheel_encoder, test_count)
+{
+    uint32_t start = count_get(&pin_a);
+
+    edges(&pin_a, 25, EDGE_PERIOD_US);
+    zassert_equal(count_get(&pin_a) - start, 25, "Both edges not counted");
+}
+
+ZTEST(wheel_encoder, test_rate)
+{
+    edges(&pin_a, 10, EDGE_PERIOD_US);
+    zassert_equal(rate_get(&pin_a), 0, "Rate timed from an edge before the stop");
+
+    edges(&pin_a, 10, EDGE_PERIOD_US);
+    zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ, "Wrong rate");
+
+    /* One edge per reading times the period between the last edges */
+    for (int i = 0; i < 5; i++) {
+        edges(&pin_a, 1, 2 * EDGE_PERIOD_US);
+        zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ / 2, "Wrong rate at one edge per reading");
+    }
+}
+
+ZTEST(wheel_encoder, test_decay_and_stop)
+{
+    edges(&pin_a, 10, EDGE_PERIOD_US);
+    (void)rate_get(&pin_a);
+    edges(&pin_a, 10, EDGE_PERIOD_US);
+    zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ, "Wrong rate");
+
+    /* The rate is bounded by the time since the last edge */
+    k_busy_wait(4 * EDGE_PERIOD_US);
+    zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ / 4, "Rate not decayed");
+
+    /* Reading again without edges keeps the bound */
+    zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ / 4, "Rate raised without edges");
+
+    k_busy_wait(CONFIG_WHEEL_ENCODER_TIMEOUT_MS * USEC_PER_MSEC);
+    zassert_equal(rate_get(&pin_a), 0, "Wheel not stopped after the timeout");
+}
+
+ZTEST(wheel_encoder, test_independent_encoders)
+{
+    uint32_t start_b = count_get(&pin_b);
+
+    edges(&pin_a, 10, EDGE_PERIOD_US);
+    (void)rate_get(&pin_a);
+    edges(&pin_a, 10, EDGE_PERIOD_US);
+    zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ, "Wrong rate of A");
+    zassert_equal(count_get(&pin_b), start_b, "Edges of A counted on B");
+    zassert_equal(rate_get(&pin_b), 0, "B moving from edges of A");
+
+    edges(&pin_b, 10, 2 * EDGE_PERIOD_US);
+    (void)rate_get(&pin_b);
+    edges(&pin_b, 10, 2 * EDGE_PERIOD_US);
+    zassert_equal(rate_get(&pin_b), EDGE_RATE_MHZ / 2, "Wrong rate of B");
+
+    /* A only decays, over the 20 ms B was turning */
+    zassert_equal(rate_get(&pin_a), EDGE_RATE_MHZ / 40, "Rate of A changed by edges of B");
+}
+
+ZTEST_SUITE(wheel_encoder, NULL, encoder_setup, encoder_before, NULL, NULL);
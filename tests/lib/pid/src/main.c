@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* PID benchmark on target.
+ *
+ * The on-target counterpart of lib/pid/host/pid_bench.c, with the same gains
+ * and simulated wheel. Each controller variant is checked to settle on the
+ * setpoint, then the CPU cycles per update are counted with the DWT cycle
+ * counter, alone and batched as two wheel loops and a heading loop. Interrupts
+ * are locked while counting, so the numbers are the updates alone.
+ *
+ *   twister -T tests/lib/pid -p nrf52840dk_nrf52840 --device-testing ...
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/arch/arm/aarch32/cortex_m/cmsis.h>
+
+#include <pid.h>
+
+#define STEPS 2000
+#define ROUNDS 10000
+#define LOOPS 3
+
+#define Q15(x) ((pid_q15_t)((x) * 32767.0f))
+#define Q31(x) ((pid_q31_t)((x) * 2147483647.0))
+
+/* Wheel speed responding to motor power with a time constant of 50 updates,
+ * against a constant load.
+ */
+static float plant(float speed, float power)
+{
+	return speed + (power - 0.1f - speed) / 50.0f;
+}
+
+/* Gains shared by all variants: kp 2, ki 0.05 per update, kd 1 per update. */
+static const struct pid_f32_config f32_cfg = {
+	.kp = 2.0f, .ki = 0.05f, .kd = 1.0f, .kff = 1.0f, .d_alpha = 0.25f,
+	.out_min = -1.0f, .out_max = 1.0f,
+};
+
+static const struct pid_q15_config q15_cfg = {
+	.kp = Q15(2.0f / 4), .ki = Q15(0.05f / 4), .kd = Q15(1.0f / 4), .kff = Q15(1.0f / 4),
+	.shift = 2, .d_alpha = Q15(0.25f), .out_min = INT16_MIN, .out_max = INT16_MAX,
+};
+
+static const struct pid_q31_config q31_cfg = {
+	.kp = Q31(2.0 / 4), .ki = Q31(0.05 / 4), .kd = Q31(1.0 / 4), .kff = Q31(1.0 / 4),
+	.shift = 2, .d_alpha = Q31(0.25), .out_min = INT32_MIN, .out_max = INT32_MAX,
+};
+
+static void cycles_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cycles_get(void)
+{
+	return DWT->CYCCNT;
+}
+
+/* Keeps the compiler from dropping the benchmarked updates. */
+static volatile int64_t sink;
+
+static void report(const char *name, uint32_t single, uint32_t batch)
+{
+	TC_PRINT("%-4s %4u cycles per update, %4u cycles per %d loops batched\n", name,
+		 single / ROUNDS, batch / ROUNDS, LOOPS);
+	zassert_true(single > 0 && batch > 0, "Cycle counter not running");
+}
+
+static void *pid_setup(void)
+{
+	cycles_init();
+	return NULL;
+}
+
+ZTEST(pid, test_step_response)
+{
+	struct pid_f32 f;
+	struct pid_q15 q;
+	struct pid_q31 l;
+	float speed;
+
+	pid_f32_init(&f, &f32_cfg);
+	speed = 0.0f;
+	for (int i = 0; i < STEPS; i++) {
+		speed = plant(speed, pid_f32_update(&f, 0.5f, speed, 0.0f));
+	}
+	zassert_within(speed, 0.5f, 0.01f, "f32 settles at %d/1000", (int)(speed * 1000));
+
+	pid_q15_init(&q, &q15_cfg);
+	speed = 0.0f;
+	for (int i = 0; i < STEPS; i++) {
+		speed = plant(speed, pid_q15_update(&q, Q15(0.5f), Q15(speed), 0) / 32768.0f);
+	}
+	zassert_within(speed, 0.5f, 0.01f, "q15 settles at %d/1000", (int)(speed * 1000));
+
+	pid_q31_init(&l, &q31_cfg);
+	speed = 0.0f;
+	for (int i = 0; i < STEPS; i++) {
+		speed = plant(speed, pid_q31_update(&l, Q31(0.5), Q31(speed), 0) / 2147483648.0);
+	}
+	zassert_within(speed, 0.5f, 0.01f, "q31 settles at %d/1000", (int)(speed * 1000));
+}
+
+ZTEST(pid, test_cycles_per_update)
+{
+	static struct pid_f32 f[LOOPS];
+	static struct pid_q15 q[LOOPS];
+	static struct pid_q31 l[LOOPS];
+	float f_sp[LOOPS] = { 0.5f, 0.5f, 0.1f }, f_meas[LOOPS], f_out[LOOPS];
+	pid_q15_t q_sp[LOOPS] = { Q15(0.5f), Q15(0.5f), Q15(0.1f) }, q_meas[LOOPS], q_out[LOOPS];
+	pid_q31_t l_sp[LOOPS] = { Q31(0.5), Q31(0.5), Q31(0.1) }, l_meas[LOOPS], l_out[LOOPS];
+	uint32_t start, single, batch;
+	unsigned int key;
+
+	for (int i = 0; i < LOOPS; i++) {
+		pid_f32_init(&f[i], &f32_cfg);
+		pid_q15_init(&q[i], &q15_cfg);
+		pid_q31_init(&l[i], &q31_cfg);
+	}
+
+	key = irq_lock();
+
+	/* Measurements vary per round, so nothing is hoisted out of the loops. */
+	start = cycles_get();
+	for (int r = 0; r < ROUNDS; r++) {
+		sink += pid_f32_update(&f[0], 0.5f, (r & 0xff) / 256.0f, 0.0f) * 1000;
+	}
+	single = cycles_get() - start;
+	start = cycles_get();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < LOOPS; i++) {
+			f_meas[i] = ((r + i) & 0xff) / 256.0f;
+		}
+		pid_f32_update_batch(f, f_sp, f_meas, NULL, f_out, LOOPS);
+		sink += f_out[0] * 1000;
+	}
+	batch = cycles_get() - start;
+	irq_unlock(key);
+	report("f32", single, batch);
+
+	key = irq_lock();
+	start = cycles_get();
+	for (int r = 0; r < ROUNDS; r++) {
+		sink += pid_q15_update(&q[0], Q15(0.5f), (r & 0xff) << 7, 0);
+	}
+	single = cycles_get() - start;
+	start = cycles_get();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < LOOPS; i++) {
+			q_meas[i] = ((r + i) & 0xff) << 7;
+		}
+		pid_q15_update_batch(q, q_sp, q_meas, NULL, q_out, LOOPS);
+		sink += q_out[0];
+	}
+	batch = cycles_get() - start;
+	irq_unlock(key);
+	report("q15", single, batch);
+
+	key = irq_lock();
+	start = cycles_get();
+	for (int r = 0; r < ROUNDS; r++) {
+		sink += pid_q31_update(&l[0], Q31(0.5), (r & 0xff) << 23, 0);
+	}
+	single = cycles_get() - start;
+	start = cycles_get();
+	for (int r = 0; r < ROUNDS; r++) {
+		for (int i = 0; i < LOOPS; i++) {
+			l_meas[i] = ((r + i) & 0xff) << 23;
+		}
+		pid_q31_update_batch(l, l_sp, l_meas, NULL, l_out, LOOPS);
+		sink += l_out[0];
+	}
+	batch = cycles_get() - start;
+	irq_unlock(key);
+	report("q31", single, batch);
+}
+
+ZTEST_SUITE(pid, NULL, pid_setup, NULL, NULL, NULL);
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Event path benchmark.
+ *
+ * Sends DATA_EVT_DATA_SEND events with k_malloc'd payloads, as the data module
+ * does, through the Application Event Manager to up to MAX_SUBSCRIBERS
+ * synthetic modules. Each module enqueues the event with module_enqueue_msg()
+ * and its thread dequeues it with module_get_next_msg(). The first module owns
+ * the payload and frees it.
+ *
+ * For each number of subscribers and payload size, events are sent paced, so
+ * every event is handled before the next is sent, and in bursts, which overflow
+ * the queues. Events per second, cycles per event, the enqueue and handling
+ * cycles of the subscribers and dropped messages are reported for both.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <app_event_manager.h>
+
+#include "modules_common.h"
+#include "data_module_event.h"
+
+#if defined(CONFIG_ARCH_POSIX)
+/* Simulated time stands still while the CPU is busy, so measure host time. */
+#include <time.h>
+#endif
+
+#define MAX_SUBSCRIBERS 8
+#define QUEUE_ENTRY_COUNT 10
+#define STACK_SIZE 1024
+#define EVENT_COUNT 1000
+#define DRAIN_TIMEOUT_MS 5000
+#define MAX_PAYLOAD_SIZE 1024
+
+/* Events sent back to back, two more than the queues hold. A failed event
+ * allocation is fatal, so a burst must fit the heap.
+ */
+#define BURST_LEN (QUEUE_ENTRY_COUNT + 2)
+#define BURST_HEAP_SIZE (BURST_LEN * (MAX_PAYLOAD_SIZE + sizeof(struct data_module_event) + 32))
+
+BUILD_ASSERT(BURST_HEAP_SIZE < CONFIG_HEAP_MEM_POOL_SIZE, "Bursts do not fit the heap");
+
+static const size_t subscriber_counts[] = { 1, 2, 4, MAX_SUBSCRIBERS };
+static const size_t payload_sizes[] = { 16, 256, MAX_PAYLOAD_SIZE };
+
+static struct subscriber {
+	struct module_data module;
+	struct k_msgq msgq;
+	char __aligned(4) msgq_buf[QUEUE_ENTRY_COUNT * sizeof(struct data_module_event)];
+	struct k_thread thread;
+} subscribers[MAX_SUBSCRIBERS];
+
+K_THREAD_STACK_ARRAY_DEFINE(stacks, MAX_SUBSCRIBERS, STACK_SIZE);
+
+/* Number of subscribers taking part in the current run. */
+static size_t active;
+
+static atomic_t handled;
+static atomic_t dropped;
+
+struct run {
+	uint32_t sent;
+	uint32_t payload_alloc_failures;
+	uint64_t elapsed_ns;
+};
+
+#if defined(CONFIG_ARCH_POSIX)
+static uint64_t timestamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static uint64_t elapsed_ns(uint64_t start)
+{
+	return timestamp() - start;
+}
+#else
+static uint64_t timestamp(void)
+{
+	return k_cycle_get_32();
+}
+
+static uint64_t elapsed_ns(uint64_t start)
+{
+	return k_cyc_to_ns_floor64(k_cycle_get_32() - (uint32_t)start);
+}
+#endif
+
+/* Called for messages rejected by, or purged from, a full queue. */
+static void msg_free(void *msg)
+{
+	atomic_inc(&dropped);
+}
+
+static void owner_msg_free(void *msg)
+{
+	struct data_module_event *evt = msg;
+
+	k_free(evt->data.buffer.buf);
+	atomic_inc(&dropped);
+}
+
+static bool event_handle(size_t index, const struct app_event_header *aeh)
+{
+	if (index >= active || !is_data_module_event(aeh)) {
+		return false;
+	}
+
+	module_enqueue_msg(&subscribers[index].module, cast_data_module_event(aeh));
+	return false;
+}
+
+#define SUBSCRIBER_DEFINE(i, _)								\
+	static bool subscriber_handler_##i(const struct app_event_header *aeh)		\
+	{										\
+		return event_handle(i, aeh);						\
+	}										\
+	APP_EVENT_LISTENER(subscriber_##i, subscriber_handler_##i);			\
+	APP_EVENT_SUBSCRIBE(subscriber_##i, data_module_event);
+
+LISTIFY(MAX_SUBSCRIBERS, SUBSCRIBER_DEFINE, ())
+
+static void subscriber_thread_fn(void *p1, void *p2, void *p3)
+{
+	struct subscriber *sub = p1;
+	struct data_module_event msg;
+
+	while (true) {
+		module_get_next_msg(&sub->module, &msg);
+
+		if (sub == &subscribers[0]) {
+			k_free(msg.data.buffer.buf);
+		}
+
+		atomic_inc(&handled);
+	}
+}
+
+static int event_send(size_t payload_size, struct run *run)
+{
+	uint8_t *buf = k_malloc(payload_size);
+
+	if (buf == NULL) {
+		run->payload_alloc_failures++;
+		return -ENOMEM;
+	}
+
+	memset(buf, 0xa5, payload_size);
+
+	struct data_module_event *event = new_data_module_event();
+
+	event->type = DATA_EVT_DATA_SEND;
+	event->data.buffer.buf = buf;
+	event->data.buffer.len = payload_size;
+	APP_EVENT_SUBMIT(event);
+
+	run->sent++;
+	return 0;
+}
+
+/* Wait for every sent event to be handled or dropped by every active subscriber. */
+static void drain(const struct run *run)
+{
+	int64_t deadline = k_uptime_get() + DRAIN_TIMEOUT_MS;
+
+	while (atomic_get(&handled) + atomic_get(&dropped) < run->sent * active) {
+		zassert_true(k_uptime_get() < deadline, "%u of %u messages handled",
+			     (uint32_t)(atomic_get(&handled) + atomic_get(&dropped)),
+			     run->sent * active);
+		k_sleep(K_MSEC(1));
+	}
+
+	zassert_equal(atomic_get(&handled) + atomic_get(&dropped), run->sent * active,
+		      "Messages handled more than once");
+}
+
+/* Cycles per event are the elapsed time at the system clock rate, so on native_posix
+ * they are host time expressed in cycles. Enqueue and handling cycles are the
+ * averages per message over all subscribers.
+ */
+static void report(const char *mode, size_t payload_size, const struct run *run)
+{
+	struct module_event_stats events;
+	struct module_stats stats;
+	uint32_t high_water = 0;
+	uint32_t enqueued = 0;
+	uint32_t dequeued = 0;
+	uint64_t enqueue_cycles = 0;
+	uint64_t handle_cycles = 0;
+
+	zassert_ok(module_event_stats_get(&events, true), "Statistics not enabled");
+	zassert_equal(events.alloc_failures, 0, "Events not allocated");
+
+	for (size_t i = 0; i < active; i++) {
+		module_stats_get(&subscribers[i].module, &stats, true);
+		high_water = MAX(high_water, stats.high_water);
+		enqueued += stats.enqueued + stats.enqueue_failures;
+		dequeued += stats.dequeued;
+		enqueue_cycles += stats.enqueue_cycles;
+		handle_cycles += stats.handle_cycles;
+	}
+
+	TC_PRINT("%s, %zu subscribers, %4zu byte payload: %7llu events/s, "
+		 "%6llu cycles/event, enqueue %5llu and handling %5llu cycles/message, "
+		 "%u payload allocation failures, %u of %u messages dropped, "
+		 "high water %u/%u\n",
+		 mode, active, payload_size,
+		 run->elapsed_ns ? (uint64_t)run->sent * NSEC_PER_SEC / run->elapsed_ns : 0,
+		 run->sent ? k_ns_to_cyc_floor64(run->elapsed_ns) / run->sent : 0,
+		 enqueued ? enqueue_cycles / enqueued : 0,
+		 dequeued ? handle_cycles / dequeued : 0,
+		 run->payload_alloc_failures,
+		 (uint32_t)atomic_get(&dropped), run->sent * active, high_water,
+		 QUEUE_ENTRY_COUNT);
+}
+
+static void run_reset(size_t subscriber_count)
+{
+	struct module_event_stats events;
+	struct module_stats stats;
+
+	active = subscriber_count;
+	atomic_clear(&handled);
+	atomic_clear(&dropped);
+
+	(void)module_event_stats_get(&events, true);
+	for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+		(void)module_stats_get(&subscribers[i].module, &stats, true);
+	}
+}
+
+static void *bench_setup(void)
+{
+	zassert_ok(app_event_manager_init(), "Application Event Manager not initialized");
+
+	for (size_t i = 0; i < MAX_SUBSCRIBERS; i++) {
+		struct subscriber *sub = &subscribers[i];
+
+		k_msgq_init(&sub->msgq, sub->msgq_buf, sizeof(struct data_module_event),
+			    QUEUE_ENTRY_COUNT);
+
+		sub->module.name = "bench";
+		sub->module.msg_q = &sub->msgq;
+		sub->module.msg_free = i == 0 ? owner_msg_free : msg_free;
+		sub->module.thread_id = k_thread_create(&sub->thread, stacks[i],
+							K_THREAD_STACK_SIZEOF(stacks[i]),
+							subscriber_thread_fn, sub, NULL, NULL,
+							K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+
+		zassert_ok(module_start(&sub->module), "Failed to start subscriber %zu", i);
+	}
+
+	return NULL;
+}
+
+/* The sender has the lowest priority, so the event manager and the
+ * subscribers handle each event before the next is sent.
+ */
+ZTEST(modules_common_bench, test_paced)
+{
+	int prio = k_thread_priority_get(k_current_get());
+
+	k_thread_priority_set(k_current_get(), K_LOWEST_APPLICATION_THREAD_PRIO);
+
+	for (size_t s = 0; s < ARRAY_SIZE(subscriber_counts); s++) {
+		for (size_t p = 0; p < ARRAY_SIZE(payload_sizes); p++) {
+			struct run run = { 0 };
+			uint64_t start;
+
+			run_reset(subscriber_counts[s]);
+			start = timestamp();
+
+			for (int i = 0; i < EVENT_COUNT; i++) {
+				event_send(payload_sizes[p], &run);
+			}
+
+			drain(&run);
+			run.elapsed_ns = elapsed_ns(start);
+			report("Paced", payload_sizes[p], &run);
+
+			zassert_equal(atomic_get(&dropped), 0, "Paced messages dropped");
+			zassert_equal(run.sent, EVENT_COUNT, "Paced events not allocated");
+		}
+	}
+
+	k_thread_priority_set(k_current_get(), prio);
+}
+
+/* The sender does not yield within a burst, so the events pile up in the event
+ * manager, and then overflow the module queues.
+ */
+ZTEST(modules_common_bench, test_burst)
+{
+	int prio = k_thread_priority_get(k_current_get());
+
+	k_thread_priority_set(k_current_get(), K_PRIO_COOP(0));
+
+	for (size_t s = 0; s < ARRAY_SIZE(subscriber_counts); s++) {
+		for (size_t p = 0; p < ARRAY_SIZE(payload_sizes); p++) {
+			struct run run = { 0 };
+			uint64_t start;
+
+			run_reset(subscriber_counts[s]);
+			start = timestamp();
+
+			for (int i = 0; i < EVENT_COUNT; i += BURST_LEN) {
+				for (int b = 0; b < BURST_LEN; b++) {
+					event_send(payload_sizes[p], &run);
+				}
+
+				drain(&run);
+			}
+
+			run.elapsed_ns = elapsed_ns(start);
+			report("Burst", payload_sizes[p], &run);
+
+			zassert_equal(run.payload_alloc_failures, 0, "Burst payloads not allocated");
+			zassert_equal(atomic_get(&handled) + atomic_get(&dropped), run.sent * active,
+				      "Burst messages lost");
+			zassert_true(atomic_get(&handled) >= run.sent / BURST_LEN * active,
+				     "Subscribers did not handle every burst");
+			zassert_true(atomic_get(&dropped) > 0, "Bursts did not overflow the queues");
+		}
+	}
+
+	k_thread_priority_set(k_current_get(), prio);
+}
+
+ZTEST_SUITE(modules_common_bench, NULL, bench_setup, NULL, NULL, NULL);
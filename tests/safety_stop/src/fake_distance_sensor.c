@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#define DT_DRV_COMPAT test_fake_distance_sensor
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+
+#include "fake_drivers.h"
+
+/* Sensor drivers with CONFIG_<SENSOR>_TRIGGER_OWN_THREAD handle the interrupt in a
+ * thread of their own, which is modeled here by a workqueue.
+ */
+#define DRIVER_THREAD_STACK_SIZE 1024
+#define DRIVER_THREAD_PRIORITY 1
+
+struct fake_distance_sensor_data
+{
+    const struct device *dev;
+    struct k_work trigger_work;
+    atomic_t distance_mm;
+    atomic_t threshold_mm;
+    const struct sensor_trigger *trigger;
+    sensor_trigger_handler_t handler;
+};
+
+static K_THREAD_STACK_DEFINE(driver_stack, DRIVER_THREAD_STACK_SIZE);
+static struct k_work_q driver_work_q;
+
+static void trigger_work_fn(struct k_work *work)
+{
+    struct fake_distance_sensor_data *data =
+        CONTAINER_OF(work, struct fake_distance_sensor_data, trigger_work);
+
+    if (data->handler != NULL) {
+        data->handler(data->dev, data->trigger);
+    }
+}
+
+static int fake_attr_set(const struct device *dev, enum sensor_channel chan,
+                         enum sensor_attribute attr, const struct sensor_value *val)
+{
+    struct fake_distance_sensor_data *data = dev->data;
+
+    if (chan != SENSOR_CHAN_DISTANCE || attr != SENSOR_ATTR_LOWER_THRESH) {
+        return -ENOTSUP;
+    }
+
+    /* The distance channel is in meters */
+    atomic_set(&data->threshold_mm, val->val1 * 1000 + val->val2 / 1000);
+    return 0;
+}
+
+static int fake_trigger_set(const struct device *dev, const struct sensor_trigger *trig,
+                            sensor_trigger_handler_t handler)
+{
+    struct fake_distance_sensor_data *data = dev->data;
+
+    if (trig->type != SENSOR_TRIG_THRESHOLD || trig->chan != SENSOR_CHAN_DISTANCE) {
+        return -ENOTSUP;
+    }
+
+    data->trigger = trig;
+    data->handler = handler;
+    return 0;
+}
+
+static int fake_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+    return 0;
+}
+
+static int fake_channel_get(const struct device *dev, enum sensor_channel chan,
+                            struct sensor_value *val)
+{
+    struct fake_distance_sensor_data *data = dev->data;
+    int32_t mm = atomic_get(&data->distance_mm);
+
+    if (chan != SENSOR_CHAN_DISTANCE) {
+        return -ENOTSUP;
+    }
+
+    val->val1 = mm / 1000;
+    val->val2 = (mm % 1000) * 1000;
+    return 0;
+}
+
+bool fake_distance_sensor_armed(const struct device *dev)
+{
+    struct fake_distance_sensor_data *data = dev->data;
+
+    return data->handler != NULL;
+}
+
+void fake_distance_sensor_set(const struct device *dev, int32_t mm)
+{
+    struct fake_distance_sensor_data *data = dev->data;
+    int32_t threshold = atomic_get(&data->threshold_mm);
+    int32_t old = atomic_set(&data->distance_mm, mm);
+
+    if (old >= threshold && mm < threshold) {
+        k_work_submit_to_queue(&driver_work_q, &data->trigger_work);
+    }
+}
+
+static int fake_distance_sensor_init(const struct device *dev)
+{
+    struct fake_distance_sensor_data *data = dev->data;
+    static bool started;
+
+    if (!started) {
+        k_work_queue_start(&driver_work_q, driver_stack, K_THREAD_STACK_SIZEOF(driver_stack),
+                           DRIVER_THREAD_PRIORITY, NULL);
+        k_thread_name_set(&driver_work_q.thread, "fake_sensor");
+        started = true;
+    }
+
+    data->dev = dev;
+    k_work_init(&data->trigger_work, trigger_work_fn);
+    /* Nothing in sight */
+    atomic_set(&data->distance_mm, 2000);
+    return 0;
+}
+
+static const struct sensor_driver_api fake_distance_sensor_api = {
+    .attr_set = fake_attr_set,
+    .trigger_set = fake_trigger_set,
+    .sample_fetch = fake_sample_fetch,
+    .channel_get = fake_channel_get,
+};
+
+#define FAKE_DISTANCE_SENSOR_DEFINE(inst)                                                 \
+    static struct fake_distance_sensor_data fake_distance_sensor_data_##inst;            \
+    DEVICE_DT_INST_DEFINE(inst, fake_distance_sensor_init, NULL,                          \
+                          &fake_distance_sensor_data_##inst, NULL, POST_KERNEL,           \
+                          CONFIG_SENSOR_INIT_PRIORITY, &fake_distance_sensor_api);
+
+DT_INST_FOREACH_STATUS_OKAY(FAKE_DISTANCE_SENSOR_DEFINE)
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+
+/**
+ * @brief Get the state of a fake motor.
+ *
+ * @param dev Fake motor.
+ * @param power Set to the last power the motor accepted.
+ * @param braked_at Set to the cycle count of the last emergency stop, if stopped.
+ * @return true if the motor is emergency stopped.
+ */
+bool fake_motor_state(const struct device *dev, int32_t *power, uint32_t *braked_at);
+
+/** @brief Check if the threshold trigger of a fake distance sensor is set. */
+bool fake_distance_sensor_armed(const struct device *dev);
+
+/**
+ * @brief Set the distance measured by a fake distance sensor.
+ *
+ * Crossing below the lower threshold calls the trigger handler from the thread of the
+ * driver, like the drivers of real sensors do after the sensor interrupt.
+ *
+ * @param dev Fake distance sensor.
+ * @param mm Distance in millimeters.
+ */
+void fake_distance_sensor_set(const struct device *dev, int32_t mm);
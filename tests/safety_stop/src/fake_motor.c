@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#define DT_DRV_COMPAT test_fake_motor
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+
+#include "motor.h"
+#include "fake_drivers.h"
+
+struct fake_motor_data
+{
+    struct k_spinlock lock;
+    int32_t power;
+    bool stopped;
+    uint32_t braked_at;
+};
+
+/* Like the tb6612fng driver, a stopped motor only takes zero power */
+static int fake_drive_continous(const struct device *dev, int32_t power)
+{
+    struct fake_motor_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    int err = 0;
+
+    if (data->stopped && power != 0) {
+        err = -EBUSY;
+    } else {
+        data->power = power;
+    }
+    k_spin_unlock(&data->lock, key);
+    return err;
+}
+
+static int fake_emergency_stop(const struct device *dev)
+{
+    struct fake_motor_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    if (!data->stopped) {
+        data->braked_at = k_cycle_get_32();
+    }
+    data->stopped = true;
+    data->power = 0;
+    k_spin_unlock(&data->lock, key);
+    return 0;
+}
+
+static int fake_emergency_release(const struct device *dev)
+{
+    struct fake_motor_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+    data->stopped = false;
+    k_spin_unlock(&data->lock, key);
+    return 0;
+}
+
+bool fake_motor_state(const struct device *dev, int32_t *power, uint32_t *braked_at)
+{
+    struct fake_motor_data *data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    bool stopped = data->stopped;
+
+    *power = data->power;
+    *braked_at = data->braked_at;
+    k_spin_unlock(&data->lock, key);
+    return stopped;
+}
+
+static int fake_motor_init(const struct device *dev)
+{
+    return 0;
+}
+
+static const struct motor_api fake_motor_api = {
+    .drive_continous = fake_drive_continous,
+    .set_position = NULL,
+    .emergency_stop = fake_emergency_stop,
+    .emergency_release = fake_emergency_release,
+};
+
+#define FAKE_MOTOR_DEFINE(inst)                                                           \
+    static struct fake_motor_data fake_motor_data_##inst;                                 \
+    DEVICE_DT_INST_DEFINE(inst, fake_motor_init, NULL, &fake_motor_data_##inst, NULL,     \
+                          POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &fake_motor_api);
+
+DT_INST_FOREACH_STATUS_OKAY(FAKE_MOTOR_DEFINE)
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Safety stop test.
+ *
+ * Runs the motor module of the mesh_bot with the safety stop on fake motors and a
+ * fake distance sensor. Movements are requested with mesh events, like the mesh
+ * module does, and the sensor fires its threshold trigger from its driver thread.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <app_event_manager.h>
+
+#include "events/mesh_module_event.h"
+#include "events/motor_module_event.h"
+#include "safety_stop.h"
+#include "fake_drivers.h"
+
+#define MOTOR_A DEVICE_DT_GET(DT_NODELABEL(motor_a))
+#define MOTOR_B DEVICE_DT_GET(DT_NODELABEL(motor_b))
+#define SENSOR DEVICE_DT_GET(DT_NODELABEL(distance_sensor))
+
+#define OBSTACLE_MM (CONFIG_MOTOR_SAFETY_STOP_DISTANCE_MM / 2)
+#define CLEAR_MM (CONFIG_MOTOR_SAFETY_STOP_DISTANCE_MM * 2)
+
+/* Trigger to motors braked */
+#define BRAKE_TIMEOUT_MS 1
+/* Trigger to the end of the movement reported */
+#define DONE_TIMEOUT_MS 10
+/* Longer than any movement of the test */
+#define MOVEMENT_MS 5000
+
+/* Motor events seen by the test, in order */
+K_MSGQ_DEFINE(motor_events, sizeof(struct motor_module_event), 8, 4);
+
+static bool test_event_handler(const struct app_event_header *header)
+{
+    if (is_motor_module_event(header)) {
+        (void)k_msgq_put(&motor_events, cast_motor_module_event(header), K_NO_WAIT);
+    }
+    return false;
+}
+
+APP_EVENT_LISTENER(safety_stop_test, test_event_handler);
+APP_EVENT_SUBSCRIBE(safety_stop_test, motor_module_event);
+
+static void motor_event_expect(motor_module_event_type type, motor_done_reason reason,
+                               uint32_t timeout_ms)
+{
+    struct motor_module_event evt;
+
+    zassert_ok(k_msgq_get(&motor_events, &evt, K_MSEC(timeout_ms)),
+               "No motor event within %u ms", timeout_ms);
+    zassert_equal(evt.type, type, "Wrong motor event %d", evt.type);
+    if (type == MOTOR_EVT_MOVEMENT_DONE) {
+        zassert_equal(evt.reason, reason, "Wrong reason %d", evt.reason);
+    }
+}
+
+/* Configure a timed movement and clear it to move, like the mesh module */
+static void move(uint32_t time)
+{
+    struct mesh_module_event *evt = new_mesh_module_event();
+
+    evt->type = MESH_EVT_MOVEMENT_RECEIVED;
+    evt->data.movement.time = time;
+    evt->data.movement.angle = 0;
+    APP_EVENT_SUBMIT(evt);
+
+    evt = new_mesh_module_event();
+    evt->type = MESH_EVT_CLEAR_TO_MOVE_RECEIVED;
+    APP_EVENT_SUBMIT(evt);
+}
+
+static void motor_expect_braked(const struct device *motor, uint32_t since)
+{
+    int32_t power;
+    uint32_t braked_at;
+
+    zassert_true(fake_motor_state(motor, &power, &braked_at), "%s not braked", motor->name);
+    zassert_equal(power, 0, "%s still powered", motor->name);
+    zassert_true(braked_at - since <= k_ms_to_cyc_ceil32(BRAKE_TIMEOUT_MS),
+                 "%s braked %u cycles after the trigger", motor->name, braked_at - since);
+}
+
+static void motor_expect_running(const struct device *motor)
+{
+    int32_t power;
+    uint32_t braked_at;
+
+    zassert_false(fake_motor_state(motor, &power, &braked_at), "%s braked", motor->name);
+    zassert_not_equal(power, 0, "%s not powered", motor->name);
+}
+
+static void *safety_stop_setup(void)
+{
+    zassert_ok(app_event_manager_init(), "Application Event Manager not initialized");
+
+    /* The motor module arms the safety stop from its thread */
+    for (int i = 0; i < 100 && !fake_distance_sensor_armed(SENSOR); i++) {
+        k_msleep(1);
+    }
+    zassert_true(fake_distance_sensor_armed(SENSOR), "Threshold trigger not set");
+    return NULL;
+}
+
+/* Start every test with the way clear, the motors released and the motor module idle */
+static void safety_stop_before(void *fixture)
+{
+    fake_distance_sensor_set(SENSOR, CLEAR_MM);
+    k_msleep(DONE_TIMEOUT_MS);
+    if (safety_stop_is_active()) {
+        zassert_ok(safety_stop_release(), "Stop not released with the way clear");
+    }
+    k_msgq_purge(&motor_events);
+}
+
+ZTEST(safety_stop, test_stop_while_moving)
+{
+    struct safety_stop_stats before;
+    struct safety_stop_stats after;
+
+    move(MOVEMENT_MS);
+    motor_event_expect(MOTOR_EVT_MOVEMENT_START, 0, DONE_TIMEOUT_MS);
+    motor_expect_running(MOTOR_A);
+    motor_expect_running(MOTOR_B);
+
+    safety_stop_stats_get(&before);
+    uint32_t fired = k_cycle_get_32();
+
+    fake_distance_sensor_set(SENSOR, OBSTACLE_MM);
+    motor_event_expect(MOTOR_EVT_MOVEMENT_DONE, MOTOR_DONE_SAFETY_STOP, DONE_TIMEOUT_MS);
+
+    motor_expect_braked(MOTOR_A, fired);
+    motor_expect_braked(MOTOR_B, fired);
+    zassert_true(safety_stop_is_active(), "Stop not latched");
+
+    safety_stop_stats_get(&after);
+    zassert_equal(after.count, before.count + 1, "Stop not counted once");
+    zassert_true(after.last_ns <= BRAKE_TIMEOUT_MS * NSEC_PER_MSEC, "Stop took %u ns",
+                 after.last_ns);
+
+    /* The motors stay braked after the end of the movement is reported */
+    k_msleep(DONE_TIMEOUT_MS);
+    motor_expect_braked(MOTOR_A, fired);
+    motor_expect_braked(MOTOR_B, fired);
+}
+
+ZTEST(safety_stop, test_no_start_with_obstacle)
+{
+    uint32_t fired = k_cycle_get_32();
+
+    fake_distance_sensor_set(SENSOR, OBSTACLE_MM);
+    k_msleep(DONE_TIMEOUT_MS);
+
+    /* Not moving, so only the motors are braked */
+    zassert_equal(k_msgq_num_used_get(&motor_events), 0, "Motor event without a movement");
+    motor_expect_braked(MOTOR_A, fired);
+    motor_expect_braked(MOTOR_B, fired);
+
+    move(MOVEMENT_MS);
+    motor_event_expect(MOTOR_EVT_MOVEMENT_DONE, MOTOR_DONE_SAFETY_STOP, DONE_TIMEOUT_MS);
+    motor_expect_braked(MOTOR_A, fired);
+    motor_expect_braked(MOTOR_B, fired);
+}
+
+ZTEST(safety_stop, test_move_after_clear)
+{
+    fake_distance_sensor_set(SENSOR, OBSTACLE_MM);
+    k_msleep(DONE_TIMEOUT_MS);
+    zassert_true(safety_stop_is_active(), "Stop not latched");
+
+    /* The next movement with the way clear releases the motors */
+    fake_distance_sensor_set(SENSOR, CLEAR_MM);
+    move(DONE_TIMEOUT_MS);
+    motor_event_expect(MOTOR_EVT_MOVEMENT_START, 0, DONE_TIMEOUT_MS);
+    zassert_false(safety_stop_is_active(), "Stop not released");
+    motor_expect_running(MOTOR_A);
+    motor_expect_running(MOTOR_B);
+
+    motor_event_expect(MOTOR_EVT_MOVEMENT_DONE, MOTOR_DONE_COMPLETED, 2 * DONE_TIMEOUT_MS);
+}
+
+ZTEST_SUITE(safety_stop, NULL, safety_stop_setup, safety_stop_before, NULL, NULL);